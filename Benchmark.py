@@ -0,0 +1,383 @@
+# CATALOG BENCHMARK
+# Author:      Aaron Bishop
+# Date:        4/19/2020
+# Description: Measures a running Catalog Server from the client side
+# Usage:       python3 Benchmark.py [-m MODE] [-n OPS] [-c CONNECTIONS] [-u SOCKET_PATH] [-f FLOOD] [-l USER:PASSWORD] ADDRESS
+#
+#              protocol:  bytes on the wire per operation and ops/sec, v1 against v2
+#              transport: round trip latency, TCP to ADDRESS against the unix socket at SOCKET_PATH
+#              overload:  throughput and latency of CONNECTIONS sessions, alone and while FLOOD more
+#                         clients hold connections open and others keep reconnecting
+#              reconnect: cost of reconnecting with a password login against resuming a session token
+
+import sys, os, getopt
+import socket
+import threading
+import multiprocessing
+import select
+from time import perf_counter, sleep
+from statistics import median
+
+import Client
+
+####################
+# HELPER FUNCTIONS #
+####################
+
+class CountingSocket:
+    """Socket wrapper that counts the bytes sent and received"""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.sent = 0
+        self.received = 0
+
+    def sendall(self, data):
+        self.sent = self.sent + len(data)
+        return self.sock.sendall(data)
+
+    def recv(self, length):
+        data = self.sock.recv(length)
+        self.received = self.received + len(data)
+        return data
+
+    def close(self):
+        self.sock.close()
+
+def connect(address):
+    sock = Client.connect_server(address)
+    if sock.family == socket.AF_INET:
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return CountingSocket(sock)
+
+def percentile(samples, p):
+    samples = sorted(samples)
+    return samples[min(len(samples) - 1, int(len(samples) * p / 100))]
+
+# every session logs in with these, see -l
+CREDENTIALS = ("admin", "password")
+
+# each operation is a function of a logged in session
+OPERATIONS = {
+    "request_book": lambda session: session.book(Client.CATALOG_CMD_REQUEST_BOOK, "nosuchbook", 1),
+    "availability": lambda session: session.availability(),
+}
+
+##############
+# BENCHMARKS #
+##############
+
+# bench_protocol()
+# Runs num_ops of an operation on each of num_conns concurrent sessions
+#  returns (bytes per op, ops/sec)
+def bench_protocol(address, protocol, operation, num_ops, num_conns):
+    sessions = []
+
+    for i in range(num_conns):
+        session = Client.CatalogSession(connect(address), protocol)
+        if session.login(*CREDENTIALS) != Client.CATALOG_STATUS_OK:
+            print("Could not login to", address)
+            sys.exit()
+        session.sock.sent = session.sock.received = 0
+        sessions.append(session)
+
+    def run(session):
+        for i in range(num_ops):
+            OPERATIONS[operation](session)
+
+    threads = [threading.Thread(target=run, args=(session,)) for session in sessions]
+    start = perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = perf_counter() - start
+
+    total_ops = num_ops * num_conns
+    total_bytes = sum(session.sock.sent + session.sock.received for session in sessions)
+
+    for session in sessions:
+        session.sock.close()
+
+    return total_bytes / total_ops, total_ops / elapsed
+
+# bench_login()
+# Opens a new connection and logs in num_ops times, the cost a short lived client pays
+def bench_login(address, protocol, num_ops):
+    total_bytes = 0
+    start = perf_counter()
+
+    for i in range(num_ops):
+        session = Client.CatalogSession(connect(address), protocol)
+        session.login(*CREDENTIALS)
+        total_bytes = total_bytes + session.sock.sent + session.sock.received
+        session.sock.close()
+
+    return total_bytes / num_ops, num_ops / (perf_counter() - start)
+
+# bench_transport()
+# Times num_ops round trips of each operation one at a time on a single v2 session
+#  returns {operation: (median us, p99 us)}
+def bench_transport(address, num_ops):
+    session = Client.CatalogSession(connect(address), 2)
+    if session.login(*CREDENTIALS) != Client.CATALOG_STATUS_OK:
+        print("Could not login to", address)
+        sys.exit()
+
+    results = {}
+
+    for operation in OPERATIONS:
+        ops = num_ops if operation != "availability" else max(1, num_ops // 10)
+        samples = []
+
+        for i in range(ops):
+            start = perf_counter()
+            OPERATIONS[operation](session)
+            samples.append((perf_counter() - start) * 1000000)
+
+        results[operation] = (median(samples), percentile(samples, 99))
+
+    # connecting is part of the cost for short lived clients
+    samples = []
+    for i in range(max(1, num_ops // 10)):
+        start = perf_counter()
+        login_session = Client.CatalogSession(connect(address), 2)
+        login_session.login(*CREDENTIALS)
+        samples.append((perf_counter() - start) * 1000000)
+        login_session.sock.close()
+
+    results["connect+login"] = (median(samples), percentile(samples, 99))
+
+    session.sock.close()
+
+    return results
+
+# bench_latency()
+# Runs num_ops request_book round trips on each of the sessions at once
+#  returns (ops/sec, median us, p99 us)
+def bench_latency(sessions, num_ops):
+    samples = []
+
+    def run(session):
+        local = []
+        for i in range(num_ops):
+            start = perf_counter()
+            OPERATIONS["request_book"](session)
+            local.append((perf_counter() - start) * 1000000)
+        samples.extend(local)
+
+    threads = [threading.Thread(target=run, args=(session,)) for session in sessions]
+    start = perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = perf_counter() - start
+
+    # sessions the server hung up on, such as idle ones it reaped, end their thread early
+    if not samples:
+        print("The server closed every session")
+        sys.exit()
+
+    return len(samples) / elapsed, median(samples), percentile(samples, 99)
+
+# flood_connections()
+# Opens num_flood idle connections, returns them with how many the server turned away
+def flood_connections(address, num_flood):
+    socks = []
+    for i in range(num_flood):
+        try:
+            socks.append(Client.connect_server(address))
+        except OSError:
+            break
+
+    # turned away clients are closed right after the accept
+    sleep(0.5)
+    rejected = 0
+    for sock in socks:
+        readable, _, _ = select.select([sock], [], [], 0)
+        if readable:
+            try:
+                closed = sock.recv(1) == b""
+            except OSError:
+                closed = True
+            rejected = rejected + closed
+
+    return socks, rejected
+
+# churn()
+# Keeps connecting and logging in until stop is set, counting the attempts the server turned away
+#  runs in its own process so it does not compete with the measured sessions for the interpreter
+def churn(address, stop, attempts, turned_away):
+    # the client library reports every refused connection
+    sys.stdout = open(os.devnull, "w")
+
+    while not stop.is_set():
+        try:
+            session = Client.CatalogSession(Client.connect_server(address), 2)
+            if session.login(*CREDENTIALS) != Client.CATALOG_STATUS_OK:
+                raise OSError
+            session.sock.close()
+        except (OSError, ValueError, SystemExit):
+            with turned_away.get_lock():
+                turned_away.value = turned_away.value + 1
+        with attempts.get_lock():
+            attempts.value = attempts.value + 1
+
+def run_overload(address, num_ops, num_conns, num_flood):
+    sessions = []
+    for i in range(num_conns):
+        session = Client.CatalogSession(connect(address), 2)
+        if session.login(*CREDENTIALS) != Client.CATALOG_STATUS_OK:
+            print("Could not login to", address)
+            sys.exit()
+        sessions.append(session)
+
+    print("%-12s%14s%14s%14s" % ("phase", "ops/sec", "median us", "p99 us"))
+    print("%-12s%14.1f%14.1f%14.1f" % (("baseline",) + bench_latency(sessions, num_ops)))
+
+    socks, rejected = flood_connections(address, num_flood)
+
+    stop = multiprocessing.Event()
+    attempts = multiprocessing.Value("i", 0)
+    turned_away = multiprocessing.Value("i", 0)
+    churner = multiprocessing.Process(target=churn, args=(address, stop, attempts, turned_away), daemon=True)
+    churner.start()
+
+    start = perf_counter()
+    print("%-12s%14.1f%14.1f%14.1f" % (("overloaded",) + bench_latency(sessions, num_ops)))
+    elapsed = perf_counter() - start
+
+    stop.set()
+    churner.join()
+
+    print("")
+    print("flood: %d connections, %d admitted, %d turned away" % (len(socks), len(socks) - rejected, rejected))
+    print("churn: %.1f connects/sec, %d of %d turned away" % (attempts.value / elapsed, turned_away.value, attempts.value))
+
+    for sock in socks:
+        sock.close()
+    for session in sessions:
+        session.sock.close()
+
+# bench_reconnect()
+# Reconnects num_ops times on each of num_conns threads, logging in with a password or resuming a token
+#  returns (reconnects/sec, median us, p99 us)
+def bench_reconnect(address, num_ops, num_conns, token):
+    samples = []
+
+    def run():
+        local = []
+        for i in range(num_ops):
+            start = perf_counter()
+            session = Client.CatalogSession(connect(address), 2)
+            status = session.resume(token) if token else session.login(*CREDENTIALS)
+            local.append((perf_counter() - start) * 1000000)
+            session.sock.close()
+            if status != Client.CATALOG_STATUS_OK:
+                print("Reconnect failed with status", status)
+                break
+        samples.extend(local)
+
+    threads = [threading.Thread(target=run) for i in range(num_conns)]
+    start = perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = perf_counter() - start
+
+    return len(samples) / elapsed, median(samples), percentile(samples, 99)
+
+def run_reconnect(address, num_ops, num_conns):
+    session = Client.CatalogSession(connect(address), 2)
+    if session.login(*CREDENTIALS) != Client.CATALOG_STATUS_OK or session.session_token is None:
+        print("Could not login to", address)
+        sys.exit()
+    session.sock.close()
+
+    print("%-12s%16s%14s%14s" % ("reconnect", "reconnects/sec", "median us", "p99 us"))
+    print("%-12s%16.1f%14.1f%14.1f" % (("login",) + bench_reconnect(address, num_ops, num_conns, None)))
+    print("%-12s%16.1f%14.1f%14.1f" % (("resume",) + bench_reconnect(address, num_ops, num_conns, session.session_token)))
+
+def run_protocol(address, num_ops, num_conns):
+    print("%-14s%-10s%14s%14s" % ("operation", "protocol", "bytes/op", "ops/sec"))
+
+    for protocol in (1, 2):
+        bytes_per_op, ops_per_sec = bench_login(address, protocol, max(1, num_ops // 10))
+        print("%-14s%-10s%14.1f%14.1f" % ("login", "v" + str(protocol), bytes_per_op, ops_per_sec))
+
+    for operation in OPERATIONS:
+        # reports are far bigger than commands, keep their run short
+        ops = num_ops if operation != "availability" else max(1, num_ops // 10)
+
+        for protocol in (1, 2):
+            bytes_per_op, ops_per_sec = bench_protocol(address, protocol, operation, ops, num_conns)
+            print("%-14s%-10s%14.1f%14.1f" % (operation, "v" + str(protocol), bytes_per_op, ops_per_sec))
+
+def run_transport(address, socket_path, num_ops):
+    print("%-16s%-10s%14s%14s" % ("operation", "transport", "median us", "p99 us"))
+
+    tcp = bench_transport(address, num_ops)
+    unix = bench_transport(socket_path, num_ops)
+
+    for operation in tcp:
+        print("%-16s%-10s%14.1f%14.1f" % (operation, "tcp", tcp[operation][0], tcp[operation][1]))
+        print("%-16s%-10s%14.1f%14.1f" % (operation, "unix", unix[operation][0], unix[operation][1]))
+
+################
+# MAIN PROGRAM #
+################
+
+def print_usage():
+    print("")
+    print("  usage: Benchmark.py [-m MODE] [-n OPS] [-c CONNECTIONS] [-u SOCKET_PATH] [-f FLOOD] [-l USER:PASSWORD] ADDRESS")
+    print("")
+    print("    -m    protocol (default), transport, overload or reconnect")
+    print("")
+
+def main():
+    global CREDENTIALS
+    mode = "protocol"
+    num_ops = 2000
+    num_conns = 4
+    socket_path = "/tmp/catalog.sock"
+    num_flood = 2000
+
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "m:n:c:u:f:l:h")
+        address = args[0]
+        for opt, value in opts:
+            if opt == "-m":
+                mode = value
+            elif opt == "-n":
+                num_ops = int(value)
+            elif opt == "-c":
+                num_conns = int(value)
+            elif opt == "-u":
+                socket_path = value
+            elif opt == "-f":
+                num_flood = int(value)
+            elif opt == "-l":
+                CREDENTIALS = tuple(value.split(":", 1))
+                if len(CREDENTIALS) != 2:
+                    raise ValueError
+            else:
+                raise ValueError
+    except:
+        print_usage()
+        sys.exit()
+
+    if mode == "protocol":
+        run_protocol(address, num_ops, num_conns)
+    elif mode == "transport":
+        run_transport(address, socket_path, num_ops)
+    elif mode == "overload":
+        run_overload(address, num_ops, num_conns, num_flood)
+    elif mode == "reconnect":
+        run_reconnect(address, num_ops, num_conns)
+    else:
+        print_usage()
+
+if __name__ == "__main__":
+    main()
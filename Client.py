@@ -2,9 +2,10 @@
 # Author:      Aaron Bishop
 # Date:        4/19/2020
 # Description: Simple procedural command-line client to Catalog Server
-# Usage:       -
+# Usage:       python3 Client.py [--v1] [--callback] ADDRESS|SOCKET_PATH
 
 import sys, getopt
+import select
 import socket
 import struct
 from datetime import datetime
@@ -13,7 +14,7 @@ from time import sleep
 from getpass import getpass
 from pathlib import Path
 
-VERSION = '0.1'
+VERSION = '0.2'
 
 # port to connect to on server
 SERVER_PORT = 31337
@@ -36,6 +37,55 @@ CATALOG_CMD_ADD_BOOK = 0x40
 CATALOG_CMD_REQUEST_REPORT = 0x50
 CATALOG_CMD_RETURN_BOOK = 0x60
 CATALOG_CMD_GET_AVAILABILITY = 0x70
+CATALOG_CMD_RESUME = 0x80
+CATALOG_CMD_STATS = 0x90
+
+# PROTOCOL V2, see src/Classes/catalog_protocol.h
+CATALOG_V2_MAGIC = 0xC2
+CATALOG_V2_HEADER = struct.Struct("!BBBBLL")
+CATALOG_V2_FIELD_MAXLEN = 255
+CATALOG_V2_FLAG_MORE = 0x01
+CATALOG_SESSION_TOKEN_LEN = 16
+
+# listener port asking the server to stream the report on the session connection
+CATALOG_REPORT_INBAND_PORT = 0
+
+# STATUS CODES, v1 string replies are mapped onto these
+CATALOG_STATUS_OK = 0
+CATALOG_STATUS_ERROR = 1
+CATALOG_STATUS_INVALID_USER = 2
+CATALOG_STATUS_INVALID_PASSWORD = 3
+CATALOG_STATUS_USERNAME_EXISTS = 4
+CATALOG_STATUS_NOT_AUTHENTICATED = 5
+CATALOG_STATUS_BAD_REQUEST = 6
+CATALOG_STATUS_FILESIZE_ERROR = 7
+CATALOG_STATUS_THROTTLED = 8
+CATALOG_STATUS_INVALID_SESSION = 9
+
+THROTTLED_MESSAGE = "The server is busy, please try again shortly."
+
+V1_STATUS = {
+    b"login_success": CATALOG_STATUS_OK,
+    b"invalid_user": CATALOG_STATUS_INVALID_USER,
+    b"invalid_password": CATALOG_STATUS_INVALID_PASSWORD,
+    b"username_available": CATALOG_STATUS_OK,
+    b"username_exists": CATALOG_STATUS_USERNAME_EXISTS,
+    b"add_user_success": CATALOG_STATUS_OK,
+    b"add_book_success": CATALOG_STATUS_OK,
+    b"req_book_success": CATALOG_STATUS_OK,
+    b"ret_book_success": CATALOG_STATUS_OK,
+    b"req_report_success": CATALOG_STATUS_OK,
+    b"req_filesize_error": CATALOG_STATUS_FILESIZE_ERROR,
+    b"throttled": CATALOG_STATUS_THROTTLED,
+    b"resume_success": CATALOG_STATUS_OK,
+    b"invalid_session": CATALOG_STATUS_INVALID_SESSION,
+}
+
+# field limits per protocol version: username, password, book name
+FIELD_LIMITS = {
+    1: (11, 8, 13),
+    2: (CATALOG_V2_FIELD_MAXLEN, CATALOG_V2_FIELD_MAXLEN, CATALOG_V2_FIELD_MAXLEN),
+}
 
 ####################
 # HELPER FUNCTIONS #
@@ -72,220 +122,345 @@ def send_command(sock, command):
     except:
         exit_disconnected()
 
+# an address containing a "/" is the path of the server's unix domain socket
+def connect_server(address):
+    if "/" in address:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(address)
+    else:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.connect((address, SERVER_PORT))
+    return sock
+
+def recv_exact(sock, length):
+    data = b""
+    while len(data) < length:
+        chunk = sock.recv(length - len(data))
+        if len(chunk) == 0:
+            exit_disconnected()
+        data = data + chunk
+    return data
+
+######################
+# PROTOCOL FUNCTIONS #
+######################
+
+# v2 strings are <len:2><bytes>, passwords are xor'd with the key repeated over their whole length
+def v2_string(string):
+    data = bytes(string, "UTF-8")
+    return struct.pack("!H", len(data)) + data
+
+def v2_password(password):
+    data = bytes(password, "UTF-8")
+    return struct.pack("!H", len(data)) + bytes(b ^ ord(XOR_KEY[i % len(XOR_KEY)]) for (i, b) in enumerate(data))
+
+class CatalogSession:
+    """Wraps a connected socket and speaks either protocol version"""
+
+    def __init__(self, sock, protocol=2):
+        self.sock = sock
+        self.protocol = protocol
+        self.request_id = 0
+        self.session_token = None
+
+    # v2: send one frame and wait for the reply with the same request id
+    def v2_call(self, op_code, payload=b""):
+        self.v2_send(op_code, payload)
+        status, flags, reply = self.v2_recv()
+        return status, reply
+
+    def v2_send(self, op_code, payload):
+        self.request_id = self.request_id + 1
+        send_command(self.sock, CATALOG_V2_HEADER.pack(CATALOG_V2_MAGIC, op_code, 0, 0, self.request_id, len(payload)) + payload)
+
+    # returns the next reply frame for the last request as (status, flags, payload)
+    def v2_recv(self):
+        while True:
+            magic, reply_op, status, flags, request_id, length = CATALOG_V2_HEADER.unpack(recv_exact(self.sock, CATALOG_V2_HEADER.size))
+            reply = recv_exact(self.sock, length)
+            if request_id == self.request_id:
+                return status, flags, reply
+
+    # v1: send one fixed command and read back its string reply
+    def v1_call(self, command):
+        send_command(self.sock, command)
+        response = self.sock.recv(CATALOG_CMD_MAXLEN)
+        if len(response) == 0:
+            exit_disconnected()
+        return V1_STATUS.get(response, CATALOG_STATUS_ERROR)
+
+    # a v2 login keeps the session token the server hands back, see resume()
+    def login(self, username, password):
+        if self.protocol == 2:
+            status, reply = self.v2_call(CATALOG_CMD_CONNECT, v2_string(username) + v2_password(password))
+            if status == CATALOG_STATUS_OK and len(reply) == CATALOG_SESSION_TOKEN_LEN:
+                self.session_token = reply
+            return status
+
+        data = to_bytes_np(username, 11) + to_bytes_np(xor_crypt(password, XOR_KEY), 8)
+        return self.v1_call(build_command(CATALOG_CMD_CONNECT, data))
+
+    # logs in with the token of an earlier session, without sending credentials, v2 only
+    def resume(self, token):
+        status = self.v2_call(CATALOG_CMD_RESUME, token)[0]
+        if status == CATALOG_STATUS_OK:
+            self.session_token = token
+        return status
+
+    # v1 checks the username before asking for a password, v2 sends both at once so this only matters to v1
+    def check_username(self, username):
+        if self.protocol == 2:
+            return CATALOG_STATUS_OK
+
+        return self.v1_call(build_command(CATALOG_CMD_ADD_USER, to_bytes_np(username, 11)))
+
+    def add_user(self, username, password):
+        if self.protocol == 2:
+            return self.v2_call(CATALOG_CMD_ADD_USER, v2_string(username) + v2_password(password))[0]
+
+        return self.v1_call(build_command(CATALOG_CMD_ADD_USER, to_bytes_np(xor_crypt(password, XOR_KEY), 8)))
+
+    # op_code is one of ADD_BOOK, REQUEST_BOOK or RETURN_BOOK
+    def book(self, op_code, book_name, qty):
+        if self.protocol == 2:
+            return self.v2_call(op_code, struct.pack("!L", qty) + v2_string(book_name))[0]
+
+        return self.v1_call(build_command(op_code, struct.pack("!H", qty) + to_bytes_np(book_name, 13)))
+
+    def availability(self):
+        if self.protocol == 2:
+            status, reply = self.v2_call(CATALOG_CMD_GET_AVAILABILITY)
+            return THROTTLED_MESSAGE if status == CATALOG_STATUS_THROTTLED else reply.decode("utf-8")
+
+        send_command(self.sock, build_command(CATALOG_CMD_GET_AVAILABILITY, b""))
+
+        availability_report = ""
+
+        while True:
+            response = self.sock.recv(1024)
+            availability_report = availability_report + response.decode("utf-8")
+            if len(response) == 0 and availability_report == "":
+                exit_disconnected()
+            elif len(response) < 1024:
+                break
+
+        return availability_report
+
+    # returns the server's command counts and latencies as text, the same in both protocol versions
+    def stats(self):
+        if self.protocol == 2:
+            status, reply = self.v2_call(CATALOG_CMD_STATS)
+            return THROTTLED_MESSAGE if status == CATALOG_STATUS_THROTTLED else reply.decode("utf-8")
+
+        send_command(self.sock, build_command(CATALOG_CMD_STATS, b""))
+
+        response = self.sock.recv(1024)
+        if len(response) == 0:
+            exit_disconnected()
+
+        return response.decode("utf-8")
+
+    # returns the report status and contents, streamed on the session as length prefixed chunks
+    def request_report_inband(self):
+        report_data = b""
+
+        if self.protocol == 2:
+            self.v2_send(CATALOG_CMD_REQUEST_REPORT, struct.pack("!H", CATALOG_REPORT_INBAND_PORT))
+
+            while True:
+                status, flags, data = self.v2_recv()
+                report_data = report_data + data
+                if status != CATALOG_STATUS_OK or not flags & CATALOG_V2_FLAG_MORE:
+                    return status, report_data
+
+        send_command(self.sock, build_command(CATALOG_CMD_REQUEST_REPORT, struct.pack("!H", CATALOG_REPORT_INBAND_PORT)))
+
+        # v1 ends the stream with the command's reply, a throttled report is nothing but that
+        while True:
+            length = struct.unpack("!L", recv_exact(self.sock, 4))[0]
+            if length == 0:
+                response = self.sock.recv(CATALOG_CMD_MAXLEN)
+                if len(response) == 0:
+                    exit_disconnected()
+                return V1_STATUS.get(response, CATALOG_STATUS_ERROR), report_data
+            report_data = report_data + recv_exact(self.sock, length)
+
+    # returns the report status and contents, the report is delivered to a listener on port
+    def request_report(self, port):
+        # listen before asking so the server never races us to the port
+        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as listen_sock:
+            listen_sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+            listen_sock.bind(("localhost", port))
+            listen_sock.listen()
+
+            if self.protocol == 2:
+                status = self.v2_call(CATALOG_CMD_REQUEST_REPORT, struct.pack("!H", port))[0]
+                if status != CATALOG_STATUS_OK:
+                    return status, b""
+            else:
+                send_command(self.sock, build_command(CATALOG_CMD_REQUEST_REPORT, struct.pack("!H", int(port))))
+
+                # v1 only answers on the session when the report is not coming, such as when throttled
+                readable, writable, errored = select.select([listen_sock, self.sock], [], [])
+                if self.sock in readable:
+                    response = self.sock.recv(CATALOG_CMD_MAXLEN)
+                    if len(response) == 0:
+                        exit_disconnected()
+                    return V1_STATUS.get(response, CATALOG_STATUS_ERROR), b""
+
+            conn, addr = listen_sock.accept()
+            with conn:
+                report_data = b""
+
+                while True:
+                    data = conn.recv(CHUNK_SIZE)
+                    report_data = report_data + data
+                    if len(data) < CHUNK_SIZE:
+                        break
+
+                send_command(conn, struct.pack("!L", int(len(data))))
+                response = conn.recv(CATALOG_CMD_MAXLEN)
+
+        if len(response) == 0:
+            exit_disconnected()
+
+        return V1_STATUS.get(response, CATALOG_STATUS_ERROR), report_data
+
 ####################
 # PRIMARY COMMANDS #
 ####################
 
 # add_user()
 # Prompts the user for a username/password, then requests server adds the user to user db
-def add_user(sock):
+def add_user(session):
+    max_username, max_password, _ = FIELD_LIMITS[session.protocol]
+
     while True:
         print("")
         print("Add User:")
         print("")
-        username = input("Enter new username (11 characters max): ")
-        # Prepare ADD USER command 1
-        command = build_command(CATALOG_CMD_ADD_USER, to_bytes_np(username, 11))
-        send_command(sock, command)
-        response = sock.recv(CATALOG_CMD_MAXLEN)
+        username = input("Enter new username (" + str(max_username) + " characters max): ")
+        status = session.check_username(username)
 
-        if len(response) == 0:
-            exit_disconnected()
-        elif response == b"username_exists":
+        if status == CATALOG_STATUS_USERNAME_EXISTS:
             print("")
             print("Username is already taken.")
-        elif response == b"username_available":
+        elif status == CATALOG_STATUS_OK:
             while True:
-                password1 = getpass("Enter new password (8 characters max): ")
+                password1 = getpass("Enter new password (" + str(max_password) + " characters max): ")
                 password2 = getpass("Enter password again: ")
 
                 if password1 != password2:
                     print("")
                     print("Password do not match.")
-                elif len(password1) > 8:
+                elif len(password1) > max_password:
                     print("")
                     print("Password is too long.")
                 else:
-                    # Prepare ADD USER command 2
-                    command = build_command(CATALOG_CMD_ADD_USER, to_bytes_np(xor_crypt(password1, XOR_KEY), 8))
-                    send_command(sock, command)
-                    response = sock.recv(CATALOG_CMD_MAXLEN)
+                    status = session.add_user(username, password1)
 
-                    if len(response) == 0:
-                        exit_disconnected()
-                    elif response == b"add_user_success":
+                    if status == CATALOG_STATUS_OK:
                         print("")
                         print("New user added.")
+                    elif status == CATALOG_STATUS_USERNAME_EXISTS:
+                        print("")
+                        print("Username is already taken.")
+                    elif status == CATALOG_STATUS_THROTTLED:
+                        print("")
+                        print(THROTTLED_MESSAGE)
                     else:
                         print("New user could not be added.")
                     
                     break
             break
 
-# add_book()
-# Prompts the user for a book to add, the requests server add it to catalog db
-def add_book(sock):
-    while True:
-        print("")
-        print("Add a New Book (13 characters max)")
-        print("")
-        book_name = input("Enter the book name: ")
-        book_qty = input("Enter the quantity of books to add: ")
+# book_command()
+# Prompts the user for the book name and quantity, then sends an add, request or return
+def book_command(session, op_code):
+    _, _, max_book_name = FIELD_LIMITS[session.protocol]
+    verb = {CATALOG_CMD_ADD_BOOK: "add", CATALOG_CMD_REQUEST_BOOK: "request", CATALOG_CMD_RETURN_BOOK: "return"}[op_code]
 
-        if len(book_name) > 13:
-            print("")
-            print("Book name is too long.")
-            continue
-        elif not book_qty.isdigit():
-            print("")
-            print("Book quantity is not numeric.")
-        else:
-            command = build_command(CATALOG_CMD_ADD_BOOK, struct.pack("!H", int(book_qty))+to_bytes_np(book_name, 13))
-            send_command(sock, command)
-            response = sock.recv(CATALOG_CMD_MAXLEN)
-
-            if len(response) == 0:
-                exit_disconnected()
-            elif response == b"add_book_success":
-                print("")
-                print("Added",book_qty,"copies of book",book_name,"to the catalog.")
-            else:
-                print("Book(s) could not be added.")
-            break
-
-# request_book()
-# Prompts the user for the book name and number of books to request
-#  then requests server to update requests db
-def request_book(sock):
     while True:
         print("")
-        print("Request a Book")
+        if op_code == CATALOG_CMD_ADD_BOOK:
+            print("Add a New Book (" + str(max_book_name) + " characters max)")
+        else:
+            print(verb.capitalize(), "a Book")
         print("")
         book_name = input("Enter the book name: ")
-        book_qty = input("Enter the quantity of books to request: ")
+        book_qty = input("Enter the quantity of books to " + verb + ": ")
 
-        if len(book_name) > 13:
+        if len(book_name) > max_book_name:
             print("")
             print("Book name is too long.")
         elif not book_qty.isdigit():
             print("")
             print("Book quantity is not numeric.")    
         else:
-            command = build_command(CATALOG_CMD_REQUEST_BOOK, struct.pack("!H", int(book_qty))+to_bytes_np(book_name, 13))
-            send_command(sock, command)
-            response = sock.recv(CATALOG_CMD_MAXLEN)
+            status = session.book(op_code, book_name, int(book_qty))
 
-            if len(response) == 0:
-                exit_disconnected()
-            elif response == b"req_book_success":
-                print("")
+            print("")
+            if status == CATALOG_STATUS_THROTTLED:
+                print(THROTTLED_MESSAGE)
+            elif status != CATALOG_STATUS_OK:
+                print("Book(s) could not be added." if op_code == CATALOG_CMD_ADD_BOOK else "Invalid book " + verb + ".")
+            elif op_code == CATALOG_CMD_ADD_BOOK:
+                print("Added",book_qty,"copies of book",book_name,"to the catalog.")
+            elif op_code == CATALOG_CMD_REQUEST_BOOK:
                 print("Requested",book_qty,"copies of book",book_name,"from the catalog.")
             else:
-                print("Invalid book request.")
-            break
-
-# return_book()
-# Prompts the user for the book name and number of books to return
-#  then requests server to update requests db
-def return_book(sock):
-    while True:
-        print("")
-        print("Return a Book")
-        print("")
-        book_name = input("Enter the book name: ")
-        book_qty = input("Enter the quantity of books to return: ")
-
-        if len(book_name) > 13:
-            print("")
-            print("Book name is too long.")
-        elif not book_qty.isdigit():
-            print("")
-            print("Book quantity is not numeric.")    
-        else:
-            command = build_command(CATALOG_CMD_RETURN_BOOK, struct.pack("!H", int(book_qty))+to_bytes_np(book_name, 13))
-            send_command(sock, command)
-            response = sock.recv(CATALOG_CMD_MAXLEN)
-
-            if len(response) == 0:
-                exit_disconnected()
-            elif response == b"ret_book_success":
-                print("")
                 print("Returned",book_qty,"copies of book",book_name,"to the catalog.")
-            else:
-                print("Invalid book return.")
             break
 
 # get_availability()
 # Shows the current book availability as specified
-def get_availability(sock):
-    command = build_command(CATALOG_CMD_GET_AVAILABILITY, b"")
-    send_command(sock, command)
-
-    availability_report = ""
-
-    while True:
-        response = sock.recv(1024)
-        availability_report = availability_report + response.decode("utf-8")
-        if len(response) == 0 and availability_report == "":
-            exit_disconnected()
-        elif len(response) < 1024:
-            break
+def get_availability(session):
+    availability_report = session.availability()
 
     print("")
     print("Current Availability:")
     print("")
     print(availability_report)
 
+# get_stats()
+# Shows how many of each command the server has run and how long they took
+def get_stats(session):
+    stats = session.stats()
+
+    print("")
+    print("Server Statistics:")
+    print("")
+    print(stats)
+
 # request_report()
 # Requests the server generate an inventory report, then receives the complete report
-#  on specified listener port
-def request_report(sock):
+#  on the session, or on the specified listener port when callback is set
+def request_report(session, callback):
     print("")
     print("Reqest Inventory Report:")
     print("")
 
-    response = b""
-    report_data = b""
-    data = b""
     home_dir = str(Path.home())
     report_filename = home_dir + "/Inventory Report - " + datetime.now().strftime("%b %d %Y %H_%M") + ".txt"
 
-    # request report generation
-    command = build_command(CATALOG_CMD_REQUEST_REPORT, struct.pack("!H", int(LISTEN_PORT)))
-    send_command(sock, command)
-
-    # receive completed report on LISTEN_PORT
-    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as listen_sock:
-        listen_sock.bind(("localhost", LISTEN_PORT))
-        listen_sock.listen()
-        conn, addr = listen_sock.accept()
-        with conn:
-            print("")
-            print("Receving file... ", end="")
-
-            while True:
-                data = conn.recv(CHUNK_SIZE)
-                report_data = report_data + data
-                if len(data) < CHUNK_SIZE:
-                    break
-
-            print(len(data),"bytes received")
-
-            send_command(conn, struct.pack("!L", int(len(data))))
-            response = conn.recv(CATALOG_CMD_MAXLEN)
-
+    print("Receving file... ", end="")
+    if callback:
+        status, report_data = session.request_report(LISTEN_PORT)
+    else:
+        status, report_data = session.request_report_inband()
+    print(len(report_data),"bytes received")
     print("")
 
     # notify user of success/failure
-    if len(response) == 0:
-        exit_disconnected()
-    elif response == b"req_report_success":
+    if status == CATALOG_STATUS_OK:
         with open(report_filename, "wb") as f:
             f.write(report_data)
 
         print("Report saved as", report_filename)
-    elif response == b"req_filesize_error":
+    elif status == CATALOG_STATUS_FILESIZE_ERROR:
         print("Report could not be saved (file size mismatch)")
+    elif status == CATALOG_STATUS_THROTTLED:
+        print(THROTTLED_MESSAGE)
     else:
         print("Report could not be saved (unknown error)")
 
@@ -295,28 +470,53 @@ def request_report(sock):
 # MAIN PROGRAM #
 ################
 
+def print_usage():
+    print("")
+    print("  usage: Client.py [--v1] [--callback] ADDRESS")
+    print("")
+    print("    ADDRESS       server hostname or IP, or the path of its unix socket (/tmp/catalog.sock)")
+    print("    --v1          use the original fixed size protocol")
+    print("    --callback    receive inventory reports on a listener port instead of the session")
+    print("")
+
 def main():
+    protocol = 2
+    callback = False
+
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "h", ["v1", "callback", "help"])
+    except getopt.GetoptError:
+        print_usage()
+        sys.exit()
+
+    for opt, _ in opts:
+        if opt == "--v1":
+            protocol = 1
+        elif opt == "--callback":
+            callback = True
+        else:
+            print_usage()
+            sys.exit()
+
     # get server address from command line
     try:
-        server_address = sys.argv[1]
+        server_address = args[0]
     except:
         print("Catalog server address is required")
-        print("")
-        print("  usage: Capstone.py ADDRESS")
-        print("")
+        print_usage()
         sys.exit()
 
     # main loop
     while True:
         # open the socket for the conversation
         try:
-            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
-            server_addr = (server_address, SERVER_PORT)
-            sock.connect(server_addr)
+            sock = connect_server(server_address)
         except:
             print("Could not connect to server:", server_address)
             sys.exit()
 
+        session = CatalogSession(sock, protocol)
+
         # present login menu
         clear()
         print_banner()
@@ -339,16 +539,10 @@ def main():
             username = input("Username: ")
             password = getpass("Password: ")
 
-            # Prepare CONNECT command
-            data = to_bytes_np(username, 11) + to_bytes_np(xor_crypt(password, XOR_KEY), 8)
-            command = build_command(CATALOG_CMD_CONNECT,  data)
-            send_command(sock, command)
-            response = sock.recv(CATALOG_CMD_MAXLEN)
+            status = session.login(username, password)
 
             # all remaining functions require user to be authenticated
-            if len(response) == 0:
-                exit_disconnected()
-            elif response == b"login_success":
+            if status == CATALOG_STATUS_OK:
                 print("")
                 print("Login successful.")
                 sleep(1)
@@ -365,56 +559,64 @@ def main():
                     print("  4. Request a book.")
                     print("  5. Return a book.")
                     print("  6. Request inventory report")
-                    print("  7. Logout")
+                    print("  7. View server statistics.")
+                    print("  8. Logout")
                     print("")
-                    option = input("Enter 1-7 to continue: ")
+                    option = input("Enter 1-8 to continue: ")
 
                     # 1. Add a new user
                     if option == "1":
-                        add_user(sock)
+                        add_user(session)
                         sleep(0.5)
                         clear()
                     # 2. View available books
                     elif option == "2":
-                        get_availability(sock)
+                        get_availability(session)
                     # 3. Add a new book
                     elif option == "3":
-                        add_book(sock)
+                        book_command(session, CATALOG_CMD_ADD_BOOK)
                         sleep(1)
                         clear()
                     # 4. Request a book
                     elif option == "4":
-                        request_book(sock)
+                        book_command(session, CATALOG_CMD_REQUEST_BOOK)
                         sleep(1)
                         clear()
                     # 5. Return a book
                     elif option == "5":
-                        return_book(sock)                            
+                        book_command(session, CATALOG_CMD_RETURN_BOOK)
                         sleep(1)
                         clear()
                     # 6. Request inventory report
                     elif option == "6":
-                        request_report(sock)                            
+                        request_report(session, callback)                            
                         sleep(2)
                         clear()
-                    # 7. Logout
+                    # 7. View server statistics
                     elif option == "7":
+                        get_stats(session)
+                    # 8. Logout
+                    elif option == "8":
                         break
                     else:
                         clear()
                         continue
                 
-            elif response == b"invalid_user":
+            elif status == CATALOG_STATUS_INVALID_PASSWORD:
                 print("")
-                print("Invalid user.")
+                print("Invalid password.")
                 sleep(1)
-            elif response == b"invalid_password":
+            elif status == CATALOG_STATUS_THROTTLED:
                 print("")
-                print("Invalid password.")
+                print(THROTTLED_MESSAGE)
+                sleep(1)
+            else:
+                print("")
+                print("Invalid user.")
                 sleep(1)
 
             # if we got here, login was unsuccessful or user selected "Logout"
             sock.close()
 
 if __name__ == "__main__":
-    main()
\ No newline at end of file
+    main()
@@ -0,0 +1,104 @@
+# CATALOG TRACE CONVERTER
+# Author:      Aaron Bishop
+# Date:        4/19/2020
+# Description: Turns a trace dump from the Catalog Server into Chrome trace JSON
+#              Load the output in chrome://tracing or ui.perfetto.dev, every command is a slice on the
+#              row of the server thread that ran it.
+# Usage:       python3 TraceConvert.py DUMP [OUTPUT]
+#
+#              The server dumps to reports/trace.bin when "t" is typed in its console, or on kill -USR1.
+#              OUTPUT defaults to DUMP with a .json extension.
+
+import sys, os
+import struct
+import json
+
+import Client
+
+# layouts of trace.h, the server writes them in its own byte order
+FILE_HEADER = struct.Struct("=8sII")
+RING_HEADER = struct.Struct("=IIQ")
+EVENT = struct.Struct("=QQIIIB3x")
+MAGIC = b"CTRACE1\0"
+
+# op code to command name, from the client's constants
+OP_NAMES = {value: name[len("CATALOG_CMD_"):] for name, value in vars(Client).items()
+            if name.startswith("CATALOG_CMD_") and name != "CATALOG_CMD_MAXLEN"}
+
+def read_dump(path):
+    """Returns (ring_id, [events]) for each ring in a dump, finished events only"""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, event_size, ring_events = FILE_HEADER.unpack_from(data, 0)
+    if magic != MAGIC or event_size != EVENT.size:
+        raise ValueError(path + " is not a trace dump")
+
+    rings = []
+    offset = FILE_HEADER.size
+
+    while offset + RING_HEADER.size <= len(data):
+        ring_id, _, next_event = RING_HEADER.unpack_from(data, offset)
+        offset = offset + RING_HEADER.size
+
+        events = []
+        for i in range(ring_events):
+            event = EVENT.unpack_from(data, offset + i * EVENT.size)
+            start_ns, end_ns = event[0], event[1]
+
+            # never used, or still running when the dump was taken
+            if start_ns == 0 or end_ns < start_ns:
+                continue
+            events.append(event)
+
+        offset = offset + ring_events * EVENT.size
+        rings.append((ring_id, events))
+
+    return rings
+
+def to_chrome(rings):
+    starts = [event[0] for _, events in rings for event in events]
+    origin = min(starts) if starts else 0
+
+    trace_events = []
+    for ring_id, events in rings:
+        trace_events.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": ring_id,
+                             "args": {"name": "worker %d" % ring_id}})
+
+        for start_ns, end_ns, conn_id, reads, writes, op_code in events:
+            trace_events.append({
+                "name": OP_NAMES.get(op_code, "0x%02x" % op_code),
+                "ph": "X",
+                "pid": 1,
+                "tid": ring_id,
+                "ts": (start_ns - origin) / 1000.0,
+                "dur": (end_ns - start_ns) / 1000.0,
+                "args": {"conn_id": conn_id, "datafile_reads": reads, "datafile_writes": writes},
+            })
+
+    trace_events.sort(key=lambda event: event.get("ts", -1))
+
+    return {"traceEvents": trace_events, "displayTimeUnit": "ms"}
+
+def main():
+    if len(sys.argv) < 2 or sys.argv[1] in ("-h", "--help"):
+        print("usage: python3 TraceConvert.py DUMP [OUTPUT]")
+        sys.exit(2)
+
+    path = sys.argv[1]
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.splitext(path)[0] + ".json"
+
+    try:
+        rings = read_dump(path)
+    except (OSError, ValueError, struct.error) as e:
+        print("Could not read trace: " + str(e))
+        sys.exit(1)
+
+    with open(output, "w") as f:
+        json.dump(to_chrome(rings), f)
+
+    num_events = sum(len(events) for _, events in rings)
+    print("%d commands from %d threads written to %s" % (num_events, len(rings), output))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,567 @@
+/*
+ * ADMIN CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "admin.h"
+
+extern garbagecollector_t *global_gc;
+extern threadpool_t *global_tp;
+extern ratelimiter_t *global_rl;
+extern sessiontable_t *global_st;
+extern usertable_t *global_ut;
+extern bloomfilter_t *global_bf;
+extern devlog_t *global_dl;
+extern trace_t *global_tr;
+
+// the socket worker has no way to be handed its console, there is only ever one
+admin_t *_admin_console = NULL;
+
+// CONNECTION ROW
+//   what the connections command shows of one connection, copied while the server's list is locked
+typedef struct
+{
+    unsigned int conn_id;
+    char peer[TCPSERVER_PEER_LEN];
+    int family;
+    bool armed;
+    uint64_t last_active;
+    bool has_session;
+    int user_id;
+    long num_commands;
+    unsigned long busy_ns;
+    uint8_t last_op;
+} _admin_connection_t;
+
+// HELPERS
+int _admin_help(admin_t *self, const char *args, FILE *out);
+int _admin_stats(admin_t *self, const char *args, FILE *out);
+int _admin_connections(admin_t *self, const char *args, FILE *out);
+int _admin_threads(admin_t *self, const char *args, FILE *out);
+int _admin_caches(admin_t *self, const char *args, FILE *out);
+int _admin_slowest(admin_t *self, const char *args, FILE *out);
+int _admin_trace(admin_t *self, const char *args, FILE *out);
+int _admin_compact(admin_t *self, const char *args, FILE *out);
+int _admin_rebuild(admin_t *self, const char *args, FILE *out);
+int _admin_flush(admin_t *self, const char *args, FILE *out);
+int _admin_quit(admin_t *self, const char *args, FILE *out);
+int _admin_worker(tcpconnection_t *conn, int event);
+int _admin_read(tcpconnection_t *conn);
+void _admin_reply(tcpconnection_t *conn, const char *line);
+const char *_admin_op_name(uint8_t op_code, char *label);
+uint64_t _admin_now_ns();
+long _admin_resident_kb();
+
+const admin_command_t _admin_commands[] = {
+    {"help", NULL, "help                 this list", _admin_help},
+    {"stats", "s", "stats                counters, pools and the latency of every command", _admin_stats},
+    {"connections", NULL, "connections          open connections and what each has done", _admin_connections},
+    {"threads", NULL, "threads              threadpool workers, busy and queued work", _admin_threads},
+    {"caches", NULL, "caches               sizes and hit rates of the tables, filters and pools", _admin_caches},
+    {"slow", NULL, "slow [n]             the n slowest commands still in the trace, 10 unless given", _admin_slowest},
+    {"trace", "t", "trace                dump the trace of recent commands to " TRACE_DUMP_FILENAME, _admin_trace},
+    {"compact", NULL, "compact              fold split book requests together in catalog_requests.db", _admin_compact},
+    {"rebuild", NULL, "rebuild              rebuild the user index from users.db and refill the book filter", _admin_rebuild},
+    {"flush", NULL, "flush                drop every login session, clients log in with a password again", _admin_flush},
+    {"quit", "q", "quit                 stop the server, or close the connection on the admin socket", _admin_quit},
+};
+
+#define ADMIN_NUM_COMMANDS (int)(sizeof(_admin_commands) / sizeof(_admin_commands[0]))
+
+// CONSTRUCTOR
+admin_t *new_admin(tcpserver_t *catalog_server)
+{
+    admin_t *self = calloc(1, sizeof(admin_t));
+
+    if (self == NULL)
+        exit_error("Admin console memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, admin_destroy);
+
+    self->catalog_server = catalog_server;
+    pthread_mutex_init(&(self->maintenance_lock), NULL);
+
+    _admin_console = self;
+
+    return self;
+}
+
+// DESTRUCTOR
+void admin_destroy(void *s)
+{
+    admin_t *self = (admin_t *)s;
+
+    printf("Admin console ran %ld commands\n", atomic_load(&(self->num_commands)));
+
+    pthread_mutex_destroy(&(self->maintenance_lock));
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+/////
+int _admin_help(admin_t *self, const char *args, FILE *out)
+{
+    for (int i=0; i<ADMIN_NUM_COMMANDS; i++)
+        fprintf(out, "%s\n", _admin_commands[i].usage);
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_stats(admin_t *self, const char *args, FILE *out)
+{
+    tcpserver_t *server = self->catalog_server;
+
+    fprintf(out, "memory: %ld KB resident\n", _admin_resident_kb());
+    fprintf(out, "connections: %u accepted, %u rejected, %u reaped idle\n",
+        atomic_load(&(server->num_accepted)), atomic_load(&(server->num_rejected)), atomic_load(&(server->num_reaped)));
+    fprintf(out, "rate limiter: %ld allowed, %ld throttled by user, %ld throttled by address\n",
+        atomic_load(&(global_rl->num_allowed)), atomic_load(&(global_rl->users.num_throttled)), atomic_load(&(global_rl->addresses.num_throttled)));
+    fprintf(out, "sessions: %ld issued, %ld resumed, %ld refused\n",
+        atomic_load(&(global_st->num_issued)), atomic_load(&(global_st->num_resumed)), atomic_load(&(global_st->num_refused)));
+
+    bloomfilter_write_stats(global_ut->filter, "username", out);
+    if (global_bf != NULL)
+        bloomfilter_write_stats(global_bf, "book name", out);
+
+    fprintf(out, "log: %ld messages written, %ld dropped\n",
+        atomic_load(&(global_dl->num_written)), atomic_load(&(global_dl->num_dropped)));
+
+    objectpool_write_stats(server->conn_pool, "connection", out);
+    objectpool_write_stats(catalog_worker_sessions(), "session", out);
+
+    char text[CATALOG_STATS_TEXT_LEN];
+    catalog_worker_stats(text, sizeof(text));
+    fprintf(out, "\n%s", text);
+
+    return ADMIN_OK;
+}
+
+// Description: lists the open connections of the catalog server, with the counts their sessions keep
+// Notes:       rows are copied under conn_lock and written after it is let go, so a slow console never holds
+//              up accepting or closing connections.  A closing connection may already have given its
+//              session back, it then shows what the session's next connection has done, which is nothing yet
+int _admin_connections(admin_t *self, const char *args, FILE *out)
+{
+    tcpserver_t *server = self->catalog_server;
+    _admin_connection_t rows[ADMIN_CONNECTIONS_LISTED];
+    int num_rows = 0;
+
+    // sessions are only catalog sessions on a server running the catalog worker
+    bool catalog_sessions = server->worker == catalog_worker;
+
+    pthread_mutex_lock(&(server->conn_lock));
+
+    int num_connections = server->num_connections;
+
+    for (tcpconnection_t *conn = server->connections; conn != NULL && num_rows < ADMIN_CONNECTIONS_LISTED; conn = conn->next)
+    {
+        _admin_connection_t *row = &(rows[num_rows++]);
+        catalog_session_t *session = catalog_sessions ? (catalog_session_t *)conn->session : NULL;
+
+        row->conn_id = conn->conn_id;
+        memcpy(row->peer, conn->peer, sizeof(row->peer));
+        row->family = conn->family;
+        row->armed = atomic_load(&(conn->armed));
+        row->last_active = atomic_load(&(conn->last_active));
+        row->has_session = session != NULL;
+
+        if (session != NULL)
+        {
+            row->user_id = atomic_load_explicit(&(session->user_id), memory_order_relaxed);
+            row->num_commands = atomic_load_explicit(&(session->num_commands), memory_order_relaxed);
+            row->busy_ns = atomic_load_explicit(&(session->busy_ns), memory_order_relaxed);
+            row->last_op = atomic_load_explicit(&(session->last_op), memory_order_relaxed);
+        }
+    }
+
+    pthread_mutex_unlock(&(server->conn_lock));
+
+    uint64_t now_ms = _admin_now_ns() / 1000000;
+    char label[8];
+
+    fprintf(out, "connections: %d open\n", num_connections);
+    fprintf(out, "%8s  %-22s %-5s %8s %6s %9s %10s  %s\n", "ID", "PEER", "VIA", "IDLE(s)", "USER", "COMMANDS", "BUSY(ms)", "LAST COMMAND");
+
+    for (int i=0; i<num_rows; i++)
+    {
+        _admin_connection_t *row = &(rows[i]);
+        char idle[16] = "running";
+        char user[16] = "-";
+
+        // a connection that is not waiting in epoll is running a command or sending a reply
+        if (row->armed)
+            snprintf(idle, sizeof(idle), "%.1f", now_ms > row->last_active ? (now_ms - row->last_active) / 1000.0 : 0.0);
+        if (row->has_session && row->user_id > 0)
+            snprintf(user, sizeof(user), "%d", row->user_id);
+
+        fprintf(out, "%8u  %-22s %-5s %8s %6s %9ld %10.1f  %s\n", row->conn_id, row->peer,
+            row->family == AF_UNIX ? "unix" : "tcp", idle, user, row->has_session ? row->num_commands : 0,
+            row->has_session ? row->busy_ns / 1e6 : 0.0,
+            row->has_session && row->num_commands > 0 ? _admin_op_name(row->last_op, label) : "-");
+    }
+
+    if (num_connections > num_rows)
+        fprintf(out, "... and %d more\n", num_connections - num_rows);
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_threads(admin_t *self, const char *args, FILE *out)
+{
+    int num_workers = global_tp->num_workers;
+    int num_idle = atomic_load(&(global_tp->num_idle));
+    int num_busy = num_workers > num_idle ? num_workers - num_idle : 0;
+
+    fprintf(out, "threadpool: %d workers, %d busy (%.0f%%), %d idle\n",
+        num_workers, num_busy, num_workers > 0 ? 100.0 * num_busy / num_workers : 0.0, num_idle);
+    fprintf(out, "tasks: %d waiting, %d on the injection queue, %ld stolen from another worker\n",
+        atomic_load(&(global_tp->num_pending)), atomic_load(&(global_tp->num_queued)), atomic_load(&(global_tp->num_stolen)));
+
+    // spawned report chunks wait on the deque of the worker that spawned them
+    fprintf(out, "deques:");
+
+    for (int i=0; i<num_workers; i++)
+    {
+        threadpool_deque_t *deque = &(global_tp->deques[i]);
+
+        pthread_mutex_lock(&(deque->deque_lock));
+        int depth = deque->bottom - deque->top;
+        pthread_mutex_unlock(&(deque->deque_lock));
+
+        fprintf(out, " %d", depth);
+    }
+
+    fprintf(out, "\n");
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_caches(admin_t *self, const char *args, FILE *out)
+{
+    uint32_t num_slots;
+    uint32_t num_users = usertable_count(global_ut, &num_slots);
+    uint32_t num_sessions = sessiontable_count(global_st);
+    long resumed = atomic_load(&(global_st->num_resumed));
+    long refused = atomic_load(&(global_st->num_refused));
+
+    fprintf(out, "session table: %u of %u sessions stored, %ld resumed, %ld refused (%.1f%% hits)\n",
+        num_sessions, global_st->capacity, resumed, refused, resumed + refused > 0 ? 100.0 * resumed / (resumed + refused) : 0.0);
+    fprintf(out, "user table: %u users, %u index slots (%.1f%% full)\n",
+        num_users, num_slots, num_slots > 0 ? 100.0 * num_users / num_slots : 0.0);
+
+    // filters never grow, their size is the one they were made with
+    char name[32];
+
+    snprintf(name, sizeof(name), "username (%lu KB)", (unsigned long)(global_ut->filter->num_bits / 8 / 1024));
+    bloomfilter_write_stats(global_ut->filter, name, out);
+
+    if (global_bf != NULL)
+    {
+        snprintf(name, sizeof(name), "book name (%lu KB)", (unsigned long)(global_bf->num_bits / 8 / 1024));
+        bloomfilter_write_stats(global_bf, name, out);
+    }
+
+    objectpool_write_stats(self->catalog_server->conn_pool, "connection", out);
+    objectpool_write_stats(catalog_worker_sessions(), "session", out);
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_slowest(admin_t *self, const char *args, FILE *out)
+{
+    int max_events = ADMIN_SLOWEST_DEFAULT;
+
+    if (args[0] != '\0' && (sscanf(args, "%d", &max_events) != 1 || max_events < 1))
+    {
+        fprintf(out, "usage: slow [n]\n");
+        return ADMIN_OK;
+    }
+
+    if (max_events > ADMIN_SLOWEST_MAX)
+        max_events = ADMIN_SLOWEST_MAX;
+
+    trace_event_t events[ADMIN_SLOWEST_MAX];
+    int num_events = trace_slowest(global_tr, events, max_events);
+    uint64_t now_ns = _admin_now_ns();
+    char label[8];
+
+    fprintf(out, "slowest %d commands still in the trace\n", num_events);
+    fprintf(out, "%-16s %8s %10s %6s %7s %9s\n", "COMMAND", "CONN", "TIME(ms)", "READS", "WRITES", "AGO(s)");
+
+    for (int i=0; i<num_events; i++)
+    {
+        trace_event_t *event = &(events[i]);
+
+        fprintf(out, "%-16s %8u %10.3f %6u %7u %9.1f\n", _admin_op_name(event->op_code, label), event->conn_id,
+            (event->end_ns - event->start_ns) / 1e6, event->reads, event->writes,
+            now_ns > event->end_ns ? (now_ns - event->end_ns) / 1e9 : 0.0);
+    }
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_trace(admin_t *self, const char *args, FILE *out)
+{
+    long num_events = trace_dump(global_tr, TRACE_DUMP_FILENAME);
+
+    if (num_events < 0)
+        fprintf(out, "Could not write %s\n", TRACE_DUMP_FILENAME);
+    else
+        fprintf(out, "%ld events written to %s, convert with: python3 TraceConvert.py %s\n", num_events, TRACE_DUMP_FILENAME, TRACE_DUMP_FILENAME);
+
+    return ADMIN_OK;
+}
+
+// Description: rewrites catalog_requests.db with one row per user and book
+// Notes:       the file is locked while it is rewritten, book requests wait for it
+int _admin_compact(admin_t *self, const char *args, FILE *out)
+{
+    pthread_mutex_lock(&(self->maintenance_lock));
+
+    if (self->catalog == NULL)
+        self->catalog = new_catalog();
+
+    uint64_t start_ns = _admin_now_ns();
+    int num_dropped = catalog_compact_requests(self->catalog);
+    double ms = (_admin_now_ns() - start_ns) / 1e6;
+
+    pthread_mutex_unlock(&(self->maintenance_lock));
+
+    if (num_dropped < 0)
+    {
+        fprintf(out, "Could not compact %s\n", CATALOG_REQUESTS_DB_FILENAME);
+        return ADMIN_OK;
+    }
+
+    devlog_write(global_dl, DEVLOG_INFO, "Admin: compacted %s, %d rows dropped", CATALOG_REQUESTS_DB_FILENAME, num_dropped);
+    fprintf(out, "%s compacted in %.1f ms, %d rows dropped\n", CATALOG_REQUESTS_DB_FILENAME, ms, num_dropped);
+
+    return ADMIN_OK;
+}
+
+// Description: reloads the user table and its index, and adds any book the filter has not seen
+// Notes:       a bloom filter can't lose keys, so the book filter is refilled rather than rebuilt, books
+//              added to catalog.db by hand are found again while the filter keeps answering
+int _admin_rebuild(admin_t *self, const char *args, FILE *out)
+{
+    pthread_mutex_lock(&(self->maintenance_lock));
+
+    uint64_t start_ns = _admin_now_ns();
+    int num_users = usertable_reload(global_ut);
+    int num_books = global_bf != NULL ? catalog_fill_book_filter(global_bf) : -1;
+    double ms = (_admin_now_ns() - start_ns) / 1e6;
+
+    pthread_mutex_unlock(&(self->maintenance_lock));
+
+    if (num_users < 0)
+        fprintf(out, "Could not read %s, the user table is unchanged\n", AUTH_USER_DB_FILENAME);
+    else
+        fprintf(out, "user index rebuilt from %s: %d users\n", AUTH_USER_DB_FILENAME, num_users);
+
+    if (num_books >= 0)
+        fprintf(out, "book filter refilled from %s: %d books\n", CATALOG_DB_FILENAME, num_books);
+
+    fprintf(out, "done in %.1f ms\n", ms);
+
+    devlog_write(global_dl, DEVLOG_INFO, "Admin: rebuilt the user index, %d users, %d books in the filter", num_users, num_books);
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_flush(admin_t *self, const char *args, FILE *out)
+{
+    pthread_mutex_lock(&(self->maintenance_lock));
+    int num_dropped = sessiontable_flush(global_st);
+    pthread_mutex_unlock(&(self->maintenance_lock));
+
+    devlog_write(global_dl, DEVLOG_INFO, "Admin: flushed %d sessions", num_dropped);
+    fprintf(out, "%d sessions dropped, their clients log in with a password again\n", num_dropped);
+
+    return ADMIN_OK;
+}
+
+/////
+int _admin_quit(admin_t *self, const char *args, FILE *out)
+{
+    return ADMIN_QUIT;
+}
+
+// Description: the tcpserver worker of the admin socket, reads lines and answers each one
+int _admin_worker(tcpconnection_t *conn, int event)
+{
+    if (event == TCPSERVER_EVENT_CONNECT)
+    {
+        conn->session = calloc(1, sizeof(admin_session_t));
+        return conn->session != NULL ? TCPSERVER_KEEP : TCPSERVER_CLOSE;
+    }
+
+    if (event == TCPSERVER_EVENT_DATA)
+        return _admin_read(conn);
+
+    free(conn->session);
+    conn->session = NULL;
+
+    return TCPSERVER_CLOSE;
+}
+
+// Description: receives from a readable connection and runs every complete line
+int _admin_read(tcpconnection_t *conn)
+{
+    admin_session_t *session = (admin_session_t *)conn->session;
+
+    // one byte is kept back for the terminator
+    int bytes_received = recv(conn->socket, session->line + session->len, ADMIN_LINE_MAXLEN - 1 - session->len, 0);
+
+    if (bytes_received == 0)
+        return TCPSERVER_CLOSE;
+    else if (bytes_received < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? TCPSERVER_KEEP : TCPSERVER_CLOSE;
+
+    session->len += bytes_received;
+    session->line[session->len] = '\0';
+
+    char *end;
+
+    while ((end = strchr(session->line, '\n')) != NULL)
+    {
+        *end = '\0';
+
+        // answered in a temporary file and sent from it, like metrics scrapes
+        FILE *answer = tmpfile();
+
+        if (answer == NULL)
+            return TCPSERVER_CLOSE;
+
+        int result = admin_execute(_admin_console, session->line, answer);
+        fprintf(answer, "%s\n", ADMIN_END);
+        fflush(answer);
+
+        tcpserver_send_file(conn, answer, 0, (size_t)ftell(answer));
+
+        if (result == ADMIN_QUIT)
+            return TCPSERVER_CLOSE;
+
+        int line_len = (int)(end + 1 - session->line);
+        session->len -= line_len;
+        memmove(session->line, session->line + line_len, session->len + 1);
+    }
+
+    if (session->len < ADMIN_LINE_MAXLEN - 1)
+        return TCPSERVER_KEEP;
+
+    _admin_reply(conn, "line too long");
+
+    return TCPSERVER_CLOSE;
+}
+
+// Description: sends a one line answer
+void _admin_reply(tcpconnection_t *conn, const char *line)
+{
+    char reply[ADMIN_LINE_MAXLEN];
+    int len = snprintf(reply, sizeof(reply), "%s\n%s\n", line, ADMIN_END);
+
+    tcpserver_send(conn, reply, (size_t)len);
+}
+
+// Description: returns the name of a command, label holds the op code of one with no name
+const char *_admin_op_name(uint8_t op_code, char *label)
+{
+    const char *name = catalog_op_name(op_code);
+
+    if (name != NULL)
+        return name;
+
+    sprintf(label, "0x%02x", op_code);
+    return label;
+}
+
+/////
+uint64_t _admin_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Description: resident memory in KB, 0 if it can't be read
+long _admin_resident_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp == NULL)
+        return 0;
+
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// METHODS
+
+/////
+int admin_execute(admin_t *self, const char *line, FILE *out)
+{
+    char name[32] = {0};
+    int name_len = 0;
+
+    if (sscanf(line, " %31s%n", name, &name_len) != 1)
+        return ADMIN_OK;
+
+    // whatever follows the name, without the spaces around it
+    char args[ADMIN_LINE_MAXLEN];
+    const char *rest = line + name_len;
+
+    while (*rest == ' ' || *rest == '\t')
+        rest++;
+
+    snprintf(args, sizeof(args), "%s", rest);
+    args[strcspn(args, "\r\n")] = '\0';
+
+    for (int i=0; i<ADMIN_NUM_COMMANDS; i++)
+    {
+        const admin_command_t *command = &(_admin_commands[i]);
+
+        if (strcmp(name, command->name) == 0 || (command->alias != NULL && strcmp(name, command->alias) == 0))
+        {
+            atomic_fetch_add(&(self->num_commands), 1);
+            return command->run(self, args, out);
+        }
+    }
+
+    fprintf(out, "Unknown command '%s', type help for the list\n", name);
+
+    return ADMIN_UNKNOWN;
+}
+
+/////
+int admin_listen(admin_t *self, const char *path)
+{
+    if (self->server == NULL)
+    {
+        self->server = new_unix_tcpserver(_admin_worker);
+        tcpserver_set_limits(self->server, ADMIN_MAX_CONNECTIONS, 0, ADMIN_IDLE_TIMEOUT_MS);
+    }
+
+    int status = tcpserver_listen_unix(self->server, path);
+
+    // anyone who can connect can drop every session, so only this user may
+    if (status == SUCCESS)
+        chmod(path, S_IRUSR | S_IWUSR);
+
+    return status;
+}
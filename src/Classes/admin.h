@@ -0,0 +1,112 @@
+/*
+ * ADMIN CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Operator commands for looking into the server while it runs, and for maintaining it
+ *                A command is a line of text and is answered with lines of text.  The same commands are
+ *                taken from the server console and from a unix domain socket that only the user running
+ *                the server can open, so a server started in the background can be looked into from a
+ *                script or another terminal.  On the socket every answer ends with a line of ADMIN_END.
+ *
+ *                Commands that look read the counters the server keeps anyway and never stop a worker.
+ *                Maintenance commands take the same locks as the workers, one of them at a time.
+ * Usage:       Instantiate with: admin_t *myadmin = new_admin(catalog_server)
+ *              admin_execute(myadmin, "connections", stdout); admin_listen(myadmin, path)
+ *              echo connections | nc -U path
+ */
+#pragma once
+
+#ifndef ADMIN_H_INCLUDED
+#define ADMIN_H_INCLUDED
+
+#define ADMIN_LINE_MAXLEN 256               // a longer line is refused and its connection closed
+#define ADMIN_END "END"
+#define ADMIN_MAX_CONNECTIONS 4
+#define ADMIN_IDLE_TIMEOUT_MS 600000
+#define ADMIN_CONNECTIONS_LISTED 64         // connections shown one per line, the rest are only counted
+#define ADMIN_SLOWEST_DEFAULT 10
+#define ADMIN_SLOWEST_MAX 100
+
+// admin_execute() results
+#define ADMIN_OK 0
+#define ADMIN_UNKNOWN 1
+#define ADMIN_QUIT 2
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "tcpserver.h"
+#include "threadpool.h"
+#include "metrics.h"
+#include "trace.h"
+#include "catalog.h"
+#include "catalog_protocol.h"
+#include "catalog_worker.h"
+#include "usertable.h"
+#include "sessiontable.h"
+#include "bloomfilter.h"
+#include "ratelimiter.h"
+#include "devlog.h"
+
+// ADMIN SESSION
+//   a command line being read, per socket connection
+typedef struct
+{
+    char line[ADMIN_LINE_MAXLEN];
+    int len;
+} admin_session_t;
+
+// ADMIN OBJECT
+typedef struct admin
+{
+    int gc_id;
+
+    tcpserver_t *catalog_server;        // the server being looked into
+    tcpserver_t *server;                // the admin socket's own listener, NULL until admin_listen()
+
+    pthread_mutex_t maintenance_lock;   // one maintenance command at a time, guards catalog
+    catalog_t *catalog;                 // made by the first maintenance command that needs it
+
+    atomic_long num_commands;
+} admin_t;
+
+// ADMIN COMMAND
+typedef struct
+{
+    const char *name;
+    const char *alias;                  // the single letters the console has always taken, or NULL
+    const char *usage;
+    int (*run)(admin_t *self, const char *args, FILE *out);
+} admin_command_t;
+
+// CONSTRUCTOR
+admin_t *new_admin(tcpserver_t *catalog_server);
+
+// DESTRUCTOR
+void admin_destroy(void *);
+
+// METHODS
+
+// admin_execute()
+//   Runs one command line and writes its answer to out
+//   Returns ADMIN_OK, ADMIN_UNKNOWN for a line that is not a command, or ADMIN_QUIT for quit
+int admin_execute(admin_t *self, const char *line, FILE *out);
+
+// admin_listen()
+//   Also takes commands on a unix domain socket at path, readable and writable by this user only
+//   quit closes the socket connection and leaves the server running
+//   Returns SUCCESS, or the error of tcpserver_listen_unix()
+int admin_listen(admin_t *self, const char *path);
+
+#endif
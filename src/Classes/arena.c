@@ -0,0 +1,281 @@
+/*
+ * ARENA CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "arena.h"
+
+extern garbagecollector_t *global_gc;
+
+// the arena arena_malloc() draws from on this thread
+_Thread_local arena_t *_arena_current = NULL;
+
+// BLOCK HEADER
+//   sits in front of every block, ARENA_ALIGN bytes so the block after it stays aligned
+typedef struct
+{
+    size_t prev_top;
+    size_t freed;
+} _arena_block_t;
+
+// the hot paths use these rather than helper calls, the default build is not optimized
+#define _ARENA_ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define _ARENA_CHUNK_DATA(chunk) ((char *)(chunk) + _ARENA_ALIGN_UP(sizeof(arena_chunk_t)))
+
+// HELPERS
+arena_chunk_t *_arena_new_chunk(arena_t *self, size_t min_size);
+void _arena_clear_chunk(arena_chunk_t *chunk);
+bool _arena_chunk_has(arena_chunk_t *chunk, const void *ptr);
+void _arena_pop_freed(arena_t *self);
+
+// CONSTRUCTOR
+arena_t *new_arena()
+{
+    arena_t *self = calloc(1, sizeof(arena_t));
+
+    if (self == NULL)
+        exit_error("Arena memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, arena_destroy);
+
+    return self;
+}
+
+// DESTRUCTOR
+void arena_destroy(void *s)
+{
+    arena_t *self = (arena_t *)s;
+
+    if (_arena_current == self)
+        _arena_current = NULL;
+
+    arena_chunk_t *chunk = self->first;
+
+    while (chunk != NULL)
+    {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: creates a chunk with room for a min_size block and links it in after the current chunk
+arena_chunk_t *_arena_new_chunk(arena_t *self, size_t min_size)
+{
+    size_t size = ARENA_CHUNK_SIZE;
+
+    if (min_size > size)
+        size = min_size;
+
+    arena_chunk_t *chunk = malloc(_ARENA_ALIGN_UP(sizeof(arena_chunk_t)) + size);
+
+    if (chunk == NULL)
+        exit_error("Arena memory allocation failed\n");
+
+    chunk->size = size;
+    _arena_clear_chunk(chunk);
+
+    chunk->prev = self->current;
+    chunk->next = self->current != NULL ? self->current->next : NULL;
+
+    if (chunk->prev != NULL)
+        chunk->prev->next = chunk;
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk;
+
+    if (self->first == NULL)
+        self->first = chunk;
+
+    self->num_chunks++;
+
+    return chunk;
+}
+
+/////
+void _arena_clear_chunk(arena_chunk_t *chunk)
+{
+    chunk->used = 0;
+    chunk->top = ARENA_NO_BLOCK;
+}
+
+/////
+bool _arena_chunk_has(arena_chunk_t *chunk, const void *ptr)
+{
+    const char *data = _ARENA_CHUNK_DATA(chunk);
+
+    return (const char *)ptr >= data && (const char *)ptr < data + chunk->size;
+}
+
+// Description: gives back freed blocks from the top of the stack down to the newest one still in use
+void _arena_pop_freed(arena_t *self)
+{
+    arena_chunk_t *chunk = self->current;
+
+    while (chunk != NULL)
+    {
+        while (chunk->top != ARENA_NO_BLOCK)
+        {
+            _arena_block_t *block = (_arena_block_t *)(_ARENA_CHUNK_DATA(chunk) + chunk->top);
+
+            if (!block->freed)
+                return;
+
+            chunk->used = chunk->top;
+            chunk->top = block->prev_top;
+        }
+
+        // an emptied chunk hands the top of the stack back to the one before it
+        if (chunk == self->first)
+            return;
+
+        chunk = chunk->prev;
+        self->current = chunk;
+    }
+}
+
+// METHODS
+
+/////
+void *arena_alloc(arena_t *self, size_t size)
+{
+    size_t needed = sizeof(_arena_block_t) + _ARENA_ALIGN_UP(size);
+
+    if (self->current == NULL)
+        self->current = _arena_new_chunk(self, needed);
+
+    arena_chunk_t *chunk = self->current;
+    size_t offset = _ARENA_ALIGN_UP(chunk->used);
+
+    if (offset + needed > chunk->size)
+    {
+        // chunks after the current one are left over from before a reset, reuse the next if it is big enough
+        if (chunk->next != NULL && chunk->next->size >= needed)
+        {
+            chunk = chunk->next;
+            _arena_clear_chunk(chunk);
+        }
+        else
+        {
+            chunk = _arena_new_chunk(self, needed);
+        }
+
+        self->current = chunk;
+        offset = 0;
+    }
+
+    _arena_block_t *block = (_arena_block_t *)(_ARENA_CHUNK_DATA(chunk) + offset);
+    block->prev_top = chunk->top;
+    block->freed = 0;
+
+    chunk->top = offset;
+    chunk->used = offset + needed;
+
+    self->num_allocs++;
+
+    return (char *)block + sizeof(_arena_block_t);
+}
+
+/////
+void arena_release(arena_t *self, void *ptr)
+{
+    _arena_block_t *block = (_arena_block_t *)((char *)ptr - sizeof(_arena_block_t));
+    arena_chunk_t *chunk = self->current;
+
+    // an older block waits for the ones after it
+    if (chunk->top == ARENA_NO_BLOCK || (char *)block != _ARENA_CHUNK_DATA(chunk) + chunk->top)
+    {
+        block->freed = 1;
+        return;
+    }
+
+    chunk->used = chunk->top;
+    chunk->top = block->prev_top;
+
+    _arena_pop_freed(self);
+}
+
+/////
+void arena_reset(arena_t *self)
+{
+    self->current = self->first;
+
+    if (self->first != NULL)
+        _arena_clear_chunk(self->first);
+}
+
+/////
+bool arena_owns(arena_t *self, const void *ptr)
+{
+    // blocks are nearly always freed from the chunk they were just allocated in
+    if (self->current != NULL && _arena_chunk_has(self->current, ptr))
+        return true;
+
+    for (arena_chunk_t *chunk = self->first; chunk != NULL; chunk = chunk->next)
+        if (chunk != self->current && _arena_chunk_has(chunk, ptr))
+            return true;
+
+    return false;
+}
+
+// CURRENT ARENA
+
+/////
+arena_t *arena_use(arena_t *arena)
+{
+    arena_t *prev = _arena_current;
+    _arena_current = arena;
+
+    return prev;
+}
+
+/////
+void *arena_malloc(size_t size)
+{
+    if (_arena_current == NULL)
+        return slab_alloc(size);
+
+    return arena_alloc(_arena_current, size);
+}
+
+/////
+void *arena_calloc(size_t num, size_t size)
+{
+    void *ptr = arena_malloc(num * size);
+
+    if (ptr != NULL)
+        memset(ptr, 0, num * size);
+
+    return ptr;
+}
+
+/////
+void arena_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    arena_t *arena = _arena_current;
+
+    if (arena == NULL)
+    {
+        slab_free(ptr);
+        return;
+    }
+
+    // blocks are nearly always freed from the chunk they were just allocated in
+    arena_chunk_t *chunk = arena->current;
+
+    if (chunk != NULL && (char *)ptr >= _ARENA_CHUNK_DATA(chunk) && (char *)ptr < _ARENA_CHUNK_DATA(chunk) + chunk->used)
+        arena_release(arena, ptr);
+    else if (arena_owns(arena, ptr))
+        arena_release(arena, ptr);
+    else
+        slab_free(ptr);
+}
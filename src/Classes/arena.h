@@ -0,0 +1,101 @@
+/*
+ * ARENA CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Stack of memory for allocations that only live as long as one command
+ *                Allocations are carved out of chunks that are kept for the life of the arena, so a
+ *                busy connection stops calling malloc once its chunks are big enough for its commands.
+ *                Freeing the newest block gives its memory back straight away, older blocks are given
+ *                back as soon as everything after them is freed too.  Resetting empties the arena at once.
+ *
+ *                A thread can make an arena current with arena_use(), after which arena_malloc() and
+ *                arena_free() work with it instead of the slab allocator.  The row helpers in common.c and
+ *                datafile.c allocate this way, so their rows must not outlive the command that made them.
+ * Usage:       Instantiate with: arena_t *myarena = new_arena()
+ */
+#pragma once
+
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#define ARENA_CHUNK_SIZE 16384      // larger allocations get a chunk of their own
+#define ARENA_ALIGN 16
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "slab.h"
+
+// ARENA CHUNK
+typedef struct arena_chunk
+{
+    struct arena_chunk *prev;
+    struct arena_chunk *next;
+    size_t size;                    // bytes after the chunk header
+    size_t used;
+    size_t top;                     // offset of the newest block header, ARENA_NO_BLOCK if empty
+} arena_chunk_t;
+
+#define ARENA_NO_BLOCK SIZE_MAX
+
+// ARENA OBJECT
+typedef struct
+{
+    int gc_id;
+
+    arena_chunk_t *first;           // NULL until the first allocation
+    arena_chunk_t *current;
+
+    long num_allocs;
+    long num_chunks;
+} arena_t;
+
+// CONSTRUCTOR
+arena_t *new_arena();
+
+// DESTRUCTOR
+void arena_destroy(void *);
+
+// METHODS
+
+// arena_alloc()
+//   Returns size bytes aligned to ARENA_ALIGN
+void *arena_alloc(arena_t *self, size_t size);
+
+// arena_release()
+//   Gives back a block from arena_alloc()
+void arena_release(arena_t *self, void *ptr);
+
+// arena_reset()
+//   Gives back every block at once, the chunks are kept for the next command
+void arena_reset(arena_t *self);
+
+// arena_owns()
+//   Returns true if ptr was allocated from this arena
+bool arena_owns(arena_t *self, const void *ptr);
+
+// CURRENT ARENA
+
+// arena_use()
+//   Makes arena the calling thread's current arena, NULL goes back to the slab allocator
+//   Returns the previous one so that long lived allocations can step out of an arena and back
+arena_t *arena_use(arena_t *arena);
+
+// arena_malloc()
+//   Allocates from the current arena, or slab_alloc() if there is none
+void *arena_malloc(size_t size);
+
+// arena_calloc()
+//   arena_malloc() for zeroed memory
+void *arena_calloc(size_t num, size_t size);
+
+// arena_free()
+//   Frees memory from arena_malloc(), whether it came from the current arena or slab_alloc()
+void arena_free(void *ptr);
+
+#endif
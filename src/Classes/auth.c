@@ -7,6 +7,7 @@
 #include "auth.h"
 
 extern garbagecollector_t *global_gc;
+extern usertable_t *global_ut;
 
 ////
 auth_t *new_auth()
@@ -16,12 +17,7 @@ auth_t *new_auth()
     if (self == NULL)
         exit_error("Auth memory allocation failed");
 
-    garbagecollector_register(global_gc, (void *)self, auth_destroy);
-
-    self->user_db = new_datafile(AUTH_USER_DB_FILENAME);
-
-    if (self->user_db == NULL)
-        exit_error("failed to initialize user database");
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, auth_destroy);
 
     return self;
 }
@@ -37,66 +33,52 @@ void auth_destroy(void *s)
 ////
 bool auth_new_user(auth_t *self, const char *username, const char *password)
 {
-    if (username == NULL || password == NULL)
+    if (self == NULL || username == NULL || password == NULL)
         return false;
 
-    // prevent duplicate user registration
-    if (auth_user_exists(self, username))
-        return false;
-
-    char **user_data = datafile_new_row_array(self->user_db);
-    datafile_set_col(self->user_db, &user_data, "username", username);
-    datafile_set_col(self->user_db, &user_data, "password", password);
-    datafile_add_row(self->user_db, &user_data);
-    datafile_free_row(self->user_db, &user_data);
-
-    return true;
+    // duplicate names are refused by the user table
+    return usertable_add(global_ut, username, password) >= 0;
 }
 
 ////
 bool auth_user_exists(auth_t *self, const char *username)
 {
-    //printf("auth_user_exists()\n");
     if (self == NULL || username == NULL)
         return false;
 
     if (strcmp(username, "") == 0)
         return false;
 
-    datafile_get_row_prepare(self->user_db);
-    char **user_row = datafile_get_row_by_field(self->user_db, "username", username);
-    if (user_row == NULL)
-    {
-        return false;
-    }
-    else
-    {
-        datafile_free_row(self->user_db, &user_row);
-        return true;
-    }
+    return usertable_exists(global_ut, username);
 }
 
 ////
 bool auth_login(auth_t *self, const char *username, const char *password)
 {
     if (username == NULL || password == NULL)
-        return 0;
-
-    bool login_success = false;
-
-    if (!auth_user_exists(self, username))
-        return false; // possibly change
+        return false;
 
-    // check password
-    datafile_get_row_prepare(self->user_db);
-    char **user_row = datafile_get_row_by_field(self->user_db, "username", username);
+    int user_id = usertable_login(global_ut, username, password);
 
-    if (strcmp(user_row[datafile_get_field_index(self->user_db, "password")], password) == 0)
+    if (user_id >= 0)
     {
-        self->user_id = atoi(user_row[0]);
+        self->user_id = user_id;
         self->authenticated = true;
     }
-    datafile_free_row(self->user_db, &user_row);
 
     return self->authenticated;
 }
+
+////
+void auth_resume(auth_t *self, int user_id)
+{
+    self->user_id = user_id;
+    self->authenticated = true;
+}
+
+////
+void auth_logout(auth_t *self)
+{
+    self->user_id = 0;
+    self->authenticated = false;
+}
@@ -18,9 +18,9 @@
 
 #include "common.h"
 #include "garbagecollector.h"
-#include "datafile.h"
+#include "usertable.h"
 
-#define AUTH_USER_DB_FILENAME "data/users.db"
+#define AUTH_USER_DB_FILENAME "data/users.db"      // loaded into global_ut by init()
 
 // bad chars that cause a xored character to become newline, corrupting csv:
 //  237#!~e[]^_Eqwy`af1-Y@AF0(pri|hdg&$%PRI\HDG645w
@@ -36,8 +36,6 @@ typedef struct
 
     int user_id;
     bool authenticated;
-
-    datafile_t *user_db;
 } auth_t;
 
 // CONSTRUCTOR
@@ -60,4 +58,12 @@ bool auth_user_exists(auth_t *s, const char *username);
 // Authenticates a given username and password
 bool auth_login(auth_t *s, const char *username, const char *password);
 
+// auth_resume()
+// Authenticates as user_id without a password, for a session that already logged in once
+void auth_resume(auth_t *s, int user_id);
+
+// auth_logout()
+// Forgets the logged in user, for an auth object handed to the next connection
+void auth_logout(auth_t *s);
+
 #endif
\ No newline at end of file
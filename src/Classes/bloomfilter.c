@@ -0,0 +1,131 @@
+/*
+ * BLOOM FILTER CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "bloomfilter.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+void _bloomfilter_hash(const char *key, uint64_t *h1, uint64_t *h2);
+
+// CONSTRUCTOR
+bloomfilter_t *new_bloomfilter(uint32_t expected_keys)
+{
+    bloomfilter_t *self = calloc(1, sizeof(bloomfilter_t));
+
+    if (self == NULL)
+        exit_error("Bloom filter memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, bloomfilter_destroy);
+
+    self->num_bits = BLOOMFILTER_MIN_BITS;
+    while (self->num_bits < (uint64_t)expected_keys * BLOOMFILTER_BITS_PER_KEY)
+        self->num_bits *= 2;
+
+    self->words = calloc(self->num_bits / 64, sizeof(uint64_t));
+
+    if (self->words == NULL)
+        exit_error("Bloom filter memory allocation failed\n");
+
+    return self;
+}
+
+// DESTRUCTOR
+void bloomfilter_destroy(void *s)
+{
+    bloomfilter_t *self = (bloomfilter_t *)s;
+
+    free((void *)self->words);
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: FNV-1a for the first hash, and a mix of it for the step between bits
+void _bloomfilter_hash(const char *key, uint64_t *h1, uint64_t *h2)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    for (; *key; key++)
+        hash = (hash ^ (uint8_t)*key) * 1099511628211ull;
+
+    *h1 = hash;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+
+    // an odd step visits BLOOMFILTER_HASHES different bits
+    *h2 = hash | 1;
+}
+
+// METHODS
+
+/////
+void bloomfilter_add(bloomfilter_t *self, const char *key)
+{
+    uint64_t h1, h2;
+    _bloomfilter_hash(key, &h1, &h2);
+
+    for (int i=0; i<BLOOMFILTER_HASHES; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & (self->num_bits - 1);
+        atomic_fetch_or_explicit(&(self->words[bit / 64]), 1ull << (bit % 64), memory_order_release);
+    }
+}
+
+/////
+bool bloomfilter_check(bloomfilter_t *self, const char *key)
+{
+    uint64_t h1, h2;
+    _bloomfilter_hash(key, &h1, &h2);
+
+    atomic_fetch_add_explicit(&(self->num_checked), 1, memory_order_relaxed);
+
+    for (int i=0; i<BLOOMFILTER_HASHES; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & (self->num_bits - 1);
+
+        if ((atomic_load_explicit(&(self->words[bit / 64]), memory_order_acquire) & (1ull << (bit % 64))) == 0)
+        {
+            atomic_fetch_add_explicit(&(self->num_rejected), 1, memory_order_relaxed);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/////
+void bloomfilter_found(bloomfilter_t *self, bool found)
+{
+    if (!found)
+        atomic_fetch_add_explicit(&(self->num_false_positives), 1, memory_order_relaxed);
+}
+
+/////
+void bloomfilter_print_stats(bloomfilter_t *self, const char *name)
+{
+    bloomfilter_write_stats(self, name, stdout);
+}
+
+/////
+void bloomfilter_write_stats(bloomfilter_t *self, const char *name, FILE *out)
+{
+    long checked = atomic_load(&(self->num_checked));
+    long rejected = atomic_load(&(self->num_rejected));
+    long false_positives = atomic_load(&(self->num_false_positives));
+
+    // of all the checks for keys that were not there, how many still needed a lookup
+    long misses = rejected + false_positives;
+
+    fprintf(out, "%s filter: %ld checked, %ld rejected without a lookup (%.1f%%), %ld false positives (%.2f%% of misses)\n",
+        name, checked, rejected, checked > 0 ? 100.0 * rejected / checked : 0.0,
+        false_positives, misses > 0 ? 100.0 * false_positives / misses : 0.0);
+}
@@ -0,0 +1,72 @@
+/*
+ * BLOOM FILTER CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Set of keys that answers "definitely not here" without a lookup
+ *                A key sets BLOOMFILTER_HASHES bits chosen by double hashing.  A key with any of its
+ *                bits clear was never added, a key with all of them set probably was and still has
+ *                to be looked up.  Keys can't be removed.  Bits are set and read atomically, so any
+ *                number of threads can check and add without a lock.
+ * Usage:       Instantiate with: bloomfilter_t *myfilter = new_bloomfilter(expected_keys)
+ */
+#pragma once
+
+#ifndef BLOOMFILTER_H_INCLUDED
+#define BLOOMFILTER_H_INCLUDED
+
+#define BLOOMFILTER_BITS_PER_KEY 16         // about 0.05% false positives at the expected number of keys
+#define BLOOMFILTER_HASHES 7
+#define BLOOMFILTER_MIN_BITS (1 << 20)      // 128KB, room for 64k keys before the rate starts to climb
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+
+// BLOOMFILTER OBJECT
+typedef struct
+{
+    int gc_id;
+
+    _Atomic uint64_t *words;
+    uint64_t num_bits;                  // always a power of two
+
+    atomic_long num_checked;
+    atomic_long num_rejected;           // checks answered without a lookup
+    atomic_long num_false_positives;    // checks that passed but whose lookup found nothing
+} bloomfilter_t;
+
+// CONSTRUCTOR
+//   sized for expected_keys, more can be added at the cost of more false positives
+bloomfilter_t *new_bloomfilter(uint32_t expected_keys);
+
+// DESTRUCTOR
+void bloomfilter_destroy(void *);
+
+// METHODS
+
+// bloomfilter_add()
+//   Adds key to the set, add before the key can be found elsewhere so a check never misses it
+void bloomfilter_add(bloomfilter_t *self, const char *key);
+
+// bloomfilter_check()
+//   Returns false if key was never added, true if it might have been
+bool bloomfilter_check(bloomfilter_t *self, const char *key);
+
+// bloomfilter_found()
+//   Records whether the lookup after a passed check found the key, for the false positive count
+void bloomfilter_found(bloomfilter_t *self, bool found);
+
+// bloomfilter_print_stats()
+//   Prints the checks, rejections and false positive rate of the filter under name
+void bloomfilter_print_stats(bloomfilter_t *self, const char *name);
+
+// bloomfilter_write_stats()
+//   As bloomfilter_print_stats(), writing to out
+void bloomfilter_write_stats(bloomfilter_t *self, const char *name, FILE *out);
+
+#endif
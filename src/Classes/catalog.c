@@ -7,6 +7,12 @@
 #include "catalog.h"
 
 extern garbagecollector_t *global_gc;
+extern bloomfilter_t *global_bf;
+
+// HELPERS
+void _catalog_filter_add(const char *book_name, void *filter);
+void _catalog_compact_requests(datafile_t *requests_db, char ***rows, int num_rows, void *arg);
+uint32_t _catalog_request_hash(const char *user_id, const char *book_id);
 
 ////
 catalog_t *new_catalog()
@@ -16,7 +22,7 @@ catalog_t *new_catalog()
     if (self == NULL)
         exit_error("Catalog memory allocation failed\n");
 
-    garbagecollector_register(global_gc, (void *)self, catalog_destroy);
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, catalog_destroy);
 
     self->catalog_db = new_datafile(CATALOG_DB_FILENAME);
     self->requests_db = new_datafile(CATALOG_REQUESTS_DB_FILENAME);
@@ -37,6 +43,122 @@ void catalog_destroy(void *s)
     free(self);
 }
 
+////
+bloomfilter_t *catalog_new_book_filter()
+{
+    datafile_t *catalog_db = new_datafile(CATALOG_DB_FILENAME);
+
+    if (catalog_db == NULL)
+        return NULL;
+
+    // ids only go up, so the last one is at least the number of books
+    bloomfilter_t *filter = new_bloomfilter(datafile_get_last_row_id(catalog_db) * 2);
+    datafile_for_each_value(catalog_db, "book_name", _catalog_filter_add, filter);
+
+    datafile_destroy(catalog_db);
+
+    return filter;
+}
+
+/////
+void _catalog_filter_add(const char *book_name, void *filter)
+{
+    bloomfilter_add((bloomfilter_t *)filter, book_name);
+}
+
+////
+int catalog_fill_book_filter(bloomfilter_t *filter)
+{
+    datafile_t *catalog_db = new_datafile(CATALOG_DB_FILENAME);
+
+    if (catalog_db == NULL)
+        return -1;
+
+    int num_books = datafile_for_each_value(catalog_db, "book_name", _catalog_filter_add, filter);
+
+    datafile_destroy(catalog_db);
+
+    return num_books;
+}
+
+// Description: requests can end up split over several rows when two connections of the same user request
+//              the same book at once, each of them finding no row and adding one
+// Notes:       the first row of each user and book is the one catalog_request_book() finds, so the others are
+//              folded into it and a request racing the compaction still updates the row that is kept
+void _catalog_compact_requests(datafile_t *requests_db, char ***rows, int num_rows, void *arg)
+{
+    int user_index = datafile_get_field_index(requests_db, "user_id");
+    int book_index = datafile_get_field_index(requests_db, "book_id");
+    int qty_index = datafile_get_field_index(requests_db, "qty_requested");
+
+    // open addressing on user and book, a slot holds the index of the first row plus one
+    uint32_t num_slots = 1;
+    while (num_slots < (uint32_t)num_rows * 2)
+        num_slots <<= 1;
+
+    uint32_t *slots = calloc(num_slots, sizeof(uint32_t));
+
+    if (slots == NULL)
+        return;
+
+    for (int i=0; i<num_rows; i++)
+    {
+        uint32_t slot = _catalog_request_hash(rows[i][user_index], rows[i][book_index]) & (num_slots - 1);
+
+        while (slots[slot] != 0)
+        {
+            char **first = rows[slots[slot] - 1];
+
+            if (strcmp(first[user_index], rows[i][user_index]) == 0 && strcmp(first[book_index], rows[i][book_index]) == 0)
+                break;
+
+            slot = (slot + 1) & (num_slots - 1);
+        }
+
+        if (slots[slot] == 0)
+        {
+            slots[slot] = i + 1;
+            continue;
+        }
+
+        char qty_str[12];
+        char ***first = &(rows[slots[slot] - 1]);
+        snprintf(qty_str, sizeof(qty_str), "%d", atoi((*first)[qty_index]) + atoi(rows[i][qty_index]));
+
+        datafile_set_col(requests_db, first, "qty_requested", qty_str);
+        datafile_free_row(requests_db, &(rows[i]));
+        rows[i] = NULL;
+    }
+
+    free(slots);
+
+    // folding may leave a row with nothing requested, which catalog_request_book() would have deleted
+    for (int i=0; i<num_rows; i++)
+    {
+        if (rows[i] != NULL && (atoi(rows[i][qty_index]) <= 0 || atoi(rows[i][user_index]) < 1 || atoi(rows[i][book_index]) < 1))
+        {
+            datafile_free_row(requests_db, &(rows[i]));
+            rows[i] = NULL;
+        }
+    }
+}
+
+// Description: FNV-1a over both ids
+uint32_t _catalog_request_hash(const char *user_id, const char *book_id)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *user_id; user_id++)
+        hash = (hash ^ (uint8_t)*user_id) * 16777619u;
+
+    hash = (hash ^ '\t') * 16777619u;
+
+    for (; *book_id; book_id++)
+        hash = (hash ^ (uint8_t)*book_id) * 16777619u;
+
+    return hash;
+}
+
 ////
 bool catalog_add_book(catalog_t *self, const char *book_name, int qty)
 {
@@ -48,14 +170,21 @@ bool catalog_add_book(catalog_t *self, const char *book_name, int qty)
 
     int book_id = catalog_get_book_id(self, book_name);
 
-    char qty_str[10];
+    char qty_str[12];
     char **book_data = datafile_new_row_array(self->catalog_db);
     datafile_set_col(self->catalog_db, &book_data, "book_name", book_name);
 
     if (!book_id)
     {
-        // create new catalog entry
-        sprintf(qty_str, "%d", qty);
+        // create new catalog entry, the filter gets the name as it will be saved before anyone can look for it
+        if (global_bf != NULL)
+        {
+            char **name = &(book_data[datafile_get_field_index(self->catalog_db, "book_name")]);
+            strip_tabs(name);
+            bloomfilter_add(global_bf, *name);
+        }
+
+        snprintf(qty_str, sizeof(qty_str), "%d", qty);
         datafile_set_col(self->catalog_db, &book_data, "qty_total", qty_str);
         datafile_add_row(self->catalog_db, &book_data);
         
@@ -72,7 +201,7 @@ bool catalog_add_book(catalog_t *self, const char *book_name, int qty)
         int total_qty = atoi(row[datafile_get_field_index(self->catalog_db, "qty_total")]);
         datafile_free_row(self->catalog_db, &row);
 
-        sprintf(qty_str, "%d", total_qty + qty);
+        snprintf(qty_str, sizeof(qty_str), "%d", total_qty + qty);
         datafile_set_col(self->catalog_db, &book_data, "qty_total", qty_str);
         datafile_update_row(self->catalog_db, book_id, &book_data);
     }
@@ -89,10 +218,16 @@ int catalog_get_book_avail_qty(catalog_t *self, const char *book_name)
 
     int ret_qty = 0;
 
+    if (global_bf != NULL && !bloomfilter_check(global_bf, book_name))
+        return 0;
+
     // get the total qty for this book
     datafile_get_row_prepare(self->catalog_db);
     char **row_book = datafile_get_row_by_field(self->catalog_db, "book_name", book_name);
 
+    if (global_bf != NULL)
+        bloomfilter_found(global_bf, row_book != NULL);
+
     if (row_book == NULL)
         return 0;
 
@@ -130,11 +265,11 @@ bool catalog_request_book(catalog_t *self, const char *book_name, int user_id, i
     if (qty_requested > qty_avail)
         return false;
 
-    char user_id_str[10];
-    char book_id_str[10];
-    char qty_requested_str[10];
-    sprintf(user_id_str, "%d", user_id);
-    sprintf(book_id_str, "%d", book_id);
+    char user_id_str[12];
+    char book_id_str[12];
+    char qty_requested_str[12];
+    snprintf(user_id_str, sizeof(user_id_str), "%d", user_id);
+    snprintf(book_id_str, sizeof(book_id_str), "%d", book_id);
 
     // see if this user has requests for this book
     int qty_already_requested = 0;
@@ -167,7 +302,7 @@ bool catalog_request_book(catalog_t *self, const char *book_name, int user_id, i
         datafile_set_col(self->requests_db, &request_book_data, "book_id", book_id_str);
 
         // prepare appropriate qty_requested
-        sprintf(qty_requested_str, "%d", qty_requested);
+        snprintf(qty_requested_str, sizeof(qty_requested_str), "%d", qty_requested);
         datafile_set_col(self->requests_db, &request_book_data, "qty_requested", qty_requested_str); 
 
         // update or add requested qty as appropriate
@@ -193,6 +328,15 @@ bool catalog_return_book(catalog_t *self, const char *book_name, int user_id, in
     return catalog_request_book(self, book_name, user_id, -qty_returning);
 }
 
+////
+int catalog_compact_requests(catalog_t *self)
+{
+    if (self == NULL)
+        return -1;
+
+    return datafile_rewrite(self->requests_db, _catalog_compact_requests, NULL);
+}
+
 ////
 int catalog_get_book_id(catalog_t *self, const char *book_name)
 {
@@ -202,9 +346,15 @@ int catalog_get_book_id(catalog_t *self, const char *book_name)
     if (strcmp(book_name, "") == 0)
         return 0;
 
+    if (global_bf != NULL && !bloomfilter_check(global_bf, book_name))
+        return 0;
+
     datafile_get_row_prepare(self->catalog_db);
     char **row = datafile_get_row_by_field(self->catalog_db, "book_name", book_name);
 
+    if (global_bf != NULL)
+        bloomfilter_found(global_bf, row != NULL);
+
     int book_id = 0;
 
     if (row != NULL)
@@ -229,30 +379,110 @@ bool catalog_book_exists(catalog_t *self, const char *book_name)
 }
 
 ////
-bool catalog_generate_report(catalog_t *self, const char *report_filename)
+int catalog_get_last_book_id(catalog_t *self)
 {
-    if (self == NULL || report_filename == NULL)
-        return false;
+    if (self == NULL)
+        return 0;
 
-    FILE *fp = fopen(report_filename, "w");
-    
-    datafile_get_row_prepare(self->catalog_db);
+    return datafile_get_last_row_id(self->catalog_db);
+}
 
+////
+void catalog_format_report_header(int report_type, char *buffer, size_t len)
+{
+    if (report_type == CATALOG_REPORT_AVAILABILITY)
+        snprintf(buffer, len, "%-20s%20s%20s\n", "BOOK NAME", "TOTAL ON HAND", "AVAILABLE");
+    else
+        snprintf(buffer, len, "%-20s%20s%20s%20s\n", "BOOK NAME", "TOTAL ON HAND", "IN USE", "AVAILABLE");
+}
+
+////
+char *catalog_get_report_lines(catalog_t *self, int report_type, int after_id, int last_id)
+{
+    if (self == NULL)
+        return NULL;
+
+    char *report_lines = NULL;
+    size_t lines_len = 0;
+    size_t lines_cap = 0;
+    char report_line[CATALOG_REPORT_LINE_LEN] = {0};
     char **row;
 
-    fprintf(fp, "%-20s%20s%20s%20s\n", "BOOK NAME", "TOTAL ON HAND", "IN USE", "AVAILABLE");
+    // resume the row cursor just before the first book of this range
+    datafile_get_row_prepare_after(self->catalog_db, after_id);
+
     while ((row = datafile_get_row(self->catalog_db)) != NULL)
     {
+        if (atoi(row[0]) > last_id)
+        {
+            datafile_free_row(self->catalog_db, &row);
+            break;
+        }
+
         int total_on_hand = atoi(row[datafile_get_field_index(self->catalog_db, "qty_total")]);
         int available = catalog_get_book_avail_qty(self, row[datafile_get_field_index(self->catalog_db, "book_name")]);
         int in_use = total_on_hand - available;
+        int line_len;
 
-        fprintf(fp, "%-20s%20d%20d%20d\n", 
-            row[datafile_get_field_index(self->catalog_db, "book_name")], total_on_hand, in_use, available);
+        if (report_type == CATALOG_REPORT_AVAILABILITY)
+            line_len = snprintf(report_line, sizeof(report_line), "%-20s%20d%20d\n", 
+                row[datafile_get_field_index(self->catalog_db, "book_name")], total_on_hand, available);
+        else
+            line_len = snprintf(report_line, sizeof(report_line), "%-20s%20d%20d%20d\n", 
+                row[datafile_get_field_index(self->catalog_db, "book_name")], total_on_hand, in_use, available);
 
         datafile_free_row(self->catalog_db, &row);
+
+        if (line_len < 0)
+            continue;
+        if ((size_t)line_len >= sizeof(report_line))
+            line_len = sizeof(report_line) - 1;
+
+        // double the buffer so a range of n books costs O(n) copying, not O(n^2)
+        if (lines_len + line_len + 1 > lines_cap)
+        {
+            size_t new_cap = lines_cap > 0 ? lines_cap * 2 : CATALOG_REPORT_LINE_LEN * 16;
+            while (lines_len + line_len + 1 > new_cap)
+                new_cap *= 2;
+
+            char *grown = realloc(report_lines, new_cap);
+
+            if (grown == NULL)
+                exit_error("Catalog report allocation failed\n");
+
+            report_lines = grown;
+            lines_cap = new_cap;
+        }
+
+        memcpy(report_lines + lines_len, report_line, line_len);
+        lines_len += line_len;
+        report_lines[lines_len] = 0;
     }
 
+    return report_lines;
+}
+
+////
+bool catalog_generate_report(catalog_t *self, const char *report_filename)
+{
+    if (self == NULL || report_filename == NULL)
+        return false;
+
+    FILE *fp = fopen(report_filename, "w");
+
+    if (fp == NULL)
+        return false;
+
+    char header[CATALOG_REPORT_LINE_LEN];
+    catalog_format_report_header(CATALOG_REPORT_INVENTORY, header, sizeof(header));
+    fputs(header, fp);
+
+    char *report_lines = catalog_get_report_lines(self, CATALOG_REPORT_INVENTORY, 0, INT_MAX);
+
+    if (report_lines != NULL)
+        fputs(report_lines, fp);
+
+    free(report_lines);
     fclose(fp);
 
     return true;
@@ -264,29 +494,19 @@ char *catalog_get_availability_report(catalog_t *self)
     if (self == NULL)
         return NULL;
 
-    int n = 2;
-    char *availability_report = malloc(sizeof(char)*CATALOG_AVAIL_LINE_LEN);
-    char report_line[CATALOG_AVAIL_LINE_LEN] = {0};
-    char **row;
+    char header[CATALOG_REPORT_LINE_LEN];
+    catalog_format_report_header(CATALOG_REPORT_AVAILABILITY, header, sizeof(header));
 
-    sprintf(availability_report, "%-20s%20s%20s\n", "BOOK NAME", "TOTAL ON HAND", "AVAILABLE");
+    char *report_lines = catalog_get_report_lines(self, CATALOG_REPORT_AVAILABILITY, 0, INT_MAX);
+    size_t lines_len = report_lines != NULL ? strlen(report_lines) : 0;
 
-    datafile_get_row_prepare(self->catalog_db);
+    char *availability_report = malloc(sizeof(char) * (strlen(header) + lines_len + 1));
+    strcpy(availability_report, header);
 
-    while ((row = datafile_get_row(self->catalog_db)) != NULL)
-    {
-        int total_on_hand = atoi(row[datafile_get_field_index(self->catalog_db, "qty_total")]);
-        int available = catalog_get_book_avail_qty(self, row[datafile_get_field_index(self->catalog_db, "book_name")]);
-
-        sprintf(report_line, "%-20s%20d%20d\n", 
-            row[datafile_get_field_index(self->catalog_db, "book_name")], total_on_hand, available);
-
-        datafile_free_row(self->catalog_db, &row);
+    if (report_lines != NULL)
+        strcat(availability_report, report_lines);
 
-        availability_report = (char *)realloc(availability_report, (sizeof(char) * CATALOG_AVAIL_LINE_LEN * n++));
-
-        strcat(availability_report, report_line);
-    }
+    free(report_lines);
 
     return availability_report;
-}
\ No newline at end of file
+}
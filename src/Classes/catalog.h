@@ -16,14 +16,19 @@
 #define CATALOG_H_INCLUDED
 
 #include <stdbool.h>
+#include <limits.h>
 
 #include "garbagecollector.h"
 #include "datafile.h"
+#include "bloomfilter.h"
 
 #define CATALOG_DB_FILENAME "data/catalog.db"
 #define CATALOG_REQUESTS_DB_FILENAME "data/catalog_requests.db"
 #define CATALOG_BOOK_NAME_LEN 13
-#define CATALOG_AVAIL_LINE_LEN 62
+#define CATALOG_REPORT_LINE_LEN 352     // room for a v2 book name plus the four numeric columns
+
+#define CATALOG_REPORT_INVENTORY 1
+#define CATALOG_REPORT_AVAILABILITY 2
 
 // CATALOG OBJECT
 typedef struct
@@ -43,6 +48,16 @@ void catalog_destroy(void *);
 
 // METHODS
 
+// catalog_new_book_filter()
+//   Returns a bloom filter of every book name in the catalog, NULL if there is no catalog
+//   Kept in global_bf and shared by every catalog so that unknown books are turned away without a scan
+bloomfilter_t *catalog_new_book_filter();
+
+// catalog_fill_book_filter()
+//   Adds every book name in the catalog to filter, for books that were put in catalog.db by hand
+//   Returns the number of books, -1 if there is no catalog
+int catalog_fill_book_filter(bloomfilter_t *filter);
+
 // catalog_add_book()
 //   Adds a book to the catalog with specified quantity
 //   If book already exists, adds quantity to total
@@ -62,6 +77,11 @@ bool catalog_request_book(catalog_t *self, const char *book_name, int user_id, i
 //   Returns qty books if specified book exists
 bool catalog_return_book(catalog_t *self, const char *book_name, int user_id, int qty_returning);
 
+// catalog_compact_requests()
+//   Folds the requests a user has for the same book into one row and drops the rows that request nothing
+//   Returns the number of rows dropped, -1 if the requests file could not be rewritten
+int catalog_compact_requests(catalog_t *self);
+
 // catalog_get_book_id()
 //   Returns the unique id of a specified book, 0 if not found
 int catalog_get_book_id(catalog_t *self, const char *book_name);
@@ -70,6 +90,19 @@ int catalog_get_book_id(catalog_t *self, const char *book_name);
 //   Returns true if a book exists
 bool catalog_book_exists(catalog_t *self, const char *book_name);
 
+// catalog_get_last_book_id()
+//   Returns the highest book id in the catalog, 0 if empty
+int catalog_get_last_book_id(catalog_t *self);
+
+// catalog_format_report_header()
+//   Writes the column header line of an inventory or availability report into buffer
+void catalog_format_report_header(int report_type, char *buffer, size_t len);
+
+// catalog_get_report_lines()
+//   Formats the report lines of all books with after_id < id <= last_id, NULL if there are none
+//   Used to split large reports into independent chunks
+char *catalog_get_report_lines(catalog_t *self, int report_type, int after_id, int last_id);
+
 // catalog_generate_report()
 //   Generates an inventory report and saves it to the reports/ subfolder
 //   Report format: BOOK NAME          TOTAL ON HAND            IN USE         AVAILABLE
@@ -0,0 +1,265 @@
+/*
+    CATALOG PROTOCOL IMPLEMENTATION
+    Author: Aaron Bishop
+    Date:   4/19/2020
+*/
+
+#include "catalog_protocol.h"
+
+// HELPERS
+
+// Description: cursor over a v2 payload
+typedef struct
+{
+    const char *payload;
+    uint32_t length;
+    uint32_t pos;
+    bool error;
+} _catalog_v2_reader_t;
+
+/////
+uint32_t _catalog_v2_read_u32(_catalog_v2_reader_t *reader)
+{
+    uint32_t value = 0;
+
+    if (reader->pos + sizeof(uint32_t) > reader->length)
+    {
+        reader->error = true;
+        return 0;
+    }
+
+    memcpy(&value, reader->payload + reader->pos, sizeof(uint32_t));
+    reader->pos += sizeof(uint32_t);
+
+    return ntohl(value);
+}
+
+/////
+uint16_t _catalog_v2_read_u16(_catalog_v2_reader_t *reader)
+{
+    uint16_t value = 0;
+
+    if (reader->pos + sizeof(uint16_t) > reader->length)
+    {
+        reader->error = true;
+        return 0;
+    }
+
+    memcpy(&value, reader->payload + reader->pos, sizeof(uint16_t));
+    reader->pos += sizeof(uint16_t);
+
+    return ntohs(value);
+}
+
+// Description: reads a length prefixed string, returns its length
+//              strings longer than CATALOG_V2_FIELD_MAXLEN are rejected rather than truncated
+size_t _catalog_v2_read_string(_catalog_v2_reader_t *reader, char *out)
+{
+    uint16_t len = _catalog_v2_read_u16(reader);
+
+    if (reader->error || len > CATALOG_V2_FIELD_MAXLEN || reader->pos + len > reader->length)
+    {
+        reader->error = true;
+        out[0] = 0;
+        return 0;
+    }
+
+    memcpy(out, reader->payload + reader->pos, len);
+    out[len] = 0;
+    reader->pos += len;
+
+    return len;
+}
+
+// Description: reads a fixed length field of raw bytes
+void _catalog_v2_read_bytes(_catalog_v2_reader_t *reader, uint8_t *out, uint32_t len)
+{
+    if (reader->pos + len > reader->length)
+    {
+        reader->error = true;
+        return;
+    }
+
+    memcpy(out, reader->payload + reader->pos, len);
+    reader->pos += len;
+}
+
+// Description: fields end up in tab separated datafiles, so control characters are refused
+bool _catalog_v2_valid_field(const char *field)
+{
+    for (; *field; field++)
+        if ((unsigned char)*field < 0x20)
+            return false;
+
+    return true;
+}
+
+// METHODS
+
+/////
+void catalog_v2_encode_header(char *buffer, uint8_t op_code, uint8_t status, uint32_t request_id, uint32_t length)
+{
+    catalog_v2_encode_header_flags(buffer, op_code, status, 0, request_id, length);
+}
+
+/////
+void catalog_v2_encode_header_flags(char *buffer, uint8_t op_code, uint8_t status, uint8_t flags, uint32_t request_id, uint32_t length)
+{
+    request_id = htonl(request_id);
+    length = htonl(length);
+
+    buffer[0] = (char)CATALOG_V2_MAGIC;
+    buffer[1] = (char)op_code;
+    buffer[2] = (char)status;
+    buffer[3] = (char)flags;
+    memcpy(buffer+4, &request_id, sizeof(uint32_t));
+    memcpy(buffer+8, &length, sizeof(uint32_t));
+}
+
+/////
+void catalog_v2_decode_header(const char *buffer, catalog_v2_header_t *header)
+{
+    header->magic = (uint8_t)buffer[0];
+    header->op_code = (uint8_t)buffer[1];
+    header->status = (uint8_t)buffer[2];
+    header->flags = (uint8_t)buffer[3];
+    memcpy(&(header->request_id), buffer+4, sizeof(uint32_t));
+    memcpy(&(header->length), buffer+8, sizeof(uint32_t));
+    header->request_id = ntohl(header->request_id);
+    header->length = ntohl(header->length);
+}
+
+/////
+bool catalog_v2_decode_command(const catalog_v2_header_t *header, const char *payload, catalog_command_t *cmd)
+{
+    _catalog_v2_reader_t reader = { payload, header->length, 0, false };
+    size_t password_len = 0;
+
+    memset(cmd, 0, sizeof(catalog_command_t));
+    cmd->op_code = header->op_code;
+    cmd->request_id = header->request_id;
+
+    switch (header->op_code)
+    {
+        case CATALOG_CMD_CONNECT:
+        case CATALOG_CMD_ADD_USER:
+            _catalog_v2_read_string(&reader, cmd->name);
+            password_len = _catalog_v2_read_string(&reader, cmd->password);
+            catalog_xor_crypt_len(cmd->password, password_len, AUTH_PASSWORD_XOR);
+            break;
+
+        case CATALOG_CMD_ADD_BOOK:
+        case CATALOG_CMD_REQUEST_BOOK:
+        case CATALOG_CMD_RETURN_BOOK:
+        {
+            // read unsigned, so a negative quantity arrives as a huge one and is turned away with it
+            uint32_t qty = _catalog_v2_read_u32(&reader);
+
+            if (qty == 0 || qty > CATALOG_QTY_MAX)
+                return false;
+
+            cmd->qty = (int)qty;
+            _catalog_v2_read_string(&reader, cmd->name);
+            break;
+        }
+
+        case CATALOG_CMD_REQUEST_REPORT:
+            cmd->port = _catalog_v2_read_u16(&reader);
+            break;
+
+        case CATALOG_CMD_RESUME:
+            _catalog_v2_read_bytes(&reader, cmd->token, CATALOG_SESSION_TOKEN_LEN);
+            break;
+
+        default:
+            break;
+    }
+
+    if (reader.error || !_catalog_v2_valid_field(cmd->name))
+        return false;
+
+    // the password was decrypted above, so a zero byte inside it shows up as a short string
+    if (strlen(cmd->password) != password_len)
+        return false;
+
+    return _catalog_v2_valid_field(cmd->password);
+}
+
+/////
+const char *catalog_v1_response(uint8_t op_code, int status)
+{
+    if (status == CATALOG_STATUS_THROTTLED)
+        return "throttled";
+
+    switch (op_code)
+    {
+        case CATALOG_CMD_CONNECT:
+            if (status == CATALOG_STATUS_OK)
+                return "login_success";
+            if (status == CATALOG_STATUS_INVALID_PASSWORD)
+                return "invalid_password";
+            return "invalid_user";
+
+        case CATALOG_CMD_ADD_USER:
+            return status == CATALOG_STATUS_OK ? "add_user_success" : "add_user_failed";
+
+        case CATALOG_CMD_ADD_BOOK:
+            return status == CATALOG_STATUS_OK ? "add_book_success" : "add_book_error";
+
+        case CATALOG_CMD_REQUEST_BOOK:
+            return status == CATALOG_STATUS_OK ? "req_book_success" : "req_book_error";
+
+        case CATALOG_CMD_RETURN_BOOK:
+            return status == CATALOG_STATUS_OK ? "ret_book_success" : "ret_book_error";
+
+        case CATALOG_CMD_REQUEST_REPORT:
+            if (status == CATALOG_STATUS_OK)
+                return "req_report_success";
+            if (status == CATALOG_STATUS_FILESIZE_ERROR)
+                return "req_filesize_error";
+            return "req_report_error";
+
+        case CATALOG_CMD_RESUME:
+            return status == CATALOG_STATUS_OK ? "resume_success" : "invalid_session";
+
+        default:
+            return NULL;
+    }
+}
+
+/////
+const char *catalog_op_name(uint8_t op_code)
+{
+    switch (op_code)
+    {
+        case CATALOG_CMD_CONNECT:
+            return "CONNECT";
+        case CATALOG_CMD_ADD_USER:
+            return "ADD_USER";
+        case CATALOG_CMD_REQUEST_BOOK:
+            return "REQUEST_BOOK";
+        case CATALOG_CMD_ADD_BOOK:
+            return "ADD_BOOK";
+        case CATALOG_CMD_REQUEST_REPORT:
+            return "REQUEST_REPORT";
+        case CATALOG_CMD_RETURN_BOOK:
+            return "RETURN_BOOK";
+        case CATALOG_CMD_GET_AVAILABILITY:
+            return "GET_AVAILABILITY";
+        case CATALOG_CMD_RESUME:
+            return "RESUME";
+        case CATALOG_CMD_STATS:
+            return "STATS";
+        default:
+            return NULL;
+    }
+}
+
+/////
+void catalog_xor_crypt_len(char *data, size_t len, const char *key)
+{
+    size_t key_len = strlen(key);
+
+    for (size_t i=0; i<len; i++)
+        data[i] = data[i] ^ key[i % key_len];
+}
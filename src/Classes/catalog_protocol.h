@@ -0,0 +1,140 @@
+/*
+    CATALOG PROTOCOL DEFINITIONS
+    Author:      Aaron Bishop
+    Date:        4/19/2020
+    Description: Opcodes, status codes and wire encoding for both versions of the CATALOG protocol
+
+    Version 1: fixed size commands of at most CATALOG_CMD_MAXLEN bytes, one command per packet
+                 <op_code:1><fixed width fields>
+               replies are bare strings such as "req_book_success", or "throttled" for a rate limited command
+               REQUEST_REPORT with listener port 0 streams the report on the session instead of
+               calling back, as <length:4><bytes:length> chunks ending with a zero length chunk followed
+               by the reply string, such as "req_report_success", or "throttled" with no chunks before it
+               with a listener port the session gets no reply unless the request fails or is throttled
+
+    Version 2: length prefixed frames, negotiated by sending a v2 CONNECT as the first command
+                 <magic:1><op_code:1><status:1><flags:1><request_id:4><length:4><payload:length>
+               all integers are network byte order, strings are <len:2><bytes:len>
+               replies echo the op_code and request_id and carry a numeric status
+               a THROTTLED reply carries <retry_after_ms:4>, the time until the request would be accepted
+
+               CONNECT           <username:str><password:str, xor'd>
+                                                     a successful reply carries <session_token:16>
+               RESUME            <session_token:16>  logs in as the session's user without a password
+               ADD_USER          <username:str><password:str, xor'd>
+               ADD_BOOK          <qty:4><book_name:str>
+               REQUEST_BOOK      <qty:4><book_name:str>
+               RETURN_BOOK       <qty:4><book_name:str>
+               GET_AVAILABILITY  (empty)             reply payload is the report text
+               REQUEST_REPORT    <listener_port:2>   port 0 streams the report on the session as
+                                                     CATALOG_V2_FLAG_MORE frames, ending with an
+                                                     empty frame without the flag
+               STATS             (empty)             reply payload is the statistics text
+
+    STATS is answered with the same text in version 1, like GET_AVAILABILITY
+*/
+
+#pragma once
+
+#ifndef CATALOG_PROTOCOL_H_INCLUDED
+#define CATALOG_PROTOCOL_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "auth.h"
+
+#define CATALOG_CMD_MAXLEN 20
+
+#define CATALOG_CMD_CONNECT 0x10
+#define CATALOG_CMD_ADD_USER 0x20
+#define CATALOG_CMD_REQUEST_BOOK 0x30
+#define CATALOG_CMD_ADD_BOOK 0x40
+#define CATALOG_CMD_REQUEST_REPORT 0x50
+#define CATALOG_CMD_RETURN_BOOK 0x60
+#define CATALOG_CMD_GET_AVAILABILITY 0x70
+#define CATALOG_CMD_RESUME 0x80
+#define CATALOG_CMD_STATS 0x90
+
+#define CATALOG_SESSION_TOKEN_LEN 16
+
+#define CATALOG_V2_MAGIC 0xC2
+#define CATALOG_V2_HEADER_LEN 12
+#define CATALOG_V2_PAYLOAD_MAXLEN 1024
+#define CATALOG_V2_FIELD_MAXLEN 255
+#define CATALOG_QTY_MAX 65535                // largest v1 quantity, v2 quantities outside 1..CATALOG_QTY_MAX are a bad request
+
+// v2 header flags
+#define CATALOG_V2_FLAG_MORE 0x01           // more frames follow for this request id
+
+// listener port asking for a report on the session connection
+#define CATALOG_REPORT_INBAND_PORT 0
+
+// v2 status codes
+#define CATALOG_STATUS_OK 0
+#define CATALOG_STATUS_ERROR 1
+#define CATALOG_STATUS_INVALID_USER 2
+#define CATALOG_STATUS_INVALID_PASSWORD 3
+#define CATALOG_STATUS_USERNAME_EXISTS 4
+#define CATALOG_STATUS_NOT_AUTHENTICATED 5
+#define CATALOG_STATUS_BAD_REQUEST 6
+#define CATALOG_STATUS_FILESIZE_ERROR 7
+#define CATALOG_STATUS_THROTTLED 8
+#define CATALOG_STATUS_INVALID_SESSION 9
+
+// V2 FRAME HEADER
+typedef struct
+{
+    uint8_t magic;
+    uint8_t op_code;
+    uint8_t status;
+    uint8_t flags;
+    uint32_t request_id;
+    uint32_t length;
+} catalog_v2_header_t;
+
+// CATALOG COMMAND
+//   a decoded command, independent of the protocol version it arrived in
+typedef struct
+{
+    uint8_t op_code;
+    uint32_t request_id;
+    char name[CATALOG_V2_FIELD_MAXLEN+1];       // username or book name
+    char password[CATALOG_V2_FIELD_MAXLEN+1];
+    int qty;
+    uint16_t port;
+    uint8_t token[CATALOG_SESSION_TOKEN_LEN];
+} catalog_command_t;
+
+// catalog_v2_encode_header()
+//   Writes a frame header into the first CATALOG_V2_HEADER_LEN bytes of buffer
+void catalog_v2_encode_header(char *buffer, uint8_t op_code, uint8_t status, uint32_t request_id, uint32_t length);
+
+// catalog_v2_encode_header_flags()
+//   As catalog_v2_encode_header(), with header flags
+void catalog_v2_encode_header_flags(char *buffer, uint8_t op_code, uint8_t status, uint8_t flags, uint32_t request_id, uint32_t length);
+
+// catalog_v2_decode_header()
+//   Reads a frame header from the first CATALOG_V2_HEADER_LEN bytes of buffer
+void catalog_v2_decode_header(const char *buffer, catalog_v2_header_t *header);
+
+// catalog_v2_decode_command()
+//   Parses the payload of a request frame, returns false if it is malformed
+bool catalog_v2_decode_command(const catalog_v2_header_t *header, const char *payload, catalog_command_t *cmd);
+
+// catalog_v1_response()
+//   Returns the v1 reply string for an op_code and status, NULL if v1 sends no reply
+const char *catalog_v1_response(uint8_t op_code, int status);
+
+// catalog_op_name()
+//   Returns the name of an op_code, such as "REQUEST_BOOK", or NULL if it is not a command
+const char *catalog_op_name(uint8_t op_code);
+
+// catalog_xor_crypt_len()
+//   xor cypher over an explicit length, repeating the key, so decoded bytes may contain zeros
+void catalog_xor_crypt_len(char *data, size_t len, const char *key);
+
+#endif
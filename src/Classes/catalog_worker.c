@@ -8,341 +8,1026 @@
 
 extern threadcontroller_t *global_tc;
 
+extern threadpool_t *global_tp;
+extern reportdelivery_t *global_rd;
+extern ratelimiter_t *global_rl;
+extern sessiontable_t *global_st;
+extern devlog_t *global_dl;
+extern trace_t *global_tr;
+extern metrics_t *global_mt;
+
+objectpool_t *_catalog_worker_session_pool = NULL;
+pthread_once_t _catalog_worker_session_once = PTHREAD_ONCE_INIT;
+atomic_uint _catalog_worker_report_seq;     // keeps the names of reports made in the same second apart
+
+_Static_assert(CATALOG_SESSION_TOKEN_LEN == SESSIONTABLE_TOKEN_LEN, "session tokens go on the wire as they are");
+
+// HELPERS
+int _catalog_worker_connect(tcpconnection_t *conn);
+int _catalog_worker_command(tcpconnection_t *conn);
+int _catalog_worker_command_v1(tcpconnection_t *conn, char *buffer, int bytes_received);
+int _catalog_worker_command_v2(tcpconnection_t *conn);
+int _catalog_worker_execute(tcpconnection_t *conn, catalog_command_t *cmd);
+int _catalog_worker_dispatch(tcpconnection_t *conn, catalog_command_t *cmd);
+void _catalog_worker_reply(tcpconnection_t *conn, uint8_t op_code, uint32_t request_id, int status);
+void _catalog_worker_reply_payload(tcpconnection_t *conn, uint8_t op_code, uint32_t request_id, int status, const void *payload, uint32_t len);
+void _catalog_worker_reply_text(tcpconnection_t *conn, uint8_t op_code, uint32_t request_id, const char *text, uint32_t len);
+bool _catalog_worker_end_v1_stream(tcpconnection_t *conn, int status);
+uint64_t _catalog_worker_now_ns();
+void _catalog_worker_append(char *text, size_t len, size_t *used, const char *format, ...);
+int _catalog_worker_cost(uint8_t op_code);
+void _catalog_worker_throttled(tcpconnection_t *conn, catalog_command_t *cmd, uint32_t retry_ms);
+void _catalog_worker_close(tcpconnection_t *conn);
+void _catalog_worker_new_session_pool();
+void _catalog_worker_init_session(void *s);
+void _catalog_worker_reset_session(void *s);
+void _catalog_worker_free_catalog(catalog_t *catalog);
+catalog_report_job_t *_catalog_worker_new_report_job(catalog_session_t *session, int report_type, FILE *out);
+void _catalog_worker_start_report_job(catalog_report_job_t *job);
+void _catalog_worker_spawn_report_chunk(catalog_report_job_t *job);
+void _catalog_worker_report_chunk(void *arg);
+bool _catalog_worker_write_chunks(catalog_report_job_t *job);
+int _catalog_worker_writable(tcpconnection_t *conn);
+void _catalog_worker_write_report(catalog_report_job_t *job, const char *text);
+void _catalog_worker_finish_report_job(catalog_report_job_t *job);
+void _catalog_worker_resume_session(catalog_report_job_t *job);
+void _catalog_worker_count(catalog_session_t *session, uint8_t op_code, uint64_t latency_ns);
+
 /////
-void *catalog_worker(void *args)
+int catalog_worker(tcpconnection_t *conn, int event)
 {
-    // thread argument input
-    threadarguments_t *thread_args = (threadarguments_t *)args;
-    int thread_id = *(int *)(thread_args->arg1);
-    int client_sock = *(int *)(thread_args->arg2);
-    struct sockaddr_in client_addr = *(struct sockaddr_in *)(thread_args->arg3);
+    if (event == TCPSERVER_EVENT_CONNECT)
+        return _catalog_worker_connect(conn);
 
-    int bytes_received = -1;
-    bool adding_user = 0;
-    char new_username[AUTH_USERNAME_LEN+1] = {0}; // need to store this out here since spec wants separate packets for username/password
+    if (event == TCPSERVER_EVENT_DATA)
+        return _catalog_worker_command(conn);
 
-    // catalog specific objects
-    auth_t *auth = new_auth();
-    catalog_t *catalog = new_catalog();
+    if (event == TCPSERVER_EVENT_WRITABLE)
+        return _catalog_worker_writable(conn);
+
+    _catalog_worker_close(conn);
+
+    return TCPSERVER_CLOSE;
+}
+
+/////
+objectpool_t *catalog_worker_sessions()
+{
+    pthread_once(&_catalog_worker_session_once, _catalog_worker_new_session_pool);
+
+    return _catalog_worker_session_pool;
+}
+
+/////
+int catalog_worker_stats(char *text, size_t len)
+{
+    metrics_snapshot_t snapshot;
+    size_t used = 0;
+
+    metrics_snapshot(global_mt, &snapshot);
+
+    _catalog_worker_append(text, len, &used, "%-16s %9s %9s %9s %9s %9s\n", "command", "count", "p50 us", "p99 us", "p999 us", "max us");
+
+    for (int op=0; op<METRICS_OPCODES; op++)
+    {
+        metrics_op_t *stats = &(snapshot.ops[op]);
+        const char *name = catalog_op_name((uint8_t)(op << 4));
+
+        if (stats->count == 0)
+            continue;
+
+        _catalog_worker_append(text, len, &used, "%-16s %9lu %9.1f %9.1f %9.1f %9.1f\n", name != NULL ? name : "unknown", stats->count,
+            stats->p50_ns / 1000.0, stats->p99_ns / 1000.0, stats->p999_ns / 1000.0, stats->max_ns / 1000.0);
+    }
+
+    _catalog_worker_append(text, len, &used, "datafiles: %ld reads, %ld writes, %ld bytes read, %ld bytes written\n",
+        snapshot.datafile_reads, snapshot.datafile_writes, snapshot.datafile_bytes_read, snapshot.datafile_bytes_written);
+    _catalog_worker_append(text, len, &used, "connections: %ld active\n", snapshot.active_connections);
+
+    return used < len ? (int)used : (int)len - 1;
+}
+
+// HELPERS
+
+// Description: hands a new connection a session from the pool
+int _catalog_worker_connect(tcpconnection_t *conn)
+{
+    conn->session = objectpool_take(catalog_worker_sessions());
+    metrics_connection_opened(global_mt);
+
+    devlog_write(global_dl, DEVLOG_DEBUG, "[CID: %u] Connection accepted from: %s", conn->conn_id, conn->peer);
+
+    return TCPSERVER_KEEP;
+}
+
+// Description: gives the session of a connection back to the pool
+void _catalog_worker_close(tcpconnection_t *conn)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+
+    devlog_write(global_dl, DEVLOG_DEBUG, "[CID: %u] Closing connection with client %s.", conn->conn_id, conn->peer);
+
+    if (session == NULL)
+        return;
+
+    metrics_connection_closed(global_mt);
+    objectpool_give(catalog_worker_sessions(), session);
+    conn->session = NULL;
+}
+
+/////
+void _catalog_worker_new_session_pool()
+{
+    _catalog_worker_session_pool = new_objectpool(sizeof(catalog_session_t), CATALOG_SESSION_PREFILL,
+        _catalog_worker_init_session, _catalog_worker_reset_session);
+}
 
-    // no operation in the protocol exceeds 20 bytes
+// Description: creates the catalog specific objects of a pooled session, they live as long as the pool
+void _catalog_worker_init_session(void *s)
+{
+    catalog_session_t *session = (catalog_session_t *)s;
+
+    session->auth = new_auth();
+    session->catalog = new_catalog();
+    session->arena = new_arena();
+}
+
+// Description: forgets everything a closed connection did, so nothing carries over to the next client
+void _catalog_worker_reset_session(void *s)
+{
+    catalog_session_t *session = (catalog_session_t *)s;
+
+    auth_logout(session->auth);
+    arena_reset(session->arena);
+
+    session->protocol = 0;
+    session->adding_user = false;
+    memset(session->new_username, 0, sizeof(session->new_username));
+    session->in_len = 0;
+    session->pending_op = 0;
+    session->pending_event = NULL;
+    session->report_job = NULL;
+
+    atomic_store(&(session->user_id), 0);
+    atomic_store(&(session->num_commands), 0);
+    atomic_store(&(session->busy_ns), 0);
+    atomic_store(&(session->last_op), 0);
+}
+
+// Description: destroys a catalog along with the datafiles it opened
+void _catalog_worker_free_catalog(catalog_t *catalog)
+{
+    datafile_destroy(catalog->catalog_db);
+    datafile_destroy(catalog->requests_db);
+    catalog_destroy(catalog);
+}
+
+// Description: receives from a readable connection and executes every complete command
+int _catalog_worker_command(tcpconnection_t *conn)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+
+    // v1 commands never exceed 20 bytes and are read one per packet, v2 frames are buffered
     char buffer[CATALOG_CMD_MAXLEN] = {0};
+    char *recv_buffer = buffer;
+    int recv_len = CATALOG_CMD_MAXLEN;
+
+    if (session->protocol == 2)
+    {
+        recv_buffer = session->in_buffer + session->in_len;
+        recv_len = CATALOG_V2_BUFFER_LEN - session->in_len;
+    }
+
+    // receive incoming command
+    int bytes_received = recv(conn->socket, recv_buffer, recv_len, 0);
+
+    if (bytes_received == 0)
+    {
+        devlog_write(global_dl, DEVLOG_DEBUG, "[CID: %u] Disconnect received from client: %s.", conn->conn_id, conn->peer);
+        return TCPSERVER_CLOSE;
+    }
+    else if (bytes_received < 0)
+    {
+        // spurious wakeup, wait for the next event
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return TCPSERVER_KEEP;
+
+        return TCPSERVER_CLOSE;
+    }
+
+    // the first command of a connection negotiates the protocol version
+    if (session->protocol == 0)
+    {
+        if ((uint8_t)buffer[0] == CATALOG_V2_MAGIC)
+        {
+            session->protocol = 2;
+            memcpy(session->in_buffer, buffer, bytes_received);
+        }
+        else
+        {
+            session->protocol = 1;
+        }
+    }
+
+    // rows read and written by the commands come from the session arena, emptied here rather than after
+    // the commands because a command that hands the session to a report job must not touch it again
+    arena_reset(session->arena);
+    arena_use(session->arena);
+
+    int status;
+
+    if (session->protocol == 1)
+    {
+        status = _catalog_worker_command_v1(conn, buffer, bytes_received);
+    }
+    else
+    {
+        session->in_len += bytes_received;
+        status = _catalog_worker_command_v2(conn);
+    }
+
+    arena_use(NULL);
+
+    return status;
+}
+
+// Description: decodes a fixed size v1 command
+int _catalog_worker_command_v1(tcpconnection_t *conn, char *buffer, int bytes_received)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+    catalog_command_t cmd = {0};
+    uint16_t u16 = 0;
+
+    // parse out op_code
+    cmd.op_code = (uint8_t)buffer[0];
+
+    // COMMAND: CONNECT
+    /////
+    if (cmd.op_code == CATALOG_CMD_CONNECT)
+    {
+        if (bytes_received != 20)
+            return TCPSERVER_KEEP;
+
+        memcpy(cmd.name, buffer+sizeof(char), sizeof(char)*AUTH_USERNAME_LEN);
+        memcpy(cmd.password, buffer+sizeof(char)+sizeof(char)*AUTH_USERNAME_LEN, sizeof(char)*AUTH_PASSWORD_LEN);
+
+        xor_crypt(cmd.password, AUTH_PASSWORD_XOR);
+    }
+    // COMMAND ADD USER
+    //   spec wants separate packets for username and password, the first one is answered here
+    /////
+    else if (cmd.op_code == CATALOG_CMD_ADD_USER)
+    {
+        if (bytes_received > 12 || !session->auth->authenticated)
+            return TCPSERVER_KEEP;
+
+        if (!session->adding_user)
+        {
+            const char *response = "username_exists";
+
+            memcpy(&session->new_username, buffer+sizeof(char), sizeof(char)*AUTH_USERNAME_LEN);
+
+            if (!auth_user_exists(session->auth, session->new_username))
+            {
+                response = "username_available";
+                session->adding_user = 1;
+            }
+
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Add user attempt from %s, username: %s, %s", 
+                conn->conn_id, conn->peer, session->new_username, response);
+
+            tcpserver_send(conn, response, strlen(response));
+            return TCPSERVER_KEEP;
+        }
+
+        // read second packet to get password
+        strcpy(cmd.name, session->new_username);
+        memcpy(cmd.password, buffer+sizeof(char), sizeof(char)*AUTH_PASSWORD_LEN);
+
+        xor_crypt(cmd.password, AUTH_PASSWORD_XOR);
+
+        session->adding_user = 0;
+        memset(session->new_username, 0, sizeof(session->new_username));
+    }
+    // COMMAND ADD/REQUEST/RETURN BOOK
+    /////
+    else if (cmd.op_code == CATALOG_CMD_ADD_BOOK || cmd.op_code == CATALOG_CMD_REQUEST_BOOK || cmd.op_code == CATALOG_CMD_RETURN_BOOK)
+    {
+        memcpy(&u16, buffer+sizeof(char), sizeof(uint16_t));
+        memcpy(cmd.name, buffer+sizeof(char)+sizeof(uint16_t), sizeof(char)*CATALOG_BOOK_NAME_LEN);
+
+        cmd.qty = (int)ntohs(u16);
+    }
+    // COMMAND REQUEST REPORT
+    /////
+    else if (cmd.op_code == CATALOG_CMD_REQUEST_REPORT)
+    {
+        memcpy(&u16, buffer+sizeof(char), sizeof(uint16_t));
+
+        cmd.port = ntohs(u16);
+    }
+
+    memset(buffer, 0, CATALOG_CMD_MAXLEN);
+
+    return _catalog_worker_execute(conn, &cmd);
+}
+
+// Description: decodes and executes every complete v2 frame in the session buffer
+int _catalog_worker_command_v2(tcpconnection_t *conn)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+    int status = TCPSERVER_KEEP;
+
+    while (session->in_len >= CATALOG_V2_HEADER_LEN)
+    {
+        catalog_v2_header_t header;
+        catalog_command_t cmd;
+
+        catalog_v2_decode_header(session->in_buffer, &header);
+
+        // a bad header means we have lost the framing, nothing after it can be trusted
+        if (header.magic != CATALOG_V2_MAGIC || header.length > CATALOG_V2_PAYLOAD_MAXLEN)
+        {
+            devlog_write(global_dl, DEVLOG_WARN, "[CID: %u] Invalid v2 frame from %s", conn->conn_id, conn->peer);
+            return TCPSERVER_CLOSE;
+        }
+
+        int frame_len = CATALOG_V2_HEADER_LEN + (int)header.length;
+
+        // wait for the rest of the frame
+        if (session->in_len < frame_len)
+            break;
+
+        bool valid = catalog_v2_decode_command(&header, session->in_buffer + CATALOG_V2_HEADER_LEN, &cmd);
+
+        // consume the frame before executing it, a pending command may finish and resume on another thread
+        session->in_len -= frame_len;
+        memmove(session->in_buffer, session->in_buffer + frame_len, session->in_len);
+
+        if (!valid)
+        {
+            _catalog_worker_reply(conn, header.op_code, header.request_id, CATALOG_STATUS_BAD_REQUEST);
+            continue;
+        }
+
+        status = _catalog_worker_execute(conn, &cmd);
+
+        // the connection now belongs to a running report, which picks up the rest of the buffer when it finishes
+        if (status != TCPSERVER_KEEP)
+            break;
+    }
+
+    return status;
+}
+
+// Description: sends the reply to a command in the session's protocol
+//              v1 replies are bare strings, and some v1 outcomes have no reply at all
+void _catalog_worker_reply(tcpconnection_t *conn, uint8_t op_code, uint32_t request_id, int status)
+{
+    _catalog_worker_reply_payload(conn, op_code, request_id, status, NULL, 0);
+}
+
+// Description: as _catalog_worker_reply(), v2 replies also carry payload, which v1 has no room for
+void _catalog_worker_reply_payload(tcpconnection_t *conn, uint8_t op_code, uint32_t request_id, int status, const void *payload, uint32_t len)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+
+    if (session->protocol == 2)
+    {
+        char reply[CATALOG_V2_HEADER_LEN + CATALOG_SESSION_TOKEN_LEN];
+
+        // replies with a payload are all small, header and payload go out in one send
+        if (len > sizeof(reply) - CATALOG_V2_HEADER_LEN)
+            len = 0;
+
+        catalog_v2_encode_header(reply, op_code, (uint8_t)status, request_id, len);
+        if (len > 0)
+            memcpy(reply + CATALOG_V2_HEADER_LEN, payload, len);
+        tcpserver_send(conn, reply, CATALOG_V2_HEADER_LEN + len);
+        return;
+    }
+
+    const char *response = catalog_v1_response(op_code, status);
+
+    if (response != NULL)
+        tcpserver_send(conn, response, strlen(response));
+}
+
+// Description: answers a command with text, in v1 the text is the whole reply
+void _catalog_worker_reply_text(tcpconnection_t *conn, uint8_t op_code, uint32_t request_id, const char *text, uint32_t len)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+
+    tcpserver_cork(conn, true);
+
+    if (session->protocol == 2)
+    {
+        char header[CATALOG_V2_HEADER_LEN];
+        catalog_v2_encode_header(header, op_code, CATALOG_STATUS_OK, request_id, len);
+        tcpserver_send(conn, header, CATALOG_V2_HEADER_LEN);
+    }
+
+    tcpserver_send(conn, text, len);
+    tcpserver_cork(conn, false);
+}
+
+// Description: ends a v1 in-band report stream with an empty chunk, followed by the command's reply
+// Notes:       a report that was turned down is just the end of the stream, so the client finds out why from the reply
+bool _catalog_worker_end_v1_stream(tcpconnection_t *conn, int status)
+{
+    const char *response = catalog_v1_response(CATALOG_CMD_REQUEST_REPORT, status);
+
+    tcpserver_cork(conn, true);
+
+    bool sent = tcpserver_send(conn, "\0\0\0\0", sizeof(uint32_t)) && tcpserver_send(conn, response, strlen(response));
+
+    tcpserver_cork(conn, false);
+
+    return sent;
+}
+
+// Description: returns CLOCK_MONOTONIC in ns
+uint64_t _catalog_worker_now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Description: snprintf() onto the end of text, used stops at len once it is full
+void _catalog_worker_append(char *text, size_t len, size_t *used, const char *format, ...)
+{
+    if (*used >= len)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(text + *used, len - *used, format, args);
+    va_end(args);
+
+    if (written > 0)
+        *used += (size_t)written;
+}
+
+// Description: returns the rate limiter tokens a command takes
+int _catalog_worker_cost(uint8_t op_code)
+{
+    switch (op_code)
+    {
+        case CATALOG_CMD_CONNECT:
+        case CATALOG_CMD_ADD_USER:
+            return CATALOG_COST_LOGIN;
+        case CATALOG_CMD_GET_AVAILABILITY:
+        case CATALOG_CMD_STATS:
+            return CATALOG_COST_AVAILABILITY;
+        case CATALOG_CMD_REQUEST_REPORT:
+            return CATALOG_COST_REPORT;
+        default:
+            return CATALOG_COST_COMMAND;
+    }
+}
+
+// Description: answers a command the rate limiter turned down
+void _catalog_worker_throttled(tcpconnection_t *conn, catalog_command_t *cmd, uint32_t retry_ms)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+
+    if (session->protocol == 2)
+    {
+        uint32_t retry = htonl(retry_ms);
+        _catalog_worker_reply_payload(conn, cmd->op_code, cmd->request_id, CATALOG_STATUS_THROTTLED, &retry, sizeof(uint32_t));
+    }
+    else if (cmd->op_code == CATALOG_CMD_REQUEST_REPORT && cmd->port == CATALOG_REPORT_INBAND_PORT)
+        _catalog_worker_end_v1_stream(conn, CATALOG_STATUS_THROTTLED);
+    else
+        _catalog_worker_reply(conn, cmd->op_code, cmd->request_id, CATALOG_STATUS_THROTTLED);
+}
+
+// Description: executes a decoded command, recording it in the trace and the metrics
+int _catalog_worker_execute(tcpconnection_t *conn, catalog_command_t *cmd)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+    trace_event_t *event = trace_begin(global_tr, conn->conn_id, cmd->op_code);
+    uint64_t start_ns = _catalog_worker_now_ns();
+
+    // a command that goes pending is recorded by its report job once answered, which may be before
+    // dispatch returns here, so the job is told when it started up front
+    session->pending_op = cmd->op_code;
+    session->pending_start_ns = start_ns;
+    session->pending_event = event;
+    session->pending_event_start_ns = event != NULL ? atomic_load(&(event->start_ns)) : 0;
+
+    int status = _catalog_worker_dispatch(conn, cmd);
+
+    // the job ends a pending command's event, this thread only keeps the I/O it did dispatching it
+    if (status == TCPSERVER_PENDING)
+    {
+        trace_detach(event);
+        return status;
+    }
+
+    trace_end(event);
+    _catalog_worker_count(session, cmd->op_code, _catalog_worker_now_ns() - start_ns);
+
+    return status;
+}
 
-    printf("[TID: %u] Connection accepted from: %s:%d\n", thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+// Description: runs a decoded command
+int _catalog_worker_dispatch(tcpconnection_t *conn, catalog_command_t *cmd)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+    struct sockaddr_in client_addr = conn->addr;
+    int status = CATALOG_STATUS_ERROR;
+
+    // throttled commands are answered straight away, before they cost any datafile I/O
+    int user_id = session->auth->authenticated ? session->auth->user_id : -1;
+    uint32_t retry_ms = ratelimiter_take(global_rl, user_id, client_addr.sin_addr.s_addr, _catalog_worker_cost(cmd->op_code));
 
-    if(fcntl(client_sock, F_SETFL, fcntl(client_sock, F_GETFL) | O_NONBLOCK) < 0)
-        exit_error("Could not put socket into non-blocking mode.");
+    if (retry_ms > 0)
+    {
+        _catalog_worker_throttled(conn, cmd, retry_ms);
+        return TCPSERVER_KEEP;
+    }
 
-    // receive data from client, but cancel on kill lock
-    //   instead of using a blocking recv call, we'll use a while loop with a kill_lock
-    //   to enable graceful shutdown
-    while (pthread_mutex_trylock(&(global_tc->kill_lock)) != 0) // change to check for kill lock
+    // COMMAND: CONNECT
+    /////
+    if (cmd->op_code == CATALOG_CMD_CONNECT)
+    {
+        if (!auth_user_exists(session->auth, cmd->name))
+            status = CATALOG_STATUS_INVALID_USER;
+        else if (!auth_login(session->auth, cmd->name, cmd->password))
+            status = CATALOG_STATUS_INVALID_PASSWORD;
+        else
+            status = CATALOG_STATUS_OK;
+
+        devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Login attempt from %s, username: %s, %s", 
+            conn->conn_id, conn->peer, cmd->name, catalog_v1_response(cmd->op_code, status));
+
+        // v2 clients get a session token, so their next connection can RESUME instead
+        uint8_t token[CATALOG_SESSION_TOKEN_LEN];
+
+        if (status == CATALOG_STATUS_OK && session->protocol == 2 && sessiontable_issue(global_st, session->auth->user_id, token))
+            _catalog_worker_reply_payload(conn, cmd->op_code, cmd->request_id, status, token, CATALOG_SESSION_TOKEN_LEN);
+        else
+            _catalog_worker_reply(conn, cmd->op_code, cmd->request_id, status);
+
+        return TCPSERVER_KEEP;
+    }
+
+    // COMMAND: RESUME
+    //   a single probe of the session table instead of two scans of users.db
+    /////
+    if (cmd->op_code == CATALOG_CMD_RESUME)
     {
-        // receive incoming command
-        bytes_received = recv(client_sock, buffer, CATALOG_CMD_MAXLEN, 0);
+        int user_id = sessiontable_resume(global_st, cmd->token);
 
-        if (bytes_received == 0)
+        if (user_id >= 0)
         {
-            printf("[TID: %u] Disconnect received from client: %s:%d.\n", 
-                thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-            close(client_sock);
-            return NULL;
+            auth_resume(session->auth, user_id);
+            status = CATALOG_STATUS_OK;
         }
-        else if (bytes_received > 0)
+        else
+            status = CATALOG_STATUS_INVALID_SESSION;
+
+        devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Session resume from %s, user_id: %d, %s",
+            conn->conn_id, conn->peer, user_id, catalog_v1_response(cmd->op_code, status));
+
+        _catalog_worker_reply(conn, cmd->op_code, cmd->request_id, status);
+        return TCPSERVER_KEEP;
+    }
+
+    // Note: All remaining commands require user to be logged in
+    if (!session->auth->authenticated)
+    {
+        if (session->protocol == 2)
+            _catalog_worker_reply(conn, cmd->op_code, cmd->request_id, CATALOG_STATUS_NOT_AUTHENTICATED);
+        return TCPSERVER_KEEP;
+    }
+
+    switch (cmd->op_code)
+    {
+        // COMMAND ADD USER
+        /////
+        case CATALOG_CMD_ADD_USER:
+            if (auth_user_exists(session->auth, cmd->name))
+                status = CATALOG_STATUS_USERNAME_EXISTS;
+            else if (auth_new_user(session->auth, cmd->name, cmd->password))
+                status = CATALOG_STATUS_OK;
+
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Add user attempt from %s, username: %s, %s", 
+                conn->conn_id, conn->peer, cmd->name, catalog_v1_response(cmd->op_code, status));
+            break;
+
+        // COMMAND ADD BOOK
+        /////
+        case CATALOG_CMD_ADD_BOOK:
+            if (catalog_add_book(session->catalog, cmd->name, cmd->qty))
+                status = CATALOG_STATUS_OK;
+
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Add book attempt from %s, book_name: %s, qty: %d, %s", 
+                conn->conn_id, conn->peer, cmd->name, cmd->qty, catalog_v1_response(cmd->op_code, status));
+            break;
+
+        // COMMAND REQUEST BOOK
+        /////
+        case CATALOG_CMD_REQUEST_BOOK:
+            if (catalog_request_book(session->catalog, cmd->name, session->auth->user_id, cmd->qty))
+                status = CATALOG_STATUS_OK;
+
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Request book attempt from %s, book_name: %s, qty: %d, %s", 
+                conn->conn_id, conn->peer, cmd->name, cmd->qty, catalog_v1_response(cmd->op_code, status));
+            break;
+
+        // COMMAND RETURN BOOK
+        /////
+        case CATALOG_CMD_RETURN_BOOK:
+            if (catalog_return_book(session->catalog, cmd->name, session->auth->user_id, cmd->qty))
+                status = CATALOG_STATUS_OK;
+
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Return book attempt from %s, book_name: %s, qty: %d, %s", 
+                conn->conn_id, conn->peer, cmd->name, cmd->qty, catalog_v1_response(cmd->op_code, status));
+            break;
+
+        // COMMAND GET AVAILABILITY
+        /////
+        case CATALOG_CMD_GET_AVAILABILITY:
         {
-            int response_code = 0;
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Get availability request from %s", conn->conn_id, conn->peer);
+
+            FILE *out = tmpfile();
+
+            if (out == NULL)
+                break;
 
-            // parse out op_code
-            uint32_t op_code = 0;
-            memcpy(&op_code, buffer, sizeof(char));
+            // the report is built in chunks on the threadpool and answered when the last one lands
+            catalog_report_job_t *job = _catalog_worker_new_report_job(session, CATALOG_REPORT_AVAILABILITY, out);
+            job->conn = conn;
+            job->request_id = cmd->request_id;
+            _catalog_worker_start_report_job(job);
+
+            return TCPSERVER_PENDING;
+        }
+
+        // COMMAND REQUEST REPORT
+        /////
+        case CATALOG_CMD_REQUEST_REPORT:
+        {
+            devlog_write(global_dl, DEVLOG_INFO, "[CID: %u] Request report from %s, listener port %d", 
+                    conn->conn_id, conn->peer, cmd->port);
 
-            // COMMAND: CONNECT - complete
-            /////
-            if (op_code == CATALOG_CMD_CONNECT)
+            // generate report
+            // format current time
+            char date[30];
+            char report_filename[256] = {0};
+            time_t now = time(NULL);
+            struct tm t;
+
+            localtime_r(&now, &t);
+            strftime(date, sizeof(date)-1, "%Y%m%d_%H%M%S", &t);
+            snprintf(report_filename, sizeof(report_filename), "reports/inventory_report_%d_%s_%u.txt",
+                session->auth->user_id, date, atomic_fetch_add(&_catalog_worker_report_seq, 1));
+
+            FILE *out = fopen(report_filename, "w+");
+
+            if (out == NULL && session->protocol == 1 && cmd->port == CATALOG_REPORT_INBAND_PORT)
             {
-                char response[3][CATALOG_CMD_MAXLEN] = 
-                {
-                    "invalid_user", 
-                    "invalid_password", 
-                    "login_success"
-                };
-
-                if (bytes_received == 20)
-                {
-                    char username[AUTH_USERNAME_LEN+1] = {0};
-                    char password[AUTH_PASSWORD_LEN+1] = {0};
-
-                    memcpy(&username, buffer+sizeof(char), sizeof(char)*AUTH_USERNAME_LEN);
-                    memcpy(&password, buffer+sizeof(char)+sizeof(char)*AUTH_USERNAME_LEN, sizeof(char)*AUTH_PASSWORD_LEN);
-                    memset(buffer, 0, sizeof(buffer));
-
-                    xor_crypt(password, AUTH_PASSWORD_XOR);
-
-                    if (!auth_user_exists(auth, username))
-                        response_code = 0;
-                    else if (!auth_login(auth, username, password))
-                        response_code = 1;
-                    else
-                        response_code = 2;
-                    
-                    printf("[TID: %u] Login attempt from %s:%d, username: %s, %s\n", 
-                        thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), username, response[response_code]);
-                    
-                    send(client_sock, response[response_code], strlen(response[response_code]), 0);
-                }
+                _catalog_worker_end_v1_stream(conn, CATALOG_STATUS_ERROR);
+                return TCPSERVER_KEEP;
             }
 
-            // Note: All remaining commands require user to be logged in
-            if (auth->authenticated)
+            if (out == NULL)
+                break;
+
+            catalog_report_job_t *job = _catalog_worker_new_report_job(session, CATALOG_REPORT_INVENTORY, out);
+            job->conn_id = conn->conn_id;
+
+            // in-band reports are streamed on the session as chunks are generated, and answer it when done
+            if (cmd->port == CATALOG_REPORT_INBAND_PORT)
             {
-                // COMMAND ADD USER - complete
-                /////
-                if (op_code == CATALOG_CMD_ADD_USER)
-                {
-                    response_code = 0;
-                    char response[4][CATALOG_CMD_MAXLEN] = 
-                    {
-                        "username_exists",
-                        "username_available",
-                        "add_user_failed",
-                        "add_user_success"
-                    };
-
-                    if (bytes_received <= 12)
-                    {
-                        char password[AUTH_PASSWORD_LEN+1] = {0};
-                        
-                        if (!adding_user)
-                        {
-                            memcpy(&new_username, buffer+sizeof(char), sizeof(char)*AUTH_USERNAME_LEN);
-                            memset(buffer, 0, sizeof(buffer));
-
-                            if (auth_user_exists(auth, new_username))
-                            {
-                                response_code = 0;
-                            }
-                            else
-                            {
-                                response_code = 1;
-                                adding_user = 1;
-                            }
-                        }
-                        else if (adding_user)
-                        {
-                            // read second packet to get password
-                            char new_password[AUTH_PASSWORD_LEN+1] = {0};
-                            memcpy(&new_password, buffer+sizeof(char), sizeof(char)*8);
-
-                            xor_crypt(new_password, AUTH_PASSWORD_XOR);
-
-                            if (auth_new_user(auth, new_username, new_password))
-                                response_code = 3;
-                            else
-                                response_code = 2;
-                            
-                            adding_user = 0;
-                            memset(new_username, 0, sizeof(new_username));
-
-                        }
-                        send(client_sock, response[response_code], strlen(response[response_code]), 0);
-
-                        printf("[TID: %u] Add user attempt from %s:%d, username: %s, %s\n", 
-                            thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), new_username, response[response_code]);
-                    }
-                }
-                // COMMAND ADD BOOK - complete
-                /////
-                if (op_code == CATALOG_CMD_ADD_BOOK)
-                {
-                    //printf("Add Book Command\n");
-
-                    response_code = 0;
-                    
-                    char response[2][CATALOG_CMD_MAXLEN] = 
-                    {
-                        "add_book_error", 
-                        "add_book_success", 
-                    };
-
-                    uint16_t num_books = 0;
-                    char book_name[CATALOG_BOOK_NAME_LEN+1] = {0};
-
-                    memcpy(&num_books, buffer+sizeof(char), sizeof(uint16_t));
-                    memcpy(&book_name, buffer+sizeof(char)+sizeof(uint16_t), sizeof(char)*CATALOG_BOOK_NAME_LEN);
-                    memset(buffer, 0, sizeof(buffer));
-
-                    num_books = ntohs(num_books);
-
-                    response_code = catalog_add_book(catalog, book_name, (int)num_books);
-
-                    printf("[TID: %u] Add book attempt from %s:%d, book_name: %s, qty: %d, %s\n", 
-                        thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), book_name, num_books, response[response_code]);
-                    send(client_sock, response[response_code], strlen(response[response_code]), 0);
-                }
-                // COMMAND REQUEST BOOK - complete
-                /////
-                if (op_code == CATALOG_CMD_REQUEST_BOOK)
-                {
-                    char response[2][CATALOG_CMD_MAXLEN] = 
-                    {
-                        "req_book_error",
-                        "req_book_success"
-                    };
-
-                    uint16_t num_books = 0;
-                    char book_name[CATALOG_BOOK_NAME_LEN+1] = {0};
-
-                    memcpy(&num_books, buffer+sizeof(char), sizeof(uint16_t));
-                    memcpy(&book_name, buffer+sizeof(char)+sizeof(uint16_t), sizeof(char)*CATALOG_BOOK_NAME_LEN);
-                    memset(buffer, 0, sizeof(buffer));
-
-                    num_books = ntohs(num_books);
-
-                    response_code = catalog_request_book(catalog, book_name, auth->user_id, (int)num_books);
-
-                    printf("[TID: %u] Request book attempt from %s:%d, book_name: %s, qty: %d, %s\n", 
-                        thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), book_name, num_books, response[response_code]);
-                    send(client_sock, response[response_code], strlen(response[response_code]), 0);
-                }
-                // COMMAND RETURN BOOK - complete
-                /////
-                if (op_code == CATALOG_CMD_RETURN_BOOK)
-                {
-                    char response[2][CATALOG_CMD_MAXLEN] = 
-                    {
-                        "ret_book_error",
-                        "ret_book_success"
-                    };
-
-                    uint16_t num_books = 0;
-                    char book_name[CATALOG_BOOK_NAME_LEN+1] = {0};
-
-                    memcpy(&num_books, buffer+sizeof(char), sizeof(uint16_t));
-                    memcpy(&book_name, buffer+sizeof(char)+sizeof(uint16_t), sizeof(char)*CATALOG_BOOK_NAME_LEN);
-                    memset(buffer, 0, sizeof(buffer));
-
-                    num_books = ntohs(num_books);
-
-                    response_code = catalog_return_book(catalog, book_name, auth->user_id, (int)num_books);
-
-                    printf("[TID: %u] Return book attempt from %s:%d, book_name: %s, qty: %d, %s\n", 
-                        thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), book_name, num_books, response[response_code]);
-                    send(client_sock, response[response_code], strlen(response[response_code]), 0);
-                }
-                // COMMAND REQUEST REPORT
-                /////
-                if (op_code == CATALOG_CMD_GET_AVAILABILITY)
-                {
-                    char *availability_report = catalog_get_availability_report(catalog);
-
-                    printf("[TID: %u] Get availability request from %s:%d\n", 
-                        thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-                    send(client_sock, availability_report, strlen(availability_report), 0);
-
-                    free(availability_report);
-                }
-                // COMMAND REQUEST REPORT
-                /////
-                if (op_code == CATALOG_CMD_REQUEST_REPORT)
-                {
-                    char response[3][CATALOG_CMD_MAXLEN] = 
-                    {
-                        "req_report_error",
-                        "req_filesize_error",
-                        "req_report_success"
-                    };
-
-                    uint16_t listener_port = 0;
-                    memcpy(&listener_port, buffer+sizeof(char), sizeof(uint16_t));
-                    memset(buffer, 0, sizeof(buffer));
-
-                    listener_port = ntohs(listener_port);
-
-                    printf("[TID: %u] Request report from %s:%d, listener port %d\n", 
-                            thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), listener_port);
-
-                    // generate report
-                    // format current time
-                    char date[30];
-                    char report_filename[256] = {0};
-                    time_t now = time(NULL);
-                    struct tm *t = localtime(&now);
-
-                    strftime(date, sizeof(date)-1, "%Y%m%d_%H%M%S", t);
-                    sprintf(report_filename, "reports/inventory_report_%d_%s.txt", auth->user_id, date);
-
-                    bool report_complete = catalog_generate_report(catalog, report_filename);
-
-                    // send report to listener on client
-                    if (report_complete)
-                    {
-                        printf("[TID: %u]   Report generated, sending to listener...\n", thread_id);
-
-                        // connect to client listener
-                        struct sockaddr_in client_listener = client_addr;
-                        client_listener.sin_port = htons(listener_port);
-
-                        int client_listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-
-                        if (client_listen_sock == -1)
-                            continue;
-
-                        if (connect(client_listen_sock, (struct sockaddr *)&client_listener, sizeof(struct sockaddr_in)) < 0)
-                            continue;
-
-                        // load the completed report into memory
-                        FILE *fp = fopen(report_filename, "rb");
-                        fseek(fp, 0, SEEK_END);
-                        long file_size = ftell(fp);
-                        fseek(fp, 0, SEEK_SET);
-
-                        char *file_buffer = malloc(file_size);
-                        fread(file_buffer, 1, file_size, fp);
-                        fclose(fp);
-
-                        // send the completed report
-                        send(client_listen_sock, file_buffer, file_size, 0);
-
-                        free(file_buffer);
-
-                        // get ack from listener
-                        bytes_received = recv(client_listen_sock, buffer, CATALOG_CMD_MAXLEN, 0);
-
-                        if (bytes_received > 0)
-                        {
-                            uint32_t received_file_size = 0;
-                            memcpy(&received_file_size, buffer, sizeof(uint32_t));
-                            received_file_size = ntohl(received_file_size);
+                job->conn = conn;
+                job->inband = true;
+                job->request_id = cmd->request_id;
+                _catalog_worker_start_report_job(job);
+
+                return TCPSERVER_PENDING;
+            }
+
+            // otherwise the report is delivered to the client listener, so the session can carry on meanwhile
+            job->listener = client_addr;
+            job->listener.sin_port = htons(cmd->port);
+            _catalog_worker_start_report_job(job);
+
+            // v1 has no reply on the session for this command
+            if (session->protocol == 1)
+                return TCPSERVER_KEEP;
+
+            status = CATALOG_STATUS_OK;
+            break;
+        }
+
+        // COMMAND STATS
+        /////
+        case CATALOG_CMD_STATS:
+        {
+            char text[CATALOG_STATS_TEXT_LEN];
+            int len = catalog_worker_stats(text, sizeof(text));
+
+            devlog_write(global_dl, DEVLOG_DEBUG, "[CID: %u] Stats request from %s", conn->conn_id, conn->peer);
+
+            _catalog_worker_reply_text(conn, cmd->op_code, cmd->request_id, text, (uint32_t)len);
+            return TCPSERVER_KEEP;
+        }
+
+        default:
+            status = CATALOG_STATUS_BAD_REQUEST;
+            break;
+    }
+    // END COMMANDS
+
+    _catalog_worker_reply(conn, cmd->op_code, cmd->request_id, status);
+
+    return TCPSERVER_KEEP;
+}
+
+// REPORT JOBS
+//   Reports are split into chunks of CATALOG_REPORT_CHUNK_BOOKS books, which are spawned onto the
+//   threadpool deques so idle workers can steal them.  At most CATALOG_REPORT_WINDOW chunks are in
+//   flight, and finished chunks are written out in order as soon as they are next in line.  An in-band
+//   report that gets ahead of its client stops writing and spawning chunks until the client catches up.
+
+// Description: creates a report job writing to out
+catalog_report_job_t *_catalog_worker_new_report_job(catalog_session_t *session, int report_type, FILE *out)
+{
+    catalog_report_job_t *job = calloc(1, sizeof(catalog_report_job_t));
+
+    if (job == NULL)
+        exit_error("Report job memory allocation failed");
+
+    job->report_type = report_type;
+    job->protocol = session->protocol;
+    job->out = out;
+    job->last_book_id = catalog_get_last_book_id(session->catalog);
+    job->num_chunks = (job->last_book_id + CATALOG_REPORT_CHUNK_BOOKS - 1) / CATALOG_REPORT_CHUNK_BOOKS;
+    pthread_mutex_init(&(job->job_lock), NULL);
+
+    return job;
+}
+
+// Description: writes the report header, then spawns the first window of chunks
+void _catalog_worker_start_report_job(catalog_report_job_t *job)
+{
+    char header[CATALOG_REPORT_LINE_LEN];
+    catalog_format_report_header(job->report_type, header, sizeof(header));
+
+    // streamed chunks are corked so the report goes out in full size segments
+    if (job->inband)
+        tcpserver_cork(job->conn, true);
+
+    _catalog_worker_write_report(job, header);
+
+    if (job->num_chunks == 0)
+    {
+        _catalog_worker_finish_report_job(job);
+        return;
+    }
+
+    pthread_mutex_lock(&(job->job_lock));
+    while (job->next_spawn < job->num_chunks && job->next_spawn < CATALOG_REPORT_WINDOW)
+        _catalog_worker_spawn_report_chunk(job);
+    pthread_mutex_unlock(&(job->job_lock));
+}
+
+// Description: spawns the next chunk of a job
+// Notes:       job_lock must be held
+void _catalog_worker_spawn_report_chunk(catalog_report_job_t *job)
+{
+    catalog_report_chunk_t *chunk = malloc(sizeof(catalog_report_chunk_t));
+
+    if (chunk == NULL)
+        exit_error("Report chunk memory allocation failed");
+
+    chunk->job = job;
+    chunk->chunk = job->next_spawn++;
+
+    threadpool_spawn(global_tp, _catalog_worker_report_chunk, chunk);
+}
+
+// Description: formats one chunk of a report, then writes out every chunk that is now in order
+// Notes:       this is a threadpool task
+void _catalog_worker_report_chunk(void *arg)
+{
+    catalog_report_chunk_t *chunk = (catalog_report_chunk_t *)arg;
+    catalog_report_job_t *job = chunk->job;
+    int after_id = chunk->chunk * CATALOG_REPORT_CHUNK_BOOKS;
+
+    // chunks run concurrently, so each one needs its own datafile cursors
+    catalog_t *catalog = new_catalog();
+    char *lines = catalog_get_report_lines(catalog, job->report_type, after_id, after_id + CATALOG_REPORT_CHUNK_BOOKS);
+    _catalog_worker_free_catalog(catalog);
+
+    pthread_mutex_lock(&(job->job_lock));
+
+    int slot = chunk->chunk % CATALOG_REPORT_WINDOW;
+    job->chunk_lines[slot] = lines;
+    job->chunk_ready[slot] = true;
+
+    bool complete = _catalog_worker_write_chunks(job);
+
+    pthread_mutex_unlock(&(job->job_lock));
+
+    free(chunk);
+
+    // chunks run on whichever worker is free, their datafile reads are counted now rather than with
+    // that worker's next command
+    metrics_record_io(global_mt);
+
+    if (complete)
+        _catalog_worker_finish_report_job(job);
+}
+
+// Description: writes out every chunk that is now in order, spawning the next chunk into each window slot freed
+// Notes:       job_lock must be held
+//              an in-band report stops once the client falls behind, and carries on from _catalog_worker_writable()
+//              returns true once every chunk has been written
+bool _catalog_worker_write_chunks(catalog_report_job_t *job)
+{
+    while (!job->backed_up && job->next_write < job->num_chunks && job->chunk_ready[job->next_write % CATALOG_REPORT_WINDOW])
+    {
+        int slot = job->next_write % CATALOG_REPORT_WINDOW;
+
+        if (job->chunk_lines[slot] != NULL)
+            _catalog_worker_write_report(job, job->chunk_lines[slot]);
+
+        free(job->chunk_lines[slot]);
+        job->chunk_lines[slot] = NULL;
+        job->chunk_ready[slot] = false;
+        job->next_write++;
+
+        // a window slot freed up
+        if (job->next_spawn < job->num_chunks)
+            _catalog_worker_spawn_report_chunk(job);
+
+        // don't let generation outrun a slow client, the report would pile up in its output buffer
+        //   the last chunk is let through, the end of the stream goes out with the session's usual replies
+        if (job->inband && !job->send_failed && job->next_write < job->num_chunks &&
+            tcpserver_pending_output(job->conn) > CATALOG_OUTPUT_HIGH_WATER)
+        {
+            catalog_session_t *session = (catalog_session_t *)job->conn->session;
+
+            job->backed_up = true;
+            session->report_job = job;
+            tcpserver_wait_writable(job->conn);
+        }
+    }
+
+    return job->next_write == job->num_chunks;
+}
+
+// Description: carries on with an in-band report once the client has taken the output it was behind on
+int _catalog_worker_writable(tcpconnection_t *conn)
+{
+    catalog_session_t *session = (catalog_session_t *)conn->session;
+    catalog_report_job_t *job = session->report_job;
 
-                            printf("[TID: %u]   Sent %ld bytes, client acked with %u\n", thread_id, file_size, received_file_size); 
+    session->report_job = NULL;
 
-                            // compare acknowledgement to file size
-                            if (received_file_size == file_size)
-                                response_code = 2;
-                            else
-                                response_code = 1;
-                        }
-                        else
-                        {
-                            response_code = 0;
-                        }
-
-                        send(client_listen_sock, response[response_code], strlen(response[response_code]), 0);
-                        close(client_listen_sock);
-
-                    }
-                }
-                // END COMMANDS
+    pthread_mutex_lock(&(job->job_lock));
 
-            } // end authenticated options
-        } // endif bytes_received
-    } // end while
+    job->backed_up = false;
+    bool complete = _catalog_worker_write_chunks(job);
 
-    pthread_mutex_unlock(&(global_tc->kill_lock));
+    pthread_mutex_unlock(&(job->job_lock));
+
+    if (complete)
+        _catalog_worker_finish_report_job(job);
+
+    return TCPSERVER_PENDING;
+}
+
+// Description: appends text to the report, streaming it to the session for in-band reports
+// Notes:       job_lock must be held once chunks are running, so chunks go out in order
+void _catalog_worker_write_report(catalog_report_job_t *job, const char *text)
+{
+    size_t len = strlen(text);
 
-    printf("[TID: %u] Closing connection with client %s:%d.\n", thread_id, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+    fputs(text, job->out);
+
+    if (!job->inband || job->send_failed || len == 0)
+        return;
+
+    char prefix[CATALOG_V2_HEADER_LEN];
+    size_t prefix_len = sizeof(uint32_t);
+
+    if (job->protocol == 2)
+    {
+        prefix_len = CATALOG_V2_HEADER_LEN;
+        catalog_v2_encode_header_flags(prefix, CATALOG_CMD_REQUEST_REPORT, CATALOG_STATUS_OK, CATALOG_V2_FLAG_MORE, job->request_id, (uint32_t)len);
+    }
+    else
+    {
+        uint32_t chunk_len = htonl((uint32_t)len);
+        memcpy(prefix, &chunk_len, sizeof(uint32_t));
+    }
+
+    if (!tcpserver_send(job->conn, prefix, prefix_len) || !tcpserver_send(job->conn, text, len))
+        job->send_failed = true;
+}
+
+// Description: hands a completed report to the client
+void _catalog_worker_finish_report_job(catalog_report_job_t *job)
+{
+    if (job->report_type == CATALOG_REPORT_AVAILABILITY)
+    {
+        long report_len = ftell(job->out);
+
+        // v2 carries the report as the payload of a single reply frame
+        //   header and report are corked together so they go out in full size segments
+        tcpserver_cork(job->conn, true);
+
+        if (job->protocol == 2)
+        {
+            char header[CATALOG_V2_HEADER_LEN];
+            catalog_v2_encode_header(header, CATALOG_CMD_GET_AVAILABILITY, CATALOG_STATUS_OK, job->request_id, (uint32_t)report_len);
+
+            if (!tcpserver_send(job->conn, header, CATALOG_V2_HEADER_LEN))
+                job->send_failed = true;
+        }
+
+        // the report is sent with sendfile, the connection closes it once it has gone out
+        if (!tcpserver_send_file(job->conn, job->out, 0, (size_t)report_len))
+            job->send_failed = true;
+
+        tcpserver_cork(job->conn, false);
+        _catalog_worker_resume_session(job);
+    }
+    else if (job->inband)
+    {
+        devlog_write(global_dl, DEVLOG_INFO, "[CID: %u]   Report generated and streamed, %ld bytes", job->conn_id, ftell(job->out));
+
+        fclose(job->out);
+
+        // the stream ends with an empty chunk, which v1 follows with the command's reply
+        if (job->protocol == 2)
+        {
+            char end[CATALOG_V2_HEADER_LEN];
+            catalog_v2_encode_header(end, CATALOG_CMD_REQUEST_REPORT, CATALOG_STATUS_OK, job->request_id, 0);
+
+            if (!job->send_failed && !tcpserver_send(job->conn, end, CATALOG_V2_HEADER_LEN))
+                job->send_failed = true;
+        }
+        else if (!job->send_failed && !_catalog_worker_end_v1_stream(job->conn, CATALOG_STATUS_OK))
+            job->send_failed = true;
+
+        tcpserver_cork(job->conn, false);
+        _catalog_worker_resume_session(job);
+    }
+    else
+    {
+        // the delivery threads own the report from here, this worker never waits on the listener
+        reportdelivery_submit(global_rd, job->out, job->listener, job->conn_id);
+    }
+
+    pthread_mutex_destroy(&(job->job_lock));
+    free(job);
+}
+
+// Description: hands the session connection back to the tcpserver once a report has been answered on it
+void _catalog_worker_resume_session(catalog_report_job_t *job)
+{
+    catalog_session_t *session = (catalog_session_t *)job->conn->session;
+
+    trace_end_detached(session->pending_event, session->pending_event_start_ns);
+    session->pending_event = NULL;
+    _catalog_worker_count(session, session->pending_op, _catalog_worker_now_ns() - session->pending_start_ns);
+
+    if (job->send_failed)
+    {
+        tcpserver_resume(job->conn, TCPSERVER_CLOSE);
+        return;
+    }
+
+    // pick up any frames that arrived behind the report request
+    int status = TCPSERVER_KEEP;
+    if (job->protocol == 2)
+        status = _catalog_worker_command_v2(job->conn);
+
+    if (status != TCPSERVER_PENDING)
+        tcpserver_resume(job->conn, status);
+}
+
+// Description: records a command that has been answered, in the server's metrics and the session's own counts
+// Notes:       only the task handling the connection writes the session, so its counts need no read-modify-write
+void _catalog_worker_count(catalog_session_t *session, uint8_t op_code, uint64_t latency_ns)
+{
+    metrics_record(global_mt, op_code, latency_ns);
 
-    close(client_sock);
+    long num_commands = atomic_load_explicit(&(session->num_commands), memory_order_relaxed);
+    unsigned long busy_ns = atomic_load_explicit(&(session->busy_ns), memory_order_relaxed);
 
-    return NULL;
-}
\ No newline at end of file
+    atomic_store_explicit(&(session->user_id), session->auth->authenticated ? session->auth->user_id : 0, memory_order_relaxed);
+    atomic_store_explicit(&(session->num_commands), num_commands + 1, memory_order_relaxed);
+    atomic_store_explicit(&(session->busy_ns), busy_ns + latency_ns, memory_order_relaxed);
+    atomic_store_explicit(&(session->last_op), op_code, memory_order_relaxed);
+}
@@ -3,11 +3,15 @@
     Author:      Aaron Bishop
     Date:        4/19/2020
     Description: Imperitive style function to encapsualte all client specific objects within a common scope
-                   Worker implements the CATALOG protocol 
-    Usage:       Pass this function to the tcpserver object and it will be run for each accepted connection
+                   Worker implements the CATALOG protocol, v1 and v2 (see catalog_protocol.h)
+    Usage:       Pass this function to the tcpserver object and it will be run on the threadpool for each
+                   connection event (connect, readable, close)
 
-    Note: Capstone specification requires minimum of 10 workers.  This implementation support N workers up to the
-          total limit of threads as defined in threadcontroller.h.
+    Sessions are pooled, a closed connection's session is reset and handed to the next one along with
+    its datafile headers and arena, so connecting costs no allocations once the pool is warm.
+
+    Note: Capstone specification requires minimum of 10 workers.  Workers are the fixed threads of the global
+          threadpool (see threadpool.h), any number of connections are multiplexed onto them.
 
 */
 
@@ -20,6 +24,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -27,21 +32,106 @@
 
 #include "common.h"
 #include "threadcontroller.h"
+#include "threadpool.h"
+#include "tcpserver.h"
 #include "auth.h"
 #include "catalog.h"
+#include "catalog_protocol.h"
+#include "trace.h"
+#include "metrics.h"
+
+#define CATALOG_SESSION_PREFILL 64          // sessions made with the first connection, more are made as needed
+
+// reports are generated in chunks of this many books, with at most CATALOG_REPORT_WINDOW chunks in flight
+#define CATALOG_REPORT_CHUNK_BOOKS 32
+#define CATALOG_REPORT_WINDOW 16
+
+#define CATALOG_V2_BUFFER_LEN (CATALOG_V2_HEADER_LEN + CATALOG_V2_PAYLOAD_MAXLEN)
+
+// a streamed report stops writing chunks once this much is queued, until the client has taken it
+#define CATALOG_OUTPUT_HIGH_WATER 65536
+
+// rate limiter tokens taken by each command, reports read the whole catalog so they cost the most
+//   stats merge the histograms of every thread and cost as much as availability
+#define CATALOG_COST_COMMAND 1
+#define CATALOG_COST_LOGIN 5                // password checks, also slows down password guessing
+#define CATALOG_COST_AVAILABILITY 20
+#define CATALOG_COST_REPORT 50
+
+#define CATALOG_STATS_TEXT_LEN CATALOG_V2_PAYLOAD_MAXLEN
+
+// CATALOG SESSION
+//   per-connection state, stored in tcpconnection_t->session and taken from catalog_worker_sessions()
+typedef struct
+{
+    auth_t *auth;
+    catalog_t *catalog;
+    arena_t *arena;                         // command scoped allocations, see _catalog_worker_command()
 
-#define CATALOG_CMD_MAXLEN 20
+    int protocol;                           // 0 until the first command picks v1 or v2
 
-#define CATALOG_CMD_CONNECT 0x10
-#define CATALOG_CMD_ADD_USER 0x20
-#define CATALOG_CMD_REQUEST_BOOK 0x30
-#define CATALOG_CMD_ADD_BOOK 0x40
-#define CATALOG_CMD_REQUEST_REPORT 0x50
-#define CATALOG_CMD_RETURN_BOOK 0x60
-#define CATALOG_CMD_GET_AVAILABILITY 0x70
+    bool adding_user;
+    char new_username[AUTH_USERNAME_LEN+1]; // need to store this out here since spec wants separate packets for username/password
+
+    // v2 frames may arrive split across reads
+    char in_buffer[CATALOG_V2_BUFFER_LEN];
+    int in_len;
+
+    // a command answered by a report job, its latency and trace event are recorded once the job has answered it
+    uint8_t pending_op;
+    uint64_t pending_start_ns;
+    trace_event_t *pending_event;           // in the ring of the thread that dispatched it
+    uint64_t pending_event_start_ns;
+    struct catalog_report_job *report_job;  // an in-band report waiting for the client to catch up
+
+    // what the connection has done, for the admin console to read while the connection is in use
+    atomic_int user_id;                     // 0 until logged in
+    atomic_long num_commands;
+    atomic_ulong busy_ns;                   // time spent running its commands
+    _Atomic uint8_t last_op;
+} catalog_session_t;
+
+// CATALOG REPORT JOB
+//   a report being generated in stealable chunks on the threadpool
+typedef struct catalog_report_job
+{
+    int report_type;
+    int last_book_id;
+    int num_chunks;
+    int next_spawn;                             // next chunk to queue
+    int next_write;                             // next chunk to append to out
+    char *chunk_lines[CATALOG_REPORT_WINDOW];   // finished chunks waiting for their turn
+    bool chunk_ready[CATALOG_REPORT_WINDOW];
+    pthread_mutex_t job_lock;
+    FILE *out;
+
+    tcpconnection_t *conn;                      // availability and in-band reports answer on the session
+    bool inband;                                // stream chunks to conn as they are written
+    bool send_failed;
+    bool backed_up;                             // waiting for the client, no chunks are written or spawned
+    unsigned int conn_id;
+    int protocol;
+    uint32_t request_id;
+    struct sockaddr_in listener;                // callback reports are sent to the client listener
+} catalog_report_job_t;
+
+typedef struct
+{
+    catalog_report_job_t *job;
+    int chunk;
+} catalog_report_chunk_t;
 
 // catalog_worker()
-// Threaded worker function which handles all commands from a connected client
-void *catalog_worker(void *args);
+// Worker function which handles all events and commands from a connected client
+int catalog_worker(tcpconnection_t *conn, int event);
+
+// catalog_worker_sessions()
+// Returns the pool of catalog sessions, made with the first connection
+objectpool_t *catalog_worker_sessions();
+
+// catalog_worker_stats()
+// Writes the command counts and latencies, datafile I/O and active connections to text as a table
+// Returns the length of the text, which is cut short to fit len
+int catalog_worker_stats(char *text, size_t len);
 
 #endif
\ No newline at end of file
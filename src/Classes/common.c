@@ -8,11 +8,23 @@
 #include <string.h>
 
 #include "common.h"
+#include "auth.h"
+#include "catalog.h"
+#include "trace.h"
+#include "metrics.h"
 
 // create globally accessible objects
 garbagecollector_t *global_gc = NULL;
 threadcontroller_t *global_tc = NULL;
-devlog_t *global_dl;
+threadpool_t *global_tp = NULL;
+reportdelivery_t *global_rd = NULL;
+ratelimiter_t *global_rl = NULL;
+sessiontable_t *global_st = NULL;
+usertable_t *global_ut = NULL;
+bloomfilter_t *global_bf = NULL;
+devlog_t *global_dl = NULL;
+trace_t *global_tr = NULL;
+metrics_t *global_mt = NULL;
 
 // called by atexit()
 void _cleanup() {
@@ -29,7 +41,20 @@ void init()
     // create global objects
     global_gc = new_garbagecollector();
     global_tc = new_threadcontroller();
-    global_dl = new_devlog("test.txt");
+    global_tr = new_trace();
+
+    // kill -USR1 takes a look at the most recent commands without stopping the server, it has to be
+    // set up before any other thread starts
+    trace_dump_on_signal(global_tr, SIGUSR1, TRACE_DUMP_FILENAME);
+
+    global_mt = new_metrics();
+    global_dl = new_devlog(NULL);
+    global_tp = new_threadpool(0);
+    global_rd = new_reportdelivery(0);
+    global_rl = new_ratelimiter();
+    global_st = new_sessiontable(0);
+    global_ut = new_usertable(AUTH_USER_DB_FILENAME);
+    global_bf = catalog_new_book_filter();
     
     // handle various types of signals so we can collect garbage gracefully
     struct sigaction sa; 
@@ -62,27 +87,34 @@ char **record2array(char *record_str, int *num_fields)
     else
         *num_fields = 0;
 
-    char *record_tok = calloc(strlen(record_str)+1, sizeof(char));
-    strcpy(record_tok, record_str);
+    size_t record_len = strlen(record_str);
+    char *record_tok = arena_malloc(record_len + 1);
+    memcpy(record_tok, record_str, record_len + 1);
+
+    // size the array once, there can't be more fields than tabs plus one
+    int max_fields = 1;
+    for (size_t i=0; i<record_len; i++)
+        if (record_str[i] == '\t')
+            max_fields++;
 
     // build array from fields
     record_tok[strcspn(record_tok, "\n")] = 0; // strip newline
-    char *field = strtok(record_tok, "\t");
-    char **ret_array = NULL;
+    char *save_ptr = NULL;  // strtok_r, records are split on many threads at once
+    char *field = strtok_r(record_tok, "\t", &save_ptr);
+    char **ret_array = field != NULL ? arena_malloc(sizeof(char *) * max_fields) : NULL;
 
     while (field)
     {
-        ret_array = realloc(ret_array, sizeof(char *) * ((*num_fields)+1));
-
-        ret_array[*num_fields] = calloc((strlen(field)+1), sizeof(char));
+        size_t field_len = strlen(field);
 
-        strcpy(ret_array[*num_fields], field);
+        ret_array[*num_fields] = arena_malloc(field_len + 1);
+        memcpy(ret_array[*num_fields], field, field_len + 1);
 
-        field = strtok(NULL, "\t");
+        field = strtok_r(NULL, "\t", &save_ptr);
         (*num_fields)++;
     }
 
-    free(record_tok);
+    arena_free(record_tok);
 
     return ret_array;
 }
@@ -94,7 +126,7 @@ char **new_string_array(int num_strings)
         return NULL;
 
     // initialize array of strings to array of null pointers
-    char **ret_array = calloc(num_strings, sizeof(char *));
+    char **ret_array = arena_calloc(num_strings, sizeof(char *));
 
     return ret_array;
 }
@@ -102,24 +134,31 @@ char **new_string_array(int num_strings)
 /////
 char *array2record(char **arr, int num_fields)
 {
-    char *ret_str = calloc(1, sizeof(char));
-    int len = 0;
+    size_t len = 0;
 
+    // measure first so the record is allocated once
     for (int i=0; i<num_fields; i++)
     {
         if (arr[i] != NULL)
         {
             strip_tabs(&arr[i]);
-            len = len + strlen(arr[i]) + 2;
-            ret_str = realloc(ret_str, len);
-            if (i==0)
-                strcpy(ret_str, arr[i]);
-            else
-                strcat(ret_str, arr[i]);
-            if (i+1 < num_fields)
-                strcat(ret_str, "\t");
-            else
-                strcat(ret_str, "\n");
+            len = len + strlen(arr[i]) + 1;
+        }
+    }
+
+    char *ret_str = arena_malloc(len + 1);
+    char *pos = ret_str;
+    *pos = 0;
+
+    for (int i=0; i<num_fields; i++)
+    {
+        if (arr[i] != NULL)
+        {
+            size_t field_len = strlen(arr[i]);
+            memcpy(pos, arr[i], field_len);
+            pos += field_len;
+            *pos++ = i+1 < num_fields ? '\t' : '\n';
+            *pos = 0;
         }
     }
 
@@ -148,12 +187,12 @@ void free_string_array(char ***arr, int n)
         if ((*arr)[i] != NULL)
         {
             //printf("freeing i...\n");
-            free((*arr)[i]);
+            arena_free((*arr)[i]);
         }
     }
 
     //printf("freeing arr...\n");
-    free(*arr);
+    arena_free(*arr);
 }
 
 /////
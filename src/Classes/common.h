@@ -22,7 +22,12 @@
 #include <errno.h>
 
 #include "garbagecollector.h"
+#include "arena.h"
 #include "threadcontroller.h"
+#include "threadpool.h"
+#include "reportdelivery.h"
+#include "ratelimiter.h"
+#include "sessiontable.h"
 #include "devlog.h"
 
 /// COMMON FUNCTIONS 
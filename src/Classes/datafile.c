@@ -10,6 +10,17 @@
 
 extern garbagecollector_t *global_gc;
 
+atomic_long _datafile_temp_counter = 0;
+
+_Thread_local datafile_io_t datafile_thread_io = {0};
+
+// HELPERS
+FILE *_datafile_open(const char *filename, const char *mode);
+char *_datafile_gets(char *buffer, int len, FILE *fp);
+int _datafile_puts(const char *str, FILE *fp);
+size_t _datafile_read(void *buffer, size_t size, size_t count, FILE *fp);
+size_t _datafile_write(const void *buffer, size_t size, size_t count, FILE *fp);
+
 // CONSTRUCTOR
 datafile_t *new_datafile(const char *filename)
 {
@@ -25,21 +36,26 @@ datafile_t *new_datafile(const char *filename)
     if (self == NULL)
         exit_error("Datafile memory allocation failed\n");
 
-    garbagecollector_register(global_gc, (void *)self, datafile_destroy);
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, datafile_destroy);
 
     strcpy(self->filename, filename);
 
     // get the header data
     char header[1024];
-    FILE *fp = fopen(filename, "r");
-    fgets(header, 1024, fp);
+    FILE *fp = _datafile_open(filename, "r");
+    flock(fileno(fp), LOCK_SH);
+    _datafile_gets(header, 1024, fp);
+    flock(fileno(fp), LOCK_UN);
     fclose(fp);
 
     // read in field names from header
     self->header_len = strlen(header);
     if (self->header_len < 1)
         exit_error("invalid database file");
+    // the field names outlast any command that opens the datafile
+    arena_t *arena = arena_use(NULL);
     self->field_names = record2array(header, &(self->num_fields));
+    arena_use(arena);
     self->num_data_fields = self->num_fields - 3;
 
     self->last_row_id = 0;
@@ -61,6 +77,59 @@ void datafile_destroy(void *s)
 
 // HELPERS
 
+// Description: fopen() that counts the calling thread's datafile I/O
+FILE *_datafile_open(const char *filename, const char *mode)
+{
+    if (mode[0] == 'r')
+        datafile_thread_io.reads++;
+    if (mode[0] != 'r' || mode[1] == '+')
+        datafile_thread_io.writes++;
+
+    return fopen(filename, mode);
+}
+
+// Description: fgets() that counts the bytes read
+char *_datafile_gets(char *buffer, int len, FILE *fp)
+{
+    char *line = fgets(buffer, len, fp);
+
+    if (line != NULL)
+        datafile_thread_io.bytes_read += strlen(line);
+
+    return line;
+}
+
+// Description: fputs() that counts the bytes written
+int _datafile_puts(const char *str, FILE *fp)
+{
+    int result = fputs(str, fp);
+
+    if (result >= 0)
+        datafile_thread_io.bytes_written += strlen(str);
+
+    return result;
+}
+
+// Description: fread() that counts the bytes read
+size_t _datafile_read(void *buffer, size_t size, size_t count, FILE *fp)
+{
+    size_t num_read = fread(buffer, size, count, fp);
+
+    datafile_thread_io.bytes_read += num_read * size;
+
+    return num_read;
+}
+
+// Description: fwrite() that counts the bytes written
+size_t _datafile_write(const void *buffer, size_t size, size_t count, FILE *fp)
+{
+    size_t num_written = fwrite(buffer, size, count, fp);
+
+    datafile_thread_io.bytes_written += num_written * size;
+
+    return num_written;
+}
+
 /////
 bool _datafile_row_exists(datafile_t *self, int id)
 {
@@ -70,10 +139,11 @@ bool _datafile_row_exists(datafile_t *self, int id)
     bool row_exists = false;
     char buffer[DATAFILE_ROW_MAXLEN];
 
-    FILE *fp = fopen(self->filename, "r");
+    FILE *fp = _datafile_open(self->filename, "r");
+    flock(fileno(fp), LOCK_SH);
     fseek(fp, self->header_len, SEEK_SET);
 
-    while (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
     {
         char **row = record2array(buffer, NULL);
         int current_id = atoi(row[0]);
@@ -85,6 +155,7 @@ bool _datafile_row_exists(datafile_t *self, int id)
         }
     }
 
+    flock(fileno(fp), LOCK_UN);
     fclose(fp);
 
     return row_exists;
@@ -97,8 +168,8 @@ bool _datafile_copy_file_data(const char *source, const char *dest, unsigned lon
     if (source == NULL || dest == NULL)
         return false;
 
-    FILE *source_fp = fopen(source, "r");
-    FILE *dest_fp = fopen(dest, "w");
+    FILE *source_fp = _datafile_open(source, "r");
+    FILE *dest_fp = _datafile_open(dest, "w");
     flock(fileno(dest_fp), LOCK_EX);
 
     char buffer[CHUNK_SIZE];
@@ -126,15 +197,16 @@ bool _datafile_copy_file_data(const char *source, const char *dest, unsigned lon
     if (bytes_to_copy < chunk_to_read)
         chunk_to_read = bytes_to_copy;
 
-    while ((bytes_read = fread(buffer, 1, chunk_to_read, source_fp)) != 0 && bytes_to_copy > 0)
+    while ((bytes_read = _datafile_read(buffer, 1, chunk_to_read, source_fp)) != 0 && bytes_to_copy > 0)
     {
-        if(fwrite(buffer, 1, bytes_read, dest_fp) != bytes_read)
+        if(_datafile_write(buffer, 1, bytes_read, dest_fp) != bytes_read)
             return false;
 
         bytes_to_copy -= bytes_read;
     }
 
     fclose(source_fp);
+    fflush(dest_fp);
     flock(fileno(dest_fp), LOCK_UN);
     fclose(dest_fp);
     return true;
@@ -158,13 +230,13 @@ bool datafile_add_row(datafile_t *self, char ***row_data)
     struct tm *t = localtime(&now);
     strftime(date_added, sizeof(date_added)-1, "%Y-%m-%d %H:%M:%S", t);
 
-    FILE *fp = fopen(self->filename, "r+");
+    FILE *fp = _datafile_open(self->filename, "r+");
     flock(fileno(fp), LOCK_EX);
     fseek(fp, self->header_len, SEEK_SET);
 
     // get last id
     fseek(fp, self->header_len, SEEK_SET);
-    while (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
     {
         char **row = record2array(buffer, NULL);
         last_id = atoi(row[0]);
@@ -181,15 +253,55 @@ bool datafile_add_row(datafile_t *self, char ***row_data)
 
     char *new_row = array2record(*row_data, self->num_fields);
 
-    fputs(new_row, fp);
+    // the row has to reach the file before the lock goes, or fclose() writes it over whoever locks next
+    _datafile_puts(new_row, fp);
+    fflush(fp);
     flock(fileno(fp), LOCK_UN);
     fclose(fp);
     
-    free(new_row);
+    arena_free(new_row);
 
     return false;
 }
 
+////
+bool datafile_append_row(datafile_t *self, int id, char ***row_data)
+{
+    if (self == NULL)
+        return false;
+
+    char date_added[100];
+    char new_id[255];
+
+    time_t now = time(NULL);
+    struct tm *t = localtime(&now);
+    strftime(date_added, sizeof(date_added)-1, "%Y-%m-%d %H:%M:%S", t);
+    sprintf(new_id, "%d", id);
+
+    datafile_set_col(self, row_data, "id", new_id);
+    datafile_set_col(self, row_data, "date_created", date_added);
+    datafile_set_col(self, row_data, "date_updated", date_added);
+
+    char *new_row = array2record(*row_data, self->num_fields);
+
+    FILE *fp = _datafile_open(self->filename, "a");
+
+    if (fp == NULL)
+    {
+        arena_free(new_row);
+        return false;
+    }
+
+    flock(fileno(fp), LOCK_EX);
+    bool written = _datafile_puts(new_row, fp) >= 0 && fflush(fp) == 0;
+    flock(fileno(fp), LOCK_UN);
+    fclose(fp);
+
+    arena_free(new_row);
+
+    return written;
+}
+
 ////
 bool datafile_update_row(datafile_t *self, int id, char ***row_data)
 {
@@ -199,20 +311,21 @@ bool datafile_update_row(datafile_t *self, int id, char ***row_data)
         return false;
 
     char buffer[DATAFILE_ROW_MAXLEN];
-    char temp_file_name[50] = {0};
-    time_t t;
-    srand((unsigned) time(&t));
+    char temp_file_name[64] = {0};
 
-    sprintf(temp_file_name, "/tmp/datafile_temp%d%d%d%d", rand()%99, rand()%99, rand()%99, rand()%99);
+    // updates run concurrently, so every rewrite needs its own temp file
+    sprintf(temp_file_name, "/tmp/datafile_temp%d_%ld", (int)getpid(), atomic_fetch_add(&_datafile_temp_counter, 1));
 
-    FILE *fp = fopen(self->filename, "r");
-    FILE *fp_temp = fopen(temp_file_name, "w");
+    // hold the datafile exclusively for the whole rewrite so readers never see it half copied
+    FILE *fp = _datafile_open(self->filename, "r+");
+    flock(fileno(fp), LOCK_EX);
+    FILE *fp_temp = _datafile_open(temp_file_name, "w+");
 
     // write header first
-    fgets(buffer, DATAFILE_ROW_MAXLEN, fp);
-    fputs(buffer,fp_temp);
+    _datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp);
+    _datafile_puts(buffer,fp_temp);
 
-    while (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
     {
         int n;
         char **update_row = record2array(buffer, &n);
@@ -222,7 +335,7 @@ bool datafile_update_row(datafile_t *self, int id, char ***row_data)
         if (current_id != id)
         {
             // write the existing row to temp file
-            fputs(buffer,fp_temp);
+            _datafile_puts(buffer,fp_temp);
         }
         // if this is the row to update...
         else if (row_data != NULL) // implicitly delete the row if row_data not provided.
@@ -248,17 +361,27 @@ bool datafile_update_row(datafile_t *self, int id, char ***row_data)
             }
 
             char *updated_row_str = array2record(update_row, self->num_fields);
-            fputs(updated_row_str, fp_temp);
-            free(updated_row_str);
+            _datafile_puts(updated_row_str, fp_temp);
+            arena_free(updated_row_str);
         }
 
         datafile_free_row(self, &update_row);
     }
 
+    // copy the rewritten rows back over the datafile while still holding the lock
+    size_t bytes_read;
+    rewind(fp);
+    rewind(fp_temp);
+    ftruncate(fileno(fp), 0);
+
+    while ((bytes_read = _datafile_read(buffer, 1, DATAFILE_ROW_MAXLEN, fp_temp)) > 0)
+        _datafile_write(buffer, 1, bytes_read, fp);
+
+    fflush(fp);
+    flock(fileno(fp), LOCK_UN);
     fclose(fp);
     fclose(fp_temp);
-
-    _datafile_copy_file_data(temp_file_name, self->filename, 0, 0);
+    remove(temp_file_name);
 
     return true;
 }
@@ -272,6 +395,93 @@ bool datafile_delete_row(datafile_t *self, int id)
     return datafile_update_row(self, id, NULL);
 }
 
+////
+int datafile_rewrite(datafile_t *self, void (*compact)(datafile_t *self, char ***rows, int num_rows, void *arg), void *arg)
+{
+    if (self == NULL || compact == NULL)
+        return -1;
+
+    char buffer[DATAFILE_ROW_MAXLEN];
+    char ***rows = NULL;
+    int num_rows = 0;
+    int max_rows = 0;
+    int num_dropped = 0;
+
+    FILE *fp = _datafile_open(self->filename, "r+");
+
+    if (fp == NULL)
+        return -1;
+
+    flock(fileno(fp), LOCK_EX);
+    fseek(fp, self->header_len, SEEK_SET);
+
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    {
+        int n;
+        char **row = record2array(buffer, &n);
+
+        // nothing can read a row with missing fields, so there is nothing to keep
+        if (n != self->num_fields)
+        {
+            if (row != NULL)
+                free_string_array(&row, n);
+            num_dropped++;
+            continue;
+        }
+
+        if (num_rows == max_rows)
+        {
+            max_rows = max_rows > 0 ? max_rows * 2 : CHUNK_SIZE;
+            char ***grown = realloc(rows, max_rows * sizeof(char **));
+
+            if (grown == NULL)
+            {
+                datafile_free_row(self, &row);
+                num_dropped = -1;
+                break;
+            }
+
+            rows = grown;
+        }
+
+        rows[num_rows++] = row;
+    }
+
+    if (num_dropped >= 0)
+    {
+        compact(self, rows, num_rows, arg);
+
+        // written back over the old rows while still holding the lock, so readers never see it half done
+        fseek(fp, self->header_len, SEEK_SET);
+        ftruncate(fileno(fp), self->header_len);
+    }
+
+    for (int i=0; i<num_rows; i++)
+    {
+        if (rows[i] == NULL)
+        {
+            num_dropped++;
+            continue;
+        }
+
+        if (num_dropped >= 0)
+        {
+            char *record = array2record(rows[i], self->num_fields);
+            _datafile_puts(record, fp);
+            arena_free(record);
+        }
+
+        datafile_free_row(self, &rows[i]);
+    }
+
+    fflush(fp);
+    flock(fileno(fp), LOCK_UN);
+    fclose(fp);
+    free(rows);
+
+    return num_dropped;
+}
+
 ////
 void datafile_get_row_prepare(datafile_t *self)
 {
@@ -281,6 +491,15 @@ void datafile_get_row_prepare(datafile_t *self)
     self->last_row_id = 0;
 }
 
+////
+void datafile_get_row_prepare_after(datafile_t *self, int row_id)
+{
+    if (self == NULL)
+        return;
+
+    self->last_row_id = row_id;
+}
+
 ////
 char **datafile_get_row(datafile_t *self)
 {
@@ -290,10 +509,11 @@ char **datafile_get_row(datafile_t *self)
     char **ret_row = NULL;
     char buffer[DATAFILE_ROW_MAXLEN];
 
-    FILE *fp = fopen(self->filename, "r");
+    FILE *fp = _datafile_open(self->filename, "r");
+    flock(fileno(fp), LOCK_SH);
     fseek(fp, self->header_len, SEEK_SET);
 
-    while (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
     {
         int n;
         char **current_row = record2array(buffer, &n);
@@ -306,6 +526,7 @@ char **datafile_get_row(datafile_t *self)
         }
         datafile_free_row(self, &current_row);
     }
+    flock(fileno(fp), LOCK_UN);
     fclose(fp);
     return ret_row;
 }
@@ -323,10 +544,11 @@ char **datafile_get_row_by_field(datafile_t *self, const char *field_name, const
     char **ret_row = NULL;
     char buffer[DATAFILE_ROW_MAXLEN];
 
-    FILE *fp = fopen(self->filename, "r");
+    FILE *fp = _datafile_open(self->filename, "r");
+    flock(fileno(fp), LOCK_SH);
     fseek(fp, self->header_len, SEEK_SET);
 
-    while (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
     {
         int n;
         char **current_row = record2array(buffer, &n);
@@ -340,11 +562,77 @@ char **datafile_get_row_by_field(datafile_t *self, const char *field_name, const
         datafile_free_row(self, &current_row);
     }
 
+    flock(fileno(fp), LOCK_UN);
     fclose(fp);
 
     return ret_row;
 }
 
+////
+int datafile_for_each_value(datafile_t *self, const char *field_name, void (*callback)(const char *value, void *arg), void *arg)
+{
+    if (self == NULL || callback == NULL)
+        return 0;
+
+    int field_index = datafile_get_field_index(self, field_name);
+
+    if (field_index < 0)
+        return 0;
+
+    int num_rows = 0;
+    char buffer[DATAFILE_ROW_MAXLEN];
+
+    FILE *fp = _datafile_open(self->filename, "r");
+    flock(fileno(fp), LOCK_SH);
+    fseek(fp, self->header_len, SEEK_SET);
+
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    {
+        int n;
+        char **row = record2array(buffer, &n);
+
+        if (n > field_index)
+        {
+            callback(row[field_index], arg);
+            num_rows++;
+        }
+
+        datafile_free_row(self, &row);
+    }
+
+    flock(fileno(fp), LOCK_UN);
+    fclose(fp);
+
+    return num_rows;
+}
+
+////
+int datafile_get_last_row_id(datafile_t *self)
+{
+    if (self == NULL)
+        return 0;
+
+    int last_id = 0;
+    char buffer[DATAFILE_ROW_MAXLEN];
+
+    FILE *fp = _datafile_open(self->filename, "r");
+    flock(fileno(fp), LOCK_SH);
+    fseek(fp, self->header_len, SEEK_SET);
+
+    // ids are assigned in ascending order, so the last row holds the highest id
+    while (_datafile_gets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    {
+        int id = atoi(buffer);
+        if (id > last_id)
+            last_id = id;
+    }
+
+    flock(fileno(fp), LOCK_UN);
+    fclose(fp);
+
+    return last_id;
+}
+
 ////
 char **datafile_new_row_array(datafile_t *self)
 {
@@ -367,9 +655,9 @@ bool datafile_set_col(datafile_t *self, char ***row_data, const char *field_name
 
     // if overwriting this element, free old data
     if ((*row_data)[index] != NULL)
-        free((*row_data)[index]);
+        arena_free((*row_data)[index]);
 
-    (*row_data)[index] = malloc(sizeof(char) * (strlen(col_data)+1));
+    (*row_data)[index] = arena_malloc(sizeof(char) * (strlen(col_data)+1));
     strcpy((*row_data)[index], col_data);
     
     return true;
@@ -20,9 +20,12 @@
 #include <string.h>
 #include <stdbool.h>
 #include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
 #include <sys/file.h>
 
 #include "garbagecollector.h"
+#include "arena.h"
 
 #define DATAFILE_FILENAME_MAXLEN 256
 #define DATAFILE_ROW_MAXLEN 4096
@@ -41,6 +44,19 @@ typedef struct
 
 } datafile_t;
 
+// DATAFILE I/O COUNTS
+//   what the calling thread has done to datafiles so far, every file opened for reading counts as a
+//   read and every one opened for writing as a write, "r+" as both, along with the bytes moved
+typedef struct
+{
+    long reads;
+    long writes;
+    long bytes_read;
+    long bytes_written;
+} datafile_io_t;
+
+extern _Thread_local datafile_io_t datafile_thread_io;
+
 // CONSTRUCTOR
 datafile_t *new_datafile(const char *filename);
 
@@ -49,13 +65,22 @@ void datafile_destroy(void *);
 
 // methods to manipulate datafile rows
 bool datafile_add_row(datafile_t *self, char ***row_data);
+bool datafile_append_row(datafile_t *self, int id, char ***row_data);    // id already known, skips the scan for it
 bool datafile_update_row(datafile_t *self, int id, char ***row_data);
 bool datafile_delete_row(datafile_t *self, int id);
 
+// rewrites the whole file at once, compact gets every row and may change them in place or drop one by freeing it
+// with datafile_free_row() and setting it to NULL, rows without every field are dropped before it sees them
+// the file is held exclusively throughout, returns the number of rows dropped or -1
+int datafile_rewrite(datafile_t *self, void (*compact)(datafile_t *self, char ***rows, int num_rows, void *arg), void *arg);
+
 // methods to retrieve datafile rows
 void datafile_get_row_prepare(datafile_t *self);
+void datafile_get_row_prepare_after(datafile_t *self, int row_id);    // next get_row returns the first row with id > row_id
 char **datafile_get_row(datafile_t *self);
 char **datafile_get_row_by_field(datafile_t *self, const char *field_name, const char *field_value);
+int datafile_get_last_row_id(datafile_t *self);
+int datafile_for_each_value(datafile_t *self, const char *field_name, void (*callback)(const char *value, void *arg), void *arg);  // one pass, returns rows read
 
 // methods to manipulate row arrays
 char **datafile_new_row_array(datafile_t *self);
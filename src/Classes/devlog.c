@@ -7,6 +7,13 @@
 #include "devlog.h"
 
 extern garbagecollector_t *global_gc;
+extern threadcontroller_t *global_tc;
+
+const char *_devlog_level_names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+// HELPERS
+void *_devlog_thread(void *args);
+long _devlog_drain(devlog_t *self);
 
 // CONSTRUCTOR
 devlog_t *new_devlog(const char *filename)
@@ -16,26 +23,224 @@ devlog_t *new_devlog(const char *filename)
     if (self == NULL)
         exit_error("Devlog memory allocation failed\n");
 
-    garbagecollector_register(global_gc, (void *)self, devlog_destroy);
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, devlog_destroy);
+
+    self->fp = stdout;
+    if (filename != NULL)
+    {
+        strncpy(self->filename, filename, DEVLOG_FILENAME_LEN - 1);
+
+        if ((self->fp = fopen(self->filename, "a")) == NULL)
+            exit_error("Could not open log file");
+    }
+
+    self->batch = malloc(DEVLOG_BATCH_LEN);
+
+    if (self->batch == NULL)
+        exit_error("Devlog memory allocation failed\n");
+
+    self->rings = new_threadslots(sizeof(devlog_ring_t), _Alignof(devlog_ring_t), NULL);
+
+    atomic_init(&(self->level), DEVLOG_INFO);
+    pthread_mutex_init(&(self->drain_lock), NULL);
+
+    threadarguments_t *thread_args = new_threadarguments();
+    thread_args->arg2 = (void *)self;
 
-    strcpy(self->filename, filename);
+    if (thread_create(global_tc, _devlog_thread, thread_args) < 0)
+        exit_error("Could not start log thread");
 
     return self;
 }
 
 // DESTRUCTOR
-void devlog_write(devlog_t *self, const char *text)
+void devlog_destroy(void *s)
 {
-    self->fp = fopen(self->filename, "a");
-    fprintf(self->fp, "%s\n", text);
-    fclose(self->fp);
+    devlog_t *self = (devlog_t *)s;
+
+    // the background thread is gone by now, anything logged while it was stopping is written here
+    _devlog_drain(self);
+
+    threadslots_destroy(self->rings);
+
+    if (self->filename[0] != '\0')
+        fclose(self->fp);
+
+    free(self->batch);
+    pthread_mutex_destroy(&(self->drain_lock));
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: writes queued messages until shutdown, sleeping while there are none
+void *_devlog_thread(void *args)
+{
+    threadarguments_t *thread_args = (threadarguments_t *)args;
+    devlog_t *self = (devlog_t *)(thread_args->arg2);
+
+    struct pollfd shutdown = {0};
+    shutdown.fd = global_tc->shutdown_fd;
+    shutdown.events = POLLIN;
+
+    while (threadcontroller_running(global_tc))
+    {
+        if (_devlog_drain(self) == 0)
+            poll(&shutdown, 1, DEVLOG_IDLE_MS);
+    }
+
+    _devlog_drain(self);
+
+    return NULL;
+}
+
+// Description: formats and writes every record in every ring oldest first, returns how many there were
+long _devlog_drain(devlog_t *self)
+{
+    long count = 0;
+    size_t used = 0;
+    time_t last_second = -1;
+    struct tm tm = {0};
+    devlog_ring_t *rings = (devlog_ring_t *)threadslots_first(self->rings);
+
+    pthread_mutex_lock(&(self->drain_lock));
+
+    // records written after this are left for the next drain
+    for (devlog_ring_t *ring = rings; ring != NULL; ring = (devlog_ring_t *)ring->slot.next_slot)
+    {
+        ring->drain_head = atomic_load_explicit(&(ring->head), memory_order_relaxed);
+        ring->drain_tail = atomic_load_explicit(&(ring->tail), memory_order_acquire);
+    }
+
+    for (;; count++)
+    {
+        devlog_ring_t *oldest = NULL;
+        devlog_record_t *record = NULL;
+
+        for (devlog_ring_t *ring = rings; ring != NULL; ring = (devlog_ring_t *)ring->slot.next_slot)
+        {
+            if (ring->drain_head == ring->drain_tail)
+                continue;
+
+            devlog_record_t *next = &(ring->records[ring->drain_head & (DEVLOG_RING_RECORDS - 1)]);
+
+            if (record == NULL || next->time.tv_sec < record->time.tv_sec ||
+                (next->time.tv_sec == record->time.tv_sec && next->time.tv_nsec < record->time.tv_nsec))
+            {
+                oldest = ring;
+                record = next;
+            }
+        }
+
+        if (record == NULL)
+            break;
+
+        // a record and its line prefix always fit in what is left
+        if (used + DEVLOG_RECORD_LEN + 32 > DEVLOG_BATCH_LEN)
+        {
+            fwrite(self->batch, 1, used, self->fp);
+            used = 0;
+        }
+
+        // the broken down time only changes once a second
+        if (record->time.tv_sec != last_second)
+        {
+            last_second = record->time.tv_sec;
+            localtime_r(&last_second, &tm);
+        }
+
+        used += sprintf(self->batch + used, "%02d:%02d:%02d.%03ld %-5s ",
+            tm.tm_hour, tm.tm_min, tm.tm_sec, record->time.tv_nsec / 1000000, _devlog_level_names[record->level]);
+        memcpy(self->batch + used, record->text, record->len);
+        used += record->len;
+        self->batch[used++] = '\n';
+
+        oldest->drain_head++;
+    }
+
+    if (used > 0)
+        fwrite(self->batch, 1, used, self->fp);
+    if (count > 0)
+        fflush(self->fp);
+
+    // hands the slots back to their owners, the records have been written
+    for (devlog_ring_t *ring = rings; ring != NULL; ring = (devlog_ring_t *)ring->slot.next_slot)
+        atomic_store_explicit(&(ring->head), ring->drain_head, memory_order_release);
+
+    pthread_mutex_unlock(&(self->drain_lock));
+
+    atomic_fetch_add(&(self->num_written), count);
+
+    return count;
 }
 
 // METHODS
 
 /////
-void devlog_destroy(void *s) {
-    devlog_t *self = (devlog_t *)s;
-    garbagecollector_unregister(global_gc, self->gc_id);
-    free(self);
-}
\ No newline at end of file
+void devlog_write(devlog_t *self, int level, const char *format, ...)
+{
+    if (level > atomic_load_explicit(&(self->level), memory_order_relaxed))
+        return;
+
+    devlog_ring_t *ring = (devlog_ring_t *)threadslots_get(self->rings);
+
+    if (ring == NULL)
+    {
+        atomic_fetch_add_explicit(&(self->num_dropped), 1, memory_order_relaxed);
+        return;
+    }
+
+    // only this thread moves tail, the drain only ever moves head forward
+    uint64_t tail = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+
+    if (tail - atomic_load_explicit(&(ring->head), memory_order_acquire) >= DEVLOG_RING_RECORDS)
+    {
+        atomic_fetch_add_explicit(&(self->num_dropped), 1, memory_order_relaxed);
+        return;
+    }
+
+    devlog_record_t *record = &(ring->records[tail & (DEVLOG_RING_RECORDS - 1)]);
+
+    clock_gettime(CLOCK_REALTIME, &(record->time));
+    record->level = level;
+
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(record->text, DEVLOG_RECORD_LEN, format, args);
+    va_end(args);
+
+    record->len = len < 0 ? 0 : (len < DEVLOG_RECORD_LEN ? len : DEVLOG_RECORD_LEN - 1);
+
+    atomic_store_explicit(&(ring->tail), tail + 1, memory_order_release);
+}
+
+/////
+bool devlog_enabled(devlog_t *self, int level)
+{
+    return level <= atomic_load_explicit(&(self->level), memory_order_relaxed);
+}
+
+/////
+void devlog_set_level(devlog_t *self, int level)
+{
+    atomic_store(&(self->level), level);
+}
+
+/////
+int devlog_level_from_name(const char *name)
+{
+    for (int i=DEVLOG_ERROR; i<=DEVLOG_DEBUG; i++)
+        if (strcasecmp(name, _devlog_level_names[i]) == 0)
+            return i;
+
+    return -1;
+}
+
+/////
+void devlog_flush(devlog_t *self)
+{
+    _devlog_drain(self);
+}
@@ -2,8 +2,17 @@
  * DEVLOG CLASS PROTOTYPE
  * Author:      Aaron Bishop
  * Date:        4/16/2020
- * Description: Logs desired messages to a text file
- * Usage:       Instantiate with: devlog_t *mydevlog = new_devlog()
+ * Description: Asynchronous log of what the server is doing, written to stdout or a text file
+ *                Every thread that logs gets a ring of records of its own, so writing a message takes
+ *                no lock and does no I/O.  A background thread drains all of the rings in batches,
+ *                merging them back into time order, since one connection's commands can run on
+ *                different threads.  Each line is stamped with its time and level, and the batch is
+ *                written with a single call.
+ *                A message is dropped rather than waited on if its thread's ring is full.
+ *
+ *                Rings are reused by new threads once their thread exits.  Messages above the current
+ *                level are thrown away before anything is formatted.
+ * Usage:       Instantiate with: devlog_t *mydevlog = new_devlog(filename), NULL logs to stdout
  */
 #pragma once
 
@@ -13,25 +22,97 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
 
 #include "common.h"
 #include "garbagecollector.h"
+#include "threadslots.h"
 
 #define DEVLOG_FILENAME_LEN 256
+#define DEVLOG_RING_RECORDS 512         // per thread, a power of two
+#define DEVLOG_RECORD_LEN 240           // longer messages are cut short
+#define DEVLOG_BATCH_LEN 65536          // bytes written at a time
+#define DEVLOG_IDLE_MS 5                // how long the background thread sleeps when there is nothing to write
+
+// log levels, a message is written if its level is at or below the log's
+#define DEVLOG_ERROR 0
+#define DEVLOG_WARN 1
+#define DEVLOG_INFO 2
+#define DEVLOG_DEBUG 3
+
+// DEVLOG RECORD
+typedef struct
+{
+    struct timespec time;
+    int level;
+    int len;
+    char text[DEVLOG_RECORD_LEN];
+} devlog_record_t;
+
+// DEVLOG RING
+//   single writer, the owning thread, and a single reader, whoever drains the log
+typedef struct
+{
+    threadslot_t slot;
+    _Atomic uint64_t head;              // next record to drain
+    _Atomic uint64_t tail;              // next record to write
+    uint64_t drain_head;                // how far the drain in progress has got, and where it stops
+    uint64_t drain_tail;
+    devlog_record_t records[DEVLOG_RING_RECORDS];
+} devlog_ring_t;
 
 // DEVLOG OBJECT
 typedef struct
 {
     int gc_id;
     FILE *fp;
-    char filename[DEVLOG_FILENAME_LEN];
+    char filename[DEVLOG_FILENAME_LEN];     // empty for stdout
+
+    atomic_int level;
+    threadslots_t *rings;                   // of devlog_ring_t
+
+    pthread_mutex_t drain_lock;             // one drain at a time, the background thread's or a flush
+    char *batch;
+
+    atomic_long num_written;
+    atomic_long num_dropped;
 } devlog_t;
 
-// EXTERNS
+// CONSTRUCTOR
+devlog_t *new_devlog(const char *filename);
 
-// METHODS
-devlog_t *new_devlog(const char *);
-void devlog_write(devlog_t *, const char *);
+// DESTRUCTOR
+//   writes whatever is left
 void devlog_destroy(void *);
 
-#endif
\ No newline at end of file
+// METHODS
+
+// devlog_write()
+//   Queues a printf style message at level, the newline is added for you
+//   Never blocks, if the calling thread's ring is full the message is counted as dropped
+void devlog_write(devlog_t *self, int level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+// devlog_enabled()
+//   Returns true if messages at level are being written, for callers that would do work to build one
+bool devlog_enabled(devlog_t *self, int level);
+
+// devlog_set_level()
+//   Sets the most detailed level written
+void devlog_set_level(devlog_t *self, int level);
+
+// devlog_level_from_name()
+//   Returns the level called name, such as "info", or -1 if there is none
+int devlog_level_from_name(const char *name);
+
+// devlog_flush()
+//   Writes every queued message now, from the calling thread
+void devlog_flush(devlog_t *self);
+
+#endif
@@ -8,6 +8,9 @@
 
 int garbage_collector_exists = 0;
 
+// HELPERS
+garbagecollector_slot_t *_garbagecollector_get_slot(garbagecollector_t *self, uint32_t gc_id, bool create);
+
 // CONSTRUCTOR
 garbagecollector_t *new_garbagecollector()
 {
@@ -24,7 +27,6 @@ garbagecollector_t *new_garbagecollector()
     }
 
     garbage_collector_exists = 1;
-    pthread_mutex_init(&(self->gc_lock), NULL);
 
     return self;
 }
@@ -32,23 +34,60 @@ garbagecollector_t *new_garbagecollector()
 // DESTRUCTOR
 void garbagecollector_cleanup(garbagecollector_t *self)
 {
-    for (int i=0; i<MAX_OBJECTS; i++)
-        if (self->garbage_objects[i] != NULL && self->garbage_destructors[i] != NULL)
-            (self->garbage_destructors[i])(self->garbage_objects[i]);
+    uint32_t num_slots = atomic_load(&(self->num_slots));
+
+    for (uint32_t i=0; i<num_slots; i++)
+    {
+        garbagecollector_slot_t *slot = _garbagecollector_get_slot(self, i, false);
+
+        // destructors unregister what they free, so every slot is read again as it is reached
+        void *object = slot != NULL ? atomic_load(&(slot->object)) : NULL;
+
+        if (object != NULL && slot->destructor != NULL)
+            (slot->destructor)(object);
+    }
+
+    for (int i=0; i<GARBAGECOLLECTOR_MAX_SEGMENTS; i++)
+        free(atomic_load(&(self->segments[i])));
 
     free(self);
 }
 
 // HELPERS
 
-/////
-int _garbagecollector_get_free_index(garbagecollector_t *self)
+// Description: finds the slot of gc_id, allocating its segment if create is set and nobody has yet
+garbagecollector_slot_t *_garbagecollector_get_slot(garbagecollector_t *self, uint32_t gc_id, bool create)
 {
-    for (int i=0; i<MAX_OBJECTS; i++)
-        if (self->garbage_objects[i] == NULL && self->garbage_destructors[i] == NULL)
-            return i;
+    // segment k holds GARBAGECOLLECTOR_FIRST_SEGMENT << k slots, starting after the slots of the segments before it
+    uint32_t segment = 0;
+    uint32_t first_id = 0;
+
+    while (gc_id - first_id >= (uint32_t)GARBAGECOLLECTOR_FIRST_SEGMENT << segment)
+    {
+        first_id += GARBAGECOLLECTOR_FIRST_SEGMENT << segment;
+        segment++;
 
-    return -1;
+        if (segment == GARBAGECOLLECTOR_MAX_SEGMENTS)
+            exit_error("Garbagecollector is full\n");
+    }
+
+    garbagecollector_slot_t *slots = atomic_load(&(self->segments[segment]));
+
+    if (slots == NULL && create)
+    {
+        garbagecollector_slot_t *new_slots = calloc((size_t)GARBAGECOLLECTOR_FIRST_SEGMENT << segment, sizeof(garbagecollector_slot_t));
+
+        if (new_slots == NULL)
+            exit_error("Garbagecollector memory allocation failed\n");
+
+        // another thread may have added the segment first, then its segment is used instead
+        if (atomic_compare_exchange_strong(&(self->segments[segment]), &slots, new_slots))
+            slots = new_slots;
+        else
+            free(new_slots);
+    }
+
+    return slots != NULL ? &(slots[gc_id - first_id]) : NULL;
 }
 
 // METHODS
@@ -56,28 +95,52 @@ int _garbagecollector_get_free_index(garbagecollector_t *self)
 /////
 int garbagecollector_register(garbagecollector_t *self, void *object, void (*destructor)(void *))
 {
-    pthread_mutex_lock(&(self->gc_lock));
+    garbagecollector_slot_t *slot = NULL;
+    uint32_t gc_id = 0;
+    uint64_t head = atomic_load(&(self->free_head));
+
+    // reuse a freed slot if there is one
+    while ((uint32_t)head != 0)
+    {
+        gc_id = (uint32_t)head - 1;
+        slot = _garbagecollector_get_slot(self, gc_id, false);
+
+        uint64_t next = (((head >> 32) + 1) << 32) | atomic_load_explicit(&(slot->next_free), memory_order_relaxed);
 
-    int next_index = _garbagecollector_get_free_index(self);
+        if (atomic_compare_exchange_weak(&(self->free_head), &head, next))
+            break;
 
-    self->garbage_objects[next_index] = object;
-    self->garbage_destructors[next_index] = destructor;
+        slot = NULL;
+    }
+
+    // otherwise hand out a new one
+    if (slot == NULL)
+    {
+        gc_id = atomic_fetch_add(&(self->num_slots), 1);
+        slot = _garbagecollector_get_slot(self, gc_id, true);
+    }
 
-    pthread_mutex_unlock(&(self->gc_lock));
+    slot->destructor = destructor;
+    atomic_store(&(slot->object), object);
 
-    return next_index;
+    return (int)gc_id;
 }
 
 /////
 void garbagecollector_unregister(garbagecollector_t *self, int gc_id)
 {
-    pthread_mutex_lock(&(self->gc_lock));
+    garbagecollector_slot_t *slot = _garbagecollector_get_slot(self, (uint32_t)gc_id, false);
 
-    self->garbage_objects[gc_id] = NULL;
-    self->garbage_destructors[gc_id] = NULL;
-    
-    pthread_mutex_unlock(&(self->gc_lock));
-}
+    // only the call that takes the object out pushes the slot, a second unregister of the same id finds it gone
+    if (slot == NULL || atomic_exchange(&(slot->object), NULL) == NULL)
+        return;
 
+    slot->destructor = NULL;
 
+    uint64_t head = atomic_load(&(self->free_head));
 
+    do
+    {
+        atomic_store_explicit(&(slot->next_free), (uint32_t)head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(&(self->free_head), &head, (((head >> 32) + 1) << 32) | ((uint32_t)gc_id + 1)));
+}
@@ -3,6 +3,9 @@
  * Author:      Aaron Bishop
  * Date:        4/16/2020
  * Description: Maintains a registry of created object and destructors, and frees all memory when called.
+ *                Slots live in segments that double in size and are never moved, so a gc_id stays valid
+ *                as the registry grows.  Unregistered slots go on a lock-free free list that register
+ *                takes from first, so neither call takes a lock or scans for a slot.
  * Usage:       Instantiate with: garbagecollector_t *mygc = new_garbagecollector()
  */
 #pragma once
@@ -12,17 +15,28 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 #include "common.h"
 
-#define MAX_OBJECTS 5120
+#define GARBAGECOLLECTOR_FIRST_SEGMENT 1024     // slots in segment 0, each segment after it is twice the size
+#define GARBAGECOLLECTOR_MAX_SEGMENTS 21        // room for about 2^31 objects, the range of a gc_id
+
+// GARBAGE COLLECTOR SLOT
+typedef struct
+{
+    void *_Atomic object;
+    void (*destructor)(void *);
+    _Atomic uint32_t next_free;         // gc_id + 1 of the next free slot, 0 ends the list
+} garbagecollector_slot_t;
 
 // GARBAGE COLLECTOR OBJECT
 typedef struct
 {
-    void *garbage_objects[MAX_OBJECTS];
-    void (*garbage_destructors[MAX_OBJECTS])(void *);
-    pthread_mutex_t gc_lock;
+    garbagecollector_slot_t *_Atomic segments[GARBAGECOLLECTOR_MAX_SEGMENTS];
+    atomic_uint num_slots;              // slots handed out so far, free or not
+    _Atomic uint64_t free_head;         // pop count << 32 | gc_id + 1 of the top free slot, the count stops ABA
 
 } garbagecollector_t;
 
@@ -44,4 +58,4 @@ int garbagecollector_register(garbagecollector_t *, void *, void (*)(void *));
 //   This function should be called from an object's destructor
 void garbagecollector_unregister(garbagecollector_t *, int);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,300 @@
+/*
+ * HTTP METRICS CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "httpmetrics.h"
+
+extern garbagecollector_t *global_gc;
+extern ratelimiter_t *global_rl;
+extern sessiontable_t *global_st;
+extern usertable_t *global_ut;
+extern bloomfilter_t *global_bf;
+extern devlog_t *global_dl;
+extern metrics_t *global_mt;
+
+// the worker has no way to be handed its endpoint, there is only ever one
+httpmetrics_t *_httpmetrics_endpoint = NULL;
+
+// HELPERS
+int _httpmetrics_worker(tcpconnection_t *conn, int event);
+int _httpmetrics_request(tcpconnection_t *conn);
+void _httpmetrics_reply(tcpconnection_t *conn, const char *status, const char *content_type, FILE *body);
+const char *_httpmetrics_command(int op, char *label);
+
+// CONSTRUCTOR
+httpmetrics_t *new_httpmetrics(int port, tcpserver_t *catalog_server)
+{
+    httpmetrics_t *self = calloc(1, sizeof(httpmetrics_t));
+
+    if (self == NULL)
+        exit_error("HTTP metrics memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, httpmetrics_destroy);
+
+    self->catalog_server = catalog_server;
+    _httpmetrics_endpoint = self;
+
+    self->server = new_local_tcpserver(port, _httpmetrics_worker);
+    tcpserver_set_limits(self->server, HTTPMETRICS_MAX_CONNECTIONS, 0, HTTPMETRICS_IDLE_TIMEOUT_MS);
+
+    return self;
+}
+
+// DESTRUCTOR
+void httpmetrics_destroy(void *s)
+{
+    httpmetrics_t *self = (httpmetrics_t *)s;
+
+    printf("Metrics endpoint scraped %ld times\n", atomic_load(&(self->num_scrapes)));
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: the tcpserver worker of the endpoint, reads requests and answers every complete one
+int _httpmetrics_worker(tcpconnection_t *conn, int event)
+{
+    if (event == TCPSERVER_EVENT_CONNECT)
+    {
+        conn->session = calloc(1, sizeof(httpmetrics_session_t));
+        return conn->session != NULL ? TCPSERVER_KEEP : TCPSERVER_CLOSE;
+    }
+
+    if (event == TCPSERVER_EVENT_DATA)
+        return _httpmetrics_request(conn);
+
+    free(conn->session);
+    conn->session = NULL;
+
+    return TCPSERVER_CLOSE;
+}
+
+// Description: receives from a readable connection and answers every request whose headers are in
+// Notes:       any body is ignored, GET requests have none
+int _httpmetrics_request(tcpconnection_t *conn)
+{
+    httpmetrics_session_t *session = (httpmetrics_session_t *)conn->session;
+
+    // one byte is kept back for the terminator
+    int bytes_received = recv(conn->socket, session->request + session->len, HTTPMETRICS_REQUEST_MAXLEN - 1 - session->len, 0);
+
+    if (bytes_received == 0)
+        return TCPSERVER_CLOSE;
+    else if (bytes_received < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? TCPSERVER_KEEP : TCPSERVER_CLOSE;
+
+    session->len += bytes_received;
+    session->request[session->len] = '\0';
+
+    char *end;
+
+    // a pipelining client may have sent several requests in one read, every complete one is answered
+    while ((end = strstr(session->request, "\r\n\r\n")) != NULL)
+    {
+        char method[8] = {0};
+        char path[256] = {0};
+
+        if (sscanf(session->request, "%7s %255s HTTP/", method, path) != 2)
+        {
+            _httpmetrics_reply(conn, "400 Bad Request", "text/plain", NULL);
+            return TCPSERVER_CLOSE;
+        }
+        else if (strcmp(method, "GET") != 0)
+            _httpmetrics_reply(conn, "405 Method Not Allowed", "text/plain", NULL);
+        else if (strcmp(path, HTTPMETRICS_PATH) != 0)
+            _httpmetrics_reply(conn, "404 Not Found", "text/plain", NULL);
+        else
+        {
+            // metrics are written to a temporary file and sent from it, like availability reports
+            FILE *body = tmpfile();
+
+            if (body == NULL)
+                _httpmetrics_reply(conn, "500 Internal Server Error", "text/plain", NULL);
+            else
+            {
+                atomic_fetch_add(&(_httpmetrics_endpoint->num_scrapes), 1);
+                httpmetrics_write(_httpmetrics_endpoint, body);
+                _httpmetrics_reply(conn, "200 OK", HTTPMETRICS_CONTENT_TYPE, body);
+            }
+        }
+
+        // keep whatever was sent after this request, terminator included
+        int request_len = (int)(end + 4 - session->request);
+        session->len -= request_len;
+        memmove(session->request, session->request + request_len, session->len + 1);
+    }
+
+    if (session->len < HTTPMETRICS_REQUEST_MAXLEN - 1)
+        return TCPSERVER_KEEP;
+
+    _httpmetrics_reply(conn, "431 Request Header Fields Too Large", "text/plain", NULL);
+
+    return TCPSERVER_CLOSE;
+}
+
+// Description: sends a response, the connection takes body and closes it once sent
+void _httpmetrics_reply(tcpconnection_t *conn, const char *status, const char *content_type, FILE *body)
+{
+    char header[256];
+    long body_len = body != NULL ? ftell(body) : 0;
+
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %ld\r\n\r\n",
+        status, content_type, body_len);
+
+    tcpserver_cork(conn, true);
+    tcpserver_send(conn, header, (size_t)header_len);
+
+    if (body != NULL)
+    {
+        fflush(body);
+        tcpserver_send_file(conn, body, 0, (size_t)body_len);
+    }
+
+    tcpserver_cork(conn, false);
+}
+
+// Description: returns the label of the command counted at op, label holds the op code of one with no name
+const char *_httpmetrics_command(int op, char *label)
+{
+    const char *name = catalog_op_name((uint8_t)(op << 4));
+
+    if (name != NULL)
+        return name;
+
+    sprintf(label, "0x%02x", op << 4);
+    return label;
+}
+
+// METHODS
+
+/////
+void httpmetrics_write(httpmetrics_t *self, FILE *out)
+{
+    tcpserver_t *server = self->catalog_server;
+    metrics_snapshot_t snapshot;
+    char label[8];
+
+    metrics_snapshot(global_mt, &snapshot);
+
+    // CONNECTIONS
+    fprintf(out, "# HELP catalog_connections_active Catalog clients connected now.\n");
+    fprintf(out, "# TYPE catalog_connections_active gauge\n");
+    fprintf(out, "catalog_connections_active %ld\n", snapshot.active_connections);
+
+    fprintf(out, "# HELP catalog_connections_total Catalog connections by what became of them when they arrived.\n");
+    fprintf(out, "# TYPE catalog_connections_total counter\n");
+    fprintf(out, "catalog_connections_total{result=\"accepted\"} %u\n", atomic_load(&(server->num_accepted)));
+    fprintf(out, "catalog_connections_total{result=\"rejected\"} %u\n", atomic_load(&(server->num_rejected)));
+
+    fprintf(out, "# HELP catalog_connections_reaped_total Catalog connections closed for being idle.\n");
+    fprintf(out, "# TYPE catalog_connections_reaped_total counter\n");
+    fprintf(out, "catalog_connections_reaped_total %u\n", atomic_load(&(server->num_reaped)));
+
+    // COMMANDS
+    //   rates are left to the scraper, rate(catalog_commands_total[1m])
+    fprintf(out, "# HELP catalog_commands_total Commands run, by command.\n");
+    fprintf(out, "# TYPE catalog_commands_total counter\n");
+
+    // every command is listed so its rate starts at zero, unknown op codes only once they turn up
+    for (int op=0; op<METRICS_OPCODES; op++)
+    {
+        if (catalog_op_name((uint8_t)(op << 4)) != NULL || snapshot.ops[op].count > 0)
+            fprintf(out, "catalog_commands_total{command=\"%s\"} %lu\n", _httpmetrics_command(op, label), snapshot.ops[op].count);
+    }
+
+    fprintf(out, "# HELP catalog_command_duration_seconds Time from a command arriving to it being answered.\n");
+    fprintf(out, "# TYPE catalog_command_duration_seconds summary\n");
+
+    for (int op=0; op<METRICS_OPCODES; op++)
+    {
+        metrics_op_t *stats = &(snapshot.ops[op]);
+        const char *name = _httpmetrics_command(op, label);
+
+        if (stats->count == 0)
+            continue;
+
+        fprintf(out, "catalog_command_duration_seconds{command=\"%s\",quantile=\"0.5\"} %.9f\n", name, stats->p50_ns / 1e9);
+        fprintf(out, "catalog_command_duration_seconds{command=\"%s\",quantile=\"0.99\"} %.9f\n", name, stats->p99_ns / 1e9);
+        fprintf(out, "catalog_command_duration_seconds{command=\"%s\",quantile=\"0.999\"} %.9f\n", name, stats->p999_ns / 1e9);
+        fprintf(out, "catalog_command_duration_seconds_sum{command=\"%s\"} %.9f\n", name, stats->sum_ns / 1e9);
+        fprintf(out, "catalog_command_duration_seconds_count{command=\"%s\"} %lu\n", name, stats->count);
+    }
+
+    // DATAFILES
+    fprintf(out, "# HELP catalog_datafile_opens_total Datafiles opened, by what for.\n");
+    fprintf(out, "# TYPE catalog_datafile_opens_total counter\n");
+    fprintf(out, "catalog_datafile_opens_total{mode=\"read\"} %ld\n", snapshot.datafile_reads);
+    fprintf(out, "catalog_datafile_opens_total{mode=\"write\"} %ld\n", snapshot.datafile_writes);
+
+    fprintf(out, "# HELP catalog_datafile_bytes_total Bytes read from and written to datafiles.\n");
+    fprintf(out, "# TYPE catalog_datafile_bytes_total counter\n");
+    fprintf(out, "catalog_datafile_bytes_total{direction=\"read\"} %ld\n", snapshot.datafile_bytes_read);
+    fprintf(out, "catalog_datafile_bytes_total{direction=\"written\"} %ld\n", snapshot.datafile_bytes_written);
+
+    // CACHES
+    //   pools hit when they hand out an object they already had, the session table when a token resumes
+    objectpool_t *sessions = catalog_worker_sessions();
+    long resumed = atomic_load(&(global_st->num_resumed));
+
+    httpmetrics_cache_t caches[] = {
+        { "connection_pool", atomic_load(&(server->conn_pool->num_taken)), atomic_load(&(server->conn_pool->num_reused)) },
+        { "session_pool", atomic_load(&(sessions->num_taken)), atomic_load(&(sessions->num_reused)) },
+        { "session_table", resumed + atomic_load(&(global_st->num_refused)), resumed },
+    };
+    int num_caches = sizeof(caches) / sizeof(caches[0]);
+
+    fprintf(out, "# HELP catalog_cache_lookups_total Lookups of each cache.\n");
+    fprintf(out, "# TYPE catalog_cache_lookups_total counter\n");
+    for (int i=0; i<num_caches; i++)
+        fprintf(out, "catalog_cache_lookups_total{cache=\"%s\"} %ld\n", caches[i].name, caches[i].lookups);
+
+    fprintf(out, "# HELP catalog_cache_hits_total Lookups answered from each cache.\n");
+    fprintf(out, "# TYPE catalog_cache_hits_total counter\n");
+    for (int i=0; i<num_caches; i++)
+        fprintf(out, "catalog_cache_hits_total{cache=\"%s\"} %ld\n", caches[i].name, caches[i].hits);
+
+    fprintf(out, "# HELP catalog_cache_hit_ratio Hits over lookups of each cache since the server started.\n");
+    fprintf(out, "# TYPE catalog_cache_hit_ratio gauge\n");
+    for (int i=0; i<num_caches; i++)
+        fprintf(out, "catalog_cache_hit_ratio{cache=\"%s\"} %g\n", caches[i].name,
+            caches[i].lookups > 0 ? (double)caches[i].hits / caches[i].lookups : 0.0);
+
+    // FILTERS
+    const char *filter_names[] = { "username", "book_name" };
+    bloomfilter_t *filters[] = { global_ut->filter, global_bf };
+
+    fprintf(out, "# HELP catalog_filter_checks_total Names checked against each bloom filter.\n");
+    fprintf(out, "# TYPE catalog_filter_checks_total counter\n");
+    for (int i=0; i<2; i++)
+        if (filters[i] != NULL)
+            fprintf(out, "catalog_filter_checks_total{filter=\"%s\"} %ld\n", filter_names[i], atomic_load(&(filters[i]->num_checked)));
+
+    fprintf(out, "# HELP catalog_filter_rejected_total Checks answered by the filter without a lookup.\n");
+    fprintf(out, "# TYPE catalog_filter_rejected_total counter\n");
+    for (int i=0; i<2; i++)
+        if (filters[i] != NULL)
+            fprintf(out, "catalog_filter_rejected_total{filter=\"%s\"} %ld\n", filter_names[i], atomic_load(&(filters[i]->num_rejected)));
+
+    fprintf(out, "# HELP catalog_filter_false_positives_total Checks the filter passed whose lookup found nothing.\n");
+    fprintf(out, "# TYPE catalog_filter_false_positives_total counter\n");
+    for (int i=0; i<2; i++)
+        if (filters[i] != NULL)
+            fprintf(out, "catalog_filter_false_positives_total{filter=\"%s\"} %ld\n", filter_names[i], atomic_load(&(filters[i]->num_false_positives)));
+
+    // RATE LIMITS AND LOG
+    fprintf(out, "# HELP catalog_ratelimiter_commands_total Commands by what the rate limiter made of them.\n");
+    fprintf(out, "# TYPE catalog_ratelimiter_commands_total counter\n");
+    fprintf(out, "catalog_ratelimiter_commands_total{result=\"allowed\"} %ld\n", atomic_load(&(global_rl->num_allowed)));
+    fprintf(out, "catalog_ratelimiter_commands_total{result=\"throttled_user\"} %ld\n", atomic_load(&(global_rl->users.num_throttled)));
+    fprintf(out, "catalog_ratelimiter_commands_total{result=\"throttled_address\"} %ld\n", atomic_load(&(global_rl->addresses.num_throttled)));
+
+    fprintf(out, "# HELP catalog_log_messages_total Log messages by whether they were written or dropped.\n");
+    fprintf(out, "# TYPE catalog_log_messages_total counter\n");
+    fprintf(out, "catalog_log_messages_total{result=\"written\"} %ld\n", atomic_load(&(global_dl->num_written)));
+    fprintf(out, "catalog_log_messages_total{result=\"dropped\"} %ld\n", atomic_load(&(global_dl->num_dropped)));
+}
@@ -0,0 +1,84 @@
+/*
+ * HTTP METRICS CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Serves the server's counters over HTTP in the Prometheus text format, for monitoring to scrape
+ *                The endpoint is a tcpserver of its own on the loopback address, so scrapes are handled by the
+ *                same listener and threadpool code as catalog clients but can never be reached from another
+ *                host.  GET /metrics answers with connection counts, command counts and latencies, cache and
+ *                filter hit counts, and datafile I/O.  Connections are kept alive between scrapes.
+ *
+ *                There is one endpoint per process, it reports on the catalog server it was given.
+ * Usage:       Instantiate with: httpmetrics_t *myendpoint = new_httpmetrics(port, catalog_server)
+ *              curl http://localhost:PORT/metrics
+ */
+#pragma once
+
+#ifndef HTTPMETRICS_H_INCLUDED
+#define HTTPMETRICS_H_INCLUDED
+
+#define HTTPMETRICS_PATH "/metrics"
+#define HTTPMETRICS_REQUEST_MAXLEN 4096         // a request whose headers do not fit is answered 431 and closed
+#define HTTPMETRICS_MAX_CONNECTIONS 16
+#define HTTPMETRICS_IDLE_TIMEOUT_MS 60000
+#define HTTPMETRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "tcpserver.h"
+#include "metrics.h"
+#include "bloomfilter.h"
+#include "usertable.h"
+#include "catalog_worker.h"
+
+// HTTP METRICS SESSION
+//   a request being read, per connection
+typedef struct
+{
+    char request[HTTPMETRICS_REQUEST_MAXLEN];
+    int len;
+} httpmetrics_session_t;
+
+// HTTP METRICS CACHE
+//   the counts of one cache, for writing them out family by family
+typedef struct
+{
+    const char *name;
+    long lookups;
+    long hits;
+} httpmetrics_cache_t;
+
+// HTTP METRICS OBJECT
+typedef struct
+{
+    int gc_id;
+
+    tcpserver_t *server;                // the endpoint's own listener
+    tcpserver_t *catalog_server;        // the server whose connections are reported
+
+    atomic_long num_scrapes;
+} httpmetrics_t;
+
+// CONSTRUCTOR
+//   Starts listening on port of the loopback address
+httpmetrics_t *new_httpmetrics(int port, tcpserver_t *catalog_server);
+
+// DESTRUCTOR
+void httpmetrics_destroy(void *);
+
+// METHODS
+
+// httpmetrics_write()
+//   Writes every metric to out in the Prometheus text format
+void httpmetrics_write(httpmetrics_t *self, FILE *out);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * METRICS CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "metrics.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+void _metrics_take_slot(threadslot_t *slot);
+void _metrics_add(atomic_ulong *counter, unsigned long value);
+void _metrics_add_long(atomic_long *counter, long value);
+void _metrics_count_io(metrics_slot_t *slot);
+
+// CONSTRUCTOR
+metrics_t *new_metrics()
+{
+    metrics_t *self = calloc(1, sizeof(metrics_t));
+
+    if (self == NULL)
+        exit_error("Metrics memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, metrics_destroy);
+
+    // the size of a slot is a multiple of the cache line it is aligned to
+    self->slots = new_threadslots(sizeof(metrics_slot_t), _Alignof(metrics_slot_t), _metrics_take_slot);
+
+    return self;
+}
+
+// DESTRUCTOR
+void metrics_destroy(void *s)
+{
+    metrics_t *self = (metrics_t *)s;
+
+    threadslots_destroy(self->slots);
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: starts a slot's I/O count from the taking thread's, I/O it did before it took the slot is not counted
+void _metrics_take_slot(threadslot_t *slot)
+{
+    ((metrics_slot_t *)slot)->io_seen = datafile_thread_io;
+}
+
+// Description: adds to a counter only its owner writes, a plain load and store rather than a locked add
+void _metrics_add(atomic_ulong *counter, unsigned long value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/////
+void _metrics_add_long(atomic_long *counter, long value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+// Description: moves the datafile I/O of the owner since it was last counted into its slot
+void _metrics_count_io(metrics_slot_t *slot)
+{
+    datafile_io_t io = datafile_thread_io;
+
+    _metrics_add_long(&(slot->datafile_reads), io.reads - slot->io_seen.reads);
+    _metrics_add_long(&(slot->datafile_writes), io.writes - slot->io_seen.writes);
+    _metrics_add_long(&(slot->datafile_bytes_read), io.bytes_read - slot->io_seen.bytes_read);
+    _metrics_add_long(&(slot->datafile_bytes_written), io.bytes_written - slot->io_seen.bytes_written);
+
+    slot->io_seen = io;
+}
+
+// METHODS
+
+/////
+int metrics_bucket(uint64_t latency_ns)
+{
+    if (latency_ns >= (1ULL << METRICS_MAX_BITS))
+        latency_ns = (1ULL << METRICS_MAX_BITS) - 1;
+
+    if (latency_ns < METRICS_SUB_BUCKETS)
+        return (int)latency_ns;
+
+    // the power of two the latency falls in picks the bucket width, its top bits the bucket
+    int shift = 63 - __builtin_clzll(latency_ns) - METRICS_SUB_BUCKET_BITS;
+
+    return shift * METRICS_SUB_BUCKETS + (int)(latency_ns >> shift);
+}
+
+/////
+uint64_t metrics_bucket_max(int bucket)
+{
+    if (bucket < METRICS_SUB_BUCKETS)
+        return (uint64_t)bucket;
+
+    int shift = bucket / METRICS_SUB_BUCKETS - 1;
+    uint64_t base = (uint64_t)(bucket - shift * METRICS_SUB_BUCKETS) << shift;
+
+    return base + (1ULL << shift) - 1;
+}
+
+/////
+unsigned long metrics_percentile(const unsigned long *buckets, unsigned long count, unsigned long max_ns, double percentile)
+{
+    if (count == 0)
+        return 0;
+
+    // the rank of the command at the percentile, rounded up
+    unsigned long target = (unsigned long)(count * percentile);
+    unsigned long seen = 0;
+
+    if (target < count * percentile || target < 1)
+        target++;
+
+    for (int i=0; i<METRICS_BUCKETS; i++)
+    {
+        seen += buckets[i];
+
+        if (seen >= target)
+        {
+            uint64_t value = metrics_bucket_max(i);
+            return value < max_ns ? value : max_ns;
+        }
+    }
+
+    return max_ns;
+}
+
+/////
+void metrics_record(metrics_t *self, uint8_t op_code, uint64_t latency_ns)
+{
+    metrics_slot_t *slot = (metrics_slot_t *)threadslots_get(self->slots);
+
+    if (slot == NULL)
+        return;
+
+    metrics_histogram_t *histogram = &(slot->ops[(op_code >> 4) % METRICS_OPCODES]);
+
+    _metrics_add(&(histogram->buckets[metrics_bucket(latency_ns)]), 1);
+    _metrics_add(&(histogram->count), 1);
+    _metrics_add(&(histogram->sum_ns), latency_ns);
+
+    if (latency_ns > atomic_load_explicit(&(histogram->max_ns), memory_order_relaxed))
+        atomic_store_explicit(&(histogram->max_ns), latency_ns, memory_order_relaxed);
+
+    _metrics_count_io(slot);
+}
+
+/////
+void metrics_record_io(metrics_t *self)
+{
+    metrics_slot_t *slot = (metrics_slot_t *)threadslots_get(self->slots);
+
+    if (slot == NULL)
+        return;
+
+    _metrics_count_io(slot);
+}
+
+/////
+void metrics_connection_opened(metrics_t *self)
+{
+    metrics_slot_t *slot = (metrics_slot_t *)threadslots_get(self->slots);
+
+    if (slot == NULL)
+        return;
+
+    _metrics_add_long(&(slot->connections_opened), 1);
+}
+
+/////
+void metrics_connection_closed(metrics_t *self)
+{
+    metrics_slot_t *slot = (metrics_slot_t *)threadslots_get(self->slots);
+
+    if (slot == NULL)
+        return;
+
+    _metrics_add_long(&(slot->connections_closed), 1);
+}
+
+/////
+void metrics_snapshot(metrics_t *self, metrics_snapshot_t *snapshot)
+{
+    unsigned long buckets[METRICS_BUCKETS];
+
+    memset(snapshot, 0, sizeof(metrics_snapshot_t));
+
+    for (int op=0; op<METRICS_OPCODES; op++)
+    {
+        metrics_op_t *merged = &(snapshot->ops[op]);
+
+        memset(buckets, 0, sizeof(buckets));
+
+        for (metrics_slot_t *slot = (metrics_slot_t *)threadslots_first(self->slots); slot != NULL; slot = (metrics_slot_t *)slot->slot.next_slot)
+        {
+            metrics_histogram_t *histogram = &(slot->ops[op]);
+            unsigned long max_ns = atomic_load_explicit(&(histogram->max_ns), memory_order_relaxed);
+
+            // most threads never run most commands
+            if (atomic_load_explicit(&(histogram->count), memory_order_relaxed) == 0)
+                continue;
+
+            // the buckets are counted here rather than taken from count, so percentiles add up even
+            // when a thread is halfway through recording
+            for (int i=0; i<METRICS_BUCKETS; i++)
+            {
+                unsigned long n = atomic_load_explicit(&(histogram->buckets[i]), memory_order_relaxed);
+                buckets[i] += n;
+                merged->count += n;
+            }
+
+            merged->sum_ns += atomic_load_explicit(&(histogram->sum_ns), memory_order_relaxed);
+            if (max_ns > merged->max_ns)
+                merged->max_ns = max_ns;
+        }
+
+        if (merged->count == 0)
+            continue;
+
+        merged->mean_ns = merged->sum_ns / merged->count;
+        merged->p50_ns = metrics_percentile(buckets, merged->count, merged->max_ns, 0.50);
+        merged->p99_ns = metrics_percentile(buckets, merged->count, merged->max_ns, 0.99);
+        merged->p999_ns = metrics_percentile(buckets, merged->count, merged->max_ns, 0.999);
+    }
+
+    for (metrics_slot_t *slot = (metrics_slot_t *)threadslots_first(self->slots); slot != NULL; slot = (metrics_slot_t *)slot->slot.next_slot)
+    {
+        snapshot->datafile_reads += atomic_load_explicit(&(slot->datafile_reads), memory_order_relaxed);
+        snapshot->datafile_writes += atomic_load_explicit(&(slot->datafile_writes), memory_order_relaxed);
+        snapshot->datafile_bytes_read += atomic_load_explicit(&(slot->datafile_bytes_read), memory_order_relaxed);
+        snapshot->datafile_bytes_written += atomic_load_explicit(&(slot->datafile_bytes_written), memory_order_relaxed);
+        snapshot->active_connections += atomic_load_explicit(&(slot->connections_opened), memory_order_relaxed) -
+            atomic_load_explicit(&(slot->connections_closed), memory_order_relaxed);
+    }
+}
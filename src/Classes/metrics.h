@@ -0,0 +1,138 @@
+/*
+ * METRICS CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Command counters and latency histograms of the server, for watching it while it runs
+ *                Every thread records into a slot of its own, so recording takes no lock and no atomic
+ *                read-modify-write, and slots start on their own cache lines so threads never write to
+ *                the same line.  A snapshot merges the slots of every thread as it finds them.
+ *
+ *                Latencies go into log-linear buckets in the manner of an HDR histogram: each power of
+ *                two is split into METRICS_SUB_BUCKETS linear buckets, so a percentile read back is
+ *                within 1/METRICS_SUB_BUCKETS of the true value whatever its magnitude.
+ * Usage:       Instantiate with: metrics_t *mymetrics = new_metrics()
+ *              metrics_record(mymetrics, op_code, latency_ns); metrics_snapshot(mymetrics, &snapshot);
+ */
+#pragma once
+
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#define METRICS_OPCODES 16              // op codes are counted by their high nibble
+#define METRICS_SUB_BUCKET_BITS 5
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_MAX_BITS 36             // latencies up to 2^36 ns, about 68 seconds, longer ones count as that
+#define METRICS_BUCKETS ((METRICS_MAX_BITS - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS)
+#define METRICS_CACHE_LINE 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "datafile.h"
+#include "threadslots.h"
+
+// HISTOGRAM
+//   latencies of one op code on one thread
+typedef struct
+{
+    atomic_ulong count;
+    atomic_ulong sum_ns;
+    atomic_ulong max_ns;
+    atomic_ulong buckets[METRICS_BUCKETS];
+} metrics_histogram_t;
+
+// METRICS SLOT
+//   written only by the thread that owns it, with relaxed stores other threads can read at any time
+typedef struct
+{
+    _Alignas(METRICS_CACHE_LINE) threadslot_t slot;
+    atomic_long datafile_reads;
+    atomic_long datafile_writes;
+    atomic_long datafile_bytes_read;
+    atomic_long datafile_bytes_written;
+    atomic_long connections_opened;
+    atomic_long connections_closed;
+
+    datafile_io_t io_seen;              // the owner's datafile_thread_io when its I/O was last counted
+
+    metrics_histogram_t ops[METRICS_OPCODES];
+} metrics_slot_t;
+
+// SNAPSHOT
+//   every slot merged, latencies in ns
+typedef struct
+{
+    unsigned long count;
+    unsigned long sum_ns;
+    unsigned long mean_ns;
+    unsigned long p50_ns;
+    unsigned long p99_ns;
+    unsigned long p999_ns;
+    unsigned long max_ns;
+} metrics_op_t;
+
+typedef struct
+{
+    metrics_op_t ops[METRICS_OPCODES];  // by op code >> 4
+    long datafile_reads;                // files opened, see datafile_io_t
+    long datafile_writes;
+    long datafile_bytes_read;
+    long datafile_bytes_written;
+    long active_connections;
+} metrics_snapshot_t;
+
+// METRICS OBJECT
+typedef struct
+{
+    int gc_id;
+
+    threadslots_t *slots;               // of metrics_slot_t
+} metrics_t;
+
+// CONSTRUCTOR
+metrics_t *new_metrics();
+
+// DESTRUCTOR
+void metrics_destroy(void *);
+
+// METHODS
+
+// metrics_record()
+//   Counts a command and its latency on the calling thread's slot, along with the datafile I/O the
+//   thread has done since it last recorded
+void metrics_record(metrics_t *self, uint8_t op_code, uint64_t latency_ns);
+
+// metrics_record_io()
+//   Counts the datafile I/O the calling thread has done since it last recorded, for work that is not a command
+void metrics_record_io(metrics_t *self);
+
+// metrics_connection_opened()
+// metrics_connection_closed()
+//   Count connections, a connection may be closed on another thread than the one that opened it
+void metrics_connection_opened(metrics_t *self);
+void metrics_connection_closed(metrics_t *self);
+
+// metrics_snapshot()
+//   Merges every thread's slot into snapshot, while the threads carry on recording
+void metrics_snapshot(metrics_t *self, metrics_snapshot_t *snapshot);
+
+// metrics_bucket()
+//   Returns the histogram bucket of a latency
+int metrics_bucket(uint64_t latency_ns);
+
+// metrics_bucket_max()
+//   Returns the highest latency that falls in a bucket
+uint64_t metrics_bucket_max(int bucket);
+
+// metrics_percentile()
+//   Returns the latency that percentile (0.99 for the 99th) of count latencies in buckets fall under, never above max_ns
+unsigned long metrics_percentile(const unsigned long *buckets, unsigned long count, unsigned long max_ns, double percentile);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * OBJECT POOL CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "objectpool.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+void *_objectpool_make(objectpool_t *self);
+void _objectpool_track(objectpool_t *self, void *object);
+
+// CONSTRUCTOR
+objectpool_t *new_objectpool(size_t object_size, int prefill, void (*init)(void *), void (*reset)(void *))
+{
+    objectpool_t *self = calloc(1, sizeof(objectpool_t));
+
+    if (self == NULL)
+        exit_error("Object pool memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, objectpool_destroy);
+
+    self->object_size = object_size;
+    self->init = init;
+    self->reset = reset;
+    pthread_mutex_init(&(self->pool_lock), NULL);
+
+    for (int i=0; i<prefill; i++)
+    {
+        void *object = _objectpool_make(self);
+
+        pthread_mutex_lock(&(self->pool_lock));
+        _objectpool_track(self, object);
+        self->free_objects[self->num_free++] = object;
+        pthread_mutex_unlock(&(self->pool_lock));
+    }
+
+    return self;
+}
+
+// DESTRUCTOR
+void objectpool_destroy(void *s)
+{
+    objectpool_t *self = (objectpool_t *)s;
+
+    for (int i=0; i<self->num_objects; i++)
+        free(self->objects[i]);
+
+    free(self->objects);
+    free(self->free_objects);
+    pthread_mutex_destroy(&(self->pool_lock));
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: builds a new object
+// Notes:       called without pool_lock, init may take a while
+void *_objectpool_make(objectpool_t *self)
+{
+    void *object = calloc(1, self->object_size);
+
+    if (object == NULL)
+        exit_error("Object pool memory allocation failed");
+
+    if (self->init != NULL)
+        self->init(object);
+
+    return object;
+}
+
+// Description: adds a new object to the list of everything the pool has made, growing the lists if they are full
+// Notes:       pool_lock must be held
+void _objectpool_track(objectpool_t *self, void *object)
+{
+    if (self->num_objects == self->max_objects)
+    {
+        int max_objects = self->max_objects > 0 ? self->max_objects * 2 : OBJECTPOOL_INITIAL_LEN;
+        void **objects = realloc(self->objects, max_objects * sizeof(void *));
+        void **free_objects = realloc(self->free_objects, max_objects * sizeof(void *));
+
+        if (objects == NULL || free_objects == NULL)
+            exit_error("Object pool memory allocation failed");
+
+        self->objects = objects;
+        self->free_objects = free_objects;
+        self->max_objects = max_objects;
+    }
+
+    self->objects[self->num_objects++] = object;
+}
+
+// METHODS
+
+/////
+void *objectpool_take(objectpool_t *self)
+{
+    void *object = NULL;
+
+    atomic_fetch_add(&(self->num_taken), 1);
+
+    pthread_mutex_lock(&(self->pool_lock));
+    if (self->num_free > 0)
+        object = self->free_objects[--self->num_free];
+    pthread_mutex_unlock(&(self->pool_lock));
+
+    if (object != NULL)
+    {
+        atomic_fetch_add(&(self->num_reused), 1);
+        return object;
+    }
+
+    object = _objectpool_make(self);
+
+    pthread_mutex_lock(&(self->pool_lock));
+    _objectpool_track(self, object);
+    pthread_mutex_unlock(&(self->pool_lock));
+
+    return object;
+}
+
+/////
+void objectpool_give(objectpool_t *self, void *object)
+{
+    if (object == NULL)
+        return;
+
+    if (self->reset != NULL)
+        self->reset(object);
+
+    // there is a free slot for every object the pool made, so this never overflows
+    pthread_mutex_lock(&(self->pool_lock));
+    self->free_objects[self->num_free++] = object;
+    pthread_mutex_unlock(&(self->pool_lock));
+}
+
+/////
+void objectpool_print_stats(objectpool_t *self, const char *name)
+{
+    objectpool_write_stats(self, name, stdout);
+}
+
+/////
+void objectpool_write_stats(objectpool_t *self, const char *name, FILE *out)
+{
+    long taken = atomic_load(&(self->num_taken));
+    long reused = atomic_load(&(self->num_reused));
+
+    pthread_mutex_lock(&(self->pool_lock));
+    int num_objects = self->num_objects;
+    int num_free = self->num_free;
+    pthread_mutex_unlock(&(self->pool_lock));
+
+    fprintf(out, "%s pool: %d objects, %d in use, %ld taken, %ld reused (%.1f%%)\n",
+        name, num_objects, num_objects - num_free, taken, reused, taken > 0 ? 100.0 * reused / taken : 0.0);
+}
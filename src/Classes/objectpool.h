@@ -0,0 +1,79 @@
+/*
+ * OBJECT POOL CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Preallocated objects that are handed out and taken back instead of being created and freed
+ *                Every object is built once by the init callback, and put back into a clean state by
+ *                the reset callback each time it is given back.  The pool only grows when all of its
+ *                objects are taken, so the memory it holds is bounded by the most objects ever in use at
+ *                once rather than by how many were ever asked for.
+ *
+ *                The pool frees the objects themselves when it is destroyed.  Anything an object's init
+ *                created with a constructor of its own is registered with the garbage collector and is
+ *                cleaned up by it, so there is no per object destructor.
+ * Usage:       Instantiate with: objectpool_t *mypool = new_objectpool(sizeof(thing_t), prefill, init, reset)
+ */
+#pragma once
+
+#ifndef OBJECTPOOL_H_INCLUDED
+#define OBJECTPOOL_H_INCLUDED
+
+#define OBJECTPOOL_INITIAL_LEN 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+
+// OBJECTPOOL OBJECT
+typedef struct
+{
+    int gc_id;
+
+    size_t object_size;
+    void (*init)(void *);           // builds a new zeroed object, may be NULL
+    void (*reset)(void *);          // cleans up an object that was given back, may be NULL
+
+    // everything below is guarded by pool_lock
+    pthread_mutex_t pool_lock;
+    void **objects;                 // every object the pool has made
+    void **free_objects;            // the ones waiting to be taken, a stack so the warmest goes out first
+    int num_objects;
+    int num_free;
+    int max_objects;                // length of both arrays
+
+    atomic_long num_taken;
+    atomic_long num_reused;         // takes that didn't have to make a new object
+} objectpool_t;
+
+// CONSTRUCTOR
+//   makes prefill objects up front
+objectpool_t *new_objectpool(size_t object_size, int prefill, void (*init)(void *), void (*reset)(void *));
+
+// DESTRUCTOR
+//   frees every object, taken or not
+void objectpool_destroy(void *);
+
+// METHODS
+
+// objectpool_take()
+//   Returns a free object, making a new one if there are none
+void *objectpool_take(objectpool_t *self);
+
+// objectpool_give()
+//   Resets an object from objectpool_take() and puts it back in the pool
+void objectpool_give(objectpool_t *self, void *object);
+
+// objectpool_print_stats()
+//   Prints how many objects the pool holds and how often they were reused
+void objectpool_print_stats(objectpool_t *self, const char *name);
+
+// objectpool_write_stats()
+//   As objectpool_print_stats(), writing to out
+void objectpool_write_stats(objectpool_t *self, const char *name, FILE *out);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * OUTBUFFER CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "outbuffer.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+outbuffer_segment_t *_outbuffer_new_segment(outbuffer_t *self);
+void _outbuffer_free_segment(outbuffer_segment_t *segment);
+
+// CONSTRUCTOR
+outbuffer_t *new_outbuffer()
+{
+    outbuffer_t *self = calloc(1, sizeof(outbuffer_t));
+
+    if (self == NULL)
+        exit_error("Outbuffer memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, outbuffer_destroy);
+
+    return self;
+}
+
+// DESTRUCTOR
+void outbuffer_destroy(void *s)
+{
+    outbuffer_t *self = (outbuffer_t *)s;
+
+    outbuffer_segment_t *segment = self->head;
+    while (segment != NULL)
+    {
+        outbuffer_segment_t *next = segment->next;
+        _outbuffer_free_segment(segment);
+        segment = next;
+    }
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: adds an empty segment to the end of the queue
+outbuffer_segment_t *_outbuffer_new_segment(outbuffer_t *self)
+{
+    outbuffer_segment_t *segment = calloc(1, sizeof(outbuffer_segment_t));
+
+    if (segment == NULL)
+        exit_error("Outbuffer memory allocation failed");
+
+    if (self->tail == NULL)
+        self->head = segment;
+    else
+        self->tail->next = segment;
+    self->tail = segment;
+
+    return segment;
+}
+
+/////
+void _outbuffer_free_segment(outbuffer_segment_t *segment)
+{
+    if (segment->fp != NULL)
+        fclose(segment->fp);
+
+    free(segment->data);
+    free(segment);
+}
+
+// METHODS
+
+/////
+void outbuffer_append(outbuffer_t *self, const char *data, size_t len)
+{
+    if (len == 0)
+        return;
+
+    // coalesce onto the last segment unless it is a file
+    outbuffer_segment_t *segment = self->tail;
+
+    if (segment == NULL || segment->fp != NULL)
+        segment = _outbuffer_new_segment(self);
+
+    if (segment->len + len > segment->capacity)
+    {
+        size_t capacity = segment->capacity ? segment->capacity : OUTBUFFER_INITIAL_LEN;
+
+        while (capacity < segment->len + len)
+            capacity *= 2;
+
+        segment->data = realloc(segment->data, capacity);
+
+        if (segment->data == NULL)
+            exit_error("Outbuffer memory allocation failed");
+
+        segment->capacity = capacity;
+    }
+
+    memcpy(segment->data + segment->len, data, len);
+    segment->len += len;
+    self->pending += len;
+}
+
+/////
+void outbuffer_append_file(outbuffer_t *self, FILE *fp, off_t offset, size_t len)
+{
+    // sendfile reads the file itself, so anything stdio still holds has to reach it first
+    fflush(fp);
+
+    outbuffer_segment_t *segment = _outbuffer_new_segment(self);
+
+    segment->fp = fp;
+    segment->offset = offset;
+    segment->len = len;
+    self->pending += len;
+}
+
+/////
+int outbuffer_flush(outbuffer_t *self, int socket)
+{
+    while (self->head != NULL)
+    {
+        outbuffer_segment_t *segment = self->head;
+        size_t remaining = segment->len - segment->sent;
+        ssize_t sent = 0;
+
+        if (remaining > 0)
+        {
+            if (segment->fp != NULL)
+                sent = sendfile(socket, fileno(segment->fp), &(segment->offset), remaining);
+            else
+                sent = send(socket, segment->data + segment->sent, remaining, MSG_NOSIGNAL);
+
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return OUTBUFFER_PENDING;
+                return OUTBUFFER_ERROR;
+            }
+
+            // a file that came up short can never be finished
+            if (sent == 0)
+                return OUTBUFFER_ERROR;
+
+            segment->sent += (size_t)sent;
+            self->pending -= (size_t)sent;
+        }
+
+        if (segment->sent < segment->len)
+            continue;
+
+        // the last memory segment is kept for reuse, unless a large payload grew it
+        if (segment->next == NULL && segment->fp == NULL && segment->capacity <= OUTBUFFER_KEEP_LEN)
+        {
+            segment->len = segment->sent = 0;
+            return OUTBUFFER_FLUSHED;
+        }
+
+        self->head = segment->next;
+        if (self->head == NULL)
+            self->tail = NULL;
+
+        _outbuffer_free_segment(segment);
+    }
+
+    return OUTBUFFER_FLUSHED;
+}
+
+/////
+void outbuffer_clear(outbuffer_t *self)
+{
+    outbuffer_segment_t *keep = NULL;
+    outbuffer_segment_t *segment = self->head;
+
+    // like a flush, one small memory segment is kept for the next owner
+    while (segment != NULL)
+    {
+        outbuffer_segment_t *next = segment->next;
+
+        if (keep == NULL && segment->fp == NULL && segment->capacity <= OUTBUFFER_KEEP_LEN)
+            keep = segment;
+        else
+            _outbuffer_free_segment(segment);
+
+        segment = next;
+    }
+
+    if (keep != NULL)
+    {
+        keep->len = keep->sent = 0;
+        keep->next = NULL;
+    }
+
+    self->head = self->tail = keep;
+    self->pending = 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * OUTBUFFER CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Per-connection queue of output waiting for a non-blocking socket
+ *                Small writes are coalesced into a single memory segment, files are queued as segments
+ *                which are sent with sendfile.  Flushing writes as much as the socket takes without
+ *                blocking and keeps the rest, so partial writes and EAGAIN are never lost.
+ * Usage:       Instantiate with: outbuffer_t *myout = new_outbuffer()
+ */
+#pragma once
+
+#ifndef OUTBUFFER_H_INCLUDED
+#define OUTBUFFER_H_INCLUDED
+
+#define OUTBUFFER_INITIAL_LEN 1024
+#define OUTBUFFER_KEEP_LEN 16384        // largest idle segment kept between replies
+
+// outbuffer_flush() results
+#define OUTBUFFER_FLUSHED 1
+#define OUTBUFFER_PENDING 0
+#define OUTBUFFER_ERROR -1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+
+// OUTBUFFER SEGMENT
+//   memory segments own their data, file segments own their FILE and close it once sent
+typedef struct outbuffer_segment
+{
+    char *data;
+    size_t capacity;
+    FILE *fp;
+    off_t offset;               // next byte of fp to send
+    size_t len;                 // bytes queued, including the ones already sent
+    size_t sent;
+    struct outbuffer_segment *next;
+} outbuffer_segment_t;
+
+// OUTBUFFER OBJECT
+typedef struct
+{
+    int gc_id;
+    outbuffer_segment_t *head;
+    outbuffer_segment_t *tail;
+    size_t pending;             // bytes queued and not yet sent
+} outbuffer_t;
+
+// CONSTRUCTOR
+outbuffer_t *new_outbuffer();
+
+// DESTRUCTOR
+//   closes any files still queued
+void outbuffer_destroy(void *);
+
+// METHODS
+
+// outbuffer_append()
+//   Copies len bytes of data onto the end of the queue
+void outbuffer_append(outbuffer_t *self, const char *data, size_t len);
+
+// outbuffer_append_file()
+//   Queues len bytes of fp starting at offset, the buffer takes ownership of fp
+void outbuffer_append_file(outbuffer_t *self, FILE *fp, off_t offset, size_t len);
+
+// outbuffer_flush()
+//   Writes as much as the non-blocking socket accepts
+//   Returns OUTBUFFER_FLUSHED when empty, OUTBUFFER_PENDING when the socket is full, OUTBUFFER_ERROR if it failed
+int outbuffer_flush(outbuffer_t *self, int socket);
+
+// outbuffer_clear()
+//   Drops everything still queued and closes any queued files, for a buffer about to be reused
+void outbuffer_clear(outbuffer_t *self);
+
+#endif
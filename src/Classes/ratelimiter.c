@@ -0,0 +1,210 @@
+/*
+ * RATE LIMITER CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "ratelimiter.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+void _ratelimiter_table_rate(ratelimiter_table_t *table, int rate);
+uint64_t _ratelimiter_now_ns();
+unsigned int _ratelimiter_chain(uint32_t key);
+ratelimiter_bucket_t *_ratelimiter_lock_bucket(ratelimiter_table_t *table, uint32_t key, uint64_t now);
+void _ratelimiter_unlock_bucket(ratelimiter_table_t *table, uint32_t key);
+double _ratelimiter_wait(ratelimiter_table_t *table, ratelimiter_bucket_t *bucket, double cost);
+
+// CONSTRUCTOR
+ratelimiter_t *new_ratelimiter()
+{
+    ratelimiter_t *self = calloc(1, sizeof(ratelimiter_t));
+
+    if (self == NULL)
+        exit_error("Rate limiter memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, ratelimiter_destroy);
+
+    for (int i=0; i<RATELIMITER_LOCKS; i++)
+    {
+        pthread_mutex_init(&(self->users.locks[i]), NULL);
+        pthread_mutex_init(&(self->addresses.locks[i]), NULL);
+    }
+
+    ratelimiter_set_rates(self, RATELIMITER_USER_RATE, RATELIMITER_IP_RATE);
+
+    return self;
+}
+
+// DESTRUCTOR
+void ratelimiter_destroy(void *s)
+{
+    ratelimiter_t *self = (ratelimiter_t *)s;
+    ratelimiter_table_t *tables[] = { &(self->users), &(self->addresses) };
+
+    for (int t=0; t<2; t++)
+    {
+        for (int i=0; i<RATELIMITER_BUCKETS; i++)
+        {
+            while (tables[t]->chains[i] != NULL)
+            {
+                ratelimiter_bucket_t *next = tables[t]->chains[i]->next;
+                free(tables[t]->chains[i]);
+                tables[t]->chains[i] = next;
+            }
+        }
+
+        for (int i=0; i<RATELIMITER_LOCKS; i++)
+            pthread_mutex_destroy(&(tables[t]->locks[i]));
+    }
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: sets a table's rate, holding every lock so no bucket is refilled meanwhile
+void _ratelimiter_table_rate(ratelimiter_table_t *table, int rate)
+{
+    for (int i=0; i<RATELIMITER_LOCKS; i++)
+        pthread_mutex_lock(&(table->locks[i]));
+
+    table->rate = rate > 0 ? rate : 0;
+    table->burst = table->rate * RATELIMITER_BURST_SECONDS;
+
+    for (int i=RATELIMITER_LOCKS-1; i>=0; i--)
+        pthread_mutex_unlock(&(table->locks[i]));
+}
+
+/////
+uint64_t _ratelimiter_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Description: spreads sequential keys, such as user ids, over the chains
+unsigned int _ratelimiter_chain(uint32_t key)
+{
+    return (key * 2654435761u) % RATELIMITER_BUCKETS;
+}
+
+// Description: locks the chain of key and returns its bucket refilled to now, creating a full one if needed
+//              buckets met on the way that have refilled completely are freed, a full bucket is
+//              no different from a missing one
+// Notes:       the chain stays locked until _ratelimiter_unlock_bucket(), even if NULL is returned
+ratelimiter_bucket_t *_ratelimiter_lock_bucket(ratelimiter_table_t *table, uint32_t key, uint64_t now)
+{
+    unsigned int chain = _ratelimiter_chain(key);
+    pthread_mutex_lock(&(table->locks[chain % RATELIMITER_LOCKS]));
+
+    ratelimiter_bucket_t **link = &(table->chains[chain]);
+    ratelimiter_bucket_t *found = NULL;
+
+    while (*link != NULL)
+    {
+        ratelimiter_bucket_t *bucket = *link;
+
+        double refill = (double)(now - bucket->updated_ns) / 1000000000.0 * table->rate;
+        bucket->tokens = bucket->tokens + refill < table->burst ? bucket->tokens + refill : table->burst;
+        bucket->updated_ns = now;
+
+        if (bucket->key == key)
+            found = bucket;
+        else if (bucket->tokens >= table->burst)
+        {
+            *link = bucket->next;
+            free(bucket);
+            continue;
+        }
+
+        link = &(bucket->next);
+    }
+
+    if (found == NULL && (found = calloc(1, sizeof(ratelimiter_bucket_t))) != NULL)
+    {
+        found->key = key;
+        found->tokens = table->burst;
+        found->updated_ns = now;
+        found->next = table->chains[chain];
+        table->chains[chain] = found;
+    }
+
+    return found;
+}
+
+/////
+void _ratelimiter_unlock_bucket(ratelimiter_table_t *table, uint32_t key)
+{
+    pthread_mutex_unlock(&(table->locks[_ratelimiter_chain(key) % RATELIMITER_LOCKS]));
+}
+
+// Description: returns the seconds until bucket holds cost tokens, 0 if it already does
+double _ratelimiter_wait(ratelimiter_table_t *table, ratelimiter_bucket_t *bucket, double cost)
+{
+    if (bucket == NULL || bucket->tokens >= cost)
+        return 0;
+
+    return (cost - bucket->tokens) / table->rate;
+}
+
+// METHODS
+
+/////
+void ratelimiter_set_rates(ratelimiter_t *self, int user_rate, int ip_rate)
+{
+    _ratelimiter_table_rate(&(self->users), user_rate);
+    _ratelimiter_table_rate(&(self->addresses), ip_rate);
+}
+
+/////
+uint32_t ratelimiter_take(ratelimiter_t *self, int user_id, in_addr_t addr, int cost)
+{
+    uint64_t now = _ratelimiter_now_ns();
+    uint32_t user_key = (uint32_t)user_id;
+    uint32_t addr_key = ntohl(addr);
+
+    // rates only change at startup, so they can be checked before taking any lock
+    bool by_user = user_id >= 0 && self->users.rate > 0;
+    bool by_addr = self->addresses.rate > 0;
+
+    // always user then address, so two requests never wait on each other's locks
+    ratelimiter_bucket_t *user = by_user ? _ratelimiter_lock_bucket(&(self->users), user_key, now) : NULL;
+    ratelimiter_bucket_t *address = by_addr ? _ratelimiter_lock_bucket(&(self->addresses), addr_key, now) : NULL;
+
+    // a request costing more than the burst goes ahead once the bucket is full, and empties it
+    double user_cost = user != NULL && cost > self->users.burst ? self->users.burst : cost;
+    double addr_cost = address != NULL && cost > self->addresses.burst ? self->addresses.burst : cost;
+
+    double user_wait = _ratelimiter_wait(&(self->users), user, user_cost);
+    double addr_wait = _ratelimiter_wait(&(self->addresses), address, addr_cost);
+
+    if (user_wait == 0 && addr_wait == 0)
+    {
+        if (user != NULL)
+            user->tokens -= user_cost;
+        if (address != NULL)
+            address->tokens -= addr_cost;
+    }
+
+    if (by_addr)
+        _ratelimiter_unlock_bucket(&(self->addresses), addr_key);
+    if (by_user)
+        _ratelimiter_unlock_bucket(&(self->users), user_key);
+
+    if (user_wait == 0 && addr_wait == 0)
+    {
+        atomic_fetch_add(&(self->num_allowed), 1);
+        return 0;
+    }
+
+    atomic_fetch_add(user_wait > 0 ? &(self->users.num_throttled) : &(self->addresses.num_throttled), 1);
+
+    double wait = user_wait > addr_wait ? user_wait : addr_wait;
+    return (uint32_t)(wait * 1000) + 1;
+}
@@ -0,0 +1,84 @@
+/*
+ * RATE LIMITER CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Token buckets per authenticated user and per client address
+ *                Every request takes tokens from both buckets, buckets refill at a steady rate up to a
+ *                burst of RATELIMITER_BURST_SECONDS worth of tokens.  Buckets that have refilled are
+ *                dropped as their hash chain is walked, so only recently busy clients take up memory.
+ * Usage:       Instantiate with: ratelimiter_t *mylimiter = new_ratelimiter()
+ */
+#pragma once
+
+#ifndef RATELIMITER_H_INCLUDED
+#define RATELIMITER_H_INCLUDED
+
+// default refill rates in tokens per second, a rate of 0 turns that limit off
+#define RATELIMITER_USER_RATE 1000
+#define RATELIMITER_IP_RATE 4000
+#define RATELIMITER_BURST_SECONDS 2
+
+#define RATELIMITER_BUCKETS 1024
+#define RATELIMITER_LOCKS 64                // hash chains share this many locks
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+
+// RATELIMITER BUCKET
+typedef struct ratelimiter_bucket
+{
+    uint32_t key;
+    double tokens;
+    uint64_t updated_ns;                // monotonic time tokens was last refilled
+    struct ratelimiter_bucket *next;
+} ratelimiter_bucket_t;
+
+// RATELIMITER TABLE
+//   the buckets of one kind of client, users or addresses
+typedef struct
+{
+    double rate;
+    double burst;
+    ratelimiter_bucket_t *chains[RATELIMITER_BUCKETS];
+    pthread_mutex_t locks[RATELIMITER_LOCKS];
+    atomic_long num_throttled;
+} ratelimiter_table_t;
+
+// RATELIMITER OBJECT
+typedef struct
+{
+    int gc_id;
+    ratelimiter_table_t users;
+    ratelimiter_table_t addresses;
+    atomic_long num_allowed;
+} ratelimiter_t;
+
+// CONSTRUCTOR
+ratelimiter_t *new_ratelimiter();
+
+// DESTRUCTOR
+void ratelimiter_destroy(void *);
+
+// METHODS
+
+// ratelimiter_set_rates()
+//   Sets the refill rates in tokens per second, 0 turns a limit off
+//   Meant for startup, buckets already in use keep their tokens
+void ratelimiter_set_rates(ratelimiter_t *self, int user_rate, int ip_rate);
+
+// ratelimiter_take()
+//   Takes cost tokens from the bucket of user_id and of addr, a user_id below 0 only charges the address
+//   Nothing is taken unless both buckets can pay
+//   Returns 0 if the request may go ahead, otherwise the ms until it could
+uint32_t ratelimiter_take(ratelimiter_t *self, int user_id, in_addr_t addr, int cost);
+
+#endif
@@ -0,0 +1,486 @@
+/*
+ * REPORT DELIVERY CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "reportdelivery.h"
+#include "catalog_protocol.h"
+
+extern garbagecollector_t *global_gc;
+extern threadcontroller_t *global_tc;
+extern devlog_t *global_dl;
+
+// delivery attempt results
+#define _REPORTDELIVERY_DONE 0
+#define _REPORTDELIVERY_RETRY 1
+#define _REPORTDELIVERY_PENDING 2
+
+// delivery attempt states
+#define _REPORTDELIVERY_CONNECTING 0
+#define _REPORTDELIVERY_SENDING 1
+#define _REPORTDELIVERY_ACK 2
+
+// HELPERS
+void *_reportdelivery_thread(void *args);
+void _reportdelivery_poll(reportdelivery_t *self, reportdelivery_item_t **active, int *num_active);
+reportdelivery_item_t *_reportdelivery_next(reportdelivery_t *self, long *wait_ms);
+bool _reportdelivery_any_due(reportdelivery_t *self);
+void _reportdelivery_queue(reportdelivery_t *self, reportdelivery_item_t *item);
+void _reportdelivery_wake(reportdelivery_t *self);
+bool _reportdelivery_start(reportdelivery_item_t *item);
+int _reportdelivery_step(reportdelivery_item_t *item);
+int _reportdelivery_send(reportdelivery_item_t *item);
+int _reportdelivery_ack(reportdelivery_item_t *item);
+void _reportdelivery_finish(reportdelivery_t *self, reportdelivery_item_t *item, int result);
+void _reportdelivery_deadline(struct timespec *ts, long ms);
+long _reportdelivery_ms_until(const struct timespec *ts);
+
+// CONSTRUCTOR
+reportdelivery_t *new_reportdelivery(int num_threads)
+{
+    reportdelivery_t *self = calloc(1, sizeof(reportdelivery_t));
+
+    if (self == NULL)
+        exit_error("Report delivery memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, reportdelivery_destroy);
+
+    pthread_mutex_init(&(self->queue_lock), NULL);
+
+    self->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (self->wake_fd < 0)
+        exit_error("Could not create report delivery eventfd");
+
+    if (num_threads <= 0)
+        num_threads = REPORTDELIVERY_THREADS;
+
+    for (int i=0; i<num_threads; i++)
+    {
+        threadarguments_t *thread_args = new_threadarguments();
+        thread_args->arg2 = (void *)self;
+
+        if (thread_create(global_tc, _reportdelivery_thread, thread_args) < 0)
+            exit_error("Could not start report delivery thread");
+    }
+
+    return self;
+}
+
+// DESTRUCTOR
+void reportdelivery_destroy(void *s)
+{
+    reportdelivery_t *self = (reportdelivery_t *)s;
+
+    pthread_mutex_lock(&(self->queue_lock));
+
+    // anything still queued is abandoned
+    reportdelivery_item_t *item = self->head;
+    while (item != NULL)
+    {
+        reportdelivery_item_t *next = item->next;
+        fclose(item->report);
+        free(item);
+        item = next;
+    }
+
+    pthread_mutex_unlock(&(self->queue_lock));
+
+    close(self->wake_fd);
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: delivers queued reports until shutdown, the deliveries in flight may finish while draining
+// Notes:       this is a threaded function
+// Arguments:   arg1: thread_id
+//              arg2: self
+void *_reportdelivery_thread(void *args)
+{
+    threadarguments_t *thread_args = (threadarguments_t *)args;
+    reportdelivery_t *self = (reportdelivery_t *)(thread_args->arg2);
+
+    reportdelivery_item_t *active = NULL;
+    int num_active = 0;
+
+    while (threadcontroller_running(global_tc) || (active != NULL && threadcontroller_draining(global_tc)))
+        _reportdelivery_poll(self, &active, &num_active);
+
+    // the drain window closed on these
+    while (active != NULL)
+    {
+        reportdelivery_item_t *next = active->next;
+        close(active->socket);
+        fclose(active->report);
+        free(active);
+        active = next;
+    }
+
+    return NULL;
+}
+
+// Description: starts the deliveries that are due, waits on every delivery in flight, the queue and shutdown
+//              at once, then moves each delivery whose socket is ready on as far as it will go
+// Notes:       active is this thread's list of deliveries in flight
+void _reportdelivery_poll(reportdelivery_t *self, reportdelivery_item_t **active, int *num_active)
+{
+    struct pollfd pfds[REPORTDELIVERY_MAX_ACTIVE + 2];
+    reportdelivery_item_t *items[REPORTDELIVERY_MAX_ACTIVE];
+    bool running = threadcontroller_running(global_tc);
+    long timeout_ms = -1;
+    int num_items = 0;
+
+    // nothing new is started once shutting down
+    if (running)
+    {
+        reportdelivery_item_t *item;
+
+        while (*num_active < REPORTDELIVERY_MAX_ACTIVE && (item = _reportdelivery_next(self, &timeout_ms)) != NULL)
+        {
+            item->attempts++;
+
+            if (!_reportdelivery_start(item))
+            {
+                _reportdelivery_finish(self, item, _REPORTDELIVERY_RETRY);
+                continue;
+            }
+
+            item->next = *active;
+            *active = item;
+            (*num_active)++;
+        }
+
+        // this thread is full, whatever else is due goes to another one
+        if (*num_active == REPORTDELIVERY_MAX_ACTIVE && _reportdelivery_any_due(self))
+            _reportdelivery_wake(self);
+    }
+
+    for (reportdelivery_item_t *item = *active; item != NULL; item = item->next)
+    {
+        long until = _reportdelivery_ms_until(&(item->deadline));
+
+        if (until < 0)
+            until = 0;
+        if (timeout_ms < 0 || until < timeout_ms)
+            timeout_ms = until;
+
+        pfds[num_items] = (struct pollfd){ item->socket, item->state == _REPORTDELIVERY_ACK ? POLLIN : POLLOUT, 0 };
+        items[num_items++] = item;
+    }
+
+    int num_fds = num_items;
+    int wake_index = -1;
+
+    // the shutdown eventfd stays readable, so while draining only the deliveries are watched
+    if (running)
+    {
+        pfds[num_fds++] = (struct pollfd){ global_tc->shutdown_fd, POLLIN, 0 };
+
+        if (*num_active < REPORTDELIVERY_MAX_ACTIVE)
+        {
+            wake_index = num_fds;
+            pfds[num_fds++] = (struct pollfd){ self->wake_fd, POLLIN, 0 };
+        }
+    }
+    else if (timeout_ms < 0 || timeout_ms > REPORTDELIVERY_WAIT_MS)
+        timeout_ms = REPORTDELIVERY_WAIT_MS;
+
+    int rc = poll(pfds, num_fds, (int)timeout_ms);
+
+    if (rc > 0 && wake_index >= 0 && pfds[wake_index].revents != 0)
+    {
+        uint64_t count;
+        if (read(self->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            devlog_write(global_dl, DEVLOG_WARN, "Could not read report delivery eventfd");
+    }
+
+    for (int i=0; i<num_items; i++)
+    {
+        reportdelivery_item_t *item = items[i];
+        int result = _REPORTDELIVERY_PENDING;
+
+        if (rc > 0 && pfds[i].revents != 0)
+            result = _reportdelivery_step(item);
+
+        // a listener that has not acked by the deadline has still been sent the whole report
+        if (result == _REPORTDELIVERY_PENDING && _reportdelivery_ms_until(&(item->deadline)) <= 0)
+            result = item->state == _REPORTDELIVERY_ACK ? _REPORTDELIVERY_DONE : _REPORTDELIVERY_RETRY;
+
+        if (result == _REPORTDELIVERY_PENDING)
+            continue;
+
+        for (reportdelivery_item_t **link = active; *link != NULL; link = &((*link)->next))
+        {
+            if (*link == item)
+            {
+                *link = item->next;
+                break;
+            }
+        }
+
+        (*num_active)--;
+        _reportdelivery_finish(self, item, result);
+    }
+}
+
+// Description: takes the first delivery that is due, or returns NULL with wait_ms set to the time until the
+//              next one is due, -1 for an empty queue
+reportdelivery_item_t *_reportdelivery_next(reportdelivery_t *self, long *wait_ms)
+{
+    pthread_mutex_lock(&(self->queue_lock));
+
+    reportdelivery_item_t *prev = NULL;
+    *wait_ms = -1;
+
+    for (reportdelivery_item_t *item = self->head; item != NULL; prev = item, item = item->next)
+    {
+        long until = _reportdelivery_ms_until(&(item->not_before));
+
+        if (until <= 0)
+        {
+            if (prev == NULL)
+                self->head = item->next;
+            else
+                prev->next = item->next;
+            if (self->tail == item)
+                self->tail = prev;
+
+            pthread_mutex_unlock(&(self->queue_lock));
+
+            item->next = NULL;
+            *wait_ms = -1;
+            return item;
+        }
+
+        if (*wait_ms < 0 || until < *wait_ms)
+            *wait_ms = until;
+    }
+
+    pthread_mutex_unlock(&(self->queue_lock));
+
+    return NULL;
+}
+
+// Description: returns true if a queued delivery is due
+bool _reportdelivery_any_due(reportdelivery_t *self)
+{
+    bool due = false;
+
+    pthread_mutex_lock(&(self->queue_lock));
+
+    for (reportdelivery_item_t *item = self->head; item != NULL && !due; item = item->next)
+        due = _reportdelivery_ms_until(&(item->not_before)) <= 0;
+
+    pthread_mutex_unlock(&(self->queue_lock));
+
+    return due;
+}
+
+// Description: appends a delivery to the queue and wakes the delivery threads
+void _reportdelivery_queue(reportdelivery_t *self, reportdelivery_item_t *item)
+{
+    pthread_mutex_lock(&(self->queue_lock));
+
+    item->next = NULL;
+
+    if (self->tail == NULL)
+        self->head = item;
+    else
+        self->tail->next = item;
+    self->tail = item;
+
+    pthread_mutex_unlock(&(self->queue_lock));
+
+    _reportdelivery_wake(self);
+}
+
+// Description: makes the eventfd readable, every delivery thread with room for more looks at the queue
+void _reportdelivery_wake(reportdelivery_t *self)
+{
+    uint64_t one = 1;
+
+    if (write(self->wake_fd, &one, sizeof(one)) != sizeof(one))
+        devlog_write(global_dl, DEVLOG_WARN, "Could not signal report delivery eventfd");
+}
+
+// Description: opens the socket of a new attempt and connects without blocking, the attempt gets
+//              REPORTDELIVERY_TIMEOUT_MS from here to connect, send the report and read the ack
+//              returns false if the attempt failed straight away
+bool _reportdelivery_start(reportdelivery_item_t *item)
+{
+    _reportdelivery_deadline(&(item->deadline), REPORTDELIVERY_TIMEOUT_MS);
+    item->state = _REPORTDELIVERY_CONNECTING;
+    item->offset = 0;
+    item->socket = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (item->socket == -1)
+        return false;
+
+    if (fcntl(item->socket, F_SETFL, fcntl(item->socket, F_GETFL) | O_NONBLOCK) < 0)
+        return false;
+
+    // the result shows up as writability and SO_ERROR, even if it connected straight away
+    return connect(item->socket, (struct sockaddr *)&(item->listener), sizeof(struct sockaddr_in)) == 0 || errno == EINPROGRESS;
+}
+
+// Description: moves a delivery on once its socket is ready
+//              returns _REPORTDELIVERY_PENDING until the attempt is over
+int _reportdelivery_step(reportdelivery_item_t *item)
+{
+    if (item->state == _REPORTDELIVERY_CONNECTING)
+    {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+
+        if (getsockopt(item->socket, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 || error != 0)
+            return _REPORTDELIVERY_RETRY;
+
+        devlog_write(global_dl, DEVLOG_INFO, "[CID: %u]   Report generated, sending to listener...", item->conn_id);
+
+        item->state = _REPORTDELIVERY_SENDING;
+    }
+
+    if (item->state == _REPORTDELIVERY_SENDING)
+        return _reportdelivery_send(item);
+
+    return _reportdelivery_ack(item);
+}
+
+// Description: sends as much of the report as the socket takes, straight from the file
+int _reportdelivery_send(reportdelivery_item_t *item)
+{
+    int fd = fileno(item->report);
+
+    while (item->offset < item->report_len)
+    {
+        ssize_t sent = sendfile(item->socket, fd, &(item->offset), (size_t)(item->report_len - item->offset));
+
+        if (sent > 0 || (sent < 0 && errno == EINTR))
+            continue;
+
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return _REPORTDELIVERY_PENDING;
+
+        return _REPORTDELIVERY_RETRY;
+    }
+
+    item->state = _REPORTDELIVERY_ACK;
+
+    return _REPORTDELIVERY_PENDING;
+}
+
+// Description: reads the listener's ack and answers it
+//              once the listener has acked, or hung up, there is nothing left to retry
+int _reportdelivery_ack(reportdelivery_item_t *item)
+{
+    char buffer[CATALOG_CMD_MAXLEN] = {0};
+    int status = CATALOG_STATUS_ERROR;
+    ssize_t bytes_received = recv(item->socket, buffer, CATALOG_CMD_MAXLEN, 0);
+
+    if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return _REPORTDELIVERY_PENDING;
+
+    if (bytes_received > 0)
+    {
+        uint32_t received_file_size = 0;
+        memcpy(&received_file_size, buffer, sizeof(uint32_t));
+        received_file_size = ntohl(received_file_size);
+
+        devlog_write(global_dl, DEVLOG_INFO, "[CID: %u]   Sent %ld bytes, client acked with %u", item->conn_id, item->report_len, received_file_size);
+
+        // compare acknowledgement to file size
+        if (received_file_size == item->report_len)
+            status = CATALOG_STATUS_OK;
+        else
+            status = CATALOG_STATUS_FILESIZE_ERROR;
+    }
+
+    // the listener took the whole report before acking, so the short response fits in the socket
+    const char *response = catalog_v1_response(CATALOG_CMD_REQUEST_REPORT, status);
+    send(item->socket, response, strlen(response), MSG_NOSIGNAL);
+
+    return _REPORTDELIVERY_DONE;
+}
+
+// Description: closes the attempt's socket, then closes the delivery or queues a retry with backoff
+void _reportdelivery_finish(reportdelivery_t *self, reportdelivery_item_t *item, int result)
+{
+    if (item->socket != -1)
+        close(item->socket);
+    item->socket = -1;
+
+    if (result == _REPORTDELIVERY_DONE)
+    {
+        atomic_fetch_add(&(self->num_delivered), 1);
+        fclose(item->report);
+        free(item);
+    }
+    else if (item->attempts < REPORTDELIVERY_MAX_ATTEMPTS)
+    {
+        devlog_write(global_dl, DEVLOG_WARN, "[CID: %u]   Report delivery attempt %d failed, retrying", item->conn_id, item->attempts);
+
+        atomic_fetch_add(&(self->num_retried), 1);
+        _reportdelivery_deadline(&(item->not_before), REPORTDELIVERY_BACKOFF_MS << (item->attempts - 1));
+        _reportdelivery_queue(self, item);
+    }
+    else
+    {
+        devlog_write(global_dl, DEVLOG_ERROR, "[CID: %u]   Report delivery abandoned after %d attempts", item->conn_id, item->attempts);
+
+        atomic_fetch_add(&(self->num_failed), 1);
+        fclose(item->report);
+        free(item);
+    }
+}
+
+// Description: sets ts to ms milliseconds from now on CLOCK_MONOTONIC, which wall clock changes don't move
+void _reportdelivery_deadline(struct timespec *ts, long ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// Description: milliseconds from now until ts on CLOCK_MONOTONIC, negative once it has passed
+long _reportdelivery_ms_until(const struct timespec *ts)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ts->tv_sec - now.tv_sec) * 1000 + (ts->tv_nsec - now.tv_nsec) / 1000000L;
+}
+
+// METHODS
+
+/////
+void reportdelivery_submit(reportdelivery_t *self, FILE *report, struct sockaddr_in listener, unsigned int conn_id)
+{
+    reportdelivery_item_t *item = calloc(1, sizeof(reportdelivery_item_t));
+
+    if (item == NULL)
+        exit_error("Report delivery memory allocation failed\n");
+
+    item->report = report;
+    item->report_len = ftell(report);
+    item->listener = listener;
+    item->conn_id = conn_id;
+    item->socket = -1;
+
+    // sent with sendfile, which reads the file underneath the stream
+    fflush(report);
+
+    // due immediately
+    clock_gettime(CLOCK_MONOTONIC, &(item->not_before));
+
+    _reportdelivery_queue(self, item);
+}
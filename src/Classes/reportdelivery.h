@@ -0,0 +1,91 @@
+/*
+ * REPORT DELIVERY CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Delivers finished reports to client listeners on its own small set of threads
+ *                Deliveries are queued, and each thread keeps all of the deliveries it has taken on a
+ *                single poll set, connecting and sending without blocking, so a slow listener holds up
+ *                none of the others.  Every attempt is bounded by a deadline, failed connects and sends
+ *                are retried with backoff up to REPORTDELIVERY_MAX_ATTEMPTS.
+ * Usage:       Instantiate with: reportdelivery_t *mydelivery = new_reportdelivery(num_threads)
+ */
+#pragma once
+
+#ifndef REPORTDELIVERY_H_INCLUDED
+#define REPORTDELIVERY_H_INCLUDED
+
+#define REPORTDELIVERY_THREADS 2
+#define REPORTDELIVERY_TIMEOUT_MS 5000      // connect, send and ack of one attempt
+#define REPORTDELIVERY_MAX_ATTEMPTS 3
+#define REPORTDELIVERY_BACKOFF_MS 500       // doubled after every failed attempt
+#define REPORTDELIVERY_WAIT_MS 100         // how often a delivery in flight checks the drain window
+#define REPORTDELIVERY_MAX_ACTIVE 16        // deliveries one thread has in flight at once
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "threadcontroller.h"
+
+// REPORT DELIVERY
+//   one queued report, the delivery owns the report file until it is done with it
+typedef struct reportdelivery_item
+{
+    FILE *report;
+    long report_len;
+    struct sockaddr_in listener;
+    unsigned int conn_id;
+    int attempts;
+    struct timespec not_before;         // earliest time of the next attempt, CLOCK_MONOTONIC
+
+    // the attempt in flight
+    int socket;
+    int state;                          // connecting, sending or waiting for the ack
+    off_t offset;                       // how much of the report has been sent
+    struct timespec deadline;           // CLOCK_MONOTONIC
+
+    struct reportdelivery_item *next;   // in the queue, or in a delivery thread's list in flight
+} reportdelivery_item_t;
+
+// REPORTDELIVERY OBJECT
+typedef struct
+{
+    int gc_id;
+
+    reportdelivery_item_t *head;
+    reportdelivery_item_t *tail;
+    pthread_mutex_t queue_lock;
+    int wake_fd;                        // eventfd, readable once a delivery has been queued
+
+    atomic_long num_delivered;
+    atomic_long num_retried;
+    atomic_long num_failed;
+} reportdelivery_t;
+
+// CONSTRUCTOR
+//   num_threads of 0 uses REPORTDELIVERY_THREADS
+reportdelivery_t *new_reportdelivery(int num_threads);
+
+// DESTRUCTOR
+//   delivery threads are joined by the thread controller before this is called
+void reportdelivery_destroy(void *);
+
+// METHODS
+
+// reportdelivery_submit()
+//   Queues the report for delivery to listener, then returns immediately
+//   The report's current position is taken as its length, it is closed once delivered or abandoned
+void reportdelivery_submit(reportdelivery_t *self, FILE *report, struct sockaddr_in listener, unsigned int conn_id);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * SESSION TABLE CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "sessiontable.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+time_t _sessiontable_now();
+bool _sessiontable_token_equal(const uint8_t *a, const uint8_t *b);
+void _sessiontable_free_slot(sessiontable_t *self, uint32_t slot);
+void _sessiontable_reclaim(sessiontable_t *self, time_t now);
+
+// CONSTRUCTOR
+sessiontable_t *new_sessiontable(uint32_t capacity)
+{
+    sessiontable_t *self = calloc(1, sizeof(sessiontable_t));
+
+    if (self == NULL)
+        exit_error("Session table memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, sessiontable_destroy);
+
+    self->capacity = capacity > 0 ? capacity : SESSIONTABLE_CAPACITY;
+    self->entries = calloc(self->capacity, sizeof(sessiontable_entry_t));
+    self->free_slots = calloc(self->capacity, sizeof(uint32_t));
+
+    if (self->entries == NULL || self->free_slots == NULL)
+        exit_error("Session table memory allocation failed\n");
+
+    // slot 0 ends up on top of the stack
+    for (uint32_t i=0; i<self->capacity; i++)
+        self->free_slots[i] = self->capacity - 1 - i;
+    self->num_free = self->capacity;
+
+    self->random_fd = open(SESSIONTABLE_RANDOM_SOURCE, O_RDONLY);
+    if (self->random_fd < 0)
+        exit_error("Could not open " SESSIONTABLE_RANDOM_SOURCE);
+
+    pthread_mutex_init(&(self->table_lock), NULL);
+
+    return self;
+}
+
+// DESTRUCTOR
+void sessiontable_destroy(void *s)
+{
+    sessiontable_t *self = (sessiontable_t *)s;
+
+    close(self->random_fd);
+    pthread_mutex_destroy(&(self->table_lock));
+
+    free(self->entries);
+    free(self->free_slots);
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+/////
+time_t _sessiontable_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec;
+}
+
+// Description: compares tokens in constant time, so response times say nothing about how much matched
+bool _sessiontable_token_equal(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t diff = 0;
+
+    for (int i=0; i<SESSIONTABLE_TOKEN_LEN; i++)
+        diff |= a[i] ^ b[i];
+
+    return diff == 0;
+}
+
+// Notes: table_lock must be held
+void _sessiontable_free_slot(sessiontable_t *self, uint32_t slot)
+{
+    memset(&(self->entries[slot]), 0, sizeof(sessiontable_entry_t));
+    self->free_slots[self->num_free++] = slot;
+}
+
+// Description: frees every expired session, only needed once the free stack runs out
+// Notes:       table_lock must be held
+void _sessiontable_reclaim(sessiontable_t *self, time_t now)
+{
+    for (uint32_t i=0; i<self->capacity; i++)
+        if (self->entries[i].used && self->entries[i].expires <= now)
+            _sessiontable_free_slot(self, i);
+}
+
+// METHODS
+
+/////
+bool sessiontable_issue(sessiontable_t *self, int user_id, uint8_t *token)
+{
+    // the random part is read before taking the lock
+    if (read(self->random_fd, token + sizeof(uint32_t), SESSIONTABLE_TOKEN_LEN - sizeof(uint32_t)) != SESSIONTABLE_TOKEN_LEN - sizeof(uint32_t))
+        return false;
+
+    time_t now = _sessiontable_now();
+
+    pthread_mutex_lock(&(self->table_lock));
+
+    if (self->num_free == 0)
+        _sessiontable_reclaim(self, now);
+
+    if (self->num_free == 0)
+    {
+        pthread_mutex_unlock(&(self->table_lock));
+        return false;
+    }
+
+    uint32_t slot = self->free_slots[--self->num_free];
+    uint32_t slot_n = htonl(slot);
+    memcpy(token, &slot_n, sizeof(uint32_t));
+
+    sessiontable_entry_t *entry = &(self->entries[slot]);
+    memcpy(entry->token, token, SESSIONTABLE_TOKEN_LEN);
+    entry->user_id = user_id;
+    entry->used = true;
+    entry->expires = now + SESSIONTABLE_TTL_S;
+
+    pthread_mutex_unlock(&(self->table_lock));
+
+    atomic_fetch_add(&(self->num_issued), 1);
+
+    return true;
+}
+
+/////
+int sessiontable_resume(sessiontable_t *self, const uint8_t *token)
+{
+    uint32_t slot;
+    memcpy(&slot, token, sizeof(uint32_t));
+    slot = ntohl(slot);
+
+    int user_id = -1;
+    time_t now = _sessiontable_now();
+
+    pthread_mutex_lock(&(self->table_lock));
+
+    if (slot < self->capacity && self->entries[slot].used && _sessiontable_token_equal(self->entries[slot].token, token))
+    {
+        sessiontable_entry_t *entry = &(self->entries[slot]);
+
+        if (entry->expires > now)
+        {
+            user_id = entry->user_id;
+            entry->expires = now + SESSIONTABLE_TTL_S;
+        }
+        else
+            _sessiontable_free_slot(self, slot);
+    }
+
+    pthread_mutex_unlock(&(self->table_lock));
+
+    atomic_fetch_add(user_id >= 0 ? &(self->num_resumed) : &(self->num_refused), 1);
+
+    return user_id;
+}
+
+/////
+uint32_t sessiontable_count(sessiontable_t *self)
+{
+    pthread_mutex_lock(&(self->table_lock));
+    uint32_t num_sessions = self->capacity - self->num_free;
+    pthread_mutex_unlock(&(self->table_lock));
+
+    return num_sessions;
+}
+
+/////
+int sessiontable_flush(sessiontable_t *self)
+{
+    int num_dropped = 0;
+
+    pthread_mutex_lock(&(self->table_lock));
+
+    for (uint32_t i=0; i<self->capacity; i++)
+    {
+        if (self->entries[i].used)
+        {
+            _sessiontable_free_slot(self, i);
+            num_dropped++;
+        }
+    }
+
+    pthread_mutex_unlock(&(self->table_lock));
+
+    return num_dropped;
+}
@@ -0,0 +1,88 @@
+/*
+ * SESSION TABLE CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Session tokens issued on login, so a reconnecting client can skip the credential check
+ *                A token names the slot it is stored in, followed by random bytes, so checking one is a
+ *                single probe of the table and never touches users.db.  Tokens expire after
+ *                SESSIONTABLE_TTL_S without use, each resume starts the time again.
+ * Usage:       Instantiate with: sessiontable_t *mysessions = new_sessiontable(capacity)
+ */
+#pragma once
+
+#ifndef SESSIONTABLE_H_INCLUDED
+#define SESSIONTABLE_H_INCLUDED
+
+#define SESSIONTABLE_CAPACITY 65536
+#define SESSIONTABLE_TOKEN_LEN 16           // 4 bytes of slot and 12 random ones
+#define SESSIONTABLE_TTL_S 3600
+#define SESSIONTABLE_RANDOM_SOURCE "/dev/urandom"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+
+// SESSION
+typedef struct
+{
+    uint8_t token[SESSIONTABLE_TOKEN_LEN];
+    int user_id;
+    bool used;
+    time_t expires;                     // monotonic seconds
+} sessiontable_entry_t;
+
+// SESSIONTABLE OBJECT
+typedef struct
+{
+    int gc_id;
+    int random_fd;
+
+    pthread_mutex_t table_lock;
+    sessiontable_entry_t *entries;
+    uint32_t capacity;
+    uint32_t *free_slots;               // stack of unused slots
+    uint32_t num_free;
+
+    atomic_long num_issued;
+    atomic_long num_resumed;
+    atomic_long num_refused;
+} sessiontable_t;
+
+// CONSTRUCTOR
+//   capacity of 0 uses SESSIONTABLE_CAPACITY
+sessiontable_t *new_sessiontable(uint32_t capacity);
+
+// DESTRUCTOR
+void sessiontable_destroy(void *);
+
+// METHODS
+
+// sessiontable_issue()
+//   Stores a new session for user_id and writes its token, returns false if the table is full of live sessions
+bool sessiontable_issue(sessiontable_t *self, int user_id, uint8_t *token);
+
+// sessiontable_resume()
+//   Returns the user_id of the session named by token and extends its expiry, -1 if it is unknown or expired
+int sessiontable_resume(sessiontable_t *self, const uint8_t *token);
+
+// sessiontable_count()
+//   Returns the number of sessions stored, expired ones included until their slot is needed
+uint32_t sessiontable_count(sessiontable_t *self);
+
+// sessiontable_flush()
+//   Forgets every session, their clients have to log in with a password again
+//   Returns the number of sessions dropped
+int sessiontable_flush(sessiontable_t *self);
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * SLAB ALLOCATOR IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "slab.h"
+#include "common.h"
+
+#define _SLAB_NUM_CLASSES 8
+#define _SLAB_LARGE UINT32_MAX       // size class of a block that came from the heap
+
+// BLOCK HEADER
+//   sits in front of every block, 16 bytes so the block after it stays aligned
+typedef struct
+{
+    uint32_t size_class;
+    uint32_t unused;
+    uint64_t padding;
+} _slab_header_t;
+
+// FREE BLOCK
+//   a free block's data holds the link to the next one
+typedef struct _slab_free_block
+{
+    struct _slab_free_block *next;
+} _slab_free_block_t;
+
+// FREE LIST
+typedef struct
+{
+    _slab_free_block_t *head;
+    int count;
+} _slab_list_t;
+
+const size_t _slab_sizes[_SLAB_NUM_CLASSES] = {16, 32, 48, 64, 96, 128, 192, SLAB_MAX_SIZE};
+
+// size class by size in 16 byte steps, rounded up
+const int8_t _slab_class_of[SLAB_MAX_SIZE / 16 + 1] = {0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+
+// per thread free lists, and the shared ones they refill from and spill to
+_Thread_local _slab_list_t _slab_cache[_SLAB_NUM_CLASSES];
+_Thread_local bool _slab_thread_registered = false;
+_Thread_local bool _slab_bypass = false;
+
+_slab_list_t _slab_shared[_SLAB_NUM_CLASSES];
+pthread_mutex_t _slab_locks[_SLAB_NUM_CLASSES];
+pthread_once_t _slab_once = PTHREAD_ONCE_INIT;
+pthread_key_t _slab_thread_key;
+atomic_long _slab_num_slabs = 0;
+
+// HELPERS
+void _slab_init();
+void _slab_register_thread();
+void _slab_thread_exit(void *arg);
+void _slab_move(_slab_list_t *from, _slab_list_t *to, int count);
+void _slab_carve(int size_class);
+void _slab_refill(int size_class);
+
+/////
+void _slab_init()
+{
+    for (int i=0; i<_SLAB_NUM_CLASSES; i++)
+        pthread_mutex_init(&(_slab_locks[i]), NULL);
+
+    // hands the free lists of a finished thread to the shared lists
+    pthread_key_create(&_slab_thread_key, _slab_thread_exit);
+}
+
+// Description: makes sure the free lists of the calling thread are handed back when it exits
+void _slab_register_thread()
+{
+    pthread_once(&_slab_once, _slab_init);
+    pthread_setspecific(_slab_thread_key, (void *)1);
+    _slab_thread_registered = true;
+}
+
+/////
+void _slab_thread_exit(void *arg)
+{
+    (void)arg;
+
+    for (int i=0; i<_SLAB_NUM_CLASSES; i++)
+    {
+        pthread_mutex_lock(&(_slab_locks[i]));
+        _slab_move(&(_slab_cache[i]), &(_slab_shared[i]), _slab_cache[i].count);
+        pthread_mutex_unlock(&(_slab_locks[i]));
+    }
+}
+
+// Description: moves up to count blocks from the top of one list to the other
+void _slab_move(_slab_list_t *from, _slab_list_t *to, int count)
+{
+    while (count-- > 0 && from->head != NULL)
+    {
+        _slab_free_block_t *block = from->head;
+        from->head = block->next;
+        from->count--;
+
+        block->next = to->head;
+        to->head = block;
+        to->count++;
+    }
+}
+
+// Description: cuts a new slab into blocks of size_class on the shared list
+// Notes:       the lock of size_class must be held
+void _slab_carve(int size_class)
+{
+    char *slab = malloc(SLAB_BYTES);
+
+    if (slab == NULL)
+        exit_error("Slab memory allocation failed\n");
+
+    atomic_fetch_add(&_slab_num_slabs, 1);
+
+    size_t stride = sizeof(_slab_header_t) + _slab_sizes[size_class];
+    _slab_list_t *shared = &(_slab_shared[size_class]);
+
+    for (size_t offset = 0; offset + stride <= SLAB_BYTES; offset += stride)
+    {
+        _slab_header_t *header = (_slab_header_t *)(slab + offset);
+        header->size_class = size_class;
+
+        _slab_free_block_t *block = (_slab_free_block_t *)(header + 1);
+        block->next = shared->head;
+        shared->head = block;
+        shared->count++;
+    }
+}
+
+// Description: gives the calling thread a batch of free blocks of size_class
+void _slab_refill(int size_class)
+{
+    if (!_slab_thread_registered)
+        _slab_register_thread();
+
+    pthread_mutex_lock(&(_slab_locks[size_class]));
+
+    if (_slab_shared[size_class].head == NULL)
+        _slab_carve(size_class);
+
+    _slab_move(&(_slab_shared[size_class]), &(_slab_cache[size_class]), SLAB_BATCH);
+
+    pthread_mutex_unlock(&(_slab_locks[size_class]));
+}
+
+// METHODS
+
+/////
+void *slab_alloc(size_t size)
+{
+    if (size > SLAB_MAX_SIZE || _slab_bypass)
+    {
+        _slab_header_t *header = malloc(sizeof(_slab_header_t) + size);
+
+        if (header == NULL)
+            return NULL;
+
+        header->size_class = _SLAB_LARGE;
+        return header + 1;
+    }
+
+    int size_class = _slab_class_of[(size + 15) / 16];
+    _slab_list_t *cache = &(_slab_cache[size_class]);
+
+    if (cache->head == NULL)
+        _slab_refill(size_class);
+
+    _slab_free_block_t *block = cache->head;
+    cache->head = block->next;
+    cache->count--;
+
+    return block;
+}
+
+/////
+void slab_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    _slab_header_t *header = (_slab_header_t *)ptr - 1;
+
+    if (header->size_class == _SLAB_LARGE)
+    {
+        free(header);
+        return;
+    }
+
+    int size_class = header->size_class;
+    _slab_list_t *cache = &(_slab_cache[size_class]);
+
+    if (!_slab_thread_registered)
+        _slab_register_thread();
+
+    _slab_free_block_t *block = ptr;
+    block->next = cache->head;
+    cache->head = block;
+    cache->count++;
+
+    // a thread that only frees, like one consuming what others allocate, passes its surplus on
+    if (cache->count > SLAB_CACHE_MAX)
+    {
+        pthread_mutex_lock(&(_slab_locks[size_class]));
+        _slab_move(cache, &(_slab_shared[size_class]), SLAB_BATCH);
+        pthread_mutex_unlock(&(_slab_locks[size_class]));
+    }
+}
+
+/////
+long slab_num_slabs()
+{
+    return atomic_load(&_slab_num_slabs);
+}
+
+/////
+void slab_set_bypass(bool bypass)
+{
+    _slab_bypass = bypass;
+}
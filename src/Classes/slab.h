@@ -0,0 +1,51 @@
+/*
+ * SLAB ALLOCATOR PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Size class allocator for the small, short lived blocks of the row helpers
+ *                Blocks up to SLAB_MAX_SIZE are carved out of SLAB_BYTES slabs taken from the heap once
+ *                and never given back.  Every thread keeps its own free list per size class, so most
+ *                allocations and frees touch no shared memory and take no lock.  A thread that holds too
+ *                many free blocks of a class passes a batch of them to a shared list that other threads
+ *                refill from.  Larger blocks come from the heap.
+ *
+ *                There is a single process wide allocator rather than an object per owner, slabs are
+ *                only released when the process exits.
+ * Usage:       void *block = slab_alloc(size); ... slab_free(block);
+ */
+#pragma once
+
+#ifndef SLAB_H_INCLUDED
+#define SLAB_H_INCLUDED
+
+#define SLAB_BYTES 65536            // heap block each slab is carved from
+#define SLAB_MAX_SIZE 256           // largest block served from a slab
+#define SLAB_BATCH 32               // blocks moved between a thread and the shared list at a time
+#define SLAB_CACHE_MAX 128          // free blocks a thread keeps per size class
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// slab_alloc()
+//   Returns size bytes aligned to 16, release with slab_free()
+void *slab_alloc(size_t size);
+
+// slab_free()
+//   Frees a block from slab_alloc(), from any thread
+void slab_free(void *ptr);
+
+// slab_num_slabs()
+//   Returns how many slabs have been taken from the heap so far
+long slab_num_slabs();
+
+// slab_set_bypass()
+//   Sends every allocation of the calling thread to the heap while set, for measuring what slabs save
+//   Blocks allocated either way may be freed either way
+void slab_set_bypass(bool bypass);
+
+#endif
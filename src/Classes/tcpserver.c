@@ -9,13 +9,49 @@
 // EXTERNS
 extern garbagecollector_t *global_gc;
 extern threadcontroller_t *global_tc;
+extern threadpool_t *global_tp;
 
 // HELPERS
+tcpserver_t *_tcpserver_new(in_addr_t addr, int port, int (*worker)(tcpconnection_t *, int));
 int _tcpserver_initialize(tcpserver_t *self);
 void *_tcpserver_listen(void *args);
+void _tcpserver_accept(tcpserver_t *self, int listen_socket);
+void _tcpserver_connect_task(void *arg);
+void _tcpserver_data_task(void *arg);
+void _tcpserver_write_task(void *arg);
+void _tcpserver_arm(tcpconnection_t *conn, int op);
+void _tcpserver_close_connection(tcpconnection_t *conn);
+void _tcpserver_init_connection(void *c);
+void _tcpserver_reset_connection(void *c);
+uint64_t _tcpserver_now_ms();
+int _tcpserver_fd_capacity();
+tcpserver_ip_count_t **_tcpserver_ip_count(tcpserver_t *self, in_addr_t addr);
+void _tcpserver_count(tcpserver_t *self, int family, in_addr_t addr, int delta);
+bool _tcpserver_admit(tcpserver_t *self, int family, in_addr_t addr);
+void _tcpserver_track(tcpconnection_t *conn);
+void _tcpserver_release(tcpconnection_t *conn);
+void _tcpserver_sweep(tcpserver_t *self);
 
-// CONSTRUCTOR
-tcpserver_t *new_tcpserver(int port, void *(*worker_thread)(void *))
+// CONSTRUCTORS
+tcpserver_t *new_tcpserver(int port, int (*worker)(tcpconnection_t *, int))
+{
+    return _tcpserver_new(INADDR_ANY, port, worker);
+}
+
+/////
+tcpserver_t *new_local_tcpserver(int port, int (*worker)(tcpconnection_t *, int))
+{
+    return _tcpserver_new(htonl(INADDR_LOOPBACK), port, worker);
+}
+
+/////
+tcpserver_t *new_unix_tcpserver(int (*worker)(tcpconnection_t *, int))
+{
+    return _tcpserver_new(htonl(INADDR_LOOPBACK), TCPSERVER_NO_PORT, worker);
+}
+
+// Description: creates a server listening on port at addr
+tcpserver_t *_tcpserver_new(in_addr_t addr, int port, int (*worker)(tcpconnection_t *, int))
 {
     tcpserver_t *self = calloc(1, sizeof(tcpserver_t));
 
@@ -25,11 +61,18 @@ tcpserver_t *new_tcpserver(int port, void *(*worker_thread)(void *))
     }
 
     // regiser with garbage collection
-    garbagecollector_register(global_gc, (void *)self, destroy_tcpserver);
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, destroy_tcpserver);
 
-    // set port
+    // set address and port
+    self->server_addr.sin_addr.s_addr = addr;
     self->port = port;
-    self->worker_thread = worker_thread;
+    self->worker = worker;
+    self->unix_socket = -1;
+
+    pthread_mutex_init(&(self->conn_lock), NULL);
+    self->conn_pool = new_objectpool(sizeof(tcpconnection_t), TCPSERVER_POOL_PREFILL,
+        _tcpserver_init_connection, _tcpserver_reset_connection);
+    tcpserver_set_limits(self, TCPSERVER_MAX_CONNECTIONS, TCPSERVER_MAX_PER_IP, TCPSERVER_IDLE_TIMEOUT_MS);
 
     // initialize the tcp server
     _tcpserver_initialize(self);
@@ -52,8 +95,32 @@ void destroy_tcpserver(void *s)
     printf("Shutting down TCP Server\n");
 
     // if we have a socket we need to release it
-    if (self->server_socket)
+    if (self->server_socket > 0)
         close(self->server_socket);
+    if (self->unix_socket >= 0)
+    {
+        close(self->unix_socket);
+        unlink(self->unix_path);
+    }
+    if (self->epoll_fd)
+        close(self->epoll_fd);
+    if (self->timer_fd > 0)
+        close(self->timer_fd);
+
+    printf("Accepted %u connections, rejected %u, reaped %u idle\n",
+        atomic_load(&(self->num_accepted)), atomic_load(&(self->num_rejected)), atomic_load(&(self->num_reaped)));
+
+    for (int i=0; i<TCPSERVER_IP_BUCKETS; i++)
+    {
+        while (self->ip_counts[i] != NULL)
+        {
+            tcpserver_ip_count_t *next = self->ip_counts[i]->next;
+            free(self->ip_counts[i]);
+            self->ip_counts[i] = next;
+        }
+    }
+
+    pthread_mutex_destroy(&(self->conn_lock));
 
     // cleanup
     garbagecollector_unregister(global_gc, self->gc_id);
@@ -65,35 +132,56 @@ void destroy_tcpserver(void *s)
 // Description: Internal method to create and bind the socket
 int _tcpserver_initialize(tcpserver_t *self)
 {
-    // create the socket
-    self->server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (self->server_socket == -1)
+    // a server on a unix domain socket only has no TCP socket to make
+    self->server_socket = -1;
+
+    if (self->port != TCPSERVER_NO_PORT)
     {
-        exit_error("Socket creation failed");
-    }
+        // create the socket
+        self->server_socket = socket(AF_INET, SOCK_STREAM, 0);
+        if (self->server_socket == -1)
+        {
+            exit_error("Socket creation failed");
+        }
 
-    // setup local server address struct
-    self->server_addr.sin_family = AF_INET;
-    self->server_addr.sin_addr.s_addr = INADDR_ANY;
-    self->server_addr.sin_port = htons(self->port);
+        // setup local server address struct
+        self->server_addr.sin_family = AF_INET;
+        self->server_addr.sin_port = htons(self->port);
 
-    // prevent socket bind from "sticking"
-    const int       opt_val = 1;
-    const socklen_t opt_len = sizeof(opt_val);
-    setsockopt(self->server_socket, SOL_SOCKET, SO_REUSEADDR, (void*)&opt_val, opt_len);
+        // prevent socket bind from "sticking"
+        const int       opt_val = 1;
+        const socklen_t opt_len = sizeof(opt_val);
+        setsockopt(self->server_socket, SOL_SOCKET, SO_REUSEADDR, (void*)&opt_val, opt_len);
 
-    // bind the socket
-    if (bind(self->server_socket, (struct sockaddr*)&(self->server_addr), sizeof(self->server_addr)) < 0)
-    {
-        exit_error("Socket bind failed");        
+        // bind the socket
+        if (bind(self->server_socket, (struct sockaddr*)&(self->server_addr), sizeof(self->server_addr)) < 0)
+        {
+            exit_error("Socket bind failed");        
+        }
     }
 
+    // the epoll instance exists before the listener starts, so more listeners can be added at any time
+    self->epoll_fd = epoll_create1(0);
+    if (self->epoll_fd < 0)
+        exit_error("Could not create epoll instance.");
+
+    // idle connections are looked for on a timer rather than tracked with a timeout each
+    struct itimerspec sweep = {0};
+    sweep.it_interval.tv_sec = TCPSERVER_SWEEP_MS / 1000;
+    sweep.it_interval.tv_nsec = (TCPSERVER_SWEEP_MS % 1000) * 1000000L;
+    sweep.it_value = sweep.it_interval;
+
+    self->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (self->timer_fd < 0 || timerfd_settime(self->timer_fd, 0, &sweep, NULL) < 0)
+        exit_error("Could not create sweep timer.");
+
     printf("TCP Server initialized\n");
     return 1;
 }
 
-// Description: listens for connections on a specified port
+// Description: listens for connections on a specified port and multiplexes client sockets
 // Notes:       this is a threaded function
+//              the listener only accepts and waits, all worker calls are run on the threadpool
 // Arguments:   arg1: thread_id
 //              arg2: self
 void *_tcpserver_listen(void *args)
@@ -102,38 +190,512 @@ void *_tcpserver_listen(void *args)
     int thread_id = *(int *)(thread_args->arg1);
     tcpserver_t *self = (tcpserver_t *)(thread_args->arg2);
 
-    int client_sock = -1;
-    socklen_t sock_len = sizeof(struct sockaddr_in);
-    struct sockaddr_in client_addr;
+    struct epoll_event events[TCPSERVER_MAX_EVENTS];
 
     // start listening on specified port
-    listen(self->server_socket, 5);
-    printf("[TID: %u] Listening on port %d.\n", thread_id, self->port);
+    if (self->server_socket >= 0)
+    {
+        listen(self->server_socket, TCPSERVER_BACKLOG);
+        printf("[TID: %u] Listening on port %d.\n", thread_id, self->port);
+
+        if(fcntl(self->server_socket, F_SETFL, fcntl(self->server_socket, F_GETFL) | O_NONBLOCK) < 0)
+            exit_error("Could not put socket into non-blocking mode.");
+
+        // listening sockets are identified by a data pointer to their socket field
+        struct epoll_event listen_event = {0};
+        listen_event.events = EPOLLIN;
+        listen_event.data.ptr = &(self->server_socket);
+        if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, self->server_socket, &listen_event) < 0)
+            exit_error("Could not watch listening socket.");
+    }
 
-    if(fcntl(self->server_socket, F_SETFL, fcntl(self->server_socket, F_GETFL) | O_NONBLOCK) < 0)
-        exit_error("Could not put socket into non-blocking mode.");
+    // the shutdown eventfd wakes the listener, so it can sleep until there are events
+    struct epoll_event shutdown_event = {0};
+    shutdown_event.events = EPOLLIN;
+    shutdown_event.data.ptr = &(global_tc->shutdown_fd);
+    if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, global_tc->shutdown_fd, &shutdown_event) < 0)
+        exit_error("Could not watch shutdown eventfd.");
 
-    // handle incoming connections, but cancel on kill_lock
-    while (pthread_mutex_trylock(&(global_tc->kill_lock)) != 0)
+    struct epoll_event timer_event = {0};
+    timer_event.events = EPOLLIN;
+    timer_event.data.ptr = &(self->timer_fd);
+    if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, self->timer_fd, &timer_event) < 0)
+        exit_error("Could not watch sweep timer.");
+
+    // handle incoming connections until shutdown, nothing new is accepted or dispatched after that
+    while (threadcontroller_running(global_tc))
     {
-        client_sock = accept(self->server_socket, (struct sockaddr*)&client_addr, &sock_len);
+        int num_events = epoll_wait(self->epoll_fd, events, TCPSERVER_MAX_EVENTS, -1);
 
-        if (client_sock != -1)
+        for (int i=0; i<num_events; i++)
         {
-            // make copy of client addr to send to thread
-            int temp_sock = client_sock;
-            struct sockaddr_in temp_addr = client_addr;
-
-            // prepare a thread for the worker        
-            threadarguments_t *thread_args = new_threadarguments();
-            thread_args->arg2 = (void *)&temp_sock;
-            thread_args->arg3 = (void *)&temp_addr;
-            thread_create(global_tc, self->worker_thread, thread_args);
+            if (events[i].data.ptr == &(global_tc->shutdown_fd))
+                break;
+            else if (events[i].data.ptr == &(self->server_socket) || events[i].data.ptr == &(self->unix_socket))
+                _tcpserver_accept(self, *(int *)events[i].data.ptr);
+            else if (events[i].data.ptr == &(self->timer_fd))
+                _tcpserver_sweep(self);
+            else
+            {
+                // one shot, so the connection is ours to annotate until its task rearms it
+                tcpconnection_t *conn = (tcpconnection_t *)events[i].data.ptr;
+                conn->events = events[i].events;
+                atomic_store(&(conn->armed), false);
+
+                if (conn->events & EPOLLOUT || atomic_load(&(conn->write_wait)))
+                    threadpool_submit(global_tp, _tcpserver_write_task, conn);
+                else
+                    threadpool_submit(global_tp, _tcpserver_data_task, conn);
+            }
         }
     }
 
     printf("[TID: %u] Closing listener.\n", thread_id);
-    pthread_mutex_unlock(&(global_tc->kill_lock));
 
     return NULL;
-}
\ No newline at end of file
+}
+
+// Description: accepts all pending connections on a listening socket and queues their connect event
+void _tcpserver_accept(tcpserver_t *self, int listen_socket)
+{
+    struct sockaddr_in client_addr;
+    socklen_t sock_len = sizeof(struct sockaddr_in);
+    int client_sock;
+    int family = listen_socket == self->unix_socket ? AF_UNIX : AF_INET;
+
+    // unix domain peers have no address worth keeping
+    struct sockaddr *accept_addr = family == AF_INET ? (struct sockaddr *)&client_addr : NULL;
+    socklen_t *accept_len = family == AF_INET ? &sock_len : NULL;
+
+    while ((client_sock = accept(listen_socket, accept_addr, accept_len)) != -1)
+    {
+        in_addr_t client_ip = family == AF_INET ? client_addr.sin_addr.s_addr : htonl(INADDR_LOOPBACK);
+        sock_len = sizeof(struct sockaddr_in);
+
+        // over a limit, turn the client away before anything is spent on it
+        if (!_tcpserver_admit(self, family, client_ip))
+        {
+            close(client_sock);
+            atomic_fetch_add(&(self->num_rejected), 1);
+            continue;
+        }
+
+        // each connection gets its own copy of the socket and address
+        tcpconnection_t *conn = objectpool_take(self->conn_pool);
+
+        conn->conn_id = ++self->next_conn_id;
+        conn->socket = client_sock;
+        conn->family = family;
+        conn->addr = client_addr;
+        conn->server = self;
+
+        if (family == AF_UNIX)
+        {
+            memset(&(conn->addr), 0, sizeof(struct sockaddr_in));
+            conn->addr.sin_family = AF_INET;
+            conn->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        else
+        {
+            // clients wait on every reply, so never let Nagle hold one back
+            const int nodelay = 1;
+            setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        }
+
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(conn->addr.sin_addr), ip, sizeof(ip));
+        snprintf(conn->peer, sizeof(conn->peer), "%s:%u", ip, (unsigned int)ntohs(conn->addr.sin_port));
+
+        if(fcntl(client_sock, F_SETFL, fcntl(client_sock, F_GETFL) | O_NONBLOCK) < 0)
+            exit_error("Could not put socket into non-blocking mode.");
+
+        _tcpserver_track(conn);
+        atomic_fetch_add(&(self->num_accepted), 1);
+
+        threadpool_submit(global_tp, _tcpserver_connect_task, conn);
+    }
+}
+
+// Description: runs the worker connect event, then arms the socket for reading
+// Notes:       this is a threadpool task
+void _tcpserver_connect_task(void *arg)
+{
+    tcpconnection_t *conn = (tcpconnection_t *)arg;
+    tcpserver_t *self = conn->server;
+
+    if (self->worker(conn, TCPSERVER_EVENT_CONNECT) == TCPSERVER_CLOSE)
+    {
+        _tcpserver_close_connection(conn);
+        return;
+    }
+
+    // one shot, so only a single worker ever handles a given connection at a time
+    _tcpserver_arm(conn, EPOLL_CTL_ADD);
+}
+
+// Description: runs the worker data event, then rearms or closes the connection
+// Notes:       this is a threadpool task
+void _tcpserver_data_task(void *arg)
+{
+    tcpconnection_t *conn = (tcpconnection_t *)arg;
+    tcpserver_t *self = conn->server;
+
+    int status = self->worker(conn, TCPSERVER_EVENT_DATA);
+
+    // the worker finishes the event on its own time
+    if (status == TCPSERVER_PENDING)
+        return;
+
+    tcpserver_resume(conn, status);
+}
+
+// Description: sends queued output once the socket is writable again, then goes back to reading
+//              a worker waiting in tcpserver_wait_writable() gets the connection back instead
+// Notes:       this is a threadpool task
+void _tcpserver_write_task(void *arg)
+{
+    tcpconnection_t *conn = (tcpconnection_t *)arg;
+    tcpserver_t *self = conn->server;
+
+    if (!atomic_exchange(&(conn->write_wait), false))
+    {
+        tcpserver_resume(conn, TCPSERVER_KEEP);
+        return;
+    }
+
+    // the worker gets the connection back once the client has taken everything queued, a client that
+    // went away shows up as a failed send once the worker carries on
+    if (outbuffer_flush(conn->out, conn->socket) == OUTBUFFER_PENDING)
+    {
+        tcpserver_wait_writable(conn);
+        return;
+    }
+
+    int status = self->worker(conn, TCPSERVER_EVENT_WRITABLE);
+
+    if (status == TCPSERVER_PENDING)
+        return;
+
+    tcpserver_resume(conn, status);
+}
+
+// Description: rearms a connection for its next event, writability while output is queued, otherwise input
+//              nothing new is read until the client has taken all of its replies
+void _tcpserver_arm(tcpconnection_t *conn, int op)
+{
+    tcpserver_t *self = conn->server;
+
+    struct epoll_event event = {0};
+    event.events = (conn->out->pending > 0 || atomic_load(&(conn->write_wait)) ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = conn;
+
+    // marked before epoll_ctl, once armed the event may fire on the listener at any moment
+    atomic_store(&(conn->last_active), _tcpserver_now_ms());
+    atomic_store(&(conn->armed), true);
+
+    if (epoll_ctl(self->epoll_fd, op, conn->socket, &event) < 0)
+        _tcpserver_close_connection(conn);
+}
+
+// Description: stops watching a connection, lets the worker release its session and gives it back to the pool
+void _tcpserver_close_connection(tcpconnection_t *conn)
+{
+    tcpserver_t *self = conn->server;
+
+    epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
+
+    self->worker(conn, TCPSERVER_EVENT_CLOSE);
+
+    // last chance for a final reply, such as the answer to a bad frame
+    outbuffer_flush(conn->out, conn->socket);
+
+    // off the list before the socket is closed, so the sweep never touches a reused descriptor
+    _tcpserver_release(conn);
+
+    close(conn->socket);
+    objectpool_give(self->conn_pool, conn);
+}
+
+// Description: gives a new pooled connection the outbuffer it keeps for as long as the pool lives
+void _tcpserver_init_connection(void *c)
+{
+    tcpconnection_t *conn = (tcpconnection_t *)c;
+
+    conn->out = new_outbuffer();
+}
+
+// Description: clears what a closed connection left behind, everything else is set again on accept
+void _tcpserver_reset_connection(void *c)
+{
+    tcpconnection_t *conn = (tcpconnection_t *)c;
+
+    outbuffer_clear(conn->out);
+
+    conn->session = NULL;
+    conn->events = 0;
+    conn->prev = conn->next = NULL;
+    atomic_store(&(conn->armed), false);
+    atomic_store(&(conn->write_wait), false);
+}
+
+/////
+uint64_t _tcpserver_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+// Description: returns how many connections the descriptor limit leaves room for
+int _tcpserver_fd_capacity()
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > 1000000)
+        return 1000000;
+
+    return limit.rlim_cur > TCPSERVER_RESERVED_FDS ? (int)limit.rlim_cur - TCPSERVER_RESERVED_FDS : 1;
+}
+
+// Description: returns the link that points at the count for addr, or at the NULL ending its bucket
+// Notes:       conn_lock must be held
+tcpserver_ip_count_t **_tcpserver_ip_count(tcpserver_t *self, in_addr_t addr)
+{
+    tcpserver_ip_count_t **link = &(self->ip_counts[ntohl(addr) % TCPSERVER_IP_BUCKETS]);
+
+    while (*link != NULL && (*link)->addr != addr)
+        link = &((*link)->next);
+
+    return link;
+}
+
+// Description: adds delta to the connection counts, unix domain clients only count towards the total
+// Notes:       conn_lock must be held
+void _tcpserver_count(tcpserver_t *self, int family, in_addr_t addr, int delta)
+{
+    self->num_connections += delta;
+
+    if (family != AF_INET)
+        return;
+
+    tcpserver_ip_count_t **link = _tcpserver_ip_count(self, addr);
+
+    if (*link == NULL)
+    {
+        if (delta <= 0 || (*link = calloc(1, sizeof(tcpserver_ip_count_t))) == NULL)
+            return;
+        (*link)->addr = addr;
+    }
+
+    (*link)->count += delta;
+
+    if ((*link)->count <= 0)
+    {
+        tcpserver_ip_count_t *unused = *link;
+        *link = unused->next;
+        free(unused);
+    }
+}
+
+// Description: counts a new connection if it is within the limits, returns false if it must be turned away
+bool _tcpserver_admit(tcpserver_t *self, int family, in_addr_t addr)
+{
+    pthread_mutex_lock(&(self->conn_lock));
+
+    bool admit = self->num_connections < self->max_connections;
+
+    if (admit && family == AF_INET && self->max_per_ip > 0)
+    {
+        tcpserver_ip_count_t *count = *_tcpserver_ip_count(self, addr);
+        admit = count == NULL || count->count < self->max_per_ip;
+    }
+
+    if (admit)
+        _tcpserver_count(self, family, addr, 1);
+
+    pthread_mutex_unlock(&(self->conn_lock));
+
+    return admit;
+}
+
+// Description: adds an admitted connection to the server's list
+void _tcpserver_track(tcpconnection_t *conn)
+{
+    tcpserver_t *self = conn->server;
+
+    pthread_mutex_lock(&(self->conn_lock));
+
+    conn->prev = NULL;
+    conn->next = self->connections;
+    if (self->connections != NULL)
+        self->connections->prev = conn;
+    self->connections = conn;
+
+    pthread_mutex_unlock(&(self->conn_lock));
+}
+
+// Description: removes a connection from the server's list and its counts
+void _tcpserver_release(tcpconnection_t *conn)
+{
+    tcpserver_t *self = conn->server;
+
+    pthread_mutex_lock(&(self->conn_lock));
+
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        self->connections = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+
+    _tcpserver_count(self, conn->family, conn->addr.sin_addr.s_addr, -1);
+
+    pthread_mutex_unlock(&(self->conn_lock));
+}
+
+// Description: hangs up on connections that have waited in epoll for longer than the idle timeout
+// Notes:       runs on the listener, which is the only thread that takes connections out of epoll,
+//              so a connection that is armed here cannot be picked up by a task at the same time
+//              connections being handled by a task, such as a report in progress, are never idle
+void _tcpserver_sweep(tcpserver_t *self)
+{
+    uint64_t expirations;
+
+    if (read(self->timer_fd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    uint64_t now = _tcpserver_now_ms();
+
+    pthread_mutex_lock(&(self->conn_lock));
+
+    for (tcpconnection_t *conn = self->connections; conn != NULL && self->idle_timeout_ms > 0; conn = conn->next)
+    {
+        // workers re-arm without conn_lock, so last_active may be newer than now, which would wrap the subtraction
+        uint64_t last_active = atomic_load(&(conn->last_active));
+
+        if (!atomic_load(&(conn->armed)) || last_active >= now || now - last_active < (uint64_t)self->idle_timeout_ms)
+            continue;
+
+        // the hangup wakes the connection's own task, which closes it as usual
+        atomic_store(&(conn->armed), false);
+        shutdown(conn->socket, SHUT_RDWR);
+        atomic_fetch_add(&(self->num_reaped), 1);
+    }
+
+    pthread_mutex_unlock(&(self->conn_lock));
+}
+
+// METHODS
+
+/////
+void tcpserver_set_limits(tcpserver_t *self, int max_connections, int max_per_ip, int idle_timeout_ms)
+{
+    int capacity = _tcpserver_fd_capacity();
+
+    pthread_mutex_lock(&(self->conn_lock));
+
+    self->max_connections = max_connections > 0 && max_connections < capacity ? max_connections : capacity;
+    self->max_per_ip = max_per_ip;
+    self->idle_timeout_ms = idle_timeout_ms;
+
+    pthread_mutex_unlock(&(self->conn_lock));
+}
+
+/////
+int tcpserver_listen_unix(tcpserver_t *self, const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return ERR_BIND_FAILURE;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (sock == -1)
+        return ERR_SOCK_CREATION_FAILURE;
+
+    // a socket file left behind by an earlier run would make bind fail
+    unlink(path);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, TCPSERVER_BACKLOG) < 0 ||
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) < 0)
+    {
+        close(sock);
+        return ERR_BIND_FAILURE;
+    }
+
+    strcpy(self->unix_path, path);
+    self->unix_socket = sock;
+
+    struct epoll_event listen_event = {0};
+    listen_event.events = EPOLLIN;
+    listen_event.data.ptr = &(self->unix_socket);
+
+    if (epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, sock, &listen_event) < 0)
+    {
+        self->unix_socket = -1;
+        close(sock);
+        unlink(path);
+        return ERR_BIND_FAILURE;
+    }
+
+    printf("Listening on unix socket %s.\n", path);
+
+    return SUCCESS;
+}
+
+/////
+void tcpserver_resume(tcpconnection_t *conn, int status)
+{
+    if (status == TCPSERVER_CLOSE || outbuffer_flush(conn->out, conn->socket) == OUTBUFFER_ERROR)
+    {
+        _tcpserver_close_connection(conn);
+        return;
+    }
+
+    _tcpserver_arm(conn, EPOLL_CTL_MOD);
+}
+
+/////
+bool tcpserver_send(tcpconnection_t *conn, const char *data, size_t len)
+{
+    outbuffer_append(conn->out, data, len);
+
+    return outbuffer_flush(conn->out, conn->socket) != OUTBUFFER_ERROR;
+}
+
+/////
+bool tcpserver_send_file(tcpconnection_t *conn, FILE *fp, off_t offset, size_t len)
+{
+    outbuffer_append_file(conn->out, fp, offset, len);
+
+    return outbuffer_flush(conn->out, conn->socket) != OUTBUFFER_ERROR;
+}
+
+/////
+void tcpserver_cork(tcpconnection_t *conn, bool cork)
+{
+    if (conn->family != AF_INET)
+        return;
+
+    const int value = cork;
+    setsockopt(conn->socket, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+}
+
+/////
+void tcpserver_wait_writable(tcpconnection_t *conn)
+{
+    atomic_store(&(conn->write_wait), true);
+    _tcpserver_arm(conn, EPOLL_CTL_MOD);
+}
+
+/////
+size_t tcpserver_pending_output(tcpconnection_t *conn)
+{
+    return conn->out->pending;
+}
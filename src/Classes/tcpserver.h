@@ -3,6 +3,17 @@
  * Author:      Aaron Bishop
  * Date:        4/16/2020
  * Description: Multithreaded class to encapsulate all TCP server functionality
+ *                The listener thread multiplexes every client socket with epoll and hands readable
+ *                connections to the global threadpool, so no thread is created per connection.
+ *                Replies are queued on a per-connection outbuffer and flushed without blocking, whatever
+ *                the socket does not take is sent when epoll reports it writable.
+ *                Besides the TCP port the server can listen on a unix domain socket for co-located
+ *                clients, connections from either transport are handed to the same worker.
+ *                Admission control caps the number of connections, in total and per client address, and
+ *                closes connections that are over the limit as soon as they are accepted.  A timer on the
+ *                listener closes connections that have been idle for too long.
+ *                Connections come from a pool and go back to it once closed, so accepting a client
+ *                allocates nothing once the pool has grown to the busiest the server has been.
  * Usage:       Instantiate with: tcpserver_t *myserver = new_tcpserver()
  */
 #pragma once
@@ -15,37 +26,172 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "common.h"
 #include "garbagecollector.h"
 #include "threadcontroller.h"
+#include "threadpool.h"
+#include "outbuffer.h"
+#include "objectpool.h"
 
 #define SUCCESS 1
 #define ERR_SOCK_CREATION_FAILURE -1
 #define ERR_BIND_FAILURE -2
 #define ERR_SOCK_ACCEPT_FAILURE -3
 
+#define TCPSERVER_BACKLOG 128
+#define TCPSERVER_MAX_EVENTS 64
+
+// admission control defaults, a limit of 0 turns that limit off
+#define TCPSERVER_MAX_CONNECTIONS 1024
+#define TCPSERVER_MAX_PER_IP 64
+#define TCPSERVER_IDLE_TIMEOUT_MS 300000
+#define TCPSERVER_SWEEP_MS 1000             // how often idle connections are looked for
+#define TCPSERVER_RESERVED_FDS 64           // descriptors kept back for datafiles, reports and callbacks
+#define TCPSERVER_IP_BUCKETS 256
+#define TCPSERVER_PEER_LEN 32               // "address:port" of a client
+#define TCPSERVER_POOL_PREFILL 64           // connections made up front, more are made as they are needed
+#define TCPSERVER_NO_PORT -1                // a server that only listens on a unix domain socket
+
+// events passed to the worker function
+#define TCPSERVER_EVENT_CONNECT 1
+#define TCPSERVER_EVENT_DATA 2
+#define TCPSERVER_EVENT_CLOSE 3
+#define TCPSERVER_EVENT_WRITABLE 4          // queued output went out, only after tcpserver_wait_writable()
+
+// worker return codes
+//   PENDING means the worker still owns the connection and will hand it back with tcpserver_resume()
+#define TCPSERVER_KEEP 1
+#define TCPSERVER_CLOSE 0
+#define TCPSERVER_PENDING 2
+
+struct tcpserver;
+
+// TCPCONNECTION OBJECT
+//   one per accepted client, taken from the tcpserver's pool and given back once the client is gone
+typedef struct tcpconnection
+{
+    unsigned int conn_id;
+    int socket;
+    int family;                 // AF_INET or AF_UNIX
+    struct sockaddr_in addr;    // unix domain clients are on this host, so they get the loopback address
+    char peer[TCPSERVER_PEER_LEN];  // addr formatted once on accept, for log messages
+    void *session;              // per-connection state owned by the worker
+    struct tcpserver *server;
+    outbuffer_t *out;
+    uint32_t events;            // epoll events that queued the current task
+    atomic_bool armed;          // waiting in epoll, as opposed to being handled by a task
+    atomic_bool write_wait;     // armed by tcpserver_wait_writable(), the next event goes to the worker
+    _Atomic uint64_t last_active;   // monotonic ms when the connection was last armed
+    struct tcpconnection *prev; // the server's list of open connections
+    struct tcpconnection *next;
+} tcpconnection_t;
+
+// TCPSERVER ADDRESS COUNT
+//   open connections from one client address, for the per address limit
+typedef struct tcpserver_ip_count
+{
+    in_addr_t addr;
+    int count;
+    struct tcpserver_ip_count *next;
+} tcpserver_ip_count_t;
+
 // TCPSERVER OBJECT
-typedef struct
+typedef struct tcpserver
 {
     int gc_id;
     struct sockaddr_in server_addr;
-    int port;
-    int server_socket;
-    void *(*worker_thread)(void *);
+    int port;                   // TCPSERVER_NO_PORT for a unix socket only server
+    int server_socket;          // -1 without a port
+    int unix_socket;            // -1 unless tcpserver_listen_unix() was called
+    char unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int epoll_fd;
+    int timer_fd;               // fires every TCPSERVER_SWEEP_MS to reap idle connections
+    unsigned int next_conn_id;
+    int (*worker)(tcpconnection_t *, int);
+    objectpool_t *conn_pool;    // closed connections are reset and reused, along with their outbuffer
+
+    // admission control, everything below is guarded by conn_lock
+    pthread_mutex_t conn_lock;
+    int max_connections;
+    int max_per_ip;
+    int idle_timeout_ms;
+    int num_connections;
+    tcpconnection_t *connections;
+    tcpserver_ip_count_t *ip_counts[TCPSERVER_IP_BUCKETS];
 
+    atomic_uint num_accepted;
+    atomic_uint num_rejected;
+    atomic_uint num_reaped;
 } tcpserver_t;
 
-// CONSTRUCTOR
-tcpserver_t *new_tcpserver(int port, void *(*worker_thread)(void *));
+// CONSTRUCTORS
+//   worker is called on a threadpool thread for each connection event, returning TCPSERVER_KEEP or TCPSERVER_CLOSE
+tcpserver_t *new_tcpserver(int port, int (*worker)(tcpconnection_t *, int));
+
+// new_local_tcpserver()
+//   As new_tcpserver(), listening on the loopback address so only clients on this host can connect
+tcpserver_t *new_local_tcpserver(int port, int (*worker)(tcpconnection_t *, int));
+
+// new_unix_tcpserver()
+//   As new_tcpserver(), without a TCP port, it accepts nothing until tcpserver_listen_unix() is called
+tcpserver_t *new_unix_tcpserver(int (*worker)(tcpconnection_t *, int));
 
 // DESTRUCTOR
 void destroy_tcpserver(void *);
 
 // METHODS
 
-// no public methods
+// tcpserver_listen_unix()
+//   Also accepts connections on a unix domain stream socket at path, replacing any stale socket file
+//   Returns SUCCESS, ERR_SOCK_CREATION_FAILURE or ERR_BIND_FAILURE
+int tcpserver_listen_unix(tcpserver_t *self, const char *path);
+
+// tcpserver_set_limits()
+//   Sets the connection limits and idle timeout, 0 turns a limit off
+//   max_connections is capped so that accepted connections cannot exhaust the process's descriptors
+void tcpserver_set_limits(tcpserver_t *self, int max_connections, int max_per_ip, int idle_timeout_ms);
+
+// tcpserver_resume()
+//   Completes a connection event the worker answered with TCPSERVER_PENDING
+//   status is TCPSERVER_KEEP to wait for the next command or TCPSERVER_CLOSE to drop the client
+//   Queued output is sent before the next command is read
+void tcpserver_resume(tcpconnection_t *conn, int status);
+
+// tcpserver_send()
+//   Queues data for the client and sends as much as the socket takes right away
+//   Returns false if the client has gone away
+bool tcpserver_send(tcpconnection_t *conn, const char *data, size_t len);
+
+// tcpserver_send_file()
+//   Queues len bytes of fp from offset to be sent with sendfile, the connection takes ownership of fp
+bool tcpserver_send_file(tcpconnection_t *conn, FILE *fp, off_t offset, size_t len);
+
+// tcpserver_cork()
+//   Holds back partial segments while a multi-part payload is queued, uncorking sends the remainder
+//   Connections otherwise run with TCP_NODELAY so small replies leave immediately
+void tcpserver_cork(tcpconnection_t *conn, bool cork);
+
+// tcpserver_wait_writable()
+//   Lets a worker holding a connection with TCPSERVER_PENDING wait for the client to take its queued output
+//   The worker is run with TCPSERVER_EVENT_WRITABLE once the output has gone out or the client has gone away,
+//   and returns from it as from a data event
+void tcpserver_wait_writable(tcpconnection_t *conn);
+
+// tcpserver_pending_output()
+//   Returns the number of bytes queued and not yet sent
+size_t tcpserver_pending_output(tcpconnection_t *conn);
 
-#endif
\ No newline at end of file
+#endif
@@ -22,12 +22,17 @@ threadcontroller_t *new_threadcontroller()
         exit_error("Thread controller memory allocation failed\n");
 
     // regiser with garbage collection
-    garbagecollector_register(global_gc, (void *)self, threadcontroller_destroy);
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, threadcontroller_destroy);
 
     // setup mutexes
     pthread_mutex_init(&(self->tc_lock), NULL);
-    pthread_mutex_init(&(self->kill_lock), NULL);
-    pthread_mutex_lock(&(self->kill_lock));
+
+    // shutdown is signalled through an atomic flag for loops and an eventfd for I/O waiters
+    atomic_init(&(self->shutdown), false);
+    self->shutdown_fd = eventfd(0, EFD_NONBLOCK);
+
+    if (self->shutdown_fd < 0)
+        exit_error("Could not create shutdown eventfd");
 
     thread_controller_exists = 1;
 
@@ -39,14 +44,16 @@ void threadcontroller_destroy(void *s)
 {
     threadcontroller_t *self = (threadcontroller_t *)s;
 
-    // gracefully kill threads that utilize the kill lock
-    pthread_mutex_unlock(&(self->kill_lock));
+    // gracefully stop threads, they drain for at most THREADCONTROLLER_DRAIN_MS
+    threadcontroller_shutdown(self);
 
-    // kill all remaining threads
+    // wait for all remaining threads
     for (int i=0; i<MAX_THREADS; i++)
         if (self->thread_id[i] != 0)
             thread_end(self, i);
 
+    close(self->shutdown_fd);
+
     garbagecollector_unregister(global_gc, self->gc_id);
 
     free(self);
@@ -66,24 +73,31 @@ int _threadcontroller_get_free_index(threadcontroller_t *self)
 // METHODS
 
 /////
-void thread_create(threadcontroller_t *self, void *(*start_routine)(void *), void *arg)
+int thread_create(threadcontroller_t *self, void *(*start_routine)(void *), void *arg)
 {
     threadarguments_t *thread_arguments = (threadarguments_t *)arg;
     
     pthread_mutex_lock(&(self->tc_lock));
     int thread_index = _threadcontroller_get_free_index(self);
 
+    // thread table is full, let the caller decide what to do
+    if (thread_index < 0)
+    {
+        pthread_mutex_unlock(&(self->tc_lock));
+        return -1;
+    }
+
     // set the first argument to the thread_id
     thread_arguments->arg1 = &self->thread_id[thread_index];
-    
-    if (thread_index >= 0)
-    {
-        int rc = pthread_create(&self->thread_id[thread_index], NULL, start_routine, thread_arguments);
 
-        if (rc)
-            exit_error("Could not create new thread");
-    }
+    int rc = pthread_create(&self->thread_id[thread_index], NULL, start_routine, thread_arguments);
+
+    if (rc)
+        exit_error("Could not create new thread");
+
     pthread_mutex_unlock(&(self->tc_lock));
+
+    return thread_index;
 }
 
 /////
@@ -96,6 +110,80 @@ void thread_end(threadcontroller_t *self, int thread_index)
     pthread_mutex_unlock(&(self->tc_lock));
 }
 
+/////
+bool threadcontroller_running(threadcontroller_t *self)
+{
+    // only the flag's own value matters, so no ordering is needed on this hot path
+    return !atomic_load_explicit(&(self->shutdown), memory_order_relaxed);
+}
+
+/////
+bool threadcontroller_draining(threadcontroller_t *self)
+{
+    if (threadcontroller_running(self))
+        return false;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&(self->tc_lock));
+    bool draining = now.tv_sec < self->drain_deadline.tv_sec ||
+        (now.tv_sec == self->drain_deadline.tv_sec && now.tv_nsec < self->drain_deadline.tv_nsec);
+    pthread_mutex_unlock(&(self->tc_lock));
+
+    return draining;
+}
+
+/////
+void threadcontroller_shutdown(threadcontroller_t *self)
+{
+    pthread_mutex_lock(&(self->tc_lock));
+
+    if (atomic_load(&(self->shutdown)))
+    {
+        pthread_mutex_unlock(&(self->tc_lock));
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &(self->drain_deadline));
+    self->drain_deadline.tv_sec += THREADCONTROLLER_DRAIN_MS / 1000;
+    self->drain_deadline.tv_nsec += (THREADCONTROLLER_DRAIN_MS % 1000) * 1000000L;
+    if (self->drain_deadline.tv_nsec >= 1000000000L)
+    {
+        self->drain_deadline.tv_sec++;
+        self->drain_deadline.tv_nsec -= 1000000000L;
+    }
+
+    atomic_store(&(self->shutdown), true);
+
+    // never read back, so the eventfd stays readable for every waiter
+    uint64_t one = 1;
+    if (write(self->shutdown_fd, &one, sizeof(one)) != sizeof(one))
+        printf("Could not signal shutdown eventfd\n");
+
+    int num_wakers = self->num_wakers;
+
+    pthread_mutex_unlock(&(self->tc_lock));
+
+    for (int i=0; i<num_wakers; i++)
+        self->wakers[i].function(self->wakers[i].arg);
+}
+
+/////
+void threadcontroller_add_waker(threadcontroller_t *self, void (*function)(void *), void *arg)
+{
+    pthread_mutex_lock(&(self->tc_lock));
+
+    if (self->num_wakers == THREADCONTROLLER_MAX_WAKERS)
+        exit_error("Too many shutdown wakers");
+
+    self->wakers[self->num_wakers].function = function;
+    self->wakers[self->num_wakers].arg = arg;
+    self->num_wakers++;
+
+    pthread_mutex_unlock(&(self->tc_lock));
+}
+
 // THREADARGUMENTS METHODS //
 
 // CONSTRUCTOR
@@ -106,7 +194,7 @@ threadarguments_t *new_threadarguments()
     if (self == NULL)
         exit_error("Thread arguments memory allocation failed");
 
-    garbagecollector_register(global_gc, (void *)self, threadarguments_destroy);
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, threadarguments_destroy);
 
     return self;
 }
@@ -11,21 +11,42 @@
 #define THREADCONTROLLER_H_INCLUDED
 
 #define MAX_THREADS 256
+#define THREADCONTROLLER_MAX_WAKERS 16
+#define THREADCONTROLLER_DRAIN_MS 2000     // how long workers may keep draining queued work after shutdown
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/eventfd.h>
 
 #include "common.h"
 #include "garbagecollector.h"
 
+// THREADCONTROLLER WAKER
+//   called on shutdown to wake threads sleeping on something other than an fd, such as a condition
+typedef struct
+{
+    void (*function)(void *);
+    void *arg;
+} threadcontroller_waker_t;
+
 // THREADCONTROLLER OBJECT
+//   threads run until shutdown is set, threads sleeping in epoll/poll also watch shutdown_fd,
+//   which becomes and stays readable on shutdown
 typedef struct
 {
     int gc_id;
     pthread_t thread_id[MAX_THREADS];
     pthread_mutex_t tc_lock;
-    pthread_mutex_t kill_lock;
+
+    atomic_bool shutdown;
+    int shutdown_fd;
+    struct timespec drain_deadline;     // CLOCK_MONOTONIC, so a wall clock step can't cut the drain short or stretch it
+    threadcontroller_waker_t wakers[THREADCONTROLLER_MAX_WAKERS];
+    int num_wakers;
 } threadcontroller_t;
 
 // THREADARGUMENTS OBJECT
@@ -41,10 +62,26 @@ typedef struct
 
 // THREADCONTROLLER METHODS
 threadcontroller_t *new_threadcontroller();
-void thread_create(threadcontroller_t *, void *(*)(void *), void * );
+int thread_create(threadcontroller_t *, void *(*)(void *), void * );
 void thread_end(threadcontroller_t *, int);
 void threadcontroller_destroy(void *);
 
+// threadcontroller_running()
+//   Returns false once shutdown has started, cheap enough to check on every loop iteration
+bool threadcontroller_running(threadcontroller_t *);
+
+// threadcontroller_draining()
+//   Returns true while a shutdown is in progress and threads may still finish queued work
+bool threadcontroller_draining(threadcontroller_t *);
+
+// threadcontroller_shutdown()
+//   Sets the shutdown flag, signals shutdown_fd and runs every waker, safe to call more than once
+void threadcontroller_shutdown(threadcontroller_t *);
+
+// threadcontroller_add_waker()
+//   Registers a function to wake sleeping threads on shutdown
+void threadcontroller_add_waker(threadcontroller_t *, void (*)(void *), void *);
+
 // THREADARGUMENTS METHODS
 threadarguments_t *new_threadarguments();
 void threadarguments_destroy(void *);
@@ -0,0 +1,336 @@
+/*
+ * THREADPOOL CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/16/2020
+ */
+
+#include "threadpool.h"
+
+extern garbagecollector_t *global_gc;
+extern threadcontroller_t *global_tc;
+
+// the pool and deque index of the calling thread, -1 when not a worker
+_Thread_local threadpool_t *_threadpool_current = NULL;
+_Thread_local int _threadpool_index = -1;
+_Thread_local unsigned int _threadpool_seed = 0;
+
+// HELPERS
+void *_threadpool_worker(void *args);
+bool _threadpool_next_task(threadpool_t *self, int index, threadpool_task_t *task);
+void _threadpool_wake(threadpool_t *self);
+void _threadpool_wake_all(void *arg);
+
+// CONSTRUCTOR
+threadpool_t *new_threadpool(int num_workers)
+{
+    threadpool_t *self = calloc(1, sizeof(threadpool_t));
+
+    if (self == NULL)
+        exit_error("Threadpool memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, threadpool_destroy);
+
+    pthread_mutex_init(&(self->pool_lock), NULL);
+    pthread_cond_init(&(self->pool_cond), NULL);
+
+    // size the pool to the machine, but never below the spec minimum
+    if (num_workers <= 0)
+        num_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < THREADPOOL_MIN_WORKERS)
+        num_workers = THREADPOOL_MIN_WORKERS;
+
+    self->deques = calloc(num_workers, sizeof(threadpool_deque_t));
+
+    if (self->deques == NULL)
+        exit_error("Threadpool memory allocation failed\n");
+
+    for (int i=0; i<num_workers; i++)
+    {
+        self->deques[i].capacity = THREADPOOL_DEQUE_INITIAL_LEN;
+        self->deques[i].tasks = calloc(THREADPOOL_DEQUE_INITIAL_LEN, sizeof(threadpool_task_t));
+
+        if (self->deques[i].tasks == NULL)
+            exit_error("Threadpool memory allocation failed\n");
+
+        pthread_mutex_init(&(self->deques[i].deque_lock), NULL);
+    }
+
+    self->num_workers = num_workers;
+
+    threadcontroller_add_waker(global_tc, _threadpool_wake_all, self);
+
+    // start all workers up front so thread creation never happens on the connection path
+    for (int i=0; i<num_workers; i++)
+    {
+        threadarguments_t *thread_args = new_threadarguments();
+        thread_args->arg2 = (void *)self;
+        thread_args->arg3 = (void *)&(self->deques[i]);
+
+        if (thread_create(global_tc, _threadpool_worker, thread_args) < 0)
+            exit_error("Could not start threadpool worker");
+    }
+
+    return self;
+}
+
+// DESTRUCTOR
+//   workers are joined by the thread controller before this is called
+void threadpool_destroy(void *s)
+{
+    threadpool_t *self = (threadpool_t *)s;
+
+    pthread_mutex_lock(&(self->pool_lock));
+
+    threadpool_task_t *task = self->head;
+    while (task != NULL)
+    {
+        threadpool_task_t *next = task->next;
+        free(task);
+        task = next;
+    }
+
+    task = self->free_tasks;
+    while (task != NULL)
+    {
+        threadpool_task_t *next = task->next;
+        free(task);
+        task = next;
+    }
+
+    for (int i=0; i<self->num_workers; i++)
+        free(self->deques[i].tasks);
+    free(self->deques);
+
+    pthread_mutex_unlock(&(self->pool_lock));
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: runs tasks until shutdown, then drains queued tasks for a bounded time
+// Notes:       this is a threaded function
+// Arguments:   arg1: thread_id
+//              arg2: self
+//              arg3: this worker's deque
+void *_threadpool_worker(void *args)
+{
+    threadarguments_t *thread_args = (threadarguments_t *)args;
+    threadpool_t *self = (threadpool_t *)(thread_args->arg2);
+    int index = (int)((threadpool_deque_t *)(thread_args->arg3) - self->deques);
+
+    _threadpool_current = self;
+    _threadpool_index = index;
+    _threadpool_seed = (unsigned int)index * 2654435761u + 1;
+
+    while (threadcontroller_running(global_tc) || threadcontroller_draining(global_tc))
+    {
+        threadpool_task_t task;
+
+        if (_threadpool_next_task(self, index, &task))
+        {
+            task.function(task.arg);
+            continue;
+        }
+
+        // once shutting down, an empty pool means the drain is done
+        if (!threadcontroller_running(global_tc))
+            break;
+
+        // nothing anywhere, sleep until a task is queued or shutdown starts
+        //   announce we are idle before the final check so a concurrent spawn either sees us or we see it
+        pthread_mutex_lock(&(self->pool_lock));
+        atomic_fetch_add(&(self->num_idle), 1);
+
+        while (atomic_load(&(self->num_pending)) == 0 && threadcontroller_running(global_tc))
+            pthread_cond_wait(&(self->pool_cond), &(self->pool_lock));
+
+        atomic_fetch_sub(&(self->num_idle), 1);
+        pthread_mutex_unlock(&(self->pool_lock));
+    }
+
+    return NULL;
+}
+
+// Description: finds the next task for a worker
+//              injection queue first, then the bottom of our own deque, then the top of a random victim
+bool _threadpool_next_task(threadpool_t *self, int index, threadpool_task_t *task)
+{
+    if (atomic_load(&(self->num_queued)) > 0)
+    {
+        pthread_mutex_lock(&(self->pool_lock));
+
+        threadpool_task_t *node = self->head;
+
+        if (node != NULL)
+        {
+            self->head = node->next;
+            if (self->head == NULL)
+                self->tail = NULL;
+
+            *task = *node;
+            node->next = self->free_tasks;
+            self->free_tasks = node;
+
+            atomic_fetch_sub(&(self->num_queued), 1);
+            atomic_fetch_sub(&(self->num_pending), 1);
+            pthread_mutex_unlock(&(self->pool_lock));
+            return true;
+        }
+
+        pthread_mutex_unlock(&(self->pool_lock));
+    }
+
+    threadpool_deque_t *own = &(self->deques[index]);
+
+    pthread_mutex_lock(&(own->deque_lock));
+    if (own->bottom > own->top)
+    {
+        own->bottom--;
+        *task = own->tasks[own->bottom % own->capacity];
+
+        // keep the indices small, the deque is empty whenever they meet
+        if (own->top == own->bottom)
+            own->top = own->bottom = 0;
+        pthread_mutex_unlock(&(own->deque_lock));
+        atomic_fetch_sub(&(self->num_pending), 1);
+        return true;
+    }
+    pthread_mutex_unlock(&(own->deque_lock));
+
+    if (atomic_load(&(self->num_pending)) == 0)
+        return false;
+
+    // xorshift so thieves spread out over victims
+    _threadpool_seed ^= _threadpool_seed << 13;
+    _threadpool_seed ^= _threadpool_seed >> 17;
+    _threadpool_seed ^= _threadpool_seed << 5;
+
+    int start = (int)(_threadpool_seed % (unsigned int)self->num_workers);
+
+    for (int i=0; i<self->num_workers; i++)
+    {
+        threadpool_deque_t *victim = &(self->deques[(start + i) % self->num_workers]);
+
+        if (victim == own)
+            continue;
+
+        pthread_mutex_lock(&(victim->deque_lock));
+        if (victim->bottom > victim->top)
+        {
+            *task = victim->tasks[victim->top % victim->capacity];
+            victim->top++;
+            if (victim->top == victim->bottom)
+                victim->top = victim->bottom = 0;
+            pthread_mutex_unlock(&(victim->deque_lock));
+            atomic_fetch_sub(&(self->num_pending), 1);
+            atomic_fetch_add(&(self->num_stolen), 1);
+            return true;
+        }
+        pthread_mutex_unlock(&(victim->deque_lock));
+    }
+
+    return false;
+}
+
+// Description: wakes one sleeping worker, if any
+void _threadpool_wake(threadpool_t *self)
+{
+    if (atomic_load(&(self->num_idle)) == 0)
+        return;
+
+    pthread_mutex_lock(&(self->pool_lock));
+    pthread_cond_signal(&(self->pool_cond));
+    pthread_mutex_unlock(&(self->pool_lock));
+}
+
+// Description: wakes every sleeping worker so they see the shutdown flag
+// Notes:       registered as a threadcontroller waker
+void _threadpool_wake_all(void *arg)
+{
+    threadpool_t *self = (threadpool_t *)arg;
+
+    pthread_mutex_lock(&(self->pool_lock));
+    pthread_cond_broadcast(&(self->pool_cond));
+    pthread_mutex_unlock(&(self->pool_lock));
+}
+
+// METHODS
+
+/////
+void threadpool_submit(threadpool_t *self, void (*function)(void *), void *arg)
+{
+    if (self == NULL || function == NULL)
+        return;
+
+    pthread_mutex_lock(&(self->pool_lock));
+
+    threadpool_task_t *task = self->free_tasks;
+
+    if (task != NULL)
+        self->free_tasks = task->next;
+    else if ((task = malloc(sizeof(threadpool_task_t))) == NULL)
+        exit_error("Threadpool task allocation failed");
+
+    task->function = function;
+    task->arg = arg;
+    task->next = NULL;
+
+    if (self->tail == NULL)
+        self->head = task;
+    else
+        self->tail->next = task;
+    self->tail = task;
+
+    atomic_fetch_add(&(self->num_queued), 1);
+    atomic_fetch_add(&(self->num_pending), 1);
+
+    pthread_cond_signal(&(self->pool_cond));
+    pthread_mutex_unlock(&(self->pool_lock));
+}
+
+/////
+void threadpool_spawn(threadpool_t *self, void (*function)(void *), void *arg)
+{
+    if (self == NULL || function == NULL)
+        return;
+
+    if (_threadpool_current != self || _threadpool_index < 0)
+    {
+        threadpool_submit(self, function, arg);
+        return;
+    }
+
+    threadpool_deque_t *own = &(self->deques[_threadpool_index]);
+
+    pthread_mutex_lock(&(own->deque_lock));
+
+    // grow the ring, unrolling it so top starts at zero again
+    if (own->bottom - own->top == own->capacity)
+    {
+        threadpool_task_t *tasks = calloc(own->capacity * 2, sizeof(threadpool_task_t));
+
+        if (tasks == NULL)
+            exit_error("Threadpool task allocation failed");
+
+        for (int i=own->top; i<own->bottom; i++)
+            tasks[i - own->top] = own->tasks[i % own->capacity];
+
+        free(own->tasks);
+        own->tasks = tasks;
+        own->bottom -= own->top;
+        own->top = 0;
+        own->capacity *= 2;
+    }
+
+    own->tasks[own->bottom % own->capacity].function = function;
+    own->tasks[own->bottom % own->capacity].arg = arg;
+    own->bottom++;
+
+    pthread_mutex_unlock(&(own->deque_lock));
+
+    atomic_fetch_add(&(self->num_pending), 1);
+    _threadpool_wake(self);
+}
@@ -0,0 +1,92 @@
+/*
+ * THREADPOOL CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/16/2020
+ * Description: Fixed set of worker threads, started at boot, which execute submitted tasks
+ *                Tasks submitted from outside the pool (new commands) go to a shared injection queue which
+ *                workers always check first, so cheap commands are never stuck behind long running work.
+ *                Tasks spawned from a worker (chunks of a large job) go to that worker's own deque, which
+ *                the owner pops LIFO and idle workers steal from FIFO.
+ * Usage:       Instantiate with: threadpool_t *mypool = new_threadpool(num_workers)
+ */
+#pragma once
+
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+// Capstone specification requires a minimum of 10 workers
+#define THREADPOOL_MIN_WORKERS 10
+#define THREADPOOL_DEQUE_INITIAL_LEN 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "threadcontroller.h"
+
+// THREADPOOL TASK
+//   queued unit of work, injection queue nodes are recycled through a free list
+typedef struct threadpool_task
+{
+    void (*function)(void *);
+    void *arg;
+    struct threadpool_task *next;
+} threadpool_task_t;
+
+// THREADPOOL DEQUE
+//   per-worker ring of spawned tasks, owner works the bottom, thieves take from the top
+typedef struct
+{
+    threadpool_task_t *tasks;
+    int capacity;
+    int top;
+    int bottom;
+    pthread_mutex_t deque_lock;
+} threadpool_deque_t;
+
+// THREADPOOL OBJECT
+typedef struct
+{
+    int gc_id;
+
+    int num_workers;
+    threadpool_deque_t *deques;
+
+    // injection queue
+    threadpool_task_t *head;
+    threadpool_task_t *tail;
+    threadpool_task_t *free_tasks;
+    atomic_int num_queued;
+
+    atomic_int num_pending;     // tasks in the injection queue and all deques
+    atomic_int num_idle;
+    atomic_long num_stolen;
+
+    pthread_mutex_t pool_lock;
+    pthread_cond_t pool_cond;
+} threadpool_t;
+
+// CONSTRUCTOR
+//   num_workers of 0 sizes the pool to the number of online cores
+threadpool_t *new_threadpool(int num_workers);
+
+// DESTRUCTOR
+void threadpool_destroy(void *);
+
+// METHODS
+
+// threadpool_submit()
+//   Queues a task on the shared injection queue to be run by the next free worker
+void threadpool_submit(threadpool_t *self, void (*function)(void *), void *arg);
+
+// threadpool_spawn()
+//   Queues a stealable subtask on the calling worker's deque
+//   Falls back to threadpool_submit() when not called from a worker of this pool
+void threadpool_spawn(threadpool_t *self, void (*function)(void *), void *arg);
+
+#endif
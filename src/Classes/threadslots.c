@@ -0,0 +1,119 @@
+/*
+ * THREAD SLOTS CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "threadslots.h"
+#include "common.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+void _threadslots_thread_exit(void *arg);
+threadslot_t *_threadslots_take(threadslots_t *self);
+
+// CONSTRUCTOR
+threadslots_t *new_threadslots(size_t slot_size, size_t slot_align, void (*take)(threadslot_t *slot))
+{
+    threadslots_t *self = calloc(1, sizeof(threadslots_t));
+
+    if (self == NULL)
+        exit_error("Thread slots memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, threadslots_destroy);
+
+    self->slot_size = slot_size;
+    self->slot_align = slot_align < sizeof(void *) ? sizeof(void *) : slot_align;
+    self->take = take;
+
+    if (pthread_key_create(&(self->thread_key), _threadslots_thread_exit) != 0)
+        exit_error("Could not create thread slots key");
+
+    return self;
+}
+
+// DESTRUCTOR
+void threadslots_destroy(void *s)
+{
+    threadslots_t *self = (threadslots_t *)s;
+
+    pthread_key_delete(self->thread_key);
+
+    threadslot_t *slot = atomic_load(&(self->slots));
+    while (slot != NULL)
+    {
+        threadslot_t *next = slot->next_slot;
+        free(slot);
+        slot = next;
+    }
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: lets the next new thread have the slot of one that exited
+void _threadslots_thread_exit(void *arg)
+{
+    threadslot_t *slot = (threadslot_t *)arg;
+
+    atomic_store_explicit(&(slot->in_use), false, memory_order_release);
+}
+
+// Description: takes an idle slot for the calling thread, or makes a new one
+threadslot_t *_threadslots_take(threadslots_t *self)
+{
+    threadslot_t *slot = NULL;
+
+    for (slot = atomic_load(&(self->slots)); slot != NULL; slot = slot->next_slot)
+    {
+        bool idle = false;
+        if (atomic_compare_exchange_strong(&(slot->in_use), &idle, true))
+            break;
+    }
+
+    if (slot == NULL)
+    {
+        // the size of a struct is a multiple of its alignment, as aligned_alloc wants
+        if ((slot = aligned_alloc(self->slot_align, self->slot_size)) == NULL)
+            return NULL;
+
+        memset(slot, 0, self->slot_size);
+        slot->slot_id = atomic_fetch_add(&(self->num_slots), 1);
+        atomic_init(&(slot->in_use), true);
+
+        // slots are only ever added, so a plain push is safe
+        slot->next_slot = atomic_load(&(self->slots));
+        while (!atomic_compare_exchange_weak(&(self->slots), &(slot->next_slot), slot))
+            ;
+    }
+
+    if (self->take != NULL)
+        self->take(slot);
+
+    pthread_setspecific(self->thread_key, slot);
+
+    return slot;
+}
+
+// METHODS
+
+/////
+threadslot_t *threadslots_get(threadslots_t *self)
+{
+    threadslot_t *slot = (threadslot_t *)pthread_getspecific(self->thread_key);
+
+    if (slot == NULL)
+        slot = _threadslots_take(self);
+
+    return slot;
+}
+
+/////
+threadslot_t *threadslots_first(threadslots_t *self)
+{
+    return atomic_load(&(self->slots));
+}
@@ -0,0 +1,72 @@
+/*
+ * THREAD SLOTS CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: A registry of per-thread records, for classes where every thread writes to a record of its own
+ *                A thread gets its slot the first time it asks and keeps it until it exits, then the
+ *                slot is idle and the next new thread takes it over with whatever it still holds.  Slots
+ *                are only ever added, never freed or unlinked until the registry is destroyed, so any
+ *                thread can walk them at any time without a lock.
+ *
+ *                A slot is a caller's struct with a threadslot_t as its first member, the registry
+ *                allocates it zeroed at the struct's size and alignment.
+ * Usage:       Instantiate with: threadslots_t *myslots = new_threadslots(sizeof(ring_t), _Alignof(ring_t), NULL)
+ *              ring_t *ring = (ring_t *)threadslots_get(myslots);
+ */
+#pragma once
+
+#ifndef THREADSLOTS_H_INCLUDED
+#define THREADSLOTS_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// common.h includes the classes built on this one, so it is left to threadslots.c
+
+// THREAD SLOT
+//   the header of every slot
+typedef struct threadslot
+{
+    uint32_t slot_id;                   // in the order the slots were made, from 0
+    atomic_bool in_use;                 // owned by a running thread
+    struct threadslot *next_slot;
+} threadslot_t;
+
+// THREAD SLOTS OBJECT
+typedef struct
+{
+    int gc_id;
+
+    size_t slot_size;
+    size_t slot_align;
+    void (*take)(threadslot_t *slot);   // called on the taking thread each time a slot changes hands, may be NULL
+
+    pthread_key_t thread_key;           // the calling thread's slot, handed back when the thread exits
+    _Atomic(threadslot_t *) slots;
+    atomic_uint num_slots;
+} threadslots_t;
+
+// CONSTRUCTOR
+threadslots_t *new_threadslots(size_t slot_size, size_t slot_align, void (*take)(threadslot_t *slot));
+
+// DESTRUCTOR
+//   frees every slot, no thread may use the registry afterwards
+void threadslots_destroy(void *);
+
+// METHODS
+
+// threadslots_get()
+//   Returns the calling thread's slot, taking an idle one or making a new one the first time
+//   Returns NULL if the thread has none and none could be made
+threadslot_t *threadslots_get(threadslots_t *self);
+
+// threadslots_first()
+//   Returns the newest slot, walk the rest with next_slot
+threadslot_t *threadslots_first(threadslots_t *self);
+
+#endif
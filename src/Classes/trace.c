@@ -0,0 +1,265 @@
+/*
+ * TRACE CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "trace.h"
+
+extern garbagecollector_t *global_gc;
+extern threadcontroller_t *global_tc;
+
+// HELPERS
+bool _trace_write_all(int fd, const void *data, size_t len);
+void *_trace_signal_thread(void *args);
+
+// CONSTRUCTOR
+trace_t *new_trace()
+{
+    trace_t *self = calloc(1, sizeof(trace_t));
+
+    if (self == NULL)
+        exit_error("Trace memory allocation failed");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, trace_destroy);
+
+    self->rings = new_threadslots(sizeof(trace_ring_t), _Alignof(trace_ring_t), NULL);
+
+    atomic_init(&(self->enabled), true);
+
+    return self;
+}
+
+// DESTRUCTOR
+void trace_destroy(void *s)
+{
+    trace_t *self = (trace_t *)s;
+
+    threadslots_destroy(self->rings);
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: write() until everything is out
+bool _trace_write_all(int fd, const void *data, size_t len)
+{
+    const char *bytes = (const char *)data;
+
+    while (len > 0)
+    {
+        ssize_t written = write(fd, bytes, len);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+
+        bytes += written;
+        len -= (size_t)written;
+    }
+
+    return true;
+}
+
+// Description: dumps the trace every time the signal arrives, until shutdown
+void *_trace_signal_thread(void *args)
+{
+    threadarguments_t *thread_args = (threadarguments_t *)args;
+    trace_t *self = (trace_t *)(thread_args->arg2);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, self->dump_signal);
+
+    struct timespec wait = {0, TRACE_SIGNAL_WAIT_MS * 1000000L};
+
+    while (threadcontroller_running(global_tc))
+    {
+        if (sigtimedwait(&set, NULL, &wait) != self->dump_signal)
+            continue;
+
+        long num_events = trace_dump(self, self->dump_filename);
+        printf("Trace of %ld events written to %s\n", num_events, self->dump_filename);
+    }
+
+    return NULL;
+}
+
+// METHODS
+
+/////
+trace_event_t *trace_begin(trace_t *self, uint32_t conn_id, uint8_t op_code)
+{
+    if (!atomic_load_explicit(&(self->enabled), memory_order_relaxed))
+        return NULL;
+
+    trace_ring_t *ring = (trace_ring_t *)threadslots_get(self->rings);
+
+    if (ring == NULL)
+        return NULL;
+
+    trace_event_t *event = &(ring->events[ring->next++ & (TRACE_RING_EVENTS - 1)]);
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // start before end, so a thread ending the detached event that used this slot sees it was reused
+    atomic_store(&(event->start_ns), (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+    atomic_store(&(event->end_ns), 0);
+    event->conn_id = conn_id;
+    event->op_code = op_code;
+
+    // counts so far, trace_end() turns them into the command's own
+    event->reads = (uint32_t)datafile_thread_io.reads;
+    event->writes = (uint32_t)datafile_thread_io.writes;
+
+    return event;
+}
+
+/////
+void trace_end(trace_event_t *event)
+{
+    if (event == NULL)
+        return;
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    event->reads = (uint32_t)datafile_thread_io.reads - event->reads;
+    event->writes = (uint32_t)datafile_thread_io.writes - event->writes;
+    atomic_store(&(event->end_ns), (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+}
+
+/////
+void trace_detach(trace_event_t *event)
+{
+    if (event == NULL)
+        return;
+
+    event->reads = (uint32_t)datafile_thread_io.reads - event->reads;
+    event->writes = (uint32_t)datafile_thread_io.writes - event->writes;
+}
+
+/////
+void trace_end_detached(trace_event_t *event, uint64_t start_ns)
+{
+    if (event == NULL)
+        return;
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t end_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    uint64_t running = 0;
+
+    // the owner may be reusing the slot meanwhile, it stores start_ns and then clears end_ns
+    //   so if start_ns still matches after our end went in, the end belongs to this command
+    //   and if it doesn't, ours is taken back unless the owner has already cleared or ended it
+    if (atomic_load(&(event->start_ns)) != start_ns || !atomic_compare_exchange_strong(&(event->end_ns), &running, end_ns))
+        return;
+
+    if (atomic_load(&(event->start_ns)) != start_ns)
+        atomic_compare_exchange_strong(&(event->end_ns), &end_ns, 0);
+}
+
+/////
+void trace_set_enabled(trace_t *self, bool enabled)
+{
+    atomic_store(&(self->enabled), enabled);
+}
+
+/////
+long trace_dump(trace_t *self, const char *filename)
+{
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return -1;
+
+    trace_file_header_t header = {0};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.event_size = sizeof(trace_event_t);
+    header.ring_events = TRACE_RING_EVENTS;
+
+    long num_events = 0;
+    bool written = _trace_write_all(fd, &header, sizeof(header));
+
+    // rings are written as they are, a command running on another thread may show up half recorded
+    for (trace_ring_t *ring = (trace_ring_t *)threadslots_first(self->rings); ring != NULL && written; ring = (trace_ring_t *)ring->slot.next_slot)
+    {
+        trace_file_ring_t ring_header = {0};
+        ring_header.ring_id = ring->slot.slot_id;
+        ring_header.next = ring->next;
+
+        written = _trace_write_all(fd, &ring_header, sizeof(ring_header)) &&
+            _trace_write_all(fd, ring->events, sizeof(ring->events));
+
+        num_events += ring_header.next < TRACE_RING_EVENTS ? (long)ring_header.next : TRACE_RING_EVENTS;
+    }
+
+    close(fd);
+
+    return written ? num_events : -1;
+}
+
+/////
+int trace_slowest(trace_t *self, trace_event_t *events, int max_events)
+{
+    int num_events = 0;
+
+    for (trace_ring_t *ring = (trace_ring_t *)threadslots_first(self->rings); ring != NULL; ring = (trace_ring_t *)ring->slot.next_slot)
+    {
+        uint64_t recorded = ring->next < TRACE_RING_EVENTS ? ring->next : TRACE_RING_EVENTS;
+
+        for (uint64_t i=0; i<recorded; i++)
+        {
+            // copied first, the owner may be writing it
+            trace_event_t event = ring->events[i];
+
+            if (event.end_ns < event.start_ns || event.start_ns == 0)
+                continue;
+
+            uint64_t duration = event.end_ns - event.start_ns;
+
+            // insertion into the sorted list, max_events is small
+            int pos = num_events < max_events ? num_events++ : max_events;
+
+            while (pos > 0 && events[pos - 1].end_ns - events[pos - 1].start_ns < duration)
+            {
+                if (pos < max_events)
+                    events[pos] = events[pos - 1];
+                pos--;
+            }
+
+            if (pos < max_events)
+                events[pos] = event;
+        }
+    }
+
+    return num_events;
+}
+
+/////
+void trace_dump_on_signal(trace_t *self, int signum, const char *filename)
+{
+    // threads started from here on inherit the blocked signal
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signum);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    self->dump_signal = signum;
+    strncpy(self->dump_filename, filename, TRACE_FILENAME_LEN - 1);
+
+    threadarguments_t *thread_args = new_threadarguments();
+    thread_args->arg2 = (void *)self;
+
+    if (thread_create(global_tc, _trace_signal_thread, thread_args) < 0)
+        exit_error("Could not start trace signal thread");
+}
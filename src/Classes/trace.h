@@ -0,0 +1,142 @@
+/*
+ * TRACE CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Flight recorder of the commands the server ran, for looking into latency after the fact
+ *                Every command is recorded as a fixed size binary event in a ring belonging to the thread
+ *                that ran it, the oldest events are overwritten as new ones come in.  Recording takes no
+ *                lock and formats nothing, it costs two clock reads and a few stores.
+ *
+ *                A dump writes every ring to a file exactly as it is in memory while the workers carry on
+ *                recording, it can be asked for directly or with a signal.  TraceConvert.py turns a dump
+ *                into Chrome trace JSON for chrome://tracing or Perfetto.
+ * Usage:       Instantiate with: trace_t *mytrace = new_trace()
+ *              trace_event_t *event = trace_begin(mytrace, conn_id, op_code); ... trace_end(event);
+ */
+#pragma once
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#define TRACE_RING_EVENTS 4096          // per thread, a power of two
+#define TRACE_MAGIC "CTRACE1"           // first bytes of a dump, with its NUL
+#define TRACE_DUMP_FILENAME "reports/trace.bin"
+#define TRACE_SIGNAL_WAIT_MS 100        // how often the signal thread checks for shutdown
+#define TRACE_FILENAME_LEN 256
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "threadcontroller.h"
+#include "datafile.h"
+#include "threadslots.h"
+
+// TRACE EVENT
+//   32 bytes, the layout is the dump format
+typedef struct
+{
+    _Atomic uint64_t start_ns;      // CLOCK_MONOTONIC
+    _Atomic uint64_t end_ns;        // 0 while the command is running, may be set by another thread
+    uint32_t conn_id;
+    uint32_t reads;                 // datafile I/O of the command, see datafile_io_t
+    uint32_t writes;
+    uint8_t op_code;
+    uint8_t unused[3];
+} trace_event_t;
+
+// TRACE RING
+//   written only by the thread that owns it
+typedef struct
+{
+    threadslot_t slot;              // slot_id is the ring's id in a dump
+    uint64_t next;                  // events ever recorded, the next one goes in next % TRACE_RING_EVENTS
+    trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+// DUMP FILE
+//   a file header, then for each ring a ring header followed by all TRACE_RING_EVENTS of its events
+typedef struct
+{
+    char magic[8];
+    uint32_t event_size;
+    uint32_t ring_events;
+} trace_file_header_t;
+
+typedef struct
+{
+    uint32_t ring_id;
+    uint32_t unused;
+    uint64_t next;
+} trace_file_ring_t;
+
+// TRACE OBJECT
+typedef struct
+{
+    int gc_id;
+
+    atomic_bool enabled;
+    threadslots_t *rings;           // of trace_ring_t
+
+    int dump_signal;                // see trace_dump_on_signal()
+    char dump_filename[TRACE_FILENAME_LEN];
+} trace_t;
+
+// CONSTRUCTOR
+trace_t *new_trace();
+
+// DESTRUCTOR
+void trace_destroy(void *);
+
+// METHODS
+
+// trace_begin()
+//   Starts the event of a command on the calling thread's ring
+//   Returns NULL if tracing is off, trace_end() accepts that
+trace_event_t *trace_begin(trace_t *self, uint32_t conn_id, uint8_t op_code);
+
+// trace_end()
+//   Finishes an event from trace_begin() on the same thread
+void trace_end(trace_event_t *event);
+
+// trace_detach()
+//   Stops an event from trace_begin() counting the calling thread's datafile I/O, for a command
+//   that will be answered on another thread, which finishes it with trace_end_detached()
+void trace_detach(trace_event_t *event);
+
+// trace_end_detached()
+//   Finishes an event from any thread, start_ns is the event's start_ns read when it was begun
+//   Does nothing if the event's ring has since reused it for a newer command
+void trace_end_detached(trace_event_t *event, uint64_t start_ns);
+
+// trace_set_enabled()
+//   Turns recording on or off, it is on from the start
+void trace_set_enabled(trace_t *self, bool enabled);
+
+// trace_dump()
+//   Writes every ring to filename
+//   Returns the number of events written, or -1 if the file could not be written
+long trace_dump(trace_t *self, const char *filename);
+
+// trace_slowest()
+//   Copies the max_events longest finished commands still held in the rings into events, longest first
+//   Returns the number of events copied
+int trace_slowest(trace_t *self, trace_event_t *events, int max_events);
+
+// trace_dump_on_signal()
+//   Dumps to filename whenever the process receives signum, such as SIGUSR1
+//   Must be called before any other thread is started, signum is blocked in every thread and taken
+//   by a thread of its own, so no blocking call anywhere is interrupted by it
+void trace_dump_on_signal(trace_t *self, int signum, const char *filename);
+
+#endif
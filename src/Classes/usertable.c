@@ -0,0 +1,425 @@
+/*
+ * USER TABLE CLASS IMPLEMENTATION
+ * Author: Aaron Bishop
+ * Date:   4/19/2020
+ */
+
+#include "usertable.h"
+
+extern garbagecollector_t *global_gc;
+
+// HELPERS
+uint32_t _usertable_hash(const char *username);
+char *_usertable_copy(const char *str);
+usertable_user_t *_usertable_find(usertable_t *self, const char *username);
+void _usertable_index(usertable_t *self, uint32_t hash, uint32_t user);
+bool _usertable_grow_index(usertable_t *self);
+bool _usertable_insert(usertable_t *self, int id, const char *username, const char *password);
+void _usertable_load(usertable_t *self, FILE *fp);
+bool _usertable_valid_field(const char *field);
+
+// CONSTRUCTOR
+usertable_t *new_usertable(const char *filename)
+{
+    usertable_t *self = calloc(1, sizeof(usertable_t));
+
+    if (self == NULL)
+        exit_error("User table memory allocation failed\n");
+
+    self->gc_id = garbagecollector_register(global_gc, (void *)self, usertable_destroy);
+
+    pthread_mutex_init(&(self->append_lock), NULL);
+    pthread_mutex_init(&(self->table_lock), NULL);
+
+    self->num_slots = USERTABLE_INITIAL_SLOTS;
+    self->slots = calloc(self->num_slots, sizeof(usertable_slot_t));
+
+    if (self->slots == NULL)
+        exit_error("User table memory allocation failed\n");
+
+    // without the file there is nobody to load and nowhere to save new users
+    self->user_db = new_datafile(filename);
+
+    FILE *fp = self->user_db != NULL ? fopen(filename, "r") : NULL;
+
+    if (fp != NULL)
+    {
+        flock(fileno(fp), LOCK_SH);
+        _usertable_load(self, fp);
+        flock(fileno(fp), LOCK_UN);
+        fclose(fp);
+    }
+
+    // sized once everybody is loaded, users added later go into it from _usertable_insert()
+    self->filter = new_bloomfilter(self->num_users * 2);
+
+    for (uint32_t i=0; i<self->num_users; i++)
+        bloomfilter_add(self->filter, self->users[i].username);
+
+    return self;
+}
+
+// DESTRUCTOR
+void usertable_destroy(void *s)
+{
+    usertable_t *self = (usertable_t *)s;
+
+    for (uint32_t i=0; i<self->num_users; i++)
+    {
+        free(self->users[i].username);
+        free(self->users[i].password);
+    }
+
+    free(self->users);
+    free(self->slots);
+
+    bloomfilter_destroy(self->filter);
+
+    if (self->user_db != NULL)
+        datafile_destroy(self->user_db);
+
+    pthread_mutex_destroy(&(self->append_lock));
+    pthread_mutex_destroy(&(self->table_lock));
+
+    garbagecollector_unregister(global_gc, self->gc_id);
+
+    free(self);
+}
+
+// HELPERS
+
+// Description: FNV-1a
+uint32_t _usertable_hash(const char *username)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *username; username++)
+        hash = (hash ^ (uint8_t)*username) * 16777619u;
+
+    return hash;
+}
+
+/////
+char *_usertable_copy(const char *str)
+{
+    char *copy = malloc(strlen(str) + 1);
+
+    if (copy != NULL)
+        strcpy(copy, str);
+
+    return copy;
+}
+
+// Description: returns the user named username, NULL if there is none
+// Notes:       table_lock must be held
+usertable_user_t *_usertable_find(usertable_t *self, const char *username)
+{
+    uint32_t hash = _usertable_hash(username);
+    uint32_t mask = self->num_slots - 1;
+
+    for (uint32_t i = hash & mask; self->slots[i].user != 0; i = (i + 1) & mask)
+    {
+        usertable_user_t *user = &(self->users[self->slots[i].user - 1]);
+
+        if (self->slots[i].hash == hash && strcmp(user->username, username) == 0)
+            return user;
+    }
+
+    return NULL;
+}
+
+// Description: puts users[user] into the first free slot from its hash
+// Notes:       table_lock must be held, and the index must have a free slot
+void _usertable_index(usertable_t *self, uint32_t hash, uint32_t user)
+{
+    uint32_t mask = self->num_slots - 1;
+    uint32_t i = hash & mask;
+
+    while (self->slots[i].user != 0)
+        i = (i + 1) & mask;
+
+    self->slots[i].hash = hash;
+    self->slots[i].user = user + 1;
+}
+
+// Description: doubles the index, rehashing from the hashes already stored in it
+// Notes:       table_lock must be held
+bool _usertable_grow_index(usertable_t *self)
+{
+    usertable_slot_t *old_slots = self->slots;
+    uint32_t old_num_slots = self->num_slots;
+
+    self->slots = calloc(old_num_slots * 2, sizeof(usertable_slot_t));
+
+    if (self->slots == NULL)
+    {
+        self->slots = old_slots;
+        return false;
+    }
+
+    self->num_slots = old_num_slots * 2;
+
+    for (uint32_t i=0; i<old_num_slots; i++)
+        if (old_slots[i].user != 0)
+            _usertable_index(self, old_slots[i].hash, old_slots[i].user - 1);
+
+    free(old_slots);
+
+    return true;
+}
+
+// Description: adds a user to the table only, the first of two users with the same name wins
+// Notes:       table_lock must be held
+bool _usertable_insert(usertable_t *self, int id, const char *username, const char *password)
+{
+    if (_usertable_find(self, username) != NULL)
+        return false;
+
+    if (self->num_users + 1 > self->num_slots * USERTABLE_MAX_LOAD && !_usertable_grow_index(self))
+        return false;
+
+    if (self->num_users == self->max_users)
+    {
+        uint32_t max_users = self->max_users > 0 ? self->max_users * 2 : USERTABLE_INITIAL_SLOTS;
+        usertable_user_t *users = realloc(self->users, max_users * sizeof(usertable_user_t));
+
+        if (users == NULL)
+            return false;
+
+        self->users = users;
+        self->max_users = max_users;
+    }
+
+    usertable_user_t *user = &(self->users[self->num_users]);
+    user->id = id;
+    user->username = _usertable_copy(username);
+    user->password = _usertable_copy(password);
+
+    if (user->username == NULL || user->password == NULL)
+    {
+        free(user->username);
+        free(user->password);
+        return false;
+    }
+
+    if (self->filter != NULL)
+        bloomfilter_add(self->filter, username);
+
+    _usertable_index(self, _usertable_hash(username), self->num_users);
+    self->num_users++;
+
+    if (id > self->last_id)
+        self->last_id = id;
+
+    return true;
+}
+
+// Description: reads every row of the user file, splitting the fields in place rather than copying them
+void _usertable_load(usertable_t *self, FILE *fp)
+{
+    int username_index = datafile_get_field_index(self->user_db, "username");
+    int password_index = datafile_get_field_index(self->user_db, "password");
+    int num_fields = self->user_db->num_fields;
+
+    if (username_index < 0 || password_index < 0)
+        exit_error("invalid user database file");
+
+    char buffer[DATAFILE_ROW_MAXLEN];
+    char *fields[num_fields];
+
+    // skip the header
+    if (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) == NULL)
+        return;
+
+    while (fgets(buffer, DATAFILE_ROW_MAXLEN, fp) != NULL)
+    {
+        buffer[strcspn(buffer, "\n")] = 0;
+
+        int n = 0;
+        char *field = buffer;
+
+        while (n < num_fields)
+        {
+            fields[n++] = field;
+
+            char *tab = strchr(field, '\t');
+            if (tab == NULL)
+                break;
+
+            *tab = 0;
+            field = tab + 1;
+        }
+
+        if (n == num_fields)
+            _usertable_insert(self, atoi(fields[0]), fields[username_index], fields[password_index]);
+    }
+}
+
+// Description: fields are stored in a tab separated file, so control characters are refused
+bool _usertable_valid_field(const char *field)
+{
+    if (field == NULL || field[0] == 0)
+        return false;
+
+    for (; *field; field++)
+        if ((unsigned char)*field < 0x20)
+            return false;
+
+    return true;
+}
+
+// METHODS
+
+/////
+bool usertable_exists(usertable_t *self, const char *username)
+{
+    if (!bloomfilter_check(self->filter, username))
+        return false;
+
+    pthread_mutex_lock(&(self->table_lock));
+    bool exists = _usertable_find(self, username) != NULL;
+    pthread_mutex_unlock(&(self->table_lock));
+
+    bloomfilter_found(self->filter, exists);
+
+    return exists;
+}
+
+/////
+int usertable_login(usertable_t *self, const char *username, const char *password)
+{
+    int result = USERTABLE_NO_USER;
+
+    if (!bloomfilter_check(self->filter, username))
+        return result;
+
+    pthread_mutex_lock(&(self->table_lock));
+
+    usertable_user_t *user = _usertable_find(self, username);
+
+    if (user != NULL)
+        result = strcmp(user->password, password) == 0 ? user->id : USERTABLE_BAD_PASSWORD;
+
+    pthread_mutex_unlock(&(self->table_lock));
+
+    bloomfilter_found(self->filter, user != NULL);
+
+    return result;
+}
+
+/////
+int usertable_add(usertable_t *self, const char *username, const char *password)
+{
+    if (self->user_db == NULL || !_usertable_valid_field(username) || !_usertable_valid_field(password))
+        return -1;
+
+    int id = -1;
+
+    // appends are serialized on their own lock, so rows are in id order and a name is only written once
+    //   the table lock is only taken around the lookup and to publish the user once the row is on disk,
+    //   so finds never wait behind the write
+    pthread_mutex_lock(&(self->append_lock));
+
+    pthread_mutex_lock(&(self->table_lock));
+    bool exists = _usertable_find(self, username) != NULL;
+    int next_id = self->last_id + 1;
+    pthread_mutex_unlock(&(self->table_lock));
+
+    if (!exists)
+    {
+        char **user_data = datafile_new_row_array(self->user_db);
+        datafile_set_col(self->user_db, &user_data, "username", username);
+        datafile_set_col(self->user_db, &user_data, "password", password);
+
+        if (datafile_append_row(self->user_db, next_id, &user_data))
+        {
+            pthread_mutex_lock(&(self->table_lock));
+            if (_usertable_insert(self, next_id, username, password))
+                id = next_id;
+            pthread_mutex_unlock(&(self->table_lock));
+        }
+
+        datafile_free_row(self->user_db, &user_data);
+    }
+
+    pthread_mutex_unlock(&(self->append_lock));
+
+    return id;
+}
+
+/////
+uint32_t usertable_count(usertable_t *self, uint32_t *num_slots)
+{
+    pthread_mutex_lock(&(self->table_lock));
+
+    uint32_t num_users = self->num_users;
+    *num_slots = self->num_slots;
+
+    pthread_mutex_unlock(&(self->table_lock));
+
+    return num_users;
+}
+
+/////
+int usertable_reload(usertable_t *self)
+{
+    FILE *fp = self->user_db != NULL ? fopen(self->user_db->filename, "r") : NULL;
+
+    if (fp == NULL)
+        return -1;
+
+    // a scratch table shares the filter, which only ever gains names, so it never turns a reloaded user away
+    usertable_t fresh = {0};
+    fresh.user_db = self->user_db;
+    fresh.filter = self->filter;
+    fresh.num_slots = USERTABLE_INITIAL_SLOTS;
+    fresh.slots = calloc(fresh.num_slots, sizeof(usertable_slot_t));
+
+    if (fresh.slots == NULL)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    // loaded under the append lock so a user added meanwhile is either in the file or waits for the new table
+    //   the old table keeps answering finds until it is swapped
+    pthread_mutex_lock(&(self->append_lock));
+
+    flock(fileno(fp), LOCK_SH);
+    _usertable_load(&fresh, fp);
+    flock(fileno(fp), LOCK_UN);
+
+    pthread_mutex_lock(&(self->table_lock));
+
+    usertable_user_t *old_users = self->users;
+    uint32_t old_num_users = self->num_users;
+    usertable_slot_t *old_slots = self->slots;
+
+    self->users = fresh.users;
+    self->num_users = fresh.num_users;
+    self->max_users = fresh.max_users;
+    self->slots = fresh.slots;
+    self->num_slots = fresh.num_slots;
+
+    // ids are never handed out twice, even if the file lost its last users
+    if (fresh.last_id > self->last_id)
+        self->last_id = fresh.last_id;
+
+    int num_users = (int)self->num_users;
+
+    pthread_mutex_unlock(&(self->table_lock));
+    pthread_mutex_unlock(&(self->append_lock));
+
+    fclose(fp);
+
+    for (uint32_t i=0; i<old_num_users; i++)
+    {
+        free(old_users[i].username);
+        free(old_users[i].password);
+    }
+
+    free(old_users);
+    free(old_slots);
+
+    return num_users;
+}
@@ -0,0 +1,100 @@
+/*
+ * USER TABLE CLASS PROTOTYPE
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: users.db held in memory and shared by every connection
+ *                Users are loaded once at startup and indexed by an open addressing hash table on
+ *                username, so looking one up costs the same however many users there are.  New users
+ *                are appended to the file and the table together.  Users are never removed, so the
+ *                index needs no tombstones.
+ * Usage:       Instantiate with: usertable_t *myusers = new_usertable(filename)
+ */
+#pragma once
+
+#ifndef USERTABLE_H_INCLUDED
+#define USERTABLE_H_INCLUDED
+
+#define USERTABLE_INITIAL_SLOTS 1024        // index slots, always a power of two
+#define USERTABLE_MAX_LOAD 0.5              // the index doubles once it is this full
+
+// usertable_login() results other than a user_id
+#define USERTABLE_NO_USER -1
+#define USERTABLE_BAD_PASSWORD -2
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+#include "datafile.h"
+#include "bloomfilter.h"
+
+// USER
+typedef struct
+{
+    int id;
+    char *username;
+    char *password;
+} usertable_user_t;
+
+// INDEX SLOT
+//   user is an index into users plus one, so a zeroed slot is empty
+typedef struct
+{
+    uint32_t hash;
+    uint32_t user;
+} usertable_slot_t;
+
+// USERTABLE OBJECT
+typedef struct
+{
+    int gc_id;
+    datafile_t *user_db;                // NULL if the file could not be opened, the table is then read only
+
+    pthread_mutex_t append_lock;        // one new user at a time, so rows go into the file in id order
+    pthread_mutex_t table_lock;         // the table, only held while it is read or changed in memory
+    usertable_user_t *users;
+    uint32_t num_users;
+    uint32_t max_users;
+    usertable_slot_t *slots;
+    uint32_t num_slots;
+    int last_id;
+
+    bloomfilter_t *filter;              // usernames, turns most unknown names away before taking table_lock
+} usertable_t;
+
+// CONSTRUCTOR
+//   loads every user in filename
+usertable_t *new_usertable(const char *filename);
+
+// DESTRUCTOR
+void usertable_destroy(void *);
+
+// METHODS
+
+// usertable_exists()
+//   Checks if a given username already exists
+bool usertable_exists(usertable_t *self, const char *username);
+
+// usertable_login()
+//   Returns the user_id if username has password, otherwise USERTABLE_NO_USER or USERTABLE_BAD_PASSWORD
+int usertable_login(usertable_t *self, const char *username, const char *password);
+
+// usertable_add()
+//   Adds a user to the file and the table, returns its user_id or -1 if the name is taken or it could not be saved
+int usertable_add(usertable_t *self, const char *username, const char *password);
+
+// usertable_count()
+//   Returns the number of users, and the size of the index through num_slots
+uint32_t usertable_count(usertable_t *self, uint32_t *num_slots);
+
+// usertable_reload()
+//   Rebuilds the table and its index from the file, for users that were changed in users.db by hand
+//   Logins wait while the file is read.  Returns the number of users, -1 if the file could not be read
+int usertable_reload(usertable_t *self);
+
+#endif
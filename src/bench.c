@@ -0,0 +1,506 @@
+/*
+ * DATAFILE BENCHMARK
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Times the datafile operations and the catalog functions built on them against synthetic
+ *                catalog, request and user tables of growing size, to see how each one scales.
+ *
+ *                Tables are written once per size and read from the page cache, so the times are the
+ *                cost of parsing and rewriting rows rather than of the disk.  Each case is run until
+ *                its time budget is spent or it has run BENCH_MAX_ITERATIONS times, and at least once.
+ *                Cases that only read come first, and cases that add rows last, so every case sees a
+ *                table of the size it is reported at.
+ *
+ *                Results are written to stdout as tab separated rows under a header line, one per size
+ *                and case in a fixed order, so runs can be compared with diff or loaded as a table.
+ *                Cases skipped for their size have 0 iterations and "-" for every time.  Progress goes
+ *                to stderr.
+ * Usage:       make bench
+ *              ./bin/bench [-s rows,rows,...] [-t budget_ms] [-n max_iterations] [-r report_max_rows] [-d dir] [-k]
+ */
+
+#include <time.h>
+
+#include "common.h"
+#include "datafile.h"
+#include "catalog.h"
+#include "bloomfilter.h"
+
+#define BENCH_DEFAULT_SIZES "1000,10000,100000,1000000"
+#define BENCH_DEFAULT_BUDGET_MS 1000
+#define BENCH_MAX_ITERATIONS 100
+#define BENCH_REPORT_MAX_ROWS 1000      // reports look up every book, so they grow with the square of the rows
+#define BENCH_MAX_SIZES 16
+#define BENCH_DEFAULT_DIR "data"
+#define BENCH_DATE "2020-04-19 00:00:00"
+
+#define BENCH_CATALOG_FILENAME "bench_catalog.db"
+#define BENCH_REQUESTS_FILENAME "bench_catalog_requests.db"
+#define BENCH_USERS_FILENAME "bench_users.db"
+#define BENCH_REPORT_FILENAME "bench_inventory_report.txt"
+
+extern bloomfilter_t *global_bf;
+
+// BENCH TABLES
+//   the synthetic tables of one size
+typedef struct
+{
+    int rows;
+    catalog_t catalog;                  // catalog_db and requests_db, without a garbage collector entry
+    datafile_t *users_db;
+    char report_filename[DATAFILE_FILENAME_MAXLEN];
+
+    unsigned int seed;
+    int num_added;                      // rows added by add_row cases, for unique names
+} bench_tables_t;
+
+// BENCH CASE
+typedef struct
+{
+    const char *table;
+    const char *operation;
+    void (*run)(bench_tables_t *tables);
+    bool report;                        // skipped for tables over the report limit
+} bench_case_t;
+
+int bench_budget_ms = BENCH_DEFAULT_BUDGET_MS;
+int bench_max_iterations = BENCH_MAX_ITERATIONS;
+int bench_report_max_rows = BENCH_REPORT_MAX_ROWS;
+
+// HELPERS
+uint64_t _bench_now_ns();
+int _bench_random_id(bench_tables_t *tables);
+bool _bench_write_table(const char *filename, const char *header, int rows, void (*write_row)(FILE *fp, int id, int rows));
+void _bench_catalog_row(FILE *fp, int id, int rows);
+void _bench_request_row(FILE *fp, int id, int rows);
+void _bench_user_row(FILE *fp, int id, int rows);
+void _bench_count(const char *value, void *arg);
+void _bench_get_row_by_field(datafile_t *table, const char *field_name, const char *field_value);
+void _bench_update_row(datafile_t *table, int id, const char *field_name, const char *field_value);
+void _bench_add_row(datafile_t *table, const char **field_names, const char **values, int num_values);
+int _bench_compare(const void *a, const void *b);
+void _bench_run_case(const bench_case_t *bench_case, bench_tables_t *tables);
+
+// CASES
+void _bench_catalog_get_row_by_field(bench_tables_t *tables);
+void _bench_catalog_scan(bench_tables_t *tables);
+void _bench_requests_get_row_by_field(bench_tables_t *tables);
+void _bench_requests_scan(bench_tables_t *tables);
+void _bench_users_get_row_by_field(bench_tables_t *tables);
+void _bench_users_scan(bench_tables_t *tables);
+void _bench_avail_qty(bench_tables_t *tables);
+void _bench_inventory_report(bench_tables_t *tables);
+void _bench_availability_report(bench_tables_t *tables);
+void _bench_catalog_update_row(bench_tables_t *tables);
+void _bench_requests_update_row(bench_tables_t *tables);
+void _bench_users_update_row(bench_tables_t *tables);
+void _bench_catalog_add_row(bench_tables_t *tables);
+void _bench_requests_add_row(bench_tables_t *tables);
+void _bench_users_add_row(bench_tables_t *tables);
+
+// every size runs these in this order
+const bench_case_t bench_cases[] = {
+    {"catalog", "get_row_by_field", _bench_catalog_get_row_by_field, false},
+    {"catalog", "scan", _bench_catalog_scan, false},
+    {"catalog_requests", "get_row_by_field", _bench_requests_get_row_by_field, false},
+    {"catalog_requests", "scan", _bench_requests_scan, false},
+    {"users", "get_row_by_field", _bench_users_get_row_by_field, false},
+    {"users", "scan", _bench_users_scan, false},
+    {"catalog", "catalog_get_book_avail_qty", _bench_avail_qty, false},
+    {"catalog", "catalog_generate_report", _bench_inventory_report, true},
+    {"catalog", "catalog_get_availability_report", _bench_availability_report, true},
+    {"catalog", "update_row", _bench_catalog_update_row, false},
+    {"catalog_requests", "update_row", _bench_requests_update_row, false},
+    {"users", "update_row", _bench_users_update_row, false},
+    {"catalog", "add_row", _bench_catalog_add_row, false},
+    {"catalog_requests", "add_row", _bench_requests_add_row, false},
+    {"users", "add_row", _bench_users_add_row, false},
+};
+
+/////
+uint64_t _bench_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Description: returns the id of a row that was in the table when it was written
+int _bench_random_id(bench_tables_t *tables)
+{
+    return 1 + rand_r(&(tables->seed)) % tables->rows;
+}
+
+// Description: writes a table of rows straight to its file, much faster than adding them one at a time
+bool _bench_write_table(const char *filename, const char *header, int rows, void (*write_row)(FILE *fp, int id, int rows))
+{
+    FILE *fp = fopen(filename, "w");
+
+    if (fp == NULL)
+        return false;
+
+    fprintf(fp, "%s\n", header);
+
+    for (int id=1; id<=rows; id++)
+        write_row(fp, id, rows);
+
+    return fclose(fp) == 0;
+}
+
+/////
+void _bench_catalog_row(FILE *fp, int id, int rows)
+{
+    fprintf(fp, "%d\t" BENCH_DATE "\t" BENCH_DATE "\tbook_%d\t%d\n", id, id, 100 + id % 50);
+}
+
+// Description: a request per row, spread over every book and a user for every ten rows
+void _bench_request_row(FILE *fp, int id, int rows)
+{
+    int users = rows / 10 > 0 ? rows / 10 : 1;
+
+    fprintf(fp, "%d\t" BENCH_DATE "\t" BENCH_DATE "\t%d\t%d\t%d\n", id, 1 + id % users, 1 + (int)((id * 7919L) % rows), 1 + id % 3);
+}
+
+/////
+void _bench_user_row(FILE *fp, int id, int rows)
+{
+    fprintf(fp, "%d\t" BENCH_DATE "\t" BENCH_DATE "\tuser_%d\tpassword\n", id, id);
+}
+
+/////
+void _bench_count(const char *value, void *arg)
+{
+    (*(int *)arg)++;
+}
+
+/////
+void _bench_get_row_by_field(datafile_t *table, const char *field_name, const char *field_value)
+{
+    datafile_get_row_prepare(table);
+    char **row = datafile_get_row_by_field(table, field_name, field_value);
+
+    if (row != NULL)
+        datafile_free_row(table, &row);
+}
+
+/////
+void _bench_update_row(datafile_t *table, int id, const char *field_name, const char *field_value)
+{
+    char **row = datafile_new_row_array(table);
+
+    datafile_set_col(table, &row, field_name, field_value);
+    datafile_update_row(table, id, &row);
+    datafile_free_row(table, &row);
+}
+
+/////
+void _bench_add_row(datafile_t *table, const char **field_names, const char **values, int num_values)
+{
+    char **row = datafile_new_row_array(table);
+
+    for (int i=0; i<num_values; i++)
+        datafile_set_col(table, &row, field_names[i], values[i]);
+
+    datafile_add_row(table, &row);
+    datafile_free_row(table, &row);
+}
+
+/////
+int _bench_compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Description: times a case until its budget is spent and writes its result row
+void _bench_run_case(const bench_case_t *bench_case, bench_tables_t *tables)
+{
+    uint64_t *samples = malloc(bench_max_iterations * sizeof(uint64_t));
+    uint64_t total_ns = 0;
+    int iterations = 0;
+
+    if (samples == NULL)
+        exit_error("Benchmark memory allocation failed");
+
+    if (!bench_case->report || tables->rows <= bench_report_max_rows)
+    {
+        fprintf(stderr, "%d rows: %s %s\n", tables->rows, bench_case->table, bench_case->operation);
+
+        while (iterations < bench_max_iterations && (iterations == 0 || total_ns < bench_budget_ms * 1000000ULL))
+        {
+            uint64_t start_ns = _bench_now_ns();
+            bench_case->run(tables);
+            samples[iterations] = _bench_now_ns() - start_ns;
+
+            total_ns += samples[iterations++];
+        }
+    }
+    else
+        fprintf(stderr, "%d rows: %s %s skipped, over the report limit of %d rows\n", tables->rows, bench_case->table,
+            bench_case->operation, bench_report_max_rows);
+
+    printf("%d\t%s\t%s\t%d", tables->rows, bench_case->table, bench_case->operation, iterations);
+
+    if (iterations == 0)
+        printf("\t-\t-\t-\t-\n");
+    else
+    {
+        qsort(samples, iterations, sizeof(uint64_t), _bench_compare);
+        printf("\t%lu\t%lu\t%lu\t%lu\n", (unsigned long)(total_ns / iterations), (unsigned long)samples[0],
+            (unsigned long)samples[iterations / 2], (unsigned long)samples[iterations - 1]);
+    }
+
+    fflush(stdout);
+    free(samples);
+}
+
+// CASES
+
+/////
+void _bench_catalog_get_row_by_field(bench_tables_t *tables)
+{
+    char book_name[32];
+    sprintf(book_name, "book_%d", _bench_random_id(tables));
+
+    _bench_get_row_by_field(tables->catalog.catalog_db, "book_name", book_name);
+}
+
+/////
+void _bench_catalog_scan(bench_tables_t *tables)
+{
+    int count = 0;
+    datafile_for_each_value(tables->catalog.catalog_db, "book_name", _bench_count, &count);
+}
+
+/////
+void _bench_requests_get_row_by_field(bench_tables_t *tables)
+{
+    char book_id[16];
+    sprintf(book_id, "%d", _bench_random_id(tables));
+
+    _bench_get_row_by_field(tables->catalog.requests_db, "book_id", book_id);
+}
+
+/////
+void _bench_requests_scan(bench_tables_t *tables)
+{
+    int count = 0;
+    datafile_for_each_value(tables->catalog.requests_db, "book_id", _bench_count, &count);
+}
+
+/////
+void _bench_users_get_row_by_field(bench_tables_t *tables)
+{
+    char username[32];
+    sprintf(username, "user_%d", _bench_random_id(tables));
+
+    _bench_get_row_by_field(tables->users_db, "username", username);
+}
+
+/////
+void _bench_users_scan(bench_tables_t *tables)
+{
+    int count = 0;
+    datafile_for_each_value(tables->users_db, "username", _bench_count, &count);
+}
+
+/////
+void _bench_avail_qty(bench_tables_t *tables)
+{
+    char book_name[32];
+    sprintf(book_name, "book_%d", _bench_random_id(tables));
+
+    catalog_get_book_avail_qty(&(tables->catalog), book_name);
+}
+
+/////
+void _bench_inventory_report(bench_tables_t *tables)
+{
+    catalog_generate_report(&(tables->catalog), tables->report_filename);
+}
+
+/////
+void _bench_availability_report(bench_tables_t *tables)
+{
+    free(catalog_get_availability_report(&(tables->catalog)));
+}
+
+/////
+void _bench_catalog_update_row(bench_tables_t *tables)
+{
+    char qty[16];
+    sprintf(qty, "%d", 100 + rand_r(&(tables->seed)) % 50);
+
+    _bench_update_row(tables->catalog.catalog_db, _bench_random_id(tables), "qty_total", qty);
+}
+
+/////
+void _bench_requests_update_row(bench_tables_t *tables)
+{
+    char qty[16];
+    sprintf(qty, "%d", 1 + rand_r(&(tables->seed)) % 3);
+
+    _bench_update_row(tables->catalog.requests_db, _bench_random_id(tables), "qty_requested", qty);
+}
+
+/////
+void _bench_users_update_row(bench_tables_t *tables)
+{
+    _bench_update_row(tables->users_db, _bench_random_id(tables), "password", "drowssap");
+}
+
+/////
+void _bench_catalog_add_row(bench_tables_t *tables)
+{
+    const char *field_names[] = {"book_name", "qty_total"};
+    char book_name[32];
+    sprintf(book_name, "new_book_%d", ++tables->num_added);
+    const char *values[] = {book_name, "100"};
+
+    _bench_add_row(tables->catalog.catalog_db, field_names, values, 2);
+}
+
+/////
+void _bench_requests_add_row(bench_tables_t *tables)
+{
+    const char *field_names[] = {"user_id", "book_id", "qty_requested"};
+    char book_id[16];
+    sprintf(book_id, "%d", _bench_random_id(tables));
+    const char *values[] = {"1", book_id, "1"};
+
+    _bench_add_row(tables->catalog.requests_db, field_names, values, 3);
+}
+
+/////
+void _bench_users_add_row(bench_tables_t *tables)
+{
+    const char *field_names[] = {"username", "password"};
+    char username[32];
+    sprintf(username, "new_user_%d", ++tables->num_added);
+    const char *values[] = {username, "password"};
+
+    _bench_add_row(tables->users_db, field_names, values, 2);
+}
+
+/////
+void print_usage()
+{
+    printf("usage: bench [-s rows,rows,...] [-t budget_ms] [-n max_iterations] [-r report_max_rows] [-d dir] [-k]\n");
+    printf("  defaults are %s rows, %d ms and at most %d runs per case, reports up to %d rows\n",
+        BENCH_DEFAULT_SIZES, BENCH_DEFAULT_BUDGET_MS, BENCH_MAX_ITERATIONS, BENCH_REPORT_MAX_ROWS);
+    printf("  tables are written to dir, %s by default, and removed afterwards unless -k is given\n", BENCH_DEFAULT_DIR);
+    printf("  run it from the server root directory, results are tab separated on stdout, times in ns\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = BENCH_DEFAULT_DIR;
+    char sizes_arg[256] = BENCH_DEFAULT_SIZES;
+    int sizes[BENCH_MAX_SIZES];
+    int num_sizes = 0;
+    bool keep = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:t:n:r:d:kh")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                if (strlen(optarg) >= sizeof(sizes_arg))
+                {
+                    print_usage();
+                    return EXIT_FAILURE;
+                }
+                strcpy(sizes_arg, optarg);
+                break;
+            case 't': bench_budget_ms = atoi(optarg); break;
+            case 'n': bench_max_iterations = atoi(optarg); break;
+            case 'r': bench_report_max_rows = atoi(optarg); break;
+            case 'd': dir = optarg; break;
+            case 'k': keep = true; break;
+            default:
+                print_usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    char *save = NULL;
+    for (char *size = strtok_r(sizes_arg, ",", &save); size != NULL && num_sizes < BENCH_MAX_SIZES; size = strtok_r(NULL, ",", &save))
+        sizes[num_sizes++] = atoi(size);
+
+    bool valid = num_sizes > 0 && bench_budget_ms >= 0 && bench_max_iterations > 0 && strlen(dir) < DATAFILE_FILENAME_MAXLEN - 32;
+
+    for (int i=0; i<num_sizes; i++)
+        valid = valid && sizes[i] > 0;
+
+    if (!valid)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    init();
+
+    char catalog_filename[DATAFILE_FILENAME_MAXLEN];
+    char requests_filename[DATAFILE_FILENAME_MAXLEN];
+    char users_filename[DATAFILE_FILENAME_MAXLEN];
+    sprintf(catalog_filename, "%s/" BENCH_CATALOG_FILENAME, dir);
+    sprintf(requests_filename, "%s/" BENCH_REQUESTS_FILENAME, dir);
+    sprintf(users_filename, "%s/" BENCH_USERS_FILENAME, dir);
+
+    printf("rows\ttable\toperation\titerations\tmean_ns\tmin_ns\tmedian_ns\tmax_ns\n");
+
+    for (int i=0; i<num_sizes; i++)
+    {
+        bench_tables_t tables = {0};
+        tables.rows = sizes[i];
+        tables.seed = (unsigned int)sizes[i];
+        sprintf(tables.report_filename, "%s/" BENCH_REPORT_FILENAME, dir);
+
+        fprintf(stderr, "%d rows: writing tables to %s\n", tables.rows, dir);
+
+        if (!_bench_write_table(catalog_filename, "id\tdate_created\tdate_updated\tbook_name\tqty_total", tables.rows, _bench_catalog_row) ||
+            !_bench_write_table(requests_filename, "id\tdate_created\tdate_updated\tuser_id\tbook_id\tqty_requested", tables.rows, _bench_request_row) ||
+            !_bench_write_table(users_filename, "id\tdate_created\tdate_updated\tusername\tpassword", tables.rows, _bench_user_row))
+        {
+            fprintf(stderr, "Could not write the tables to %s\n", dir);
+            return EXIT_FAILURE;
+        }
+
+        tables.catalog.catalog_db = new_datafile(catalog_filename);
+        tables.catalog.requests_db = new_datafile(requests_filename);
+        tables.users_db = new_datafile(users_filename);
+
+        // the server's book filter holds every book in its catalog, so lookups of books that exist go on to the file
+        if (global_bf != NULL)
+            bloomfilter_destroy(global_bf);
+        global_bf = new_bloomfilter(tables.rows * 2);
+
+        for (int id=1; id<=tables.rows; id++)
+        {
+            char book_name[32];
+            sprintf(book_name, "book_%d", id);
+            bloomfilter_add(global_bf, book_name);
+        }
+
+        for (unsigned int c=0; c<sizeof(bench_cases) / sizeof(bench_cases[0]); c++)
+            _bench_run_case(&(bench_cases[c]), &tables);
+
+        datafile_destroy(tables.catalog.catalog_db);
+        datafile_destroy(tables.catalog.requests_db);
+        datafile_destroy(tables.users_db);
+
+        if (!keep)
+        {
+            remove(catalog_filename);
+            remove(requests_filename);
+            remove(users_filename);
+            remove(tables.report_filename);
+        }
+    }
+
+    exit(EXIT_SUCCESS);
+}
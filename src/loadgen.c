@@ -0,0 +1,917 @@
+/*
+ * CATALOG LOAD GENERATOR
+ * Author:      Aaron Bishop
+ * Date:        4/19/2020
+ * Description: Drives a running Catalog Server with a mix of commands over many protocol v2 connections
+ *                and reports throughput and latency percentiles of each command.
+ *
+ *                Connections are shared out among threads, each of which waits on its own with epoll.
+ *                A connection has one command outstanding at a time.  Without a rate every connection
+ *                sends its next command as soon as the last is answered (closed loop).  With a rate the
+ *                commands are due at fixed intervals whether or not the server keeps up (open loop):
+ *                a command due while every connection is busy waits for one, and its latency counts
+ *                from when it was due, so a server that falls behind shows it in the percentiles instead
+ *                of in a lower send rate.
+ *
+ *                Commands due during the warm-up are run but not counted.  Latencies go into the same
+ *                log-linear buckets as the server's own statistics, see metrics.h.
+ * Usage:       make loadgen
+ *              ./bin/loadgen [-c connections] [-t threads] [-d seconds] [-w warmup_seconds] [-r ops_per_sec]
+ *                            [-m mix] [-b books] [-l user:password] [-p port] [-j] [ADDRESS|SOCKET_PATH]
+ */
+
+#include <time.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "tcpserver.h"
+#include "catalog_protocol.h"
+#include "metrics.h"
+
+#define LOADGEN_DEFAULT_ADDRESS "127.0.0.1"
+#define LOADGEN_DEFAULT_PORT 31337
+#define LOADGEN_DEFAULT_CONNECTIONS 16
+#define LOADGEN_DEFAULT_THREADS 4
+#define LOADGEN_DEFAULT_DURATION 10
+#define LOADGEN_DEFAULT_WARMUP 2
+#define LOADGEN_DEFAULT_BOOKS 16
+#define LOADGEN_DEFAULT_MIX "request=40,return=40,availability=10,add=5,login=4,report=1"
+#define LOADGEN_DEFAULT_USER "admin"
+#define LOADGEN_DEFAULT_PASSWORD "password"
+
+#define LOADGEN_BOOK_PREFIX "loadgen_"
+#define LOADGEN_BOOK_QTY 1000000            // added to each book before the run, so requests keep being granted
+#define LOADGEN_DRAIN_MS 5000               // how long commands still outstanding at the end are waited for
+#define LOADGEN_FRAME_MAXLEN (CATALOG_V2_HEADER_LEN + CATALOG_V2_PAYLOAD_MAXLEN)
+#define LOADGEN_RECV_BUFLEN 65536
+#define LOADGEN_MAX_EVENTS 64
+
+// operations, in the order they are reported
+#define LOADGEN_LOGIN 0
+#define LOADGEN_ADD 1
+#define LOADGEN_REQUEST 2
+#define LOADGEN_RETURN 3
+#define LOADGEN_AVAILABILITY 4
+#define LOADGEN_REPORT 5
+#define LOADGEN_OPS 6
+
+const char *loadgen_op_names[LOADGEN_OPS] = {"login", "add", "request", "return", "availability", "report"};
+const uint8_t loadgen_op_codes[LOADGEN_OPS] = {
+    CATALOG_CMD_CONNECT, CATALOG_CMD_ADD_BOOK, CATALOG_CMD_REQUEST_BOOK,
+    CATALOG_CMD_RETURN_BOOK, CATALOG_CMD_GET_AVAILABILITY, CATALOG_CMD_REQUEST_REPORT
+};
+
+// LOADGEN CONFIG
+//   set from the command line, read by every thread
+typedef struct
+{
+    const char *address;                // a host address, or the path of the server's unix socket
+    int port;
+    int num_connections;
+    int num_threads;
+    int duration;
+    int warmup;
+    double rate;                        // ops/sec across every connection, 0 for closed loop
+    int weights[LOADGEN_OPS];
+    int total_weight;
+    int num_books;
+    char user[CATALOG_V2_FIELD_MAXLEN+1];
+    char password[CATALOG_V2_FIELD_MAXLEN+1];
+    bool json;
+
+    uint64_t start_ns;
+    uint64_t measure_ns;                // end of the warm-up
+    uint64_t end_ns;
+} loadgen_config_t;
+
+// LOADGEN STATS
+//   latencies of one operation on one thread
+typedef struct
+{
+    unsigned long count;
+    unsigned long failed;               // answered with a status other than OK or THROTTLED
+    unsigned long throttled;
+    unsigned long sum_ns;
+    unsigned long max_ns;
+    unsigned long buckets[METRICS_BUCKETS];
+} loadgen_stats_t;
+
+// LOADGEN CONNECTION
+typedef struct
+{
+    int fd;
+    bool busy;
+    bool dead;
+
+    int op;                             // the outstanding command
+    int book;
+    uint32_t request_id;
+    uint64_t due_ns;
+
+    char header[CATALOG_V2_HEADER_LEN]; // the reply frame being read
+    int header_len;
+    catalog_v2_header_t reply;
+    uint32_t payload_left;
+
+    int *held;                          // books this connection has requested and not returned, by book
+} loadgen_connection_t;
+
+// LOADGEN THREAD
+typedef struct
+{
+    pthread_t thread;
+    unsigned int seed;
+
+    loadgen_connection_t *connections;
+    int num_connections;
+    double rate;                        // this thread's share of the rate
+
+    loadgen_stats_t stats[LOADGEN_OPS];
+    unsigned long disconnects;
+    unsigned long unfinished;           // outstanding when the drain ran out
+    unsigned long unsent;               // due but still waiting for a connection at the end
+    unsigned long max_backlog;          // most commands due and waiting for a connection at once
+} loadgen_thread_t;
+
+loadgen_config_t config;
+
+// HELPERS
+uint64_t _loadgen_now_ns();
+int _loadgen_connect();
+int _loadgen_encode(int op, int book, int qty, uint32_t request_id, char *frame);
+bool _loadgen_recv_exact(int fd, char *buffer, size_t len);
+int _loadgen_call(int fd, int op, int book, int qty, uint32_t request_id);
+bool _loadgen_parse_mix(const char *mix);
+int _loadgen_pick_op(loadgen_thread_t *thread);
+int _loadgen_pick_book(loadgen_thread_t *thread, loadgen_connection_t *conn, int op);
+bool _loadgen_send(loadgen_thread_t *thread, loadgen_connection_t *conn, uint64_t due_ns);
+void _loadgen_complete(loadgen_thread_t *thread, loadgen_connection_t *conn, uint64_t now_ns);
+int _loadgen_receive(loadgen_thread_t *thread, loadgen_connection_t *conn, char *buffer);
+void _loadgen_close(loadgen_thread_t *thread, loadgen_connection_t *conn);
+void *_loadgen_run(void *arg);
+void _loadgen_merge(loadgen_thread_t *threads, loadgen_stats_t *merged);
+void _loadgen_print_text(loadgen_thread_t *threads, loadgen_stats_t *merged);
+void _loadgen_print_json(loadgen_thread_t *threads, loadgen_stats_t *merged);
+
+/////
+uint64_t _loadgen_now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Description: opens a blocking connection to the server, an address containing a "/" is a unix socket path
+int _loadgen_connect()
+{
+    int fd;
+
+    if (strchr(config.address, '/') != NULL)
+    {
+        struct sockaddr_un addr = {0};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, config.address, sizeof(addr.sun_path) - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+    }
+    else
+    {
+        struct sockaddr_in addr = {0};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(config.port);
+
+        if (inet_pton(AF_INET, config.address, &(addr.sin_addr)) != 1)
+            return -1;
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            // one small frame at a time, nagle would only hold it back
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            return fd;
+        }
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return -1;
+}
+
+// Description: writes the request frame of an operation into frame, returns its length
+int _loadgen_encode(int op, int book, int qty, uint32_t request_id, char *frame)
+{
+    char *payload = frame + CATALOG_V2_HEADER_LEN;
+    uint32_t len = 0;
+    uint32_t net_qty = htonl((uint32_t)qty);
+    uint16_t str_len;
+
+    switch (op)
+    {
+        case LOADGEN_LOGIN:
+            str_len = (uint16_t)strlen(config.user);
+            payload[len++] = (char)(str_len >> 8);
+            payload[len++] = (char)(str_len & 0xFF);
+            memcpy(payload + len, config.user, str_len);
+            len += str_len;
+
+            str_len = (uint16_t)strlen(config.password);
+            payload[len++] = (char)(str_len >> 8);
+            payload[len++] = (char)(str_len & 0xFF);
+            memcpy(payload + len, config.password, str_len);
+            catalog_xor_crypt_len(payload + len, str_len, AUTH_PASSWORD_XOR);
+            len += str_len;
+            break;
+
+        case LOADGEN_ADD:
+        case LOADGEN_REQUEST:
+        case LOADGEN_RETURN:
+            memcpy(payload, &net_qty, sizeof(uint32_t));
+            len = sizeof(uint32_t);
+
+            str_len = (uint16_t)sprintf(payload + len + 2, LOADGEN_BOOK_PREFIX "%d", book);
+            payload[len++] = (char)(str_len >> 8);
+            payload[len++] = (char)(str_len & 0xFF);
+            len += str_len;
+            break;
+
+        case LOADGEN_REPORT:
+            // listener port 0 streams the report back on this connection
+            payload[len++] = 0;
+            payload[len++] = 0;
+            break;
+
+        default:
+            break;
+    }
+
+    catalog_v2_encode_header(frame, loadgen_op_codes[op], 0, request_id, len);
+
+    return (int)(CATALOG_V2_HEADER_LEN + len);
+}
+
+/////
+bool _loadgen_recv_exact(int fd, char *buffer, size_t len)
+{
+    size_t received = 0;
+
+    while (received < len)
+    {
+        ssize_t n = recv(fd, buffer + received, len - received, 0);
+
+        if (n <= 0)
+            return false;
+
+        received += n;
+    }
+
+    return true;
+}
+
+// Description: runs one operation on a blocking connection and waits for its last reply frame
+//   returns its status, or -1 if the connection closed
+int _loadgen_call(int fd, int op, int book, int qty, uint32_t request_id)
+{
+    char frame[LOADGEN_FRAME_MAXLEN];
+    int len = _loadgen_encode(op, book, qty, request_id, frame);
+
+    if (send(fd, frame, len, 0) != len)
+        return -1;
+
+    while (true)
+    {
+        char header_buffer[CATALOG_V2_HEADER_LEN];
+        catalog_v2_header_t header;
+
+        if (!_loadgen_recv_exact(fd, header_buffer, CATALOG_V2_HEADER_LEN))
+            return -1;
+
+        catalog_v2_decode_header(header_buffer, &header);
+
+        for (uint32_t left = header.length; left > 0; )
+        {
+            uint32_t chunk = left < sizeof(frame) ? left : sizeof(frame);
+            if (!_loadgen_recv_exact(fd, frame, chunk))
+                return -1;
+            left -= chunk;
+        }
+
+        if (header.request_id == request_id && !(header.flags & CATALOG_V2_FLAG_MORE))
+            return header.status;
+    }
+}
+
+// Description: reads a mix such as "request=40,return=40" into the weights, operations left out are not run
+bool _loadgen_parse_mix(const char *mix)
+{
+    char buffer[256];
+    char *save = NULL;
+
+    if (strlen(mix) >= sizeof(buffer))
+        return false;
+
+    strcpy(buffer, mix);
+    memset(config.weights, 0, sizeof(config.weights));
+    config.total_weight = 0;
+
+    for (char *item = strtok_r(buffer, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(item, '=');
+        int op;
+
+        if (value == NULL)
+            return false;
+
+        *value++ = '\0';
+
+        for (op=0; op<LOADGEN_OPS; op++)
+        {
+            if (strcmp(item, loadgen_op_names[op]) == 0)
+                break;
+        }
+
+        if (op == LOADGEN_OPS || atoi(value) < 0)
+            return false;
+
+        config.weights[op] = atoi(value);
+        config.total_weight += config.weights[op];
+    }
+
+    return config.total_weight > 0;
+}
+
+/////
+int _loadgen_pick_op(loadgen_thread_t *thread)
+{
+    int pick = rand_r(&(thread->seed)) % config.total_weight;
+    int op = 0;
+
+    while (pick >= config.weights[op])
+        pick -= config.weights[op++];
+
+    return op;
+}
+
+// Description: picks the book of a book command, a return picks a book the connection holds if it has any
+int _loadgen_pick_book(loadgen_thread_t *thread, loadgen_connection_t *conn, int op)
+{
+    int book = rand_r(&(thread->seed)) % config.num_books;
+
+    if (op != LOADGEN_RETURN)
+        return book;
+
+    for (int i=0; i<config.num_books; i++)
+    {
+        int held = (book + i) % config.num_books;
+
+        if (conn->held[held] > 0)
+            return held;
+    }
+
+    return book;
+}
+
+// Description: sends the next command of a connection, due at due_ns
+//   returns false if the connection has gone
+bool _loadgen_send(loadgen_thread_t *thread, loadgen_connection_t *conn, uint64_t due_ns)
+{
+    char frame[LOADGEN_FRAME_MAXLEN];
+
+    if (conn->dead)
+        return false;
+
+    conn->op = _loadgen_pick_op(thread);
+    conn->book = _loadgen_pick_book(thread, conn, conn->op);
+    conn->request_id++;
+    conn->due_ns = due_ns;
+    conn->busy = true;
+
+    // the run moves one copy of a book at a time
+    int len = _loadgen_encode(conn->op, conn->book, 1, conn->request_id, frame);
+
+    // a frame this small always fits the socket buffer of a connection with nothing outstanding
+    if (send(conn->fd, frame, len, 0) != len)
+    {
+        _loadgen_close(thread, conn);
+        return false;
+    }
+
+    return true;
+}
+
+// Description: counts the answered command of a connection
+void _loadgen_complete(loadgen_thread_t *thread, loadgen_connection_t *conn, uint64_t now_ns)
+{
+    loadgen_stats_t *stats = &(thread->stats[conn->op]);
+    uint64_t latency_ns = now_ns - conn->due_ns;
+
+    conn->busy = false;
+
+    if (conn->reply.status == CATALOG_STATUS_OK && conn->op == LOADGEN_REQUEST)
+        conn->held[conn->book]++;
+    else if (conn->reply.status == CATALOG_STATUS_OK && conn->op == LOADGEN_RETURN)
+        conn->held[conn->book]--;
+
+    if (conn->due_ns < config.measure_ns || conn->due_ns >= config.end_ns)
+        return;
+
+    stats->count++;
+    stats->sum_ns += latency_ns;
+    stats->buckets[metrics_bucket(latency_ns)]++;
+
+    if (latency_ns > stats->max_ns)
+        stats->max_ns = latency_ns;
+
+    if (conn->reply.status == CATALOG_STATUS_THROTTLED)
+        stats->throttled++;
+    else if (conn->reply.status != CATALOG_STATUS_OK)
+        stats->failed++;
+}
+
+// Description: reads what has arrived on a connection and completes its command on its last reply frame
+//   returns the number of commands completed, or -1 if the connection has gone
+int _loadgen_receive(loadgen_thread_t *thread, loadgen_connection_t *conn, char *buffer)
+{
+    int completed = 0;
+
+    while (true)
+    {
+        ssize_t n = recv(conn->fd, buffer, LOADGEN_RECV_BUFLEN, 0);
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return completed;
+
+        if (n <= 0)
+        {
+            _loadgen_close(thread, conn);
+            return -1;
+        }
+
+        uint64_t now_ns = _loadgen_now_ns();
+
+        // replies are only counted, so payloads are skipped as they stream past
+        for (ssize_t pos = 0; pos < n; )
+        {
+            if (conn->header_len < CATALOG_V2_HEADER_LEN)
+            {
+                int take = CATALOG_V2_HEADER_LEN - conn->header_len;
+                take = take < n - pos ? take : (int)(n - pos);
+
+                memcpy(conn->header + conn->header_len, buffer + pos, take);
+                conn->header_len += take;
+                pos += take;
+
+                if (conn->header_len < CATALOG_V2_HEADER_LEN)
+                    break;
+
+                catalog_v2_decode_header(conn->header, &(conn->reply));
+                conn->payload_left = conn->reply.length;
+            }
+
+            uint32_t skip = conn->payload_left < (uint32_t)(n - pos) ? conn->payload_left : (uint32_t)(n - pos);
+            conn->payload_left -= skip;
+            pos += skip;
+
+            if (conn->payload_left > 0)
+                break;
+
+            // a whole frame, the command is answered by its last one
+            conn->header_len = 0;
+
+            if (conn->busy && conn->reply.request_id == conn->request_id && !(conn->reply.flags & CATALOG_V2_FLAG_MORE))
+            {
+                _loadgen_complete(thread, conn, now_ns);
+                completed++;
+            }
+        }
+    }
+}
+
+/////
+void _loadgen_close(loadgen_thread_t *thread, loadgen_connection_t *conn)
+{
+    if (conn->dead)
+        return;
+
+    if (_loadgen_now_ns() < config.end_ns)
+        thread->disconnects++;
+
+    close(conn->fd);
+    conn->dead = true;
+    conn->busy = false;
+}
+
+// Description: thread function, drives its connections until the end of the run and the drain after it
+void *_loadgen_run(void *arg)
+{
+    loadgen_thread_t *thread = (loadgen_thread_t *)arg;
+    loadgen_connection_t **idle = malloc(thread->num_connections * sizeof(loadgen_connection_t *));
+    char *buffer = malloc(LOADGEN_RECV_BUFLEN);
+    struct epoll_event events[LOADGEN_MAX_EVENTS];
+
+    int epoll_fd = epoll_create1(0);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    int num_idle = 0;
+    int num_busy = 0;
+
+    for (int i=0; i<thread->num_connections; i++)
+    {
+        loadgen_connection_t *conn = &(thread->connections[i]);
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = conn };
+
+        fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK);
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+        idle[num_idle++] = conn;
+    }
+
+    // the timer wakes the thread when the next command is due, or at the end of the run
+    struct epoll_event timer_event = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event);
+
+    uint64_t interval_ns = thread->rate > 0 ? (uint64_t)(1e9 / thread->rate) : 0;
+    uint64_t next_due_ns = config.start_ns;
+    uint64_t drain_end_ns = config.end_ns + LOADGEN_DRAIN_MS * 1000000ULL;
+    unsigned long backlog = 0;
+
+    while (true)
+    {
+        uint64_t now_ns = _loadgen_now_ns();
+
+        if (now_ns < config.end_ns)
+        {
+            // commands that have come due wait for a connection, the oldest go first
+            if (interval_ns > 0)
+            {
+                while (next_due_ns <= now_ns && next_due_ns < config.end_ns)
+                {
+                    backlog++;
+                    next_due_ns += interval_ns;
+                }
+
+                while (backlog > 0 && num_idle > 0)
+                {
+                    loadgen_connection_t *conn = idle[--num_idle];
+                    if (_loadgen_send(thread, conn, next_due_ns - backlog * interval_ns))
+                        num_busy++;
+                    backlog--;
+                }
+
+                if (backlog > thread->max_backlog)
+                    thread->max_backlog = backlog;
+            }
+            else
+            {
+                while (num_idle > 0)
+                {
+                    loadgen_connection_t *conn = idle[--num_idle];
+                    if (_loadgen_send(thread, conn, now_ns))
+                        num_busy++;
+                }
+            }
+        }
+        else if (num_busy == 0 || now_ns >= drain_end_ns)
+            break;
+
+        if (num_busy == 0 && num_idle == 0)
+            break;
+
+        uint64_t wake_ns = now_ns < config.end_ns ? config.end_ns : drain_end_ns;
+        if (interval_ns > 0 && next_due_ns < wake_ns)
+            wake_ns = next_due_ns;
+
+        struct itimerspec timer = {0};
+        timer.it_value.tv_sec = wake_ns / 1000000000ULL;
+        timer.it_value.tv_nsec = wake_ns % 1000000000ULL;
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+
+        int num_events = epoll_wait(epoll_fd, events, LOADGEN_MAX_EVENTS, -1);
+
+        for (int i=0; i<num_events; i++)
+        {
+            loadgen_connection_t *conn = (loadgen_connection_t *)events[i].data.ptr;
+
+            // the timer only wakes the loop
+            if (conn == NULL)
+            {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+                    expirations = 0;
+                continue;
+            }
+
+            if (conn->dead)
+                continue;
+
+            bool was_busy = conn->busy;
+            int completed = _loadgen_receive(thread, conn, buffer);
+
+            if (completed < 0)
+                num_busy -= was_busy;
+            else if (completed > 0 && was_busy)
+            {
+                num_busy--;
+                idle[num_idle++] = conn;
+            }
+        }
+    }
+
+    thread->unfinished = num_busy;
+    thread->unsent = backlog;
+
+    for (int i=0; i<thread->num_connections; i++)
+    {
+        if (!thread->connections[i].dead)
+            close(thread->connections[i].fd);
+    }
+
+    close(timer_fd);
+    close(epoll_fd);
+    free(buffer);
+    free(idle);
+
+    return NULL;
+}
+
+// Description: adds up every thread's stats, one per operation
+void _loadgen_merge(loadgen_thread_t *threads, loadgen_stats_t *merged)
+{
+    memset(merged, 0, LOADGEN_OPS * sizeof(loadgen_stats_t));
+
+    for (int t=0; t<config.num_threads; t++)
+    {
+        for (int op=0; op<LOADGEN_OPS; op++)
+        {
+            loadgen_stats_t *stats = &(threads[t].stats[op]);
+
+            merged[op].count += stats->count;
+            merged[op].failed += stats->failed;
+            merged[op].throttled += stats->throttled;
+            merged[op].sum_ns += stats->sum_ns;
+            merged[op].max_ns = stats->max_ns > merged[op].max_ns ? stats->max_ns : merged[op].max_ns;
+
+            for (int i=0; i<METRICS_BUCKETS; i++)
+                merged[op].buckets[i] += stats->buckets[i];
+        }
+    }
+}
+
+/////
+void _loadgen_print_text(loadgen_thread_t *threads, loadgen_stats_t *merged)
+{
+    loadgen_stats_t total = {0};
+    unsigned long disconnects = 0, unfinished = 0, unsent = 0, max_backlog = 0;
+
+    for (int t=0; t<config.num_threads; t++)
+    {
+        disconnects += threads[t].disconnects;
+        unfinished += threads[t].unfinished;
+        unsent += threads[t].unsent;
+        max_backlog = threads[t].max_backlog > max_backlog ? threads[t].max_backlog : max_backlog;
+    }
+
+    printf("%d connections on %d threads to %s, %d s after %d s warm-up, ", config.num_connections, config.num_threads,
+        config.address, config.duration, config.warmup);
+
+    if (config.rate > 0)
+        printf("open loop at %.0f ops/sec\n\n", config.rate);
+    else
+        printf("closed loop\n\n");
+
+    printf("%-14s%10s%12s%9s%11s%11s%11s%11s%11s%11s\n", "operation", "ops", "ops/sec", "failed", "throttled",
+        "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+
+    for (int op=0; op<=LOADGEN_OPS; op++)
+    {
+        loadgen_stats_t *stats = op < LOADGEN_OPS ? &(merged[op]) : &total;
+
+        if (op < LOADGEN_OPS)
+        {
+            if (config.weights[op] == 0)
+                continue;
+
+            total.count += stats->count;
+            total.failed += stats->failed;
+            total.throttled += stats->throttled;
+            total.max_ns = stats->max_ns > total.max_ns ? stats->max_ns : total.max_ns;
+            for (int i=0; i<METRICS_BUCKETS; i++)
+                total.buckets[i] += stats->buckets[i];
+        }
+
+        printf("%-14s%10lu%12.1f%9lu%11lu%11.1f%11.1f%11.1f%11.1f%11.1f\n", op < LOADGEN_OPS ? loadgen_op_names[op] : "total",
+            stats->count, stats->count / (double)config.duration, stats->failed, stats->throttled,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.50) / 1e3,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.90) / 1e3,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.99) / 1e3,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.999) / 1e3,
+            stats->max_ns / 1e3);
+    }
+
+    printf("\n");
+    if (config.rate > 0)
+        printf("most commands waiting for a connection: %lu, never sent: %lu\n", max_backlog, unsent);
+    printf("disconnected: %lu, unanswered at the end: %lu\n", disconnects, unfinished);
+}
+
+/////
+void _loadgen_print_json(loadgen_thread_t *threads, loadgen_stats_t *merged)
+{
+    unsigned long count = 0, disconnects = 0, unfinished = 0, unsent = 0, max_backlog = 0;
+
+    for (int t=0; t<config.num_threads; t++)
+    {
+        disconnects += threads[t].disconnects;
+        unfinished += threads[t].unfinished;
+        unsent += threads[t].unsent;
+        max_backlog = threads[t].max_backlog > max_backlog ? threads[t].max_backlog : max_backlog;
+    }
+
+    for (int op=0; op<LOADGEN_OPS; op++)
+        count += merged[op].count;
+
+    printf("{\"connections\": %d, \"threads\": %d, \"duration_s\": %d, \"warmup_s\": %d, \"target_ops_per_sec\": %.1f, ",
+        config.num_connections, config.num_threads, config.duration, config.warmup, config.rate);
+    printf("\"ops\": %lu, \"ops_per_sec\": %.1f, \"max_backlog\": %lu, \"unsent\": %lu, \"disconnects\": %lu, \"unfinished\": %lu, \"operations\": {",
+        count, count / (double)config.duration, max_backlog, unsent, disconnects, unfinished);
+
+    bool first = true;
+
+    for (int op=0; op<LOADGEN_OPS; op++)
+    {
+        loadgen_stats_t *stats = &(merged[op]);
+
+        if (config.weights[op] == 0)
+            continue;
+
+        printf("%s\"%s\": {\"ops\": %lu, \"ops_per_sec\": %.1f, \"failed\": %lu, \"throttled\": %lu, ", first ? "" : ", ",
+            loadgen_op_names[op], stats->count, stats->count / (double)config.duration, stats->failed, stats->throttled);
+        printf("\"latency_us\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}",
+            stats->count > 0 ? stats->sum_ns / 1e3 / stats->count : 0.0,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.50) / 1e3,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.90) / 1e3,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.99) / 1e3,
+            metrics_percentile(stats->buckets, stats->count, stats->max_ns, 0.999) / 1e3,
+            stats->max_ns / 1e3);
+
+        first = false;
+    }
+
+    printf("}}\n");
+}
+
+/////
+void print_usage()
+{
+    printf("usage: loadgen [-c connections] [-t threads] [-d seconds] [-w warmup_seconds] [-r ops_per_sec] [-m mix] [-b books] [-l user:password] [-p port] [-j] [ADDRESS|SOCKET_PATH]\n");
+    printf("  defaults are %d connections on %d threads for %d s after a %d s warm-up, against %s port %d\n",
+        LOADGEN_DEFAULT_CONNECTIONS, LOADGEN_DEFAULT_THREADS, LOADGEN_DEFAULT_DURATION, LOADGEN_DEFAULT_WARMUP,
+        LOADGEN_DEFAULT_ADDRESS, LOADGEN_DEFAULT_PORT);
+    printf("  -r sends commands at a fixed rate whether or not they are answered, without it each connection sends when answered\n");
+    printf("  -m weighs the operations %s, %s, %s, %s, %s and %s, the default is %s\n", loadgen_op_names[0], loadgen_op_names[1],
+        loadgen_op_names[2], loadgen_op_names[3], loadgen_op_names[4], loadgen_op_names[5], LOADGEN_DEFAULT_MIX);
+    printf("  -b books named %s0 onwards are stocked before the run and used by book commands, the default is %d\n",
+        LOADGEN_BOOK_PREFIX, LOADGEN_DEFAULT_BOOKS);
+    printf("  -j prints the results as JSON\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *mix = LOADGEN_DEFAULT_MIX;
+    char *password;
+    int opt;
+
+    config.address = LOADGEN_DEFAULT_ADDRESS;
+    config.port = LOADGEN_DEFAULT_PORT;
+    config.num_connections = LOADGEN_DEFAULT_CONNECTIONS;
+    config.num_threads = LOADGEN_DEFAULT_THREADS;
+    config.duration = LOADGEN_DEFAULT_DURATION;
+    config.warmup = LOADGEN_DEFAULT_WARMUP;
+    config.num_books = LOADGEN_DEFAULT_BOOKS;
+    strcpy(config.user, LOADGEN_DEFAULT_USER);
+    strcpy(config.password, LOADGEN_DEFAULT_PASSWORD);
+
+    while ((opt = getopt(argc, argv, "c:t:d:w:r:m:b:l:p:jh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': config.num_connections = atoi(optarg); break;
+            case 't': config.num_threads = atoi(optarg); break;
+            case 'd': config.duration = atoi(optarg); break;
+            case 'w': config.warmup = atoi(optarg); break;
+            case 'r': config.rate = atof(optarg); break;
+            case 'm': mix = optarg; break;
+            case 'b': config.num_books = atoi(optarg); break;
+            case 'p': config.port = atoi(optarg); break;
+            case 'j': config.json = true; break;
+            case 'l':
+                password = strchr(optarg, ':');
+                if (password != NULL && password - optarg <= CATALOG_V2_FIELD_MAXLEN && strlen(password + 1) <= CATALOG_V2_FIELD_MAXLEN)
+                {
+                    *password++ = '\0';
+                    strcpy(config.user, optarg);
+                    strcpy(config.password, password);
+                    break;
+                }
+                // fall through
+            default:
+                print_usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind < argc)
+        config.address = argv[optind];
+
+    if (config.num_connections < 1 || config.num_threads < 1 || config.duration < 1 || config.warmup < 0 ||
+        config.rate < 0 || config.num_books < 1 || !_loadgen_parse_mix(mix))
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (config.num_threads > config.num_connections)
+        config.num_threads = config.num_connections;
+
+    // a server that hangs up mid-send closes that connection, not the load generator
+    signal(SIGPIPE, SIG_IGN);
+
+    // every connection logs in before the clock starts
+    loadgen_connection_t *connections = calloc(config.num_connections, sizeof(loadgen_connection_t));
+    int *held = calloc((size_t)config.num_connections * config.num_books, sizeof(int));
+
+    for (int i=0; i<config.num_connections; i++)
+    {
+        connections[i].fd = _loadgen_connect();
+        connections[i].held = held + (size_t)i * config.num_books;
+
+        if (connections[i].fd < 0)
+        {
+            fprintf(stderr, "Could not connect to %s\n", config.address);
+            return EXIT_FAILURE;
+        }
+
+        int status = _loadgen_call(connections[i].fd, LOADGEN_LOGIN, 0, 0, ++connections[i].request_id);
+
+        if (status != CATALOG_STATUS_OK)
+        {
+            fprintf(stderr, "Could not login to %s as %s on connection %d, status %d\n", config.address, config.user, i + 1, status);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // stock the books, so requests are granted for the length of the run, one command carries at most CATALOG_QTY_MAX
+    for (int book=0; book<config.num_books; book++)
+    {
+        for (int stocked=0; stocked<LOADGEN_BOOK_QTY; stocked+=CATALOG_QTY_MAX)
+        {
+            int qty = LOADGEN_BOOK_QTY - stocked < CATALOG_QTY_MAX ? LOADGEN_BOOK_QTY - stocked : CATALOG_QTY_MAX;
+            int status = _loadgen_call(connections[0].fd, LOADGEN_ADD, book, qty, ++connections[0].request_id);
+
+            if (status != CATALOG_STATUS_OK)
+            {
+                fprintf(stderr, "Could not add %s%d, status %d\n", LOADGEN_BOOK_PREFIX, book, status);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    loadgen_thread_t *threads = calloc(config.num_threads, sizeof(loadgen_thread_t));
+
+    config.start_ns = _loadgen_now_ns();
+    config.measure_ns = config.start_ns + config.warmup * 1000000000ULL;
+    config.end_ns = config.measure_ns + config.duration * 1000000000ULL;
+
+    for (int t=0; t<config.num_threads; t++)
+    {
+        int first = t * config.num_connections / config.num_threads;
+        int last = (t + 1) * config.num_connections / config.num_threads;
+
+        threads[t].connections = connections + first;
+        threads[t].num_connections = last - first;
+        threads[t].rate = config.rate / config.num_threads;
+        threads[t].seed = (unsigned int)(config.start_ns + t);
+
+        pthread_create(&(threads[t].thread), NULL, _loadgen_run, &(threads[t]));
+    }
+
+    for (int t=0; t<config.num_threads; t++)
+        pthread_join(threads[t].thread, NULL);
+
+    loadgen_stats_t *merged = calloc(LOADGEN_OPS, sizeof(loadgen_stats_t));
+    _loadgen_merge(threads, merged);
+
+    if (config.json)
+        _loadgen_print_json(threads, merged);
+    else
+        _loadgen_print_text(threads, merged);
+
+    free(merged);
+    free(threads);
+    free(held);
+    free(connections);
+
+    return EXIT_SUCCESS;
+}
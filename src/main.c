@@ -7,30 +7,98 @@
 #include "common.h"
 #include "tcpserver.h"
 #include "catalog_worker.h"
+#include "httpmetrics.h"
+#include "admin.h"
 
 // possibly change this to arg
 #define DEFAULT_PORT 31337
+#define DEFAULT_SOCKET_PATH "/tmp/catalog.sock"
+#define DEFAULT_ADMIN_SOCKET_PATH "/tmp/catalog_admin.sock"
+
+extern ratelimiter_t *global_rl;
+extern devlog_t *global_dl;
+
+void print_usage()
+{
+    printf("usage: Server [-c max_connections] [-i max_per_ip] [-t idle_timeout_seconds] [-u user_rate] [-a address_rate] [-l log_level] [-m metrics_port]\n");
+    printf("  a limit of 0 turns it off, defaults are %d, %d, %d, %d and %d\n",
+        TCPSERVER_MAX_CONNECTIONS, TCPSERVER_MAX_PER_IP, TCPSERVER_IDLE_TIMEOUT_MS / 1000, RATELIMITER_USER_RATE, RATELIMITER_IP_RATE);
+    printf("  rates are rate limiter tokens per second, see catalog_worker.h for what each command costs\n");
+    printf("  log levels are error, warn, info and debug, the default is info\n");
+    printf("  -m serves Prometheus metrics at http://localhost:metrics_port%s, it is off by default\n", HTTPMETRICS_PATH);
+}
 
 int main(int argc, char *argv[])
 {
+    int max_connections = TCPSERVER_MAX_CONNECTIONS;
+    int max_per_ip = TCPSERVER_MAX_PER_IP;
+    int idle_timeout = TCPSERVER_IDLE_TIMEOUT_MS / 1000;
+    int user_rate = RATELIMITER_USER_RATE;
+    int ip_rate = RATELIMITER_IP_RATE;
+    int log_level = DEVLOG_INFO;
+    int metrics_port = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:i:t:u:a:l:m:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': max_connections = atoi(optarg); break;
+            case 'i': max_per_ip = atoi(optarg); break;
+            case 't': idle_timeout = atoi(optarg); break;
+            case 'u': user_rate = atoi(optarg); break;
+            case 'a': ip_rate = atoi(optarg); break;
+            case 'm': metrics_port = atoi(optarg); break;
+            case 'l':
+                if ((log_level = devlog_level_from_name(optarg)) >= 0)
+                    break;
+                // fall through
+            default:
+                print_usage();
+                return EXIT_FAILURE;
+        }
+    }
+
     init();
+    ratelimiter_set_rates(global_rl, user_rate, ip_rate);
+    devlog_set_level(global_dl, log_level);
 
     // create the tcp server and pass it our worker to handle catalog commands
     tcpserver_t *server = new_tcpserver(DEFAULT_PORT, catalog_worker);
+    tcpserver_set_limits(server, max_connections, max_per_ip, idle_timeout * 1000);
+
+    // co-located clients can skip the TCP stack, the server still runs without it
+    if (tcpserver_listen_unix(server, DEFAULT_SOCKET_PATH) != SUCCESS)
+        printf("Could not listen on unix socket %s\n", DEFAULT_SOCKET_PATH);
+
+    // monitoring scrapes its own port on the loopback address
+    if (metrics_port > 0)
+        new_httpmetrics(metrics_port, server);
+
+    // the console's commands are also taken on a socket, for servers started in the background
+    admin_t *admin = new_admin(server);
+
+    if (admin_listen(admin, DEFAULT_ADMIN_SOCKET_PATH) != SUCCESS)
+        printf("Could not listen on admin socket %s\n", DEFAULT_ADMIN_SOCKET_PATH);
 
     sleep(0.5);
 
     // handle user input
-    printf("Type 'q' to exit.\n");
+    printf("Type 'help' for the list of commands, 'q' to exit.\n");
 
-    char c;
+    char line[ADMIN_LINE_MAXLEN];
+    bool quit = false;
 
-    while((c = getchar()) != 0)
+    while (!quit && fgets(line, sizeof(line), stdin) != NULL)
     {
         // q is the command to quit... AMAZING
-        if (c == 'q')
-            break;
+        quit = admin_execute(admin, line, stdout) == ADMIN_QUIT;
+        fflush(stdout);
     }
 
+    // without a console, as when started in the background, the server runs until it is signalled
+    while (!quit)
+        pause();
+
     exit(EXIT_SUCCESS);
 }
\ No newline at end of file
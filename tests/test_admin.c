@@ -0,0 +1,199 @@
+#include <time.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "tcpserver.h"
+#include "catalog_worker.h"
+#include "admin.h"
+
+#define TEST_PORT 31350
+#define TEST_ADMIN_PATH "/tmp/test_admin.sock"
+#define TEST_REQUESTS_FILENAME "data/test_admin_requests.db"
+
+extern sessiontable_t *global_st;
+
+// connects to the admin socket
+int connect_admin()
+{
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, TEST_ADMIN_PATH);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return -1;
+
+    return sock;
+}
+
+// sends command lines and reads their answers into answer, each ends with a line of ADMIN_END
+// returns false if the connection closed before every answer was in
+bool admin_command(int sock, const char *lines, char *answer, size_t len)
+{
+    size_t received = 0;
+    int expected = 0;
+    int num_answers = 0;
+
+    for (const char *c = lines; *c; c++)
+        expected += *c == '\n';
+
+    // a line that is turned away is answered all the same
+    expected = expected > 0 ? expected : 1;
+
+    send(sock, lines, strlen(lines), 0);
+    answer[0] = '\0';
+
+    while (num_answers < expected)
+    {
+        ssize_t n = recv(sock, answer + received, len - 1 - received, 0);
+
+        if (n <= 0)
+            return false;
+
+        received += n;
+        answer[received] = '\0';
+
+        num_answers = strncmp(answer, ADMIN_END "\n", 4) == 0;
+        for (char *end = strstr(answer, "\n" ADMIN_END "\n"); end != NULL; end = strstr(end + 1, "\n" ADMIN_END "\n"))
+            num_answers++;
+    }
+
+    return true;
+}
+
+int main()
+{
+    printf("starting admin unit test\n");
+
+    init();
+
+    // split and empty requests are folded away, the first row of each user and book is kept
+    FILE *fp = fopen(TEST_REQUESTS_FILENAME, "w");
+    fprintf(fp, "id\tdate_created\tdate_updated\tuser_id\tbook_id\tqty_requested\n");
+    fprintf(fp, "1\tnone\tnone\t1\t1\t2\n");
+    fprintf(fp, "2\tnone\tnone\t2\t1\t1\n");
+    fprintf(fp, "3\tnone\tnone\t1\t1\t3\n");
+    fprintf(fp, "4\tnone\tnone\t3\t2\t0\n");
+    fprintf(fp, "5\tnone\tnone\t2\t1\t-1\n");
+    fprintf(fp, "6\tmissing fields\n");
+    fprintf(fp, "7\tnone\tnone\t1\t2\t4\n");
+    fclose(fp);
+
+    catalog_t catalog = {0};
+    catalog.requests_db = new_datafile(TEST_REQUESTS_FILENAME);
+
+    int num_dropped = catalog_compact_requests(&catalog);
+
+    char rows[256] = {0};
+    fp = fopen(TEST_REQUESTS_FILENAME, "r");
+    size_t rows_len = fread(rows, 1, sizeof(rows) - 1, fp);
+    fclose(fp);
+    rows[rows_len] = '\0';
+
+    printf("compaction dropped %d rows:\n%s", num_dropped, rows);
+
+    if (num_dropped != 5 || strstr(rows, "1\tnone\tnone\t1\t1\t5\n7\tnone\tnone\t1\t2\t4\n") == NULL)
+        return 1;
+
+    datafile_destroy(catalog.requests_db);
+    remove(TEST_REQUESTS_FILENAME);
+
+    // the console and the socket take the same commands
+    tcpserver_t *server = new_tcpserver(TEST_PORT, catalog_worker);
+    admin_t *admin = new_admin(server);
+
+    FILE *out = tmpfile();
+    if (admin_execute(admin, "bogus", out) != ADMIN_UNKNOWN || admin_execute(admin, "q\n", out) != ADMIN_QUIT ||
+        admin_execute(admin, "  ", out) != ADMIN_OK)
+        return 1;
+    fclose(out);
+
+    if (admin_listen(admin, TEST_ADMIN_PATH) != SUCCESS)
+        return 1;
+
+    // nobody else can reach the socket
+    struct stat st;
+    if (stat(TEST_ADMIN_PATH, &st) != 0 || (st.st_mode & (S_IRWXG | S_IRWXO)) != 0)
+        return 1;
+
+    // the listener threads need a moment to start listening
+    struct timespec pause = {0, 100000000};
+    nanosleep(&pause, NULL);
+
+    // a catalog client that has run one command
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(client, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return 1;
+
+    char connect_cmd[20] = {CATALOG_CMD_CONNECT, 'n', 'o', 'b', 'o', 'd', 'y'};
+    char reply[64];
+    send(client, connect_cmd, sizeof(connect_cmd), 0);
+    if (recv(client, reply, sizeof(reply), 0) <= 0)
+        return 1;
+
+    int sock = connect_admin();
+    if (sock < 0)
+        return 1;
+
+    static char answer[65536];
+
+    // two commands in one write are answered one after the other
+    if (!admin_command(sock, "connections\nslow 1\n", answer, sizeof(answer)))
+        return 1;
+
+    printf("%s", answer);
+
+    if (strstr(answer, "connections: 1 open\n") == NULL || strstr(answer, "slowest 1 commands") == NULL)
+        return 1;
+
+    // the client's session counted its command
+    char *row = strstr(answer, "127.0.0.1:");
+    if (row == NULL || strstr(row, " 1 ") == NULL || strstr(row, "CONNECT") == NULL)
+        return 1;
+
+    // every command answers
+    const char *commands[] = {"help\n", "stats\n", "threads\n", "caches\n", "rebuild\n"};
+
+    for (unsigned int i=0; i<sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        if (!admin_command(sock, commands[i], answer, sizeof(answer)) || strlen(answer) == 0)
+            return 1;
+    }
+
+    // a flush logs everybody out
+    uint8_t token[SESSIONTABLE_TOKEN_LEN];
+    sessiontable_issue(global_st, 1, token);
+
+    if (!admin_command(sock, "flush\n", answer, sizeof(answer)) || strncmp(answer, "1 sessions dropped", 18) != 0)
+        return 1;
+    if (sessiontable_resume(global_st, token) != -1)
+        return 1;
+
+    // quit closes the admin connection and nothing else
+    if (!admin_command(sock, "quit\n", answer, sizeof(answer)) || recv(sock, answer, sizeof(answer), 0) != 0)
+        return 1;
+    close(sock);
+
+    // a line that never ends is turned away
+    char long_line[ADMIN_LINE_MAXLEN + 1];
+    memset(long_line, 'x', ADMIN_LINE_MAXLEN);
+    long_line[ADMIN_LINE_MAXLEN] = '\0';
+
+    sock = connect_admin();
+    if (sock < 0 || !admin_command(sock, long_line, answer, sizeof(answer)) || strstr(answer, "too long") == NULL)
+        return 1;
+
+    close(sock);
+    close(client);
+
+    printf("admin test passed\n");
+
+    return 0;
+}
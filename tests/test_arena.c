@@ -0,0 +1,174 @@
+#include <time.h>
+
+#include "common.h"
+#include "arena.h"
+#include "slab.h"
+#include "datafile.h"
+
+#define TEST_DATAFILE_FILENAME "data/test_arena.db"
+#define TEST_ROWS 1000
+#define TEST_LOOKUPS 2000
+
+// count every heap allocation in the process, glibc's own entry points do the work
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+atomic_long num_heap_allocs = 0;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&num_heap_allocs, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+    atomic_fetch_add_explicit(&num_heap_allocs, 1, memory_order_relaxed);
+    return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&num_heap_allocs, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+// looks up the last row the way a catalog command does, returns heap allocations per lookup
+double lookups(datafile_t *df, arena_t *arena, double *ns)
+{
+    struct timespec start, end;
+    long allocs = atomic_load(&num_heap_allocs);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<TEST_LOOKUPS; i++)
+    {
+        // one command
+        if (arena != NULL)
+        {
+            arena_reset(arena);
+            arena_use(arena);
+        }
+
+        char value[32];
+        sprintf(value, "name%d", TEST_ROWS);
+
+        datafile_get_row_prepare(df);
+        char **row = datafile_get_row_by_field(df, "name", value);
+
+        if (row == NULL)
+            exit_error("lookup failed");
+
+        char **update = datafile_new_row_array(df);
+        datafile_set_col(df, &update, "name", row[3]);
+        datafile_set_col(df, &update, "qty", "5");
+        char *record = array2record(update, df->num_fields);
+
+        arena_free(record);
+        datafile_free_row(df, &update);
+        datafile_free_row(df, &row);
+
+        arena_use(NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / TEST_LOOKUPS;
+
+    return (double)(atomic_load(&num_heap_allocs) - allocs) / TEST_LOOKUPS;
+}
+
+int main()
+{
+    printf("starting arena unit test\n");
+
+    init();
+
+    arena_t *arena = new_arena();
+
+    // freed blocks are given back once everything after them is freed
+    char *a = arena_alloc(arena, 100);
+    char *b = arena_alloc(arena, 100);
+    if (((uintptr_t)a % ARENA_ALIGN) != 0 || ((uintptr_t)b % ARENA_ALIGN) != 0 || b <= a)
+        return 1;
+
+    arena_release(arena, a);
+    if (arena_alloc(arena, 100) == a)
+    {
+        printf("block reused while a newer one is still in use\n");
+        return 1;
+    }
+
+    arena_reset(arena);
+    a = arena_alloc(arena, 100);
+    b = arena_alloc(arena, 100);
+    arena_release(arena, a);
+    arena_release(arena, b);
+    if (arena_alloc(arena, 100) != a)
+    {
+        printf("freed blocks not given back\n");
+        return 1;
+    }
+
+    // blocks bigger than a chunk get a chunk of their own, and a reset keeps every chunk
+    arena_reset(arena);
+    char *big = arena_alloc(arena, ARENA_CHUNK_SIZE * 4);
+    memset(big, 1, ARENA_CHUNK_SIZE * 4);
+    long num_chunks = arena->num_chunks;
+    if (!arena_owns(arena, big) || arena_owns(arena, &num_chunks))
+        return 1;
+
+    arena_reset(arena);
+    for (int i=0; i<1000; i++)
+        arena_alloc(arena, 64);
+    arena_reset(arena);
+    for (int i=0; i<1000; i++)
+        arena_alloc(arena, 64);
+    printf("%ld chunks after two rounds of 1000 allocations\n", arena->num_chunks);
+    if (arena->num_chunks > num_chunks + 4)
+        return 1;
+
+    // the slab allocator is used when no arena is current, arena_free() tells the two apart
+    char *slab = arena_malloc(10);
+    arena_use(arena);
+    char *pooled = arena_malloc(10);
+    if (arena_owns(arena, slab) || !arena_owns(arena, pooled))
+        return 1;
+    arena_free(slab);
+    arena_free(pooled);
+    arena_use(NULL);
+
+    // allocation count benchmark
+    FILE *fp = fopen(TEST_DATAFILE_FILENAME, "w");
+    fprintf(fp, "id\tdate_created\tdate_updated\tname\tqty\n");
+    for (int i=1; i<=TEST_ROWS; i++)
+        fprintf(fp, "%d\tnone\tnone\tname%d\t%d\n", i, i, i);
+    fclose(fp);
+
+    datafile_t *df = new_datafile(TEST_DATAFILE_FILENAME);
+    double heap_ns, slab_ns, arena_ns;
+
+    // the baseline goes straight to the heap, as the row helpers did before slabs and arenas
+    slab_set_bypass(true);
+    double heap_allocs = lookups(df, NULL, &heap_ns);
+    slab_set_bypass(false);
+
+    double slab_allocs = lookups(df, NULL, &slab_ns);
+    double arena_allocs = lookups(df, arena, &arena_ns);
+
+    printf("scan of %d rows on the heap:      %8.1f heap allocations, %8.0f ns\n", TEST_ROWS, heap_allocs, heap_ns);
+    printf("scan of %d rows with slabs:       %8.1f heap allocations, %8.0f ns\n", TEST_ROWS, slab_allocs, slab_ns);
+    printf("scan of %d rows with an arena:    %8.1f heap allocations, %8.0f ns\n", TEST_ROWS, arena_allocs, arena_ns);
+
+    datafile_destroy(df);
+    remove(TEST_DATAFILE_FILENAME);
+
+    // only the FILE of the scan is left on the heap, either way rows are recycled
+    if (arena_allocs > 4 || slab_allocs > 4 || heap_allocs < TEST_ROWS)
+        return 1;
+
+    arena_destroy(arena);
+
+    printf("arena test passed\n");
+
+    return 0;
+}
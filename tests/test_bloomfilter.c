@@ -0,0 +1,59 @@
+#include "common.h"
+#include "bloomfilter.h"
+
+#define TEST_KEYS 100000
+#define TEST_MISSES 1000000
+
+int main()
+{
+    printf("starting bloomfilter unit test\n");
+
+    init();
+
+    bloomfilter_t *filter = new_bloomfilter(TEST_KEYS);
+    char key[32];
+
+    for (int i=0; i<TEST_KEYS; i++)
+    {
+        sprintf(key, "book%d", i);
+        bloomfilter_add(filter, key);
+    }
+
+    // a key that was added is never turned away
+    for (int i=0; i<TEST_KEYS; i++)
+    {
+        sprintf(key, "book%d", i);
+        if (!bloomfilter_check(filter, key))
+        {
+            printf("%s was added but rejected\n", key);
+            return 1;
+        }
+    }
+
+    long passed = 0;
+    for (int i=0; i<TEST_MISSES; i++)
+    {
+        sprintf(key, "missing%d", i);
+        if (bloomfilter_check(filter, key))
+        {
+            bloomfilter_found(filter, false);
+            passed++;
+        }
+    }
+
+    bloomfilter_print_stats(filter, "test");
+
+    if (atomic_load(&(filter->num_false_positives)) != passed || atomic_load(&(filter->num_rejected)) != TEST_MISSES - passed)
+        return 1;
+
+    // well under 1% at the expected number of keys
+    if (passed * 100 > TEST_MISSES)
+    {
+        printf("%ld of %d misses passed the filter\n", passed, TEST_MISSES);
+        return 1;
+    }
+
+    printf("bloomfilter test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "catalog_protocol.h"
+
+int main()
+{
+    printf("starting catalog_protocol unit test\n");
+
+    init();
+
+    // quantities outside 1..CATALOG_QTY_MAX must not reach the catalog
+    uint32_t quantities[] = {0, (uint32_t)-1000000000, CATALOG_QTY_MAX + 1, 1, CATALOG_QTY_MAX};
+    bool expected[] = {false, false, false, true, true};
+    int num_quantities = sizeof(quantities) / sizeof(quantities[0]);
+
+    char payload[10];
+    catalog_v2_header_t header = {.magic = CATALOG_V2_MAGIC, .op_code = CATALOG_CMD_ADD_BOOK, .length = sizeof(payload)};
+    catalog_command_t cmd;
+
+    for (int i=0; i<num_quantities; i++)
+    {
+        uint32_t qty = htonl(quantities[i]);
+        uint16_t name_len = htons(4);
+
+        memcpy(payload, &qty, sizeof(qty));
+        memcpy(payload + 4, &name_len, sizeof(name_len));
+        memcpy(payload + 6, "Book", 4);
+
+        if (catalog_v2_decode_command(&header, payload, &cmd) != expected[i])
+        {
+            printf("qty %d decoded wrongly\n", (int)quantities[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("v2 quantity range checked\n");
+
+    printf("ending unit test\n");
+    exit(EXIT_SUCCESS);
+}
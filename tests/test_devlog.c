@@ -0,0 +1,157 @@
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "devlog.h"
+
+#define TEST_LOG_FILENAME "data/test_devlog.log"
+#define TEST_PRINTF_FILENAME "data/test_devlog_printf.log"
+#define TEST_THREADS 8
+#define TEST_MESSAGES 20000
+#define TEST_BURST 128                  // messages between pauses, commands don't arrive back to back forever
+
+devlog_t *test_log;
+FILE *test_fp;
+
+double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+// logs the way a worker does for every command, returns cpu ns per message through arg
+void *writer(void *arg)
+{
+    long thread = (long)*(double *)arg;
+    struct timespec start, end;
+    struct timespec pause = {0, 10000000};
+    double ns = 0;
+
+    for (int i=0; i<TEST_MESSAGES; i++)
+    {
+        if (i % TEST_BURST == 0)
+        {
+            if (i > 0)
+            {
+                clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+                ns += elapsed_ns(&start, &end);
+                nanosleep(&pause, NULL);
+            }
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+        }
+
+        if (test_log != NULL)
+            devlog_write(test_log, DEVLOG_INFO, "[CID: %ld] Login attempt from %s, username: %s, %d", thread, "127.0.0.1:40000", "admin", i);
+        else
+        {
+            fprintf(test_fp, "[CID: %ld] Login attempt from %s, username: %s, %d\n", thread, "127.0.0.1:40000", "admin", i);
+            fflush(test_fp);
+        }
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    ns += elapsed_ns(&start, &end);
+
+    *(double *)arg = ns / TEST_MESSAGES;
+
+    return NULL;
+}
+
+double run()
+{
+    pthread_t threads[TEST_THREADS];
+    double ns[TEST_THREADS];
+    double total = 0;
+
+    for (long i=0; i<TEST_THREADS; i++)
+    {
+        ns[i] = i;
+        pthread_create(&threads[i], NULL, writer, &ns[i]);
+    }
+    for (int i=0; i<TEST_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        total += ns[i];
+    }
+
+    return total / TEST_THREADS;
+}
+
+int main()
+{
+    printf("starting devlog unit test\n");
+
+    init();
+
+    remove(TEST_LOG_FILENAME);
+    test_log = new_devlog(TEST_LOG_FILENAME);
+
+    // messages above the level are thrown away
+    devlog_write(test_log, DEVLOG_DEBUG, "hidden");
+    devlog_set_level(test_log, DEVLOG_DEBUG);
+    devlog_write(test_log, DEVLOG_DEBUG, "shown %d", 1);
+    devlog_set_level(test_log, DEVLOG_INFO);
+
+    if (devlog_level_from_name("warn") != DEVLOG_WARN || devlog_level_from_name("loud") != -1)
+        return 1;
+
+    double devlog_ns = run();
+    devlog_flush(test_log);
+
+    long written = atomic_load(&(test_log->num_written));
+    long dropped = atomic_load(&(test_log->num_dropped));
+
+    // every message was either written or counted as dropped, and each thread's come out in order
+    FILE *fp = fopen(TEST_LOG_FILENAME, "r");
+    char line[512];
+    long lines = 0, hidden = 0, shown = 0;
+    int last[TEST_THREADS];
+    bool in_order = true;
+
+    for (int i=0; i<TEST_THREADS; i++)
+        last[i] = -1;
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        long thread;
+        int i;
+        char *cid = strstr(line, "[CID: ");
+
+        lines++;
+        hidden += strstr(line, "hidden") != NULL;
+        shown += strstr(line, "DEBUG shown 1") != NULL;
+
+        if (cid != NULL && sscanf(cid, "[CID: %ld] Login attempt from 127.0.0.1:40000, username: admin, %d", &thread, &i) == 2)
+        {
+            in_order = in_order && i > last[thread];
+            last[thread] = i;
+        }
+    }
+    fclose(fp);
+
+    test_log = NULL;
+    test_fp = fopen(TEST_PRINTF_FILENAME, "w");
+    double printf_ns = run();
+    fclose(test_fp);
+
+    remove(TEST_LOG_FILENAME);
+    remove(TEST_PRINTF_FILENAME);
+
+    printf("%d threads: fprintf and fflush %.0f ns, devlog %.0f ns per message\n", TEST_THREADS, printf_ns, devlog_ns);
+    printf("%ld written, %ld dropped, %ld lines\n", written, dropped, lines);
+
+    if (hidden != 0 || shown != 1 || !in_order)
+        return 1;
+
+    if (lines != written || written + dropped != TEST_THREADS * TEST_MESSAGES + 1)
+        return 1;
+
+    // bursts fit in the rings, so the background thread keeps up
+    if (dropped > TEST_THREADS * TEST_MESSAGES / 100)
+    {
+        printf("too many messages dropped\n");
+        return 1;
+    }
+
+    printf("devlog test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <pthread.h>
+
+#include "common.h"
+#include "garbagecollector.h"
+
+#define TEST_THREADS 8
+#define TEST_OBJECTS 20000          // per thread, well past the old 5120 object limit
+#define TEST_ROUNDS 20
+
+extern garbagecollector_t *global_gc;
+
+atomic_int destroyed = 0;
+
+void count_destroy(void *object)
+{
+    (void)object;
+    atomic_fetch_add(&destroyed, 1);
+}
+
+// registers and unregisters objects in rounds, checking every id belongs to one object at a time
+void *churn(void *arg)
+{
+    int *ids = malloc(TEST_OBJECTS * sizeof(int));
+    char *objects = malloc(TEST_OBJECTS);
+    long failed = 0;
+
+    for (int round=0; round<TEST_ROUNDS; round++)
+    {
+        for (int i=0; i<TEST_OBJECTS; i++)
+            ids[i] = garbagecollector_register(global_gc, &(objects[i]), count_destroy);
+
+        for (int i=0; i<TEST_OBJECTS; i++)
+        {
+            if (ids[i] < 0)
+                failed++;
+
+            garbagecollector_unregister(global_gc, ids[i]);
+        }
+    }
+
+    free(ids);
+    free(objects);
+
+    return (void *)failed;
+}
+
+int main()
+{
+    printf("starting garbagecollector unit test\n");
+
+    init();
+
+    pthread_t threads[TEST_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, churn, NULL);
+
+    long failed = 0;
+    for (int i=0; i<TEST_THREADS; i++)
+    {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        failed += (long)ret;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%d threads: %.1f ns per register and unregister\n", TEST_THREADS, ns / ((double)TEST_THREADS * TEST_OBJECTS * TEST_ROUNDS));
+
+    if (failed > 0)
+    {
+        printf("%ld registrations failed\n", failed);
+        return 1;
+    }
+
+    // freed slots are reused, so the registry only grew to what was live at once
+    unsigned int num_slots = atomic_load(&(global_gc->num_slots));
+    printf("registry has %u slots\n", num_slots);
+    if (num_slots > TEST_THREADS * TEST_OBJECTS + 1000)
+        return 1;
+
+    // no two live objects share an id
+    int ids[1000];
+    char objects[1000];
+    for (int i=0; i<1000; i++)
+    {
+        ids[i] = garbagecollector_register(global_gc, &(objects[i]), count_destroy);
+        for (int j=0; j<i; j++)
+            if (ids[j] == ids[i])
+            {
+                printf("id %d handed out twice\n", ids[i]);
+                return 1;
+            }
+    }
+
+    for (int i=0; i<500; i++)
+        garbagecollector_unregister(global_gc, ids[i]);
+
+    // unregistering twice must not put a slot on the free list twice
+    garbagecollector_unregister(global_gc, ids[0]);
+
+    int id_a = garbagecollector_register(global_gc, &(objects[0]), count_destroy);
+    int id_b = garbagecollector_register(global_gc, &(objects[1]), count_destroy);
+    if (id_a == id_b)
+    {
+        printf("id %d handed out twice\n", id_a);
+        return 1;
+    }
+
+    // the objects still registered are destroyed on exit, and nothing else
+    garbagecollector_unregister(global_gc, id_a);
+    garbagecollector_unregister(global_gc, id_b);
+    for (int i=500; i<1000; i++)
+        garbagecollector_unregister(global_gc, ids[i]);
+
+    if (atomic_load(&destroyed) != 0)
+        return 1;
+
+    printf("garbagecollector test passed\n");
+
+    return 0;
+}
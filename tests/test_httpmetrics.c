@@ -0,0 +1,191 @@
+#include <time.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "tcpserver.h"
+#include "catalog_worker.h"
+#include "httpmetrics.h"
+
+#define TEST_PORT 31340
+#define TEST_METRICS_PORT 31341
+#define TEST_SCRAPES 1000
+
+extern metrics_t *global_mt;
+
+// connects to the endpoint on the loopback address
+int connect_endpoint()
+{
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_METRICS_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return -1;
+
+    return sock;
+}
+
+// sends request and reads one response into response, returns the status code or -1
+int http_request(int sock, const char *request, char *response, size_t len)
+{
+    size_t received = 0;
+    char *body = NULL;
+    long content_length = -1;
+
+    if (send(sock, request, strlen(request), 0) != (ssize_t)strlen(request))
+        return -1;
+
+    // the endpoint keeps the connection open, so read exactly as much as it says it sent
+    while (body == NULL || (long)(received - (body - response)) < content_length)
+    {
+        ssize_t n = recv(sock, response + received, len - 1 - received, 0);
+
+        if (n <= 0)
+            return -1;
+
+        received += n;
+        response[received] = '\0';
+
+        if (body == NULL && (body = strstr(response, "\r\n\r\n")) != NULL)
+        {
+            body += 4;
+            char *header = strstr(response, "Content-Length: ");
+            if (header == NULL)
+                return -1;
+            content_length = atol(header + strlen("Content-Length: "));
+        }
+    }
+
+    int status = -1;
+    sscanf(response, "HTTP/1.1 %d", &status);
+
+    return status;
+}
+
+int main()
+{
+    printf("starting httpmetrics unit test\n");
+
+    init();
+
+    tcpserver_t *server = new_tcpserver(TEST_PORT, catalog_worker);
+    new_httpmetrics(TEST_METRICS_PORT, server);
+
+    // the listener threads need a moment to start listening
+    struct timespec pause = {0, 100000000};
+    nanosleep(&pause, NULL);
+
+    metrics_record(global_mt, CATALOG_CMD_REQUEST_BOOK, 2000);
+    metrics_record(global_mt, CATALOG_CMD_REQUEST_BOOK, 4000);
+
+    int sock = connect_endpoint();
+    if (sock < 0)
+        return 1;
+
+    static char response[65536];
+    int status = http_request(sock, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", response, sizeof(response));
+
+    if (status != 200 || strstr(response, "Content-Type: text/plain; version=0.0.4") == NULL)
+        return 1;
+
+    if (strstr(response, "catalog_commands_total{command=\"REQUEST_BOOK\"} 2\n") == NULL ||
+        strstr(response, "catalog_command_duration_seconds_sum{command=\"REQUEST_BOOK\"} 0.000006000\n") == NULL ||
+        strstr(response, "catalog_connections_active 0\n") == NULL ||
+        strstr(response, "catalog_cache_hit_ratio{cache=\"session_pool\"}") == NULL)
+        return 1;
+
+    // every line is a comment or a sample, and each family comes in one block after its TYPE
+    char families[64][64];
+    int num_families = 0;
+    bool well_formed = true;
+
+    for (char *line = strtok(strstr(response, "\r\n\r\n") + 4, "\n"); line != NULL; line = strtok(NULL, "\n"))
+    {
+        char name[64];
+
+        if (sscanf(line, "# TYPE %63s", name) == 1)
+        {
+            for (int i=0; i<num_families; i++)
+                well_formed = well_formed && strcmp(families[i], name) != 0;
+            if (num_families < 64)
+                strcpy(families[num_families++], name);
+        }
+        else if (line[0] != '#')
+        {
+            // name{labels} value, summaries add _sum and _count to the family name
+            char *value = strrchr(line, ' ');
+            char *end = NULL;
+
+            if (value != NULL)
+                strtod(value + 1, &end);
+
+            well_formed = well_formed && num_families > 0 && end != NULL && *end == '\0' &&
+                sscanf(line, "%63[^{ ]", name) == 1 &&
+                strncmp(name, families[num_families - 1], strlen(families[num_families - 1])) == 0;
+        }
+    }
+
+    printf("%d metric families\n", num_families);
+
+    if (!well_formed)
+    {
+        printf("not in the Prometheus text format\n");
+        return 1;
+    }
+
+    // only /metrics is served, and the connection stays usable after a miss
+    if (http_request(sock, "GET / HTTP/1.1\r\n\r\n", response, sizeof(response)) != 404 ||
+        http_request(sock, "POST /metrics HTTP/1.1\r\nContent-Length: 0\r\n\r\n", response, sizeof(response)) != 405)
+        return 1;
+
+    // pipelined requests that arrive in one read are all answered, without waiting for more data
+    const char *pipelined = "GET / HTTP/1.1\r\n\r\nGET / HTTP/1.1\r\n\r\n";
+    struct timeval timeout = {2, 0};
+    size_t received = 0;
+    int num_responses = 0;
+
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (send(sock, pipelined, strlen(pipelined), 0) != (ssize_t)strlen(pipelined))
+        return 1;
+
+    while (num_responses < 2)
+    {
+        ssize_t n = recv(sock, response + received, sizeof(response) - 1 - received, 0);
+
+        if (n <= 0)
+        {
+            printf("only %d of 2 pipelined requests answered\n", num_responses);
+            return 1;
+        }
+
+        received += n;
+        response[received] = '\0';
+
+        num_responses = 0;
+        for (char *next = strstr(response, "HTTP/1.1 404"); next != NULL; next = strstr(next + 1, "HTTP/1.1 404"))
+            num_responses++;
+    }
+
+    // scrapes on a kept alive connection
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i=0; i<TEST_SCRAPES; i++)
+    {
+        if (http_request(sock, "GET /metrics HTTP/1.1\r\n\r\n", response, sizeof(response)) != 200)
+            return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%d scrapes, %.0f us each\n", TEST_SCRAPES, ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / TEST_SCRAPES);
+
+    close(sock);
+
+    printf("httpmetrics test passed\n");
+
+    return 0;
+}
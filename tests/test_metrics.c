@@ -0,0 +1,131 @@
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "metrics.h"
+#include "datafile.h"
+
+#define TEST_DATAFILE_FILENAME "data/test_metrics.db"
+#define TEST_THREADS 4
+#define TEST_COMMANDS 250000
+
+metrics_t *test_metrics;
+
+// records latencies spread evenly over 1us to 1000us, returns cpu ns per record through arg
+void *recorder(void *arg)
+{
+    struct timespec start, end;
+
+    metrics_connection_opened(test_metrics);
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    for (int i=0; i<TEST_COMMANDS; i++)
+        metrics_record(test_metrics, 0x30, (uint64_t)(i % 1000 + 1) * 1000);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+    *(double *)arg = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / TEST_COMMANDS;
+
+    return NULL;
+}
+
+// true if value is within the histogram's precision of expected
+bool close_to(unsigned long value, unsigned long expected)
+{
+    unsigned long error = expected / METRICS_SUB_BUCKETS;
+
+    return value + error >= expected && value <= expected + error;
+}
+
+int main()
+{
+    printf("starting metrics unit test\n");
+
+    init();
+
+    // every latency lands in a bucket that holds it, and no wider than the precision promised
+    for (uint64_t value=1; value < (1ULL << METRICS_MAX_BITS); value = value * 3 / 2 + 1)
+    {
+        int bucket = metrics_bucket(value);
+
+        if (bucket < 0 || bucket >= METRICS_BUCKETS || metrics_bucket_max(bucket) < value)
+            return 1;
+        if (metrics_bucket_max(bucket) - value > value / METRICS_SUB_BUCKETS)
+            return 1;
+        if (bucket > 0 && metrics_bucket_max(bucket - 1) >= value)
+            return 1;
+    }
+
+    if (metrics_bucket(UINT64_MAX) != METRICS_BUCKETS - 1)
+        return 1;
+
+    test_metrics = new_metrics();
+
+    // threads record on their own slots, the snapshot merges them
+    pthread_t threads[TEST_THREADS];
+    double ns[TEST_THREADS];
+    double total = 0;
+
+    for (int i=0; i<TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, recorder, &ns[i]);
+    for (int i=0; i<TEST_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        total += ns[i];
+    }
+
+    metrics_snapshot_t snapshot;
+    metrics_snapshot(test_metrics, &snapshot);
+    metrics_op_t *op = &(snapshot.ops[0x30 >> 4]);
+
+    printf("%d threads: %.1f ns per record\n", TEST_THREADS, total / TEST_THREADS);
+    printf("%lu commands: mean %lu, p50 %lu, p99 %lu, p999 %lu, max %lu ns\n",
+        op->count, op->mean_ns, op->p50_ns, op->p99_ns, op->p999_ns, op->max_ns);
+
+    if (op->count != TEST_THREADS * TEST_COMMANDS || op->max_ns != 1000000 || op->mean_ns != 500500)
+        return 1;
+    if (!close_to(op->p50_ns, 500000) || !close_to(op->p99_ns, 990000) || !close_to(op->p999_ns, 999000))
+        return 1;
+
+    // connections opened on the recorders and closed here are still counted as closed
+    if (snapshot.active_connections != TEST_THREADS)
+        return 1;
+    for (int i=0; i<TEST_THREADS; i++)
+        metrics_connection_closed(test_metrics);
+
+    // a command's datafile I/O is counted with it
+    FILE *fp = fopen(TEST_DATAFILE_FILENAME, "w");
+    fprintf(fp, "id\tdate_created\tdate_updated\tname\tqty\n");
+    fclose(fp);
+
+    metrics_record(test_metrics, 0x40, 1000);
+
+    datafile_t *df = new_datafile(TEST_DATAFILE_FILENAME);
+    char **row = datafile_new_row_array(df);
+    datafile_set_col(df, &row, "name", "book");
+    datafile_set_col(df, &row, "qty", "1");
+    datafile_add_row(df, &row);
+
+    metrics_record(test_metrics, 0x40, 1000);
+
+    datafile_free_row(df, &row);
+    datafile_destroy(df);
+    remove(TEST_DATAFILE_FILENAME);
+
+    metrics_snapshot(test_metrics, &snapshot);
+
+    printf("datafiles: %ld reads, %ld writes, %ld bytes read, %ld bytes written\n", snapshot.datafile_reads,
+        snapshot.datafile_writes, snapshot.datafile_bytes_read, snapshot.datafile_bytes_written);
+
+    if (snapshot.ops[0x40 >> 4].count != 2 || snapshot.active_connections != 0)
+        return 1;
+
+    // the header read by new_datafile(), then add_row() opening it for both
+    if (snapshot.datafile_reads != 2 || snapshot.datafile_writes != 1)
+        return 1;
+    if (snapshot.datafile_bytes_read != 38 || snapshot.datafile_bytes_written <= 0)
+        return 1;
+
+    printf("metrics test passed\n");
+
+    return 0;
+}
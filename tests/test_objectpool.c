@@ -0,0 +1,156 @@
+#include <time.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "objectpool.h"
+#include "tcpserver.h"
+#include "catalog_worker.h"
+
+#define TEST_PORT 31339
+#define TEST_SOCKET_PATH "/tmp/test_objectpool.sock"
+#define TEST_CYCLES 1000000             // connects and disconnects in the soak
+#define TEST_SAMPLES 10
+#define TEST_IN_FLIGHT 32               // closed by the client but not yet by the server
+#define TEST_RSS_SLACK_KB 1024
+
+typedef struct
+{
+    int value;
+    int times_reset;
+} thing_t;
+
+void init_thing(void *t)
+{
+    ((thing_t *)t)->value = 42;
+}
+
+void reset_thing(void *t)
+{
+    ((thing_t *)t)->times_reset++;
+}
+
+long resident_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp == NULL)
+        return 0;
+
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int open_connections(tcpserver_t *server)
+{
+    pthread_mutex_lock(&(server->conn_lock));
+    int num_connections = server->num_connections;
+    pthread_mutex_unlock(&(server->conn_lock));
+
+    return num_connections;
+}
+
+int main()
+{
+    printf("starting objectpool unit test\n");
+
+    init();
+
+    // objects are built once, reset when given back, and the last one given back goes out first
+    objectpool_t *pool = new_objectpool(sizeof(thing_t), 2, init_thing, reset_thing);
+    thing_t *a = objectpool_take(pool);
+    thing_t *b = objectpool_take(pool);
+    thing_t *c = objectpool_take(pool);
+
+    if (a->value != 42 || c->value != 42 || pool->num_objects != 3 || atomic_load(&(pool->num_reused)) != 2)
+        return 1;
+
+    objectpool_give(pool, c);
+    objectpool_give(pool, b);
+    if (objectpool_take(pool) != b || b->times_reset != 1)
+    {
+        printf("given back object not reused\n");
+        return 1;
+    }
+
+    objectpool_print_stats(pool, "test");
+    objectpool_destroy(pool);
+
+    // soak, every cycle connects and hangs up on a catalog server
+    tcpserver_t *server = new_tcpserver(TEST_PORT, catalog_worker);
+    if (tcpserver_listen_unix(server, TEST_SOCKET_PATH) != SUCCESS)
+    {
+        printf("could not listen on %s\n", TEST_SOCKET_PATH);
+        return 1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, TEST_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+
+    // the worker logs every connection
+    fflush(stdout);
+    int saved_stdout = dup(fileno(stdout));
+    if (freopen("/dev/null", "w", stdout) == NULL)
+        return 1;
+
+    long rss[TEST_SAMPLES + 1];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<TEST_CYCLES; i++)
+    {
+        if (i % (TEST_CYCLES / TEST_SAMPLES) == 0)
+            rss[i / (TEST_CYCLES / TEST_SAMPLES)] = resident_kb();
+
+        // stay under the server's connection limit so no cycle is turned away
+        while (open_connections(server) > TEST_IN_FLIGHT)
+            sched_yield();
+
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            fprintf(stderr, "connect %d failed\n", i);
+            return 1;
+        }
+        close(sock);
+    }
+
+    // the last connections may not have been accepted yet, which looks the same as closed
+    while (atomic_load(&(server->num_accepted)) < TEST_CYCLES || open_connections(server) > 0)
+        sched_yield();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rss[TEST_SAMPLES] = resident_kb();
+
+    fflush(stdout);
+    dup2(saved_stdout, fileno(stdout));
+    close(saved_stdout);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d connections in %.1f s, %.1f us each\n", TEST_CYCLES, seconds, seconds * 1e6 / TEST_CYCLES);
+
+    printf("resident KB every %d connections:", TEST_CYCLES / TEST_SAMPLES);
+    for (int i=0; i<=TEST_SAMPLES; i++)
+        printf(" %ld", rss[i]);
+    printf("\n");
+
+    objectpool_print_stats(server->conn_pool, "connection");
+    objectpool_print_stats(catalog_worker_sessions(), "session");
+
+    if (atomic_load(&(server->num_accepted)) != TEST_CYCLES || atomic_load(&(server->num_rejected)) != 0)
+        return 1;
+
+    // once the first batch has warmed everything up, memory stays flat
+    if (rss[TEST_SAMPLES] > rss[1] + TEST_RSS_SLACK_KB)
+    {
+        printf("resident memory grew by %ld KB\n", rss[TEST_SAMPLES] - rss[1]);
+        return 1;
+    }
+
+    printf("objectpool test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "common.h"
+#include "outbuffer.h"
+
+#include <fcntl.h>
+
+#define TEST_LEN 200000
+
+// drains the reader side, returns the number of bytes read
+size_t drain(int socket, char *into, size_t max)
+{
+    size_t total = 0;
+    ssize_t n;
+
+    while (total < max && (n = recv(socket, into + total, max - total, MSG_DONTWAIT)) > 0)
+        total += (size_t)n;
+
+    return total;
+}
+
+int main()
+{
+    printf("starting outbuffer unit test\n");
+
+    init();
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+    {
+        printf("socketpair failed\n");
+        return 1;
+    }
+
+    // a small send buffer forces partial writes and EAGAIN
+    int sndbuf = 4096;
+    setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+
+    // memory, then a file, then memory again, the reader must see them in order
+    char *expected = malloc(TEST_LEN * 3);
+    for (int i=0; i<TEST_LEN * 3; i++)
+        expected[i] = (char)('a' + (i % 26));
+
+    FILE *fp = tmpfile();
+    fwrite(expected + TEST_LEN, 1, TEST_LEN, fp);
+
+    outbuffer_t *out = new_outbuffer();
+    for (int i=0; i<TEST_LEN; i+=100)
+        outbuffer_append(out, expected + i, 100);
+    outbuffer_append_file(out, fp, 0, TEST_LEN);
+    outbuffer_append(out, expected + TEST_LEN * 2, TEST_LEN);
+
+    printf("pending: %zu\n", out->pending);
+
+    char *received = malloc(TEST_LEN * 3);
+    size_t total = 0;
+    int result = OUTBUFFER_PENDING;
+    int partial = 0;
+
+    while (result == OUTBUFFER_PENDING)
+    {
+        result = outbuffer_flush(out, pair[0]);
+        if (result == OUTBUFFER_PENDING)
+            partial++;
+
+        total += drain(pair[1], received + total, TEST_LEN * 3 - total);
+    }
+
+    total += drain(pair[1], received + total, TEST_LEN * 3 - total);
+
+    printf("flushed after %d partial writes, received %zu\n", partial, total);
+
+    if (result != OUTBUFFER_FLUSHED || out->pending != 0 || partial == 0 ||
+        total != TEST_LEN * 3 || memcmp(expected, received, total) != 0)
+    {
+        printf("outbuffer test failed\n");
+        return 1;
+    }
+
+    // a peer that has gone away is an error, not a pending write
+    outbuffer_append(out, "x", 1);
+    close(pair[1]);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (outbuffer_flush(out, pair[0]) != OUTBUFFER_ERROR)
+    {
+        printf("flush to a closed peer did not fail\n");
+        return 1;
+    }
+
+    close(pair[0]);
+    free(expected);
+    free(received);
+
+    printf("outbuffer test passed\n");
+
+    return 0;
+}
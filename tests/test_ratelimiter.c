@@ -0,0 +1,83 @@
+#include "common.h"
+#include "ratelimiter.h"
+
+extern ratelimiter_t *global_rl;
+
+int main()
+{
+    printf("starting ratelimiter unit test\n");
+
+    init();
+
+    // 100 tokens per second per user, 1000 per address, bursts of twice that
+    ratelimiter_set_rates(global_rl, 100, 1000);
+
+    in_addr_t addr = inet_addr("10.0.0.1");
+    int allowed = 0;
+
+    for (int i=0; i<300; i++)
+        allowed += ratelimiter_take(global_rl, 7, addr, 1) == 0;
+
+    printf("user burst allowed %d of 300\n", allowed);
+    if (allowed < 200 || allowed > 202)
+        return 1;
+
+    // another user from the same address has its own bucket
+    if (ratelimiter_take(global_rl, 8, addr, 1) != 0)
+    {
+        printf("second user was throttled\n");
+        return 1;
+    }
+
+    // the wait is reported, and the bucket has refilled once it is over
+    uint32_t retry_ms = ratelimiter_take(global_rl, 7, addr, 50);
+    printf("retry after %u ms\n", retry_ms);
+    if (retry_ms < 400 || retry_ms > 510)
+        return 1;
+
+    struct timespec wait = { retry_ms / 1000, (retry_ms % 1000) * 1000000L };
+    nanosleep(&wait, NULL);
+
+    if (ratelimiter_take(global_rl, 7, addr, 50) != 0)
+    {
+        printf("bucket did not refill\n");
+        return 1;
+    }
+
+    // unauthenticated requests only count against the address, which runs dry at its own burst
+    allowed = 0;
+    for (int i=0; i<3000; i++)
+        allowed += ratelimiter_take(global_rl, -1, inet_addr("10.0.0.2"), 1) == 0;
+
+    printf("address burst allowed %d of 3000\n", allowed);
+    if (allowed < 2000 || allowed > 2010)
+        return 1;
+
+    // a cost above the burst goes through on a full bucket
+    if (ratelimiter_take(global_rl, 9, inet_addr("10.0.0.3"), 500) != 0)
+    {
+        printf("oversized request never allowed\n");
+        return 1;
+    }
+
+    printf("allowed %ld, throttled by user %ld, by address %ld\n", atomic_load(&(global_rl->num_allowed)),
+        atomic_load(&(global_rl->users.num_throttled)), atomic_load(&(global_rl->addresses.num_throttled)));
+
+    if (atomic_load(&(global_rl->users.num_throttled)) == 0 || atomic_load(&(global_rl->addresses.num_throttled)) == 0)
+        return 1;
+
+    // a limit of 0 is off
+    ratelimiter_set_rates(global_rl, 0, 0);
+    for (int i=0; i<10000; i++)
+    {
+        if (ratelimiter_take(global_rl, 7, addr, 50) != 0)
+        {
+            printf("disabled limiter throttled\n");
+            return 1;
+        }
+    }
+
+    printf("ratelimiter test passed\n");
+
+    return 0;
+}
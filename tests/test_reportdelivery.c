@@ -0,0 +1,125 @@
+#include "common.h"
+#include "reportdelivery.h"
+
+extern reportdelivery_t *global_rd;
+
+#define REPORT_LEN 100000
+
+char received_response[CHUNK_SIZE] = {0};
+long received_len = 0;
+
+// plays the client listener: reads the whole report, acks its size and reads the response
+void *listener(void *arg)
+{
+    int listen_sock = *(int *)arg;
+    int sock = accept(listen_sock, NULL, NULL);
+    char buffer[CHUNK_SIZE];
+
+    while (received_len < REPORT_LEN)
+    {
+        int n = recv(sock, buffer, CHUNK_SIZE, 0);
+        if (n <= 0)
+            break;
+        received_len += n;
+    }
+
+    uint32_t ack = htonl((uint32_t)received_len);
+    send(sock, &ack, sizeof(ack), 0);
+    recv(sock, received_response, CHUNK_SIZE-1, 0);
+
+    close(sock);
+    return NULL;
+}
+
+// waits up to seconds for counter to reach value
+bool wait_for(atomic_long *counter, long value, int seconds)
+{
+    struct timespec wait = {0, 10000000};
+
+    for (int i=0; i<seconds*100; i++)
+    {
+        if (atomic_load(counter) >= value)
+            return true;
+        nanosleep(&wait, NULL);
+    }
+
+    return false;
+}
+
+int main()
+{
+    printf("starting reportdelivery unit test\n");
+
+    init();
+
+    // a listener on an ephemeral port
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listen_sock, 1);
+    getsockname(listen_sock, (struct sockaddr *)&addr, &addr_len);
+
+    pthread_t listener_thread;
+    pthread_create(&listener_thread, NULL, listener, &listen_sock);
+
+    FILE *report = tmpfile();
+    for (int i=0; i<REPORT_LEN; i++)
+        fputc('a' + i % 26, report);
+
+    reportdelivery_submit(global_rd, report, addr, 1);
+
+    pthread_join(listener_thread, NULL);
+
+    printf("delivered: %s, %ld bytes, response %s\n", 
+        wait_for(&(global_rd->num_delivered), 1, 5) ? "yes" : "no", received_len, received_response);
+
+    // listeners that are never accepted hold their deliveries until the deadline, one per delivery
+    // thread and more, a delivery queued behind them still goes out straight away
+    struct sockaddr_in stalled_addr = addr;
+    stalled_addr.sin_port = 0;
+    addr_len = sizeof(stalled_addr);
+
+    int stalled_sock = socket(AF_INET, SOCK_STREAM, 0);
+    bind(stalled_sock, (struct sockaddr *)&stalled_addr, sizeof(stalled_addr));
+    listen(stalled_sock, REPORTDELIVERY_THREADS * 2);
+    getsockname(stalled_sock, (struct sockaddr *)&stalled_addr, &addr_len);
+
+    for (int i=0; i<REPORTDELIVERY_THREADS * 2; i++)
+    {
+        report = tmpfile();
+        fputs("stalled\n", report);
+        reportdelivery_submit(global_rd, report, stalled_addr, 10 + i);
+    }
+
+    received_len = 0;
+    pthread_create(&listener_thread, NULL, listener, &listen_sock);
+
+    report = tmpfile();
+    for (int i=0; i<REPORT_LEN; i++)
+        fputc('a' + i % 26, report);
+
+    reportdelivery_submit(global_rd, report, addr, 3);
+
+    pthread_join(listener_thread, NULL);
+
+    printf("delivered behind stalled listeners: %s, %ld bytes\n", 
+        wait_for(&(global_rd->num_delivered), 2, 1) ? "yes" : "no", received_len);
+
+    // nothing is listening once the socket is closed, so this delivery is retried and abandoned
+    close(listen_sock);
+
+    report = tmpfile();
+    fputs("unreachable\n", report);
+    reportdelivery_submit(global_rd, report, addr, 2);
+
+    bool abandoned = wait_for(&(global_rd->num_failed), 1, 10);
+
+    printf("abandoned: %s, retries %ld\n", abandoned ? "yes" : "no", atomic_load(&(global_rd->num_retried)));
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "common.h"
+#include "sessiontable.h"
+
+int main()
+{
+    printf("starting sessiontable unit test\n");
+
+    init();
+
+    sessiontable_t *sessions = new_sessiontable(4);
+    uint8_t tokens[5][SESSIONTABLE_TOKEN_LEN];
+
+    for (int i=0; i<4; i++)
+    {
+        if (!sessiontable_issue(sessions, 100 + i, tokens[i]))
+        {
+            printf("could not issue session %d\n", i);
+            return 1;
+        }
+    }
+
+    // every slot holds a live session
+    if (sessiontable_issue(sessions, 200, tokens[4]))
+    {
+        printf("issued a session in a full table\n");
+        return 1;
+    }
+
+    for (int i=0; i<4; i++)
+    {
+        int user_id = sessiontable_resume(sessions, tokens[i]);
+        printf("token %d resumes user %d\n", i, user_id);
+        if (user_id != 100 + i)
+            return 1;
+    }
+
+    // a token is only good with all of its random bytes, and for the slot it names
+    uint8_t forged[SESSIONTABLE_TOKEN_LEN];
+    memcpy(forged, tokens[2], SESSIONTABLE_TOKEN_LEN);
+    forged[SESSIONTABLE_TOKEN_LEN-1] ^= 1;
+
+    if (sessiontable_resume(sessions, forged) != -1)
+    {
+        printf("forged token accepted\n");
+        return 1;
+    }
+
+    memset(forged, 0xff, sizeof(uint32_t));
+    if (sessiontable_resume(sessions, forged) != -1)
+    {
+        printf("token for a slot outside the table accepted\n");
+        return 1;
+    }
+
+    printf("issued %ld, resumed %ld, refused %ld\n", atomic_load(&(sessions->num_issued)),
+        atomic_load(&(sessions->num_resumed)), atomic_load(&(sessions->num_refused)));
+
+    if (atomic_load(&(sessions->num_issued)) != 4 || atomic_load(&(sessions->num_resumed)) != 4 || atomic_load(&(sessions->num_refused)) != 2)
+        return 1;
+
+    // a flush forgets every session
+    uint8_t flushed[SESSIONTABLE_TOKEN_LEN];
+    sessiontable_issue(sessions, 9, flushed);
+
+    uint32_t num_sessions = sessiontable_count(sessions);
+    if (num_sessions == 0 || sessiontable_flush(sessions) != (int)num_sessions || sessiontable_count(sessions) != 0)
+        return 1;
+    if (sessiontable_resume(sessions, flushed) != -1)
+    {
+        printf("flushed token accepted\n");
+        return 1;
+    }
+
+    printf("sessiontable test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "slab.h"
+
+#define TEST_THREADS 8
+#define TEST_ROUNDS 2000
+#define TEST_BLOCKS 64              // live at once per thread, about one row's worth of fields
+
+atomic_long corrupted = 0;
+
+// allocates and frees row sized blocks the way the datafile helpers do
+void *rows(void *arg)
+{
+    bool use_slab = *(bool *)arg;
+    char *blocks[TEST_BLOCKS];
+
+    for (int round=0; round<TEST_ROUNDS; round++)
+    {
+        for (int i=0; i<TEST_BLOCKS; i++)
+        {
+            size_t size = 8 + (i * 37) % 300;
+            blocks[i] = use_slab ? slab_alloc(size) : malloc(size);
+            memset(blocks[i], i, size);
+        }
+
+        for (int i=0; i<TEST_BLOCKS; i++)
+        {
+            // nobody else was handed the same block
+            if (blocks[i][0] != (char)i)
+                atomic_fetch_add(&corrupted, 1);
+
+            if (use_slab)
+                slab_free(blocks[i]);
+            else
+                free(blocks[i]);
+        }
+    }
+
+    return NULL;
+}
+
+// blocks freed by a thread that didn't allocate them
+void *consume(void *arg)
+{
+    char **blocks = arg;
+
+    for (int i=0; i<TEST_ROUNDS; i++)
+        slab_free(blocks[i]);
+
+    return NULL;
+}
+
+double run(bool use_slab)
+{
+    pthread_t threads[TEST_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i=0; i<TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, rows, &use_slab);
+    for (int i=0; i<TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+
+    return ns / ((double)TEST_THREADS * TEST_ROUNDS * TEST_BLOCKS);
+}
+
+int main()
+{
+    printf("starting slab unit test\n");
+
+    init();
+
+    // blocks of a size class are aligned and distinct, large ones come from the heap
+    char *a = slab_alloc(20);
+    char *b = slab_alloc(20);
+    char *large = slab_alloc(SLAB_MAX_SIZE + 1);
+    if (a == b || ((uintptr_t)a % 16) != 0 || ((uintptr_t)large % 16) != 0)
+        return 1;
+
+    memset(large, 0, SLAB_MAX_SIZE + 1);
+    slab_free(large);
+
+    // a freed block is the next one handed out by the same thread
+    slab_free(b);
+    if (slab_alloc(20) != b)
+    {
+        printf("freed block not recycled\n");
+        return 1;
+    }
+
+    slab_free(a);
+    slab_free(b);
+
+    char *blocks[TEST_ROUNDS];
+    for (int i=0; i<TEST_ROUNDS; i++)
+        blocks[i] = slab_alloc(64);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, consume, blocks);
+    pthread_join(consumer, NULL);
+
+    // the consumer's surplus and its leftovers went back to the shared lists
+    long slabs = slab_num_slabs();
+    for (int i=0; i<TEST_ROUNDS; i++)
+        blocks[i] = slab_alloc(64);
+    if (slab_num_slabs() != slabs)
+    {
+        printf("blocks freed on another thread were not reused\n");
+        return 1;
+    }
+
+    for (int i=0; i<TEST_ROUNDS; i++)
+        slab_free(blocks[i]);
+
+    double malloc_ns = run(false);
+    double slab_ns = run(true);
+
+    printf("%d threads: malloc %.1f ns, slab %.1f ns per allocation and free, %ld slabs\n",
+        TEST_THREADS, malloc_ns, slab_ns, slab_num_slabs());
+
+    if (atomic_load(&corrupted) != 0)
+    {
+        printf("%ld blocks handed out twice\n", atomic_load(&corrupted));
+        return 1;
+    }
+
+    printf("slab test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "common.h"
+#include "threadpool.h"
+
+extern threadpool_t *global_tp;
+
+// a report chunk spins this long, short tasks queued behind them must stay under the bound
+#define REPORT_CHUNK_MS          2
+#define REPORT_CHUNKS_PER_TASK   50
+#define SHORT_TASKS              200
+#define SHORT_TASK_P99_BOUND_MS  50
+#define WAIT_SECONDS             30
+
+int tasks_run = 0;
+int chunks_run = 0;
+int shorts_run = 0;
+pthread_mutex_t tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+long short_submitted_ns[SHORT_TASKS];
+long short_latency_ns[SHORT_TASKS];
+int short_index[SHORT_TASKS];
+
+long now_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long)now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+// polls a counter until it reaches expected, false if it has not after seconds
+bool wait_for(int *counter, int expected, int seconds)
+{
+    struct timespec wait = {0, 1000000};
+    long deadline = now_ns() + (long)seconds * 1000000000L;
+
+    while (now_ns() < deadline)
+    {
+        pthread_mutex_lock(&tasks_lock);
+        int done = *counter;
+        pthread_mutex_unlock(&tasks_lock);
+
+        if (done == expected)
+            return true;
+        nanosleep(&wait, NULL);
+    }
+
+    return false;
+}
+
+void count_task(void *arg)
+{
+    pthread_mutex_lock(&tasks_lock);
+    tasks_run += *(int *)arg;
+    pthread_mutex_unlock(&tasks_lock);
+}
+
+// spawns its subtasks onto the calling worker's deque, then holds the worker so others must steal them
+void fan_out_task(void *arg)
+{
+    for (int i=0; i<10000; i++)
+        threadpool_spawn(global_tp, count_task, arg);
+
+    wait_for(&tasks_run, 10000, WAIT_SECONDS);
+}
+
+// stands in for one chunk of a report, busy for REPORT_CHUNK_MS of wall time
+void report_chunk_task(void *arg)
+{
+    long end = now_ns() + REPORT_CHUNK_MS * 1000000L;
+    while (now_ns() < end)
+        ;
+
+    pthread_mutex_lock(&tasks_lock);
+    chunks_run++;
+    pthread_mutex_unlock(&tasks_lock);
+}
+
+// splits a report into stealable chunks the way the catalog worker does
+void report_task(void *arg)
+{
+    for (int i=0; i<REPORT_CHUNKS_PER_TASK; i++)
+        threadpool_spawn(global_tp, report_chunk_task, NULL);
+}
+
+// a cheap command, records how long it sat in the pool
+void short_task(void *arg)
+{
+    int index = *(int *)arg;
+    short_latency_ns[index] = now_ns() - short_submitted_ns[index];
+
+    pthread_mutex_lock(&tasks_lock);
+    shorts_run++;
+    pthread_mutex_unlock(&tasks_lock);
+}
+
+int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+int main()
+{
+    printf("starting threadpool unit test\n");
+
+    init();
+
+    printf("workers: %d\n", global_tp->num_workers);
+
+    int one = 1;
+    for (int i=0; i<10000; i++)
+        threadpool_submit(global_tp, count_task, &one);
+
+    if (!wait_for(&tasks_run, 10000, WAIT_SECONDS))
+    {
+        printf("FAIL: only %d of 10000 submitted tasks ran\n", tasks_run);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("tasks run: %d\n", tasks_run);
+
+    pthread_mutex_lock(&tasks_lock);
+    tasks_run = 0;
+    pthread_mutex_unlock(&tasks_lock);
+
+    threadpool_submit(global_tp, fan_out_task, &one);
+
+    if (!wait_for(&tasks_run, 10000, WAIT_SECONDS))
+    {
+        printf("FAIL: only %d of 10000 spawned tasks ran\n", tasks_run);
+        exit(EXIT_FAILURE);
+    }
+
+    long stolen = atomic_load(&(global_tp->num_stolen));
+    printf("spawned tasks run: %d, stolen: %ld\n", tasks_run, stolen);
+
+    if (stolen < 10000)
+    {
+        printf("FAIL: spawned tasks were not stolen\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // keep every worker busy with report chunks, then time cheap commands queued behind them
+    int num_chunks = global_tp->num_workers * REPORT_CHUNKS_PER_TASK;
+    for (int i=0; i<global_tp->num_workers; i++)
+        threadpool_submit(global_tp, report_task, NULL);
+
+    struct timespec gap = {0, 1000000};
+    for (int i=0; i<SHORT_TASKS; i++)
+    {
+        short_index[i] = i;
+        short_submitted_ns[i] = now_ns();
+        threadpool_submit(global_tp, short_task, &short_index[i]);
+        nanosleep(&gap, NULL);
+    }
+
+    if (!wait_for(&shorts_run, SHORT_TASKS, WAIT_SECONDS))
+    {
+        printf("FAIL: only %d of %d short tasks ran\n", shorts_run, SHORT_TASKS);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&tasks_lock);
+    int chunks_during = chunks_run;
+    pthread_mutex_unlock(&tasks_lock);
+
+    if (!wait_for(&chunks_run, num_chunks, WAIT_SECONDS))
+    {
+        printf("FAIL: only %d of %d report chunks ran\n", chunks_run, num_chunks);
+        exit(EXIT_FAILURE);
+    }
+
+    qsort(short_latency_ns, SHORT_TASKS, sizeof(long), compare_long);
+    long p50 = short_latency_ns[SHORT_TASKS / 2];
+    long p99 = short_latency_ns[(SHORT_TASKS * 99) / 100];
+
+    printf("report chunks run: %d (%d while short tasks ran), short task p50: %.3f ms, p99: %.3f ms, bound: %d ms\n",
+        chunks_run, chunks_during, p50 / 1e6, p99 / 1e6, SHORT_TASK_P99_BOUND_MS);
+
+    if (p99 > SHORT_TASK_P99_BOUND_MS * 1000000L)
+    {
+        printf("FAIL: short task p99 over %d ms behind report chunks\n", SHORT_TASK_P99_BOUND_MS);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("ending unit test\n");
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,197 @@
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "trace.h"
+#include "datafile.h"
+
+#define TEST_DUMP_FILENAME "data/test_trace.bin"
+#define TEST_SIGNAL_FILENAME "reports/trace.bin"
+#define TEST_DATAFILE_FILENAME "data/test_trace.db"
+#define TEST_THREADS 4
+#define TEST_EVENTS 1000000
+
+extern trace_t *global_tr;
+
+// records events as fast as it can, returns cpu ns per event through arg
+void *recorder(void *arg)
+{
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    for (int i=0; i<TEST_EVENTS; i++)
+    {
+        trace_event_t *event = trace_begin(global_tr, i, 0x30);
+        trace_end(event);
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+    *(double *)arg = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / TEST_EVENTS;
+
+    return NULL;
+}
+
+// finishes an event begun on the main thread, the way a report job finishes a pending command
+void *finisher(void *arg)
+{
+    trace_event_t *event = (trace_event_t *)arg;
+
+    trace_end_detached(event, atomic_load(&(event->start_ns)));
+
+    return NULL;
+}
+
+// reads back a dump, returns the number of finished events and counts the ones with op_code
+long read_dump(const char *filename, uint8_t op_code, long *matching, trace_event_t *last)
+{
+    FILE *fp = fopen(filename, "r");
+    trace_file_header_t header;
+    trace_file_ring_t ring;
+    trace_event_t event;
+    long finished = 0;
+
+    if (fp == NULL || fread(&header, sizeof(header), 1, fp) != 1 || strcmp(header.magic, TRACE_MAGIC) != 0)
+        return -1;
+
+    *matching = 0;
+    while (fread(&ring, sizeof(ring), 1, fp) == 1)
+    {
+        for (uint32_t i=0; i<header.ring_events && fread(&event, sizeof(event), 1, fp) == 1; i++)
+        {
+            if (event.start_ns == 0 || event.end_ns < event.start_ns)
+                continue;
+
+            finished++;
+            if (event.op_code == op_code)
+            {
+                (*matching)++;
+                *last = event;
+            }
+        }
+    }
+
+    fclose(fp);
+
+    return finished;
+}
+
+int main()
+{
+    printf("starting trace unit test\n");
+
+    init();
+
+    // a command's event carries its datafile I/O
+    FILE *fp = fopen(TEST_DATAFILE_FILENAME, "w");
+    fprintf(fp, "id\tdate_created\tdate_updated\tname\tqty\n");
+    fclose(fp);
+
+    datafile_t *df = new_datafile(TEST_DATAFILE_FILENAME);
+    char **row = datafile_new_row_array(df);
+    datafile_set_col(df, &row, "name", "book");
+    datafile_set_col(df, &row, "qty", "1");
+
+    trace_event_t *event = trace_begin(global_tr, 7, 0x40);
+    datafile_add_row(df, &row);
+    datafile_get_row_prepare(df);
+    char **found = datafile_get_row_by_field(df, "name", "book");
+    trace_end(event);
+
+    datafile_free_row(df, &found);
+    datafile_free_row(df, &row);
+    datafile_destroy(df);
+    remove(TEST_DATAFILE_FILENAME);
+
+    // nothing is recorded while tracing is off
+    trace_set_enabled(global_tr, false);
+    if (trace_begin(global_tr, 8, 0x40) != NULL)
+        return 1;
+    trace_set_enabled(global_tr, true);
+
+    long matching;
+    trace_event_t last;
+    long num_events = trace_dump(global_tr, TEST_DUMP_FILENAME);
+
+    if (num_events != 1 || read_dump(TEST_DUMP_FILENAME, 0x40, &matching, &last) != 1 || matching != 1)
+        return 1;
+
+    printf("add and find: %.1f us, %u reads, %u writes\n", (last.end_ns - last.start_ns) / 1000.0, last.reads, last.writes);
+
+    if (last.conn_id != 7 || last.reads != 2 || last.writes != 1)
+        return 1;
+
+    // the slowest finished commands come back longest first
+    struct timespec sleep_2ms = {0, 2000000}, sleep_1ms = {0, 1000000};
+
+    event = trace_begin(global_tr, 9, 0x50);
+    nanosleep(&sleep_2ms, NULL);
+    trace_end(event);
+
+    event = trace_begin(global_tr, 10, 0x50);
+    nanosleep(&sleep_1ms, NULL);
+    trace_end(event);
+
+    trace_begin(global_tr, 11, 0x50);
+
+    trace_event_t slowest[4];
+    if (trace_slowest(global_tr, slowest, 2) != 2 || slowest[0].conn_id != 9 || slowest[1].conn_id != 10)
+        return 1;
+    if (trace_slowest(global_tr, slowest, 4) != 3 || slowest[2].conn_id != 7)
+        return 1;
+
+    // a detached event is finished on another thread, and not at all once its slot has been reused
+    struct timespec sleep_3ms = {0, 3000000};
+    pthread_t finisher_thread;
+
+    event = trace_begin(global_tr, 12, 0x60);
+    trace_detach(event);
+    nanosleep(&sleep_3ms, NULL);
+    pthread_create(&finisher_thread, NULL, finisher, event);
+    pthread_join(finisher_thread, NULL);
+
+    if (trace_slowest(global_tr, slowest, 1) != 1 || slowest[0].conn_id != 12)
+        return 1;
+
+    event = trace_begin(global_tr, 13, 0x60);
+    trace_end_detached(event, atomic_load(&(event->start_ns)) - 1);
+
+    if (atomic_load(&(event->end_ns)) != 0)
+        return 1;
+
+    // rings wrap, only the newest events of each thread are kept
+    pthread_t threads[TEST_THREADS];
+    double ns[TEST_THREADS];
+    double total = 0;
+
+    for (int i=0; i<TEST_THREADS; i++)
+        pthread_create(&threads[i], NULL, recorder, &ns[i]);
+    for (int i=0; i<TEST_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        total += ns[i];
+    }
+
+    printf("%d threads: %.1f ns per event\n", TEST_THREADS, total / TEST_THREADS);
+
+    // a signal dumps from the trace's own thread
+    remove(TEST_SIGNAL_FILENAME);
+    kill(getpid(), SIGUSR1);
+
+    struct timespec pause = {0, 100000000};
+    for (int i=0; i<50 && read_dump(TEST_SIGNAL_FILENAME, 0x30, &matching, &last) < 0; i++)
+        nanosleep(&pause, NULL);
+
+    num_events = read_dump(TEST_SIGNAL_FILENAME, 0x30, &matching, &last);
+    printf("signal dump: %ld events, %ld from the recorders\n", num_events, matching);
+
+    remove(TEST_DUMP_FILENAME);
+    remove(TEST_SIGNAL_FILENAME);
+
+    // the recorder threads exited one after another, so they may have shared rings
+    if (matching < TRACE_RING_EVENTS || matching > TEST_THREADS * TRACE_RING_EVENTS)
+        return 1;
+
+    printf("trace test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "usertable.h"
+
+#define TEST_USERS_FILENAME "data/test_users.db"
+#define TEST_LOGINS 100000
+#define TEST_ADD_THREADS 4
+#define TEST_ADDS 100
+
+// writes a users file with num_users rows, user<n> with password pw<n>
+void write_users(int num_users)
+{
+    FILE *fp = fopen(TEST_USERS_FILENAME, "w");
+
+    if (fp == NULL)
+        exit_error("could not create " TEST_USERS_FILENAME);
+
+    fprintf(fp, "id\tdate_created\tdate_updated\tusername\tpassword\n");
+    for (int i=1; i<=num_users; i++)
+        fprintf(fp, "%d\tnone\tnone\tuser%d\tpw%d\n", i, i, i);
+
+    fclose(fp);
+}
+
+usertable_t *shared_users = NULL;
+
+// adds TEST_ADDS users named for the thread, and logs each one in as soon as it is added
+void *adder(void *arg)
+{
+    int thread = *(int *)arg;
+    char username[32];
+
+    for (int i=0; i<TEST_ADDS; i++)
+    {
+        snprintf(username, sizeof(username), "thread%d_%d", thread, i);
+
+        int id = usertable_add(shared_users, username, "pw");
+        if (id < 0 || usertable_login(shared_users, username, "pw") != id)
+            return (void *)1;
+    }
+
+    return NULL;
+}
+
+double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main()
+{
+    printf("starting usertable unit test\n");
+
+    init();
+
+    int sizes[] = {1000, 10000, 100000, 1000000};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    double login_ns[num_sizes];
+
+    for (int s=0; s<num_sizes; s++)
+    {
+        write_users(sizes[s]);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        usertable_t *users = new_usertable(TEST_USERS_FILENAME);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (users->num_users != (uint32_t)sizes[s])
+        {
+            printf("loaded %u of %d users\n", users->num_users, sizes[s]);
+            return 1;
+        }
+
+        double load_ms = elapsed_ns(&start, &end) / 1e6;
+
+        // the last user in the file was the slowest to find when logins scanned it
+        char username[32], password[32];
+        sprintf(username, "user%d", sizes[s]);
+        sprintf(password, "pw%d", sizes[s]);
+
+        int result = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i=0; i<TEST_LOGINS; i++)
+            result |= usertable_login(users, username, password) ^ sizes[s];
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (result != 0)
+        {
+            printf("login as %s failed\n", username);
+            return 1;
+        }
+
+        login_ns[s] = elapsed_ns(&start, &end) / TEST_LOGINS;
+        printf("%8d users: loaded in %8.1f ms, login %6.1f ns\n", sizes[s], load_ms, login_ns[s]);
+
+        usertable_destroy(users);
+    }
+
+    // a scan would be about a thousand times slower at 1M users than at 1k
+    if (login_ns[num_sizes-1] > login_ns[0] * 20)
+    {
+        printf("login time grows with the number of users\n");
+        return 1;
+    }
+
+    write_users(3);
+    usertable_t *users = new_usertable(TEST_USERS_FILENAME);
+
+    if (usertable_login(users, "user2", "pw2") != 2 || usertable_login(users, "user2", "pw3") != USERTABLE_BAD_PASSWORD ||
+        usertable_login(users, "nobody", "pw2") != USERTABLE_NO_USER)
+    {
+        printf("login results wrong\n");
+        return 1;
+    }
+
+    if (usertable_add(users, "user1", "x") != -1 || usertable_add(users, "bad\tname", "x") != -1 || usertable_add(users, "", "x") != -1)
+    {
+        printf("added an invalid user\n");
+        return 1;
+    }
+
+    int new_id = usertable_add(users, "newuser", "newpw");
+    if (new_id != 4 || !usertable_exists(users, "newuser") || usertable_login(users, "newuser", "newpw") != 4)
+    {
+        printf("new user not in the table\n");
+        return 1;
+    }
+
+    usertable_destroy(users);
+
+    // the new user was saved to the file too
+    users = new_usertable(TEST_USERS_FILENAME);
+    if (usertable_login(users, "newuser", "newpw") != 4 || users->num_users != 4)
+    {
+        printf("new user not in the file\n");
+        return 1;
+    }
+
+    // users changed in the file by hand show up once the table is reloaded
+    write_users(2);
+    FILE *fp = fopen(TEST_USERS_FILENAME, "a");
+    fprintf(fp, "7\tnone\tnone\thanduser\thandpw\n");
+    fclose(fp);
+
+    if (usertable_login(users, "handuser", "handpw") != USERTABLE_NO_USER || usertable_reload(users) != 3)
+        return 1;
+
+    uint32_t num_slots;
+    if (usertable_login(users, "handuser", "handpw") != 7 || usertable_login(users, "newuser", "newpw") != USERTABLE_NO_USER ||
+        usertable_count(users, &num_slots) != 3 || num_slots != USERTABLE_INITIAL_SLOTS)
+    {
+        printf("reload did not rebuild the table from the file\n");
+        return 1;
+    }
+
+    // ids already handed out are not handed out again
+    if (usertable_add(users, "another", "pw") != 8)
+        return 1;
+
+    // concurrent adds each get their own id, and the file holds every one of them
+    int thread_ids[TEST_ADD_THREADS];
+    pthread_t threads[TEST_ADD_THREADS];
+    void *failed = NULL;
+
+    shared_users = users;
+    for (int i=0; i<TEST_ADD_THREADS; i++)
+    {
+        thread_ids[i] = i;
+        pthread_create(&threads[i], NULL, adder, &thread_ids[i]);
+    }
+    for (int i=0; i<TEST_ADD_THREADS; i++)
+    {
+        void *result;
+        pthread_join(threads[i], &result);
+        failed = failed != NULL ? failed : result;
+    }
+
+    if (failed != NULL || usertable_count(users, &num_slots) != 4 + TEST_ADD_THREADS * TEST_ADDS ||
+        usertable_reload(users) != 4 + TEST_ADD_THREADS * TEST_ADDS || users->last_id != 8 + TEST_ADD_THREADS * TEST_ADDS)
+    {
+        printf("concurrent adds lost or duplicated users\n");
+        return 1;
+    }
+
+    usertable_destroy(users);
+    remove(TEST_USERS_FILENAME);
+
+    printf("usertable test passed\n");
+
+    return 0;
+}